@@ -0,0 +1,93 @@
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "benchmark.hpp"
+#include "log.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: torrent_bench [--filter <substring>] "
+                 "[--min-time <milliseconds>] [--json <path>]\n";
+}
+
+/*
+ * Parses a decimal number that is the whole text.
+ * @return Empty if the text is not a number.
+ * */
+std::optional<std::size_t> parse_number(std::string_view text) {
+    std::size_t number = 0;
+    const auto* end = text.data() + text.size();
+    const auto [last, error] = std::from_chars(text.data(), end, number);
+    if (error != std::errc {} || last != end) {
+        return std::nullopt;
+    }
+    return number;
+}
+
+} // namespace
+
+/*
+ * Runs the benchmarks and prints a line for each one to the stderr.
+ * With --json the results are also written to the given path,
+ *      "-" writes them to the stdout.
+ * */
+int main(int argc, char* argv[]) {
+    using namespace torrent::bench;
+
+    // Parsing a torrent logs at info level.
+    torrent::log::set_level(torrent::log::Level::warning);
+
+    Runner::Options options;
+    std::string json_path;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage();
+            return 1;
+        }
+        if (arg == "--filter") {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time") {
+            const auto min_time = parse_number(argv[++i]);
+            if (!min_time.has_value()) {
+                print_usage();
+                return 1;
+            }
+            options.min_time = std::chrono::milliseconds {min_time.value()};
+        } else if (arg == "--json") {
+            json_path = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    Runner runner;
+    add_bencode_benchmarks(runner);
+    add_piece_picker_benchmarks(runner);
+    add_message_benchmarks(runner);
+    add_pieces_benchmarks(runner);
+    add_tracker_benchmarks(runner);
+    add_encryption_benchmarks(runner);
+
+    const auto results = runner.run(options);
+
+    if (json_path == "-") {
+        Runner::write_json(std::cout, results);
+    } else if (!json_path.empty()) {
+        std::ofstream file {json_path, std::ios::trunc};
+        Runner::write_json(file, results);
+        if (!file) {
+            std::cerr << "Could not write " << json_path << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
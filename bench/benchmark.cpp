@@ -0,0 +1,87 @@
+#include "benchmark.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+namespace torrent::bench {
+
+void State::set_samples(std::vector<double> samples, std::size_t iterations) {
+    std::sort(samples.begin(), samples.end());
+    result.iterations = iterations * samples.size();
+    result.ns_per_op = samples[samples.size() / 2];
+    result.min_ns_per_op = samples.front();
+    result.max_ns_per_op = samples.back();
+}
+
+void Runner::add(std::string name, Function function) {
+    benchmarks.emplace_back(std::move(name), std::move(function));
+}
+
+std::vector<Result> Runner::run(const Options& options) const {
+    std::vector<Result> results;
+    for (const auto& [name, function] : benchmarks) {
+        if (name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        State state {name, options.min_time};
+        function(state);
+        results.push_back(state.get_result());
+        write_line(std::cerr, results.back());
+    }
+    return results;
+}
+
+namespace {
+
+/*
+ * Formats the number without depending on the stream locale.
+ * */
+std::string format_number(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+}
+
+} // namespace
+
+void Runner::write_json(std::ostream& os, const std::vector<Result>& results) {
+    // Names are plain ascii, set by the benchmarks themselfs.
+    os << "{\n  \"version\": 1,\n  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        os << (i == 0 ? "\n" : ",\n");
+        os << "    {\"name\": \"" << result.name << "\""
+           << ", \"iterations\": " << result.iterations
+           << ", \"ns_per_op\": " << format_number(result.ns_per_op)
+           << ", \"min_ns_per_op\": " << format_number(result.min_ns_per_op)
+           << ", \"max_ns_per_op\": " << format_number(result.max_ns_per_op)
+           << ", \"bytes_per_op\": " << result.bytes_per_op
+           << ", \"bytes_per_second\": "
+           << format_number(result.bytes_per_second()) << "}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+void Runner::write_line(std::ostream& os, const Result& result) {
+    char buffer[160];
+    std::snprintf(
+        buffer,
+        sizeof(buffer),
+        "%-48s %14.1f ns/op",
+        result.name.c_str(),
+        result.ns_per_op
+    );
+    os << buffer;
+    if (result.bytes_per_op != 0) {
+        std::snprintf(
+            buffer,
+            sizeof(buffer),
+            " %10.1f MiB/s",
+            result.bytes_per_second() / (1 << 20)
+        );
+        os << buffer;
+    }
+    os << '\n';
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,183 @@
+#ifndef TORRENT_BENCH_BENCHMARK_HPP
+#define TORRENT_BENCH_BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace torrent::bench {
+
+/*
+ * Prevents the compiler from optimizing away the computation of the value.
+ * */
+template<typename T>
+inline void do_not_optimize(T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/*
+ * Result of a single benchmark.
+ * */
+struct Result {
+    std::string name;
+    std::size_t iterations = 0; // Total iterations over every sample.
+    double ns_per_op = 0.0; // Median of the samples.
+    double min_ns_per_op = 0.0;
+    double max_ns_per_op = 0.0;
+    std::size_t bytes_per_op = 0; // Zero if the benchmark has no throughput.
+
+    double bytes_per_second() const {
+        return ns_per_op > 0.0
+            ? static_cast<double>(bytes_per_op) * 1e9 / ns_per_op
+            : 0.0;
+    }
+};
+
+/*
+ * Passed to every benchmark function.
+ * The function does its setup, then calls run with the measured body.
+ * The body is called in batches until a batch takes long enough to measure,
+ *      then SAMPLES batches are timed and the median is reported.
+ * */
+class State {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    State(std::string name, Clock::duration min_time) :
+        min_batch_time(min_time / SAMPLES) {
+        result.name = std::move(name);
+    }
+
+    template<typename Body>
+    void run(Body&& body) {
+        std::size_t iterations = 1;
+        while (true) {
+            const auto elapsed = time_batch(body, iterations);
+            if (elapsed >= min_batch_time || iterations >= MAX_ITERATIONS) {
+                break;
+            }
+            // Aim a bit over the target so the loop ends quickly.
+            const auto elapsed_ns = std::max<std::int64_t>(
+                1,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                    .count()
+            );
+            const auto target_ns =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    min_batch_time
+                )
+                    .count();
+            const auto scale = std::clamp<std::int64_t>(
+                target_ns * 3 / 2 / elapsed_ns,
+                2,
+                100
+            );
+            iterations = std::min(
+                MAX_ITERATIONS,
+                iterations * static_cast<std::size_t>(scale)
+            );
+        }
+
+        std::vector<double> samples;
+        samples.reserve(SAMPLES);
+        for (std::size_t i = 0; i < SAMPLES; ++i) {
+            const auto elapsed = time_batch(body, iterations);
+            samples.push_back(
+                static_cast<double>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        elapsed
+                    )
+                        .count()
+                )
+                / static_cast<double>(iterations)
+            );
+        }
+        set_samples(std::move(samples), iterations);
+    }
+
+    /*
+     * Sets the number of bytes one call of the body processes.
+     * Reported as throughput.
+     * */
+    void set_bytes_per_op(std::size_t bytes) {
+        result.bytes_per_op = bytes;
+    }
+
+    const Result& get_result() const {
+        return result;
+    }
+
+  private:
+    template<typename Body>
+    static Clock::duration time_batch(Body& body, std::size_t iterations) {
+        const auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations; ++i) {
+            body();
+        }
+        return Clock::now() - start;
+    }
+
+    void set_samples(std::vector<double> samples, std::size_t iterations);
+
+  private:
+    static constexpr std::size_t SAMPLES = 5;
+    static constexpr std::size_t MAX_ITERATIONS = 1 << 30;
+
+    Clock::duration min_batch_time;
+    Result result;
+};
+
+/*
+ * Holds the registered benchmarks and runs the ones matching the filter.
+ * */
+class Runner {
+  public:
+    using Function = std::function<void(State&)>;
+
+    struct Options {
+        // Only the benchmarks with this substring in their names are run.
+        std::string filter;
+        State::Clock::duration min_time = std::chrono::milliseconds {500};
+    };
+
+    /*
+     * Registers a benchmark. Names should not change between versions,
+     *      they are the keys results are compared with.
+     * */
+    void add(std::string name, Function function);
+
+    std::vector<Result> run(const Options& options) const;
+
+    /*
+     * Writes the results as JSON. Fields and their order are stable.
+     * */
+    static void
+    write_json(std::ostream& os, const std::vector<Result>& results);
+
+    /*
+     * Writes a line for the result in a human readable format.
+     * */
+    static void write_line(std::ostream& os, const Result& result);
+
+  private:
+    std::vector<std::pair<std::string, Function>> benchmarks;
+};
+
+/*
+ * Every file of the benchmark suite registers its benchmarks
+ *      through one of these functions.
+ * */
+void add_bencode_benchmarks(Runner& runner);
+void add_piece_picker_benchmarks(Runner& runner);
+void add_message_benchmarks(Runner& runner);
+void add_pieces_benchmarks(Runner& runner);
+void add_tracker_benchmarks(Runner& runner);
+void add_encryption_benchmarks(Runner& runner);
+
+} // namespace torrent::bench
+
+#endif
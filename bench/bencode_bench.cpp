@@ -0,0 +1,176 @@
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <variant>
+
+#include "bencode_parser.hpp"
+#include "bencode_reader.hpp"
+#include "bencode_writer.hpp"
+#include "benchmark.hpp"
+#include "metadata.hpp"
+#include "synthetic_torrent.hpp"
+
+namespace torrent::bench {
+
+namespace {
+
+std::string read_file(const std::string& path) {
+    std::ifstream file {path, std::ios::binary};
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    return {std::istreambuf_iterator<char> {file}, {}};
+}
+
+BencodeParser parse(const std::string& content) {
+    BencodeParser parser {std::make_unique<std::istringstream>(content)};
+    parser.parse();
+    return parser;
+}
+
+template<class... Ts>
+struct overloaded: Ts... {
+    using Ts::operator()...;
+};
+
+/*
+ * The std::stringstream encoder BencodeWriter replaced, kept as the
+ *      reference the writer is compared against.
+ * */
+void encode_stringstream(
+    const BencodeParser::Element& element,
+    std::stringstream& stream
+) {
+    std::visit(
+        overloaded {
+            [&](const BencodeParser::Integer value) {
+                stream << 'i' << value << 'e';
+            },
+            [&](const BencodeParser::String& value) {
+                stream << value.size() << ':' << value;
+            },
+            [&](const BencodeParser::List& list) {
+                stream << 'l';
+                for (const auto& item : list) {
+                    encode_stringstream(item, stream);
+                }
+                stream << 'e';
+            },
+            [&](const BencodeParser::Dictionary& dictionary) {
+                stream << 'd';
+                for (const auto& pair : dictionary) {
+                    stream << pair.first.size() << ':' << pair.first; // key
+                    encode_stringstream(pair.second, stream); // value
+                }
+                stream << 'e';
+            }
+        },
+        element.value
+    );
+}
+
+/*
+ * A handler that ignores every event, so only the reader is measured.
+ * */
+class NullHandler: public BencodeReader::Handler {};
+
+/*
+ * Registers every bencode benchmark for a torrent.
+ * @param load Returns the content of the .torrent file.
+ * */
+void add_torrent(
+    Runner& runner,
+    const std::string& name,
+    std::function<std::string()> load
+) {
+    runner.add("bencode/parse/" + name, [load](State& state) {
+        const auto content = load();
+        state.set_bytes_per_op(content.size());
+        state.run([&] {
+            auto parser = parse(content);
+            do_not_optimize(parser);
+        });
+    });
+
+    runner.add("bencode/reader/" + name, [load](State& state) {
+        const auto content = load();
+        NullHandler handler;
+        // Synthetic torrents have hash strings over the default limits.
+        BencodeReader reader {
+            handler,
+            {.max_depth = 32,
+             .max_string_length = content.size(),
+             .max_total_length = content.size()}
+        };
+        state.set_bytes_per_op(content.size());
+        state.run([&] {
+            reader.reset();
+            auto consumed = reader.feed(content);
+            do_not_optimize(consumed);
+        });
+    });
+
+    runner.add("bencode/encode/" + name, [load](State& state) {
+        const auto parser = parse(load());
+        const auto& element = parser.get();
+        state.set_bytes_per_op(BencodeWriter::encoded_size(element));
+        state.run([&] {
+            auto encoded = BencodeWriter::encode(element);
+            do_not_optimize(encoded);
+        });
+    });
+
+    runner.add("bencode/encode-stringstream/" + name, [load](State& state) {
+        const auto parser = parse(load());
+        const auto& element = parser.get();
+        state.set_bytes_per_op(BencodeWriter::encoded_size(element));
+        state.run([&] {
+            std::stringstream stream;
+            encode_stringstream(element, stream);
+            auto encoded = stream.str();
+            do_not_optimize(encoded);
+        });
+    });
+
+    runner.add("metadata/info_hash/" + name, [load](State& state) {
+        const auto parser = parse(load());
+        const auto& info_bencode = parser.get_info_bencode();
+        state.set_bytes_per_op(info_bencode.size());
+        state.run([&] {
+            auto info_hash = Metadata::get_info_hash(info_bencode);
+            do_not_optimize(info_hash);
+        });
+    });
+}
+
+void add_synthetic_torrent(
+    Runner& runner,
+    const std::string& name,
+    std::size_t piece_count,
+    std::size_t file_count
+) {
+    add_torrent(runner, name, [=] {
+        SyntheticTorrent torrent;
+        torrent.piece_count = piece_count;
+        torrent.piece_length = 1 << 14;
+        torrent.file_count = file_count;
+        return torrent.make_torrent();
+    });
+}
+
+} // namespace
+
+void add_bencode_benchmarks(Runner& runner) {
+    add_torrent(runner, "arch", [] {
+        return read_file(TORRENT_RES_DIR "/arch.torrent");
+    });
+    add_torrent(runner, "debian", [] {
+        return read_file(TORRENT_RES_DIR "/debian.iso.torrent");
+    });
+    add_synthetic_torrent(runner, "synthetic-10k-pieces", 10'000, 100);
+    add_synthetic_torrent(runner, "synthetic-1m-pieces", 1'000'000, 10'000);
+}
+
+} // namespace torrent::bench
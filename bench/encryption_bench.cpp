@@ -0,0 +1,191 @@
+#include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "encrypted_stream.hpp"
+#include "metadata.hpp"
+#include "rc4.hpp"
+#include "simulated_network.hpp"
+
+namespace torrent::bench {
+
+namespace {
+
+constexpr std::uint16_t PORT = 6881;
+constexpr std::size_t TRANSFER_LENGTH = 1 << 20;
+
+/*
+ * Two streams connected through a simulated network, so the benchmarks
+ *      measure the work of the streams and not the system calls.
+ * */
+class Connection {
+  public:
+    explicit Connection(EncryptionPolicy encryption_policy) :
+        policy(encryption_policy),
+        network(SimulatedNetwork::create(io_context)),
+        client_transport(network->add_host(address_v4 {{10, 0, 0, 1}}, {})),
+        server_transport(network->add_host(address_v4 {{10, 0, 0, 2}}, {})),
+        acceptor(server_transport->create_acceptor(PORT)) {
+        // Nothing runs outside of the network.
+        network->set_io_grace(std::chrono::microseconds {0});
+    }
+
+    ~Connection() {
+        if (client) {
+            client->close();
+        }
+        if (server) {
+            server->close();
+        }
+        acceptor->close();
+        network->stop();
+        io_context.poll();
+    }
+
+    /*
+     * Connects the streams and sends a byte, which runs the handshake.
+     * */
+    void connect() {
+        bool done = false;
+        acceptor->async_accept([this, &done](const auto&, auto stream) {
+            server = wrap(std::move(stream), EncryptedStream::Role::Responder);
+            server->async_read_some(
+                asio::buffer(receive_buffer.data(), 1),
+                [&done](const auto&, const auto) { done = true; }
+            );
+        });
+        client = wrap(
+            client_transport->create_stream(),
+            EncryptedStream::Role::Initiator
+        );
+        client->async_connect(
+            tcp::endpoint {address_v4 {{10, 0, 0, 2}}, PORT},
+            [this](const auto& error) {
+                if (!error) {
+                    write(send_buffer.data(), 1);
+                }
+            }
+        );
+        run([&done] { return done; });
+    }
+
+    /*
+     * Sends the bytes from the client to the server in blocks.
+     * */
+    void transfer(std::size_t length) {
+        std::size_t received = 0;
+        std::function<void()> read = [&] {
+            server->async_read_some(
+                asio::buffer(receive_buffer),
+                [&](const auto& error, const auto bytes) {
+                    received += bytes;
+                    if (!error && received < length) {
+                        read();
+                    }
+                }
+            );
+        };
+        read();
+        for (std::size_t sent = 0; sent < length;
+             sent += Metadata::BLOCK_LENGTH) {
+            write(send_buffer.data() + sent, Metadata::BLOCK_LENGTH);
+        }
+        run([&] { return received >= length; });
+    }
+
+  private:
+    std::unique_ptr<Stream>
+    wrap(std::unique_ptr<Stream> stream, EncryptedStream::Role role) {
+        if (policy == EncryptionPolicy::Disabled) {
+            return stream;
+        }
+        return std::make_unique<EncryptedStream>(
+            io_context,
+            std::move(stream),
+            role,
+            std::string(20, 'x'),
+            policy
+        );
+    }
+
+    /*
+     * Writes all of the bytes in place, as the peers send messages.
+     * */
+    void write(std::uint8_t* data, std::size_t length) {
+        client->async_write_some_in_place(
+            asio::buffer(data, length),
+            [this, data, length](const auto& error, const auto bytes) {
+                if (!error && bytes < length) {
+                    write(data + bytes, length - bytes);
+                }
+            }
+        );
+    }
+
+    void run(const std::function<bool()>& done) {
+        network->run_until(done, network->now() + std::chrono::hours {1});
+    }
+
+  private:
+    const EncryptionPolicy policy;
+
+    asio::io_context io_context;
+    std::shared_ptr<SimulatedNetwork> network;
+    std::shared_ptr<Transport> client_transport;
+    std::shared_ptr<Transport> server_transport;
+    std::unique_ptr<Acceptor> acceptor;
+    std::unique_ptr<Stream> client;
+    std::unique_ptr<Stream> server;
+
+    // Blocks in flight are encrypted in place, so they don't share memory.
+    std::vector<std::uint8_t> send_buffer =
+        std::vector<std::uint8_t>(TRANSFER_LENGTH, 1);
+    std::vector<std::uint8_t> receive_buffer =
+        std::vector<std::uint8_t>(Metadata::BLOCK_LENGTH);
+};
+
+} // namespace
+
+void add_encryption_benchmarks(Runner& runner) {
+    runner.add("encryption/rc4", [](State& state) {
+        const std::vector<std::uint8_t> key(20, 1);
+        Rc4 rc4 {key};
+        std::vector<std::uint8_t> block(Metadata::BLOCK_LENGTH, 1);
+        state.set_bytes_per_op(block.size());
+        state.run([&] {
+            rc4.process(block.data(), block.size());
+            do_not_optimize(block);
+        });
+    });
+
+    // Both ends of a connection run on the same core, so these are the
+    //      bytes a core can send and receive per second.
+    runner.add("encryption/stream/plaintext", [](State& state) {
+        Connection connection {EncryptionPolicy::Disabled};
+        connection.connect();
+        state.set_bytes_per_op(TRANSFER_LENGTH);
+        state.run([&] { connection.transfer(TRANSFER_LENGTH); });
+    });
+
+    runner.add("encryption/stream/rc4", [](State& state) {
+        Connection connection {EncryptionPolicy::Forced};
+        connection.connect();
+        state.set_bytes_per_op(TRANSFER_LENGTH);
+        state.run([&] { connection.transfer(TRANSFER_LENGTH); });
+    });
+
+    // Two DH key exchanges and a round trip on the simulated network.
+    runner.add("encryption/handshake", [](State& state) {
+        state.run([&] {
+            Connection connection {EncryptionPolicy::Forced};
+            connection.connect();
+        });
+    });
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,76 @@
+#include "loopback_tracker.hpp"
+
+#include <boost/endian/conversion.hpp>
+#include <boost/url.hpp>
+#include <stdexcept>
+#include <string_view>
+
+#include "bencode_writer.hpp"
+
+namespace torrent::bench {
+
+LoopbackTracker::LoopbackTracker(asio::io_context& io_context) :
+    server(std::make_shared<HttpServer>(
+        io_context,
+        0,
+        [this](const auto& request, auto session) {
+            on_request(request, std::move(session));
+        }
+    )) {}
+
+void LoopbackTracker::add_peer(const tcp::endpoint& endpoint) {
+    if (!endpoint.address().is_v4()) {
+        throw std::runtime_error("LoopbackTracker only supports IPv4 peers");
+    }
+    const auto address = endpoint.address().to_v4().to_bytes();
+    const auto port = boost::endian::native_to_big(endpoint.port());
+
+    std::scoped_lock<std::mutex> lock {mutex};
+    compact_peers.append(reinterpret_cast<const char*>(address.data()), 4);
+    compact_peers.append(reinterpret_cast<const char*>(&port), 2);
+}
+
+void LoopbackTracker::on_request(
+    const HttpServer::Request& request,
+    std::shared_ptr<HttpServer::Session> session
+) {
+    const auto origin_form = std::string_view {
+        request.target().data(),
+        request.target().size()
+    };
+    const auto target = boost::urls::parse_origin_form(origin_form);
+    if (!target.has_value()) {
+        session->send(http::status::bad_request, "text/plain", "Bad request");
+        return;
+    }
+    announce_count.fetch_add(1, std::memory_order_relaxed);
+
+    const auto params = target->params();
+    const auto left = params.find("left");
+    const bool is_seed = left != params.end() && (*left).value == "0";
+
+    std::string peers;
+    if (!is_seed) {
+        std::scoped_lock<std::mutex> lock {mutex};
+        peers = compact_peers;
+    }
+
+    std::string body(
+        1 + BencodeWriter::string_size("interval")
+            + BencodeWriter::integer_size(INTERVAL)
+            + BencodeWriter::string_size("peers")
+            + BencodeWriter::string_size(peers) + 1,
+        '\0'
+    );
+    BencodeWriter writer {std::span<char> {body}};
+    writer.write_dictionary_begin();
+    writer.write_string("interval");
+    writer.write_integer(INTERVAL);
+    writer.write_string("peers");
+    writer.write_string(peers);
+    writer.write_end();
+
+    session->send(http::status::ok, "text/plain", std::move(body));
+}
+
+} // namespace torrent::bench
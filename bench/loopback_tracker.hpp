@@ -0,0 +1,72 @@
+#ifndef TORRENT_BENCH_LOOPBACK_TRACKER_HPP
+#define TORRENT_BENCH_LOOPBACK_TRACKER_HPP
+
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "http_server.hpp"
+
+namespace torrent::bench {
+
+/*
+ * An HTTP tracker on the loopback interface that answers every announce
+ *      with a fixed list of peers.
+ * Peers that announce nothing left to download get an empty list,
+ *      so the seeds of a simulated swarm don't connect to each other.
+ * */
+class LoopbackTracker {
+  public:
+    LoopbackTracker(asio::io_context& io_context);
+
+    LoopbackTracker(const LoopbackTracker&) = delete;
+    const LoopbackTracker& operator=(const LoopbackTracker&) = delete;
+
+    void start() {
+        server->start();
+    }
+
+    void stop() {
+        server->stop();
+    }
+
+    /*
+     * Adds a peer to the answers. Only IPv4 peers can be added.
+     * */
+    void add_peer(const tcp::endpoint& endpoint);
+
+    /*
+     * Returns the announce url to put into the torrent.
+     * */
+    std::string get_announce() const {
+        return "http://127.0.0.1:" + std::to_string(server->get_port())
+            + "/announce";
+    }
+
+    std::size_t get_announce_count() const {
+        return announce_count.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void on_request(
+        const HttpServer::Request& request,
+        std::shared_ptr<HttpServer::Session> session
+    );
+
+  private:
+    std::mutex mutex;
+    std::string compact_peers; // 6 bytes for every peer.
+    std::atomic<std::size_t> announce_count {0};
+
+    // The io_context is stopped before the tracker is destroyed.
+    std::shared_ptr<HttpServer> server;
+
+    static constexpr std::int64_t INTERVAL = 30;
+};
+
+} // namespace torrent::bench
+
+#endif
@@ -0,0 +1,63 @@
+#include "benchmark.hpp"
+#include "bitfield.hpp"
+#include "message.hpp"
+#include "metadata.hpp"
+
+namespace torrent::bench {
+
+void add_message_benchmarks(Runner& runner) {
+    runner.add("message/have", [](State& state) {
+        std::uint32_t piece_index = 0;
+        state.run([&] {
+            Message message {
+                Message::Id::Have,
+                std::vector<std::uint8_t>(4)
+            };
+            message.write_int(0, piece_index++);
+            auto bytes = message.into_bytes();
+            do_not_optimize(bytes);
+        });
+    });
+
+    runner.add("message/request", [](State& state) {
+        std::uint32_t begin = 0;
+        state.run([&] {
+            Message message {
+                Message::Id::Request,
+                std::vector<std::uint8_t>(12)
+            };
+            message.write_int(0, 1);
+            message.write_int(1, begin);
+            message.write_int(2, Metadata::BLOCK_LENGTH);
+            begin += Metadata::BLOCK_LENGTH;
+            auto bytes = message.into_bytes();
+            do_not_optimize(bytes);
+        });
+    });
+
+    runner.add("message/piece", [](State& state) {
+        // Index, begin and a block, as a received Piece payload.
+        const std::vector<std::uint8_t> payload(8 + Metadata::BLOCK_LENGTH, 1);
+        state.set_bytes_per_op(payload.size());
+        state.run([&] {
+            Message message {
+                Message::Id::Piece,
+                payload.begin(),
+                payload.size()
+            };
+            auto bytes = message.into_bytes();
+            do_not_optimize(bytes);
+        });
+    });
+
+    runner.add("message/bitfield/1000000", [](State& state) {
+        Bitfield bitfield {1'000'000 / 8};
+        state.set_bytes_per_op(1'000'000 / 8);
+        state.run([&] {
+            auto bytes = bitfield.as_message().into_bytes();
+            do_not_optimize(bytes);
+        });
+    });
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,72 @@
+#include <array>
+
+#include "benchmark.hpp"
+#include "piece_picker.hpp"
+
+namespace torrent::bench {
+
+namespace {
+
+/*
+ * Returns the bitfield of a peer that has every step'th piece.
+ * */
+std::vector<std::uint8_t> make_peer_bitfield(
+    std::size_t piece_count,
+    std::size_t step
+) {
+    std::vector<std::uint8_t> vec((piece_count + 7) / 8, 0);
+    for (std::size_t i = 0; i < piece_count; i += step) {
+        vec[i / 8] |= static_cast<std::uint8_t>(1 << (7 - (i % 8)));
+    }
+    return vec;
+}
+
+/*
+ * Measures picking a piece and giving it back,
+ *      so every iteration sees the same picker.
+ * @param have_count Number of pieces we already have, from the start.
+ * @param step Peer has every step'th piece.
+ * */
+void add_assign(
+    Runner& runner,
+    const std::string& name,
+    std::size_t piece_count,
+    std::size_t have_count,
+    std::size_t step
+) {
+    runner.add(
+        "piece_picker/" + name + "/" + std::to_string(piece_count),
+        [=](State& state) {
+            PiecePicker picker {piece_count};
+            for (std::size_t i = 0; i < have_count; ++i) {
+                picker.set_have(i);
+            }
+            Bitfield peer_bitfield {make_peer_bitfield(piece_count, step)};
+            state.run([&] {
+                auto piece = picker.assign_piece(peer_bitfield);
+                do_not_optimize(piece);
+                picker.piece_failed(piece);
+            });
+        }
+    );
+}
+
+} // namespace
+
+void add_piece_picker_benchmarks(Runner& runner) {
+    constexpr std::array<std::size_t, 3> piece_counts {
+        10'000,
+        100'000,
+        1'000'000
+    };
+    for (const auto piece_count : piece_counts) {
+        // Start of a download from a seed.
+        add_assign(runner, "assign", piece_count, 0, 1);
+        // A peer with few pieces.
+        add_assign(runner, "assign-sparse", piece_count, 0, 64);
+        // Only the last piece is missing.
+        add_assign(runner, "assign-endgame", piece_count, piece_count - 1, 1);
+    }
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <boost/asio/io_context.hpp>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "metadata.hpp"
+#include "pieces.hpp"
+#include "synthetic_torrent.hpp"
+
+namespace torrent::bench {
+
+namespace {
+
+void add_check_sha1(Runner& runner, std::size_t piece_length) {
+    runner.add(
+        "pieces/check_sha1/" + std::to_string(piece_length),
+        [=](State& state) {
+            SyntheticTorrent torrent;
+            torrent.name = "check-sha1";
+            torrent.piece_count = 64;
+            torrent.piece_length = piece_length;
+            const auto path = torrent.write_torrent_file();
+            auto metadata = Metadata::from_torrent_file(path.string());
+            std::filesystem::remove(path);
+
+            boost::asio::io_context io_context;
+            auto pieces = Pieces::create(io_context, metadata);
+            const auto piece = torrent.make_piece();
+
+            std::size_t piece_index = 0;
+            state.set_bytes_per_op(piece.size());
+            state.run([&] {
+                auto passed = pieces->check_sha1_piece(piece_index, piece);
+                do_not_optimize(passed);
+                piece_index = (piece_index + 1) % torrent.piece_count;
+            });
+        }
+    );
+}
+
+/*
+ * Writes every block of a 64 MiB torrent to a new file in random order,
+ *      as blocks arrive from many peers.
+ * Run it on the file system to compare, and see the fragmentation
+ *      of the files with filefrag.
+ * */
+void add_write_random(
+    Runner& runner,
+    const std::string& name,
+    Pieces::Allocation allocation
+) {
+    runner.add("pieces/write_random/" + name, [=](State& state) {
+        SyntheticTorrent torrent;
+        torrent.name = "write-random-" + name;
+        torrent.piece_count = 256;
+        const auto directory = std::filesystem::temp_directory_path();
+        const auto torrent_path = torrent.write_torrent_file(directory);
+        const auto piece = torrent.make_piece();
+
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> blocks;
+        for (std::uint32_t i = 0; i < torrent.piece_count; ++i) {
+            for (std::uint32_t begin = 0; begin < torrent.piece_length;
+                 begin += Metadata::BLOCK_LENGTH) {
+                blocks.emplace_back(i, begin);
+            }
+        }
+        std::shuffle(blocks.begin(), blocks.end(), std::mt19937 {1});
+
+        state.set_bytes_per_op(torrent.piece_count * torrent.piece_length);
+        state.run([&] {
+            auto metadata = Metadata::from_torrent_file(torrent_path.string());
+            boost::asio::io_context io_context;
+            auto pieces = Pieces::create(io_context, metadata);
+            pieces->set_download_directory(directory);
+            pieces->set_extract_files(false);
+            pieces->set_allocation(allocation);
+            pieces->init_file();
+            for (const auto& [piece_index, begin] : blocks) {
+                // Index and begin, then the block, as a Piece payload.
+                std::vector<std::uint8_t> payload(8 + Metadata::BLOCK_LENGTH);
+                std::memcpy(
+                    payload.data() + 8,
+                    piece.data() + begin,
+                    Metadata::BLOCK_LENGTH
+                );
+                pieces->write_block_async(
+                    piece_index,
+                    begin,
+                    std::move(payload),
+                    {},
+                    [](const auto&, auto) {}
+                );
+            }
+            io_context.run();
+            std::filesystem::remove(directory / metadata->get_file_name());
+        });
+        std::filesystem::remove(torrent_path);
+    });
+}
+
+} // namespace
+
+void add_pieces_benchmarks(Runner& runner) {
+    add_check_sha1(runner, 1 << 14);
+    add_check_sha1(runner, 1 << 18);
+    add_check_sha1(runner, 1 << 22);
+
+    add_write_random(runner, "sparse", Pieces::Allocation::Sparse);
+    add_write_random(runner, "full", Pieces::Allocation::Full);
+    add_write_random(runner, "extents", Pieces::Allocation::Extents);
+
+    runner.add("metadata/from_torrent_file/100000", [](State& state) {
+        SyntheticTorrent torrent;
+        torrent.name = "from-torrent-file";
+        torrent.piece_count = 100'000;
+        torrent.file_count = 1'000;
+        const auto path = torrent.write_torrent_file();
+        state.set_bytes_per_op(std::filesystem::file_size(path));
+        state.run([&] {
+            auto metadata = Metadata::from_torrent_file(path.string());
+            do_not_optimize(metadata);
+        });
+        std::filesystem::remove(path);
+    });
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,229 @@
+#include "shaping_proxy.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "log.hpp"
+
+namespace torrent::bench {
+
+ShapingProxy::ShapingProxy(
+    asio::io_context& io_context_ref,
+    tcp::endpoint target_endpoint,
+    LinkProfile link_profile,
+    std::uint64_t seed
+) :
+    io_context(io_context_ref),
+    acceptor(io_context_ref),
+    target(std::move(target_endpoint)),
+    profile(link_profile),
+    next_seed(seed) {}
+
+void ShapingProxy::start() {
+    const tcp::endpoint endpoint {asio::ip::address_v4::loopback(), 0};
+    acceptor.open(endpoint.protocol());
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    accept();
+}
+
+void ShapingProxy::stop() {
+    std::scoped_lock<std::mutex> lock {mutex};
+    boost::system::error_code error;
+    acceptor.close(error);
+    for (const auto& weak_connection : connections) {
+        if (auto connection = weak_connection.lock()) {
+            connection->close();
+        }
+    }
+    connections.clear();
+}
+
+void ShapingProxy::accept() {
+    acceptor.async_accept(
+        asio::make_strand(io_context),
+        [this](const auto& error, tcp::socket socket) {
+            if (error) {
+                if (error != asio::error::operation_aborted) {
+                    TORRENT_LOG(error)
+                        << "ShapingProxy: error while accepting: "
+                        << error.message();
+                }
+                return;
+            }
+            std::shared_ptr<Connection> connection;
+            {
+                std::scoped_lock<std::mutex> lock {mutex};
+                connection = std::make_shared<Connection>(
+                    std::move(socket),
+                    *this,
+                    next_seed++
+                );
+                connections.push_back(connection);
+            }
+            connection->start();
+            accept();
+        }
+    );
+}
+
+ShapingProxy::Connection::Connection(
+    tcp::socket client_socket,
+    ShapingProxy& proxy,
+    std::uint64_t seed
+) :
+    profile(proxy.profile),
+    target(proxy.target),
+    client(std::move(client_socket)),
+    server(client.get_executor()),
+    upstream(client, server, proxy.bytes_to_target),
+    downstream(server, client, proxy.bytes_from_target),
+    random(seed) {}
+
+void ShapingProxy::Connection::start() {
+    server.async_connect(target, [self = shared_from_this()](auto error) {
+        if (error) {
+            self->close();
+            return;
+        }
+        // Small messages like requests shouldn't wait for more data.
+        self->server.set_option(tcp::no_delay(true), error);
+        self->client.set_option(tcp::no_delay(true), error);
+        self->read(self->upstream);
+        self->read(self->downstream);
+    });
+}
+
+void ShapingProxy::Connection::close() {
+    asio::post(client.get_executor(), [self = shared_from_this()] {
+        boost::system::error_code error;
+        self->client.close(error);
+        self->server.close(error);
+        self->upstream.timer.cancel();
+        self->downstream.timer.cancel();
+    });
+}
+
+void ShapingProxy::Connection::read(Direction& direction) {
+    if (direction.reading || direction.read_closed
+        || direction.queued_bytes >= MAX_QUEUED_BYTES) {
+        return;
+    }
+    direction.reading = true;
+    direction.from.async_read_some(
+        asio::buffer(direction.buffer),
+        [self = shared_from_this(), &direction](auto error, auto length) {
+            self->on_read(direction, error, length);
+        }
+    );
+}
+
+void ShapingProxy::Connection::on_read(
+    Direction& direction,
+    const boost::system::error_code& error,
+    std::size_t length
+) {
+    direction.reading = false;
+    if (error) {
+        // Deliver what is queued, then pass the end of the stream on.
+        direction.read_closed = true;
+        if (!direction.writing) {
+            write(direction);
+        }
+        return;
+    }
+
+    direction.queue.push_back(
+        {release_time(direction, length),
+         {direction.buffer.begin(),
+          direction.buffer.begin() + static_cast<std::ptrdiff_t>(length)}}
+    );
+    direction.queued_bytes += length;
+    direction.counter.fetch_add(length, std::memory_order_relaxed);
+
+    if (!direction.writing) {
+        write(direction);
+    }
+    read(direction);
+}
+
+ShapingProxy::Clock::time_point ShapingProxy::Connection::release_time(
+    Direction& direction,
+    std::size_t length
+) {
+    const auto now = Clock::now();
+    auto transmission = Clock::duration::zero();
+    if (profile.bandwidth != 0) {
+        transmission = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(
+                static_cast<double>(length)
+                / static_cast<double>(profile.bandwidth)
+            )
+        );
+    }
+    direction.link_free = std::max(direction.link_free, now) + transmission;
+    auto release = direction.link_free + profile.latency;
+
+    if (profile.loss > 0.0) {
+        // Chance that at least one packet of the segment is lost.
+        const auto packets = (length + PACKET_LENGTH - 1) / PACKET_LENGTH;
+        const auto delivered =
+            std::pow(1.0 - profile.loss, static_cast<double>(packets));
+        if (std::uniform_real_distribution<double> {0.0, 1.0}(random)
+            >= delivered) {
+            // The sender notices the loss after a timeout and sends it again.
+            release += std::max<Clock::duration>(
+                MIN_RETRANSMISSION_TIMEOUT,
+                4 * profile.latency
+            );
+        }
+    }
+    // TCP delivers in order. Nothing passes a retransmitted segment.
+    release = std::max(release, direction.last_release);
+    direction.last_release = release;
+    return release;
+}
+
+void ShapingProxy::Connection::write(Direction& direction) {
+    if (direction.queue.empty()) {
+        direction.writing = false;
+        if (direction.read_closed) {
+            boost::system::error_code error;
+            direction.to.shutdown(tcp::socket::shutdown_send, error);
+        }
+        return;
+    }
+    direction.writing = true;
+
+    const auto& segment = direction.queue.front();
+    if (Clock::now() < segment.release) {
+        direction.timer.expires_at(segment.release);
+        direction.timer.async_wait(
+            [self = shared_from_this(), &direction](auto error) {
+                if (error) {
+                    return; // Closed.
+                }
+                self->write(direction);
+            }
+        );
+        return;
+    }
+
+    asio::async_write(
+        direction.to,
+        asio::buffer(segment.data),
+        [self = shared_from_this(), &direction](auto error, auto length) {
+            if (error) {
+                self->close();
+                return;
+            }
+            direction.queued_bytes -= length;
+            direction.queue.pop_front();
+            // Reading might be paused because the queue was full.
+            self->read(direction);
+            self->write(direction);
+        }
+    );
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,204 @@
+#ifndef TORRENT_BENCH_SHAPING_PROXY_HPP
+#define TORRENT_BENCH_SHAPING_PROXY_HPP
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace torrent::bench {
+
+namespace asio = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+/*
+ * Properties of the emulated link between two peers.
+ * Every direction of a connection is shaped on its own.
+ * */
+struct LinkProfile {
+    std::chrono::microseconds latency {0}; // One way delay.
+    std::size_t bandwidth = 0; // Bytes per second. Zero is unlimited.
+    double loss = 0.0; // Probability that a packet is lost.
+
+    bool is_shaped() const {
+        return latency.count() != 0 || bandwidth != 0 || loss != 0.0;
+    }
+};
+
+/*
+ * A TCP proxy on the loopback interface that forwards every accepted
+ *      connection to the target while emulating a slower link.
+ * Data is delayed by the latency and the time it takes to send it
+ *      at the bandwidth. The proxy works above TCP, so a lost packet
+ *      can't be dropped. It is modeled as a retransmission instead,
+ *      which holds back everything after it like TCP would.
+ * */
+class ShapingProxy {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /*
+     * @param seed Seed of the random numbers deciding the losses,
+     *      so runs with the same seed lose the same packets.
+     * */
+    ShapingProxy(
+        asio::io_context& io_context_ref,
+        tcp::endpoint target_endpoint,
+        LinkProfile link_profile,
+        std::uint64_t seed
+    );
+
+    ShapingProxy(const ShapingProxy&) = delete;
+    const ShapingProxy& operator=(const ShapingProxy&) = delete;
+
+    /*
+     * Starts accepting connections on a free port.
+     * */
+    void start();
+
+    /*
+     * Stops accepting and closes every connection.
+     * */
+    void stop();
+
+    std::uint16_t get_port() const {
+        return acceptor.local_endpoint().port();
+    }
+
+    /*
+     * Returns the number of bytes forwarded from the target.
+     * */
+    std::size_t get_bytes_from_target() const {
+        return bytes_from_target.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * Returns the number of bytes forwarded to the target.
+     * */
+    std::size_t get_bytes_to_target() const {
+        return bytes_to_target.load(std::memory_order_relaxed);
+    }
+
+  private:
+    class Connection;
+
+    void accept();
+
+  private:
+    asio::io_context& io_context;
+    tcp::acceptor acceptor;
+    tcp::endpoint target;
+    LinkProfile profile;
+
+    std::atomic<std::size_t> bytes_from_target {0};
+    std::atomic<std::size_t> bytes_to_target {0};
+
+    std::mutex mutex;
+    std::uint64_t next_seed;
+    std::vector<std::weak_ptr<Connection>> connections;
+};
+
+/*
+ * A connection accepted by the proxy and its connection to the target.
+ * Every handler runs on the strand of the sockets.
+ * */
+class ShapingProxy::Connection:
+    public std::enable_shared_from_this<Connection> {
+  public:
+    Connection(
+        tcp::socket client_socket,
+        ShapingProxy& proxy,
+        std::uint64_t seed
+    );
+
+    /*
+     * Connects to the target and starts forwarding.
+     * */
+    void start();
+
+    /*
+     * Closes both sides. Can be called from any thread.
+     * */
+    void close();
+
+  private:
+    struct Segment {
+        Clock::time_point release; // When the other side may receive it.
+        std::vector<std::uint8_t> data;
+    };
+
+    /*
+     * One direction of the connection.
+     * */
+    struct Direction {
+        Direction(
+            tcp::socket& from_socket,
+            tcp::socket& to_socket,
+            std::atomic<std::size_t>& byte_counter
+        ) :
+            from(from_socket),
+            to(to_socket),
+            counter(byte_counter),
+            timer(from_socket.get_executor()) {}
+
+        tcp::socket& from;
+        tcp::socket& to;
+        std::atomic<std::size_t>& counter;
+        asio::steady_timer timer;
+
+        std::array<std::uint8_t, 1 << 14> buffer;
+        std::deque<Segment> queue;
+        std::size_t queued_bytes = 0;
+        // When the emulated link finishes sending the queued data.
+        Clock::time_point link_free;
+        Clock::time_point last_release;
+
+        bool reading = false;
+        bool writing = false;
+        bool read_closed = false;
+    };
+
+    void read(Direction& direction);
+    void on_read(
+        Direction& direction,
+        const boost::system::error_code& error,
+        std::size_t length
+    );
+    void write(Direction& direction);
+
+    /*
+     * Returns the time the segment reaches the other side.
+     * */
+    Clock::time_point release_time(Direction& direction, std::size_t length);
+
+  private:
+    const LinkProfile& profile;
+    tcp::endpoint target;
+
+    tcp::socket client;
+    tcp::socket server;
+    Direction upstream; // Client to the target.
+    Direction downstream; // Target to the client.
+
+    std::mt19937_64 random;
+
+    // Reading pauses while this much data is in flight.
+    // Like the socket buffers of a real connection.
+    static constexpr std::size_t MAX_QUEUED_BYTES = 1 << 20;
+    static constexpr std::size_t PACKET_LENGTH = 1460;
+    static constexpr auto MIN_RETRANSMISSION_TIMEOUT =
+        std::chrono::milliseconds(200);
+};
+
+} // namespace torrent::bench
+
+#endif
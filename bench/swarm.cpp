@@ -0,0 +1,357 @@
+#include "swarm.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "client.hpp"
+#include "log.hpp"
+#include "loopback_tracker.hpp"
+#include "simulated_network.hpp"
+
+namespace torrent::bench {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+double to_seconds(const timeval& time) {
+    return static_cast<double>(time.tv_sec)
+        + static_cast<double>(time.tv_usec) / 1e6;
+}
+
+double get_process_cpu_seconds() {
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return to_seconds(usage.ru_utime) + to_seconds(usage.ru_stime);
+}
+
+std::size_t get_peak_rss_bytes() {
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024; // In KiB.
+}
+
+double get_thread_cpu_seconds() {
+    timespec time {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec)
+        + static_cast<double>(time.tv_nsec) / 1e9;
+}
+
+/*
+ * Runs the io_context on the given number of threads until it is stopped.
+ * */
+class ContextThreads {
+  public:
+    ContextThreads(asio::io_context& io_context_ref, std::size_t count) :
+        io_context(io_context_ref),
+        work_guard(asio::make_work_guard(io_context_ref)) {
+        for (std::size_t i = 0; i < std::max<std::size_t>(1, count); ++i) {
+            threads.emplace_back([this] {
+                try {
+                    io_context.run();
+                } catch (const std::exception& exception) {
+                    TORRENT_LOG(error)
+                        << "Fatal error in the swarm: " << exception.what();
+                }
+                const auto cpu_seconds = get_thread_cpu_seconds();
+                std::scoped_lock<std::mutex> lock {mutex};
+                total_cpu_seconds += cpu_seconds;
+            });
+        }
+    }
+
+    ~ContextThreads() {
+        join();
+    }
+
+    /*
+     * Stops the io_context and waits for the threads.
+     * @return Total CPU time of the threads.
+     * */
+    double join() {
+        work_guard.reset();
+        io_context.stop();
+        for (auto& thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+        std::scoped_lock<std::mutex> lock {mutex};
+        return total_cpu_seconds;
+    }
+
+  private:
+    asio::io_context& io_context;
+    asio::executor_work_guard<asio::io_context::executor_type> work_guard;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    double total_cpu_seconds = 0.0;
+};
+
+/*
+ * Gives the seed its own copy of the data without copying it.
+ * */
+void link_data_file(const fs::path& data_file, const fs::path& path) {
+    std::error_code error;
+    fs::create_hard_link(data_file, path, error);
+    if (error) {
+        // File systems without hard links.
+        fs::copy_file(data_file, path, fs::copy_options::overwrite_existing);
+    }
+}
+
+} // namespace
+
+SwarmResult run_swarm(const SwarmOptions& options) {
+    fs::remove_all(options.work_directory);
+    fs::create_directories(options.work_directory);
+
+    asio::ssl::context ssl_context {asio::ssl::context::tls_client};
+
+    // Everything but the measured client runs on this context.
+    asio::io_context swarm_context;
+    LoopbackTracker tracker {swarm_context};
+    tracker.start();
+
+    auto torrent = options.torrent;
+    torrent.announce = tracker.get_announce();
+    const auto torrent_path =
+        torrent.write_torrent_file(options.work_directory).string();
+    const auto data_file = options.work_directory / (torrent.name + ".tmp");
+    torrent.write_data_file(data_file);
+
+    // The tracker hands out the proxies if the links are shaped.
+    // Ports tell which seed a connection of the client belongs to.
+    std::vector<std::shared_ptr<Client>> seeds;
+    std::vector<std::unique_ptr<ShapingProxy>> proxies;
+    std::unordered_map<std::uint16_t, std::size_t> seed_ports;
+    for (std::size_t i = 0; i < options.seed_count; ++i) {
+        const auto directory =
+            options.work_directory / ("seed-" + std::to_string(i));
+        fs::create_directories(directory);
+        link_data_file(data_file, directory / (torrent.name + ".tmp"));
+
+        auto seed = std::make_shared<Client>(swarm_context, ssl_context, 0);
+        seed->set_download_directory(directory);
+        seed->set_extract_files(false);
+        seed->start(torrent_path);
+
+        tcp::endpoint endpoint {
+            asio::ip::address_v4::loopback(),
+            seed->get_port()
+        };
+        if (options.link.is_shaped()) {
+            auto proxy = std::make_unique<ShapingProxy>(
+                swarm_context,
+                endpoint,
+                options.link,
+                options.random_seed + i * 1'000'003
+            );
+            proxy->start();
+            endpoint.port(proxy->get_port());
+            proxies.push_back(std::move(proxy));
+        }
+        tracker.add_peer(endpoint);
+        seed_ports[endpoint.port()] = i;
+        seeds.push_back(std::move(seed));
+    }
+    ContextThreads swarm_threads {swarm_context, options.swarm_threads};
+
+    const auto client_directory = options.work_directory / "client";
+    fs::create_directories(client_directory);
+
+    SwarmResult result;
+    asio::io_context client_context;
+    {
+        auto client = std::make_shared<Client>(client_context, ssl_context, 0);
+        client->set_download_directory(client_directory);
+        client->set_extract_files(false);
+
+        // Give up on the download after the timeout.
+        asio::steady_timer timeout {swarm_context};
+        timeout.expires_after(options.timeout);
+        timeout.async_wait([&client](auto error) {
+            if (!error) {
+                TORRENT_LOG(error) << "Swarm download timed out.";
+                client->stop();
+            }
+        });
+
+        const auto cpu_start = get_process_cpu_seconds();
+        const auto start = std::chrono::steady_clock::now();
+        client->start(torrent_path);
+        ContextThreads client_threads {client_context, options.client_threads};
+        client->wait();
+        const auto end = std::chrono::steady_clock::now();
+        timeout.cancel();
+
+        const auto& metadata = client->get_metadata();
+        result.completed = metadata && metadata->is_file_complete();
+        result.total_length = torrent.piece_count * torrent.piece_length;
+        result.seconds = std::chrono::duration<double>(end - start).count();
+        result.wall_seconds = result.seconds;
+        result.process_cpu_seconds = get_process_cpu_seconds() - cpu_start;
+        result.peak_rss_bytes = get_peak_rss_bytes();
+        for (const auto& info : client->get_peer_infos()) {
+            const auto seed = seed_ports.find(info.endpoint.port());
+            if (seed == seed_ports.end()) {
+                continue;
+            }
+            result.peers.push_back(
+                {seed->second,
+                 info.downloaded,
+                 static_cast<double>(info.downloaded) / result.seconds}
+            );
+        }
+
+        client->stop();
+        result.client_cpu_seconds = client_threads.join();
+    }
+
+    for (const auto& proxy : proxies) {
+        proxy->stop();
+    }
+    for (const auto& seed : seeds) {
+        seed->stop();
+    }
+    tracker.stop();
+    swarm_threads.join();
+    return result;
+}
+
+SwarmResult run_simulated_swarm(const SwarmOptions& options) {
+    fs::remove_all(options.work_directory);
+    fs::create_directories(options.work_directory);
+
+    asio::ssl::context ssl_context {asio::ssl::context::tls_client};
+    asio::io_context io_context;
+    auto network = SimulatedNetwork::create(io_context, options.random_seed);
+    const SimulatedLink link {
+        options.link.latency,
+        options.jitter,
+        options.link.bandwidth,
+        options.link.loss
+    };
+    // Hosts get consecutive addresses, the first one is the client.
+    const auto get_address = [](std::size_t index) {
+        return address_v4 {static_cast<address_v4::uint_type>(
+            address_v4 {{10, 0, 0, 1}}.to_uint() + index
+        )};
+    };
+
+    // The simulated network replaces the tracker of the torrent.
+    const auto& torrent = options.torrent;
+    const auto torrent_path =
+        torrent.write_torrent_file(options.work_directory).string();
+    const auto data_file = options.work_directory / (torrent.name + ".tmp");
+    torrent.write_data_file(data_file);
+
+    std::vector<std::shared_ptr<Client>> seeds;
+    for (std::size_t i = 0; i < options.seed_count; ++i) {
+        const auto directory =
+            options.work_directory / ("seed-" + std::to_string(i));
+        fs::create_directories(directory);
+        link_data_file(data_file, directory / (torrent.name + ".tmp"));
+
+        auto seed = std::make_shared<Client>(io_context, ssl_context);
+        seed->set_transport(network->add_host(get_address(i + 1), link));
+        seed->set_download_directory(directory);
+        seed->set_extract_files(false);
+        seed->start(torrent_path);
+        seeds.push_back(std::move(seed));
+    }
+
+    const auto client_directory = options.work_directory / "client";
+    fs::create_directories(client_directory);
+
+    SwarmResult result;
+    auto client = std::make_shared<Client>(io_context, ssl_context);
+    client->set_transport(network->add_host(get_address(0), link));
+    client->set_download_directory(client_directory);
+    client->set_extract_files(false);
+
+    const auto cpu_start = get_process_cpu_seconds();
+    const auto wall_start = std::chrono::steady_clock::now();
+    const auto start = network->now();
+    client->start(torrent_path);
+    const auto& metadata = client->get_metadata();
+    result.completed = network->run_until(
+        [&metadata] { return metadata && metadata->is_file_complete(); },
+        start + options.timeout
+    );
+    const auto wall_end = std::chrono::steady_clock::now();
+
+    result.total_length = torrent.piece_count * torrent.piece_length;
+    result.seconds =
+        std::chrono::duration<double>(network->now() - start).count();
+    result.wall_seconds =
+        std::chrono::duration<double>(wall_end - wall_start).count();
+    result.process_cpu_seconds = get_process_cpu_seconds() - cpu_start;
+    result.client_cpu_seconds = result.process_cpu_seconds;
+    result.peak_rss_bytes = get_peak_rss_bytes();
+    for (const auto& info : client->get_peer_infos()) {
+        const auto index = info.endpoint.address().to_v4().to_uint()
+            - get_address(1).to_uint();
+        if (index >= options.seed_count) {
+            continue;
+        }
+        result.peers.push_back(
+            {index,
+             info.downloaded,
+             static_cast<double>(info.downloaded) / result.seconds}
+        );
+    }
+
+    client->stop();
+    for (const auto& seed : seeds) {
+        seed->stop();
+    }
+    network->stop();
+    io_context.restart();
+    io_context.poll();
+    return result;
+}
+
+void SwarmResult::write_json(std::ostream& os) const {
+    const auto format = [](double value) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+        return std::string {buffer};
+    };
+    os << "{\n  \"version\": 1,\n"
+       << "  \"completed\": " << (completed ? "true" : "false") << ",\n"
+       << "  \"total_length\": " << total_length << ",\n"
+       << "  \"seconds\": " << format(seconds) << ",\n"
+       << "  \"wall_seconds\": " << format(wall_seconds) << ",\n"
+       << "  \"bytes_per_second\": " << format(bytes_per_second()) << ",\n"
+       << "  \"client_cpu_seconds\": " << format(client_cpu_seconds) << ",\n"
+       << "  \"client_cpu_seconds_per_gib\": "
+       << format(client_cpu_seconds_per_gib()) << ",\n"
+       << "  \"process_cpu_seconds\": " << format(process_cpu_seconds)
+       << ",\n"
+       << "  \"peak_rss_bytes\": " << peak_rss_bytes << ",\n"
+       << "  \"peers\": [";
+    for (std::size_t i = 0; i < peers.size(); ++i) {
+        const auto& peer = peers[i];
+        os << (i == 0 ? "\n" : ",\n") << "    {\"seed\": " << peer.seed_index
+           << ", \"downloaded\": " << peer.downloaded
+           << ", \"bytes_per_second\": " << format(peer.bytes_per_second)
+           << "}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,103 @@
+#ifndef TORRENT_BENCH_SWARM_HPP
+#define TORRENT_BENCH_SWARM_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "shaping_proxy.hpp"
+#include "synthetic_torrent.hpp"
+
+namespace torrent::bench {
+
+/*
+ * Parameters of a simulated swarm.
+ * */
+struct SwarmOptions {
+    SyntheticTorrent torrent;
+    std::size_t seed_count = 4;
+    // Link between the downloading client and every seed.
+    LinkProfile link;
+    // Random extra delay of the links. Only simulated swarms have it.
+    std::chrono::microseconds jitter {0};
+    // Seed of the random numbers of the links.
+    std::uint64_t random_seed = 1;
+    // Threads running the downloading client.
+    std::size_t client_threads = 2;
+    // Threads running the seeds, the tracker and the links.
+    std::size_t swarm_threads = 2;
+    std::chrono::seconds timeout {600};
+    // The torrent, the seed data and the download are created here.
+    std::filesystem::path work_directory =
+        std::filesystem::temp_directory_path() / "torrent-swarm";
+};
+
+/*
+ * Measurements of a download in the simulated swarm.
+ * */
+struct SwarmResult {
+    struct PeerResult {
+        std::size_t seed_index;
+        std::size_t downloaded; // Bytes received from the seed.
+        double bytes_per_second;
+    };
+
+    bool completed = false;
+    std::size_t total_length = 0;
+    double seconds = 0.0; // Time to complete, from start to the last piece.
+    // Time the run took. Differs from seconds for simulated swarms.
+    double wall_seconds = 0.0;
+    // CPU time of the threads running the downloading client.
+    double client_cpu_seconds = 0.0;
+    // CPU time of the whole process, including the seeds and the links.
+    double process_cpu_seconds = 0.0;
+    // Peak resident memory of the whole process.
+    std::size_t peak_rss_bytes = 0;
+    std::vector<PeerResult> peers;
+
+    double bytes_per_second() const {
+        if (seconds <= 0.0) {
+            return 0.0;
+        }
+        return static_cast<double>(total_length) / seconds;
+    }
+
+    /*
+     * Returns CPU seconds the downloading client spent per GiB downloaded.
+     * */
+    double client_cpu_seconds_per_gib() const {
+        if (total_length == 0) {
+            return 0.0;
+        }
+        return client_cpu_seconds * static_cast<double>(1ull << 30)
+            / static_cast<double>(total_length);
+    }
+
+    /*
+     * Writes the result as JSON. Fields and their order are stable.
+     * */
+    void write_json(std::ostream& os) const;
+};
+
+/*
+ * Creates a swarm of seeding clients on the loopback interface with a
+ *      tracker, then downloads the torrent with a fresh Client and
+ *      measures it. Every client runs in this process.
+ * @throws std::runtime_error If the swarm can't be set up.
+ * */
+SwarmResult run_swarm(const SwarmOptions& options);
+
+/*
+ * Same as run_swarm, but the clients are connected through a
+ *      SimulatedNetwork, so the download runs in virtual time on a
+ *      single thread. Times are virtual and the CPU time of the
+ *      client is the CPU time of the whole swarm.
+ * */
+SwarmResult run_simulated_swarm(const SwarmOptions& options);
+
+} // namespace torrent::bench
+
+#endif
@@ -0,0 +1,144 @@
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "log.hpp"
+#include "swarm.hpp"
+#include "trace.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cerr
+        << "Usage: torrent_swarm [options]\n"
+           "  --seeds <count>          Number of seeding clients. (4)\n"
+           "  --pieces <count>         Number of pieces. (1024)\n"
+           "  --piece-length <bytes>   Length of a piece. (262144)\n"
+           "  --files <count>          Number of files. (1)\n"
+           "  --latency <ms>           One way latency of the links. (0)\n"
+           "  --bandwidth <KiB/s>      Bandwidth of every link. (unlimited)\n"
+           "  --loss <probability>     Packet loss of the links. (0)\n"
+           "  --jitter <ms>            Extra random delay. (0)\n"
+           "  --random-seed <number>   Seed of the link losses. (1)\n"
+           "  --client-threads <count> Threads of the downloading client. (2)\n"
+           "  --swarm-threads <count>  Threads of the seeds and links. (2)\n"
+           "  --timeout <seconds>      Give up after this long. (600)\n"
+           "  --work-dir <path>        Directory of the files.\n"
+           "  --json <path>            Write JSON, - for stdout.\n"
+           "  --trace <path>           Write a Chrome trace at exit.\n"
+           "  --simulated              Download in virtual time.\n"
+           "  --verbose                Log everything the clients do.\n";
+}
+
+} // namespace
+
+/*
+ * Downloads a generated torrent from seeds on the loopback interface
+ *      and reports how long it took and what it cost.
+ * */
+int main(int argc, char* argv[]) {
+    using namespace torrent::bench;
+
+    SwarmOptions options;
+    options.torrent.name = "swarm";
+    options.torrent.piece_count = 1024;
+    std::string json_path;
+    bool verbose = false;
+    bool simulated = false;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view arg = argv[i];
+            if (arg == "--verbose") {
+                verbose = true;
+                continue;
+            }
+            if (arg == "--simulated") {
+                simulated = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            const std::string value = argv[++i];
+            if (arg == "--seeds") {
+                options.seed_count = std::stoul(value);
+            } else if (arg == "--pieces") {
+                options.torrent.piece_count = std::stoul(value);
+            } else if (arg == "--piece-length") {
+                options.torrent.piece_length = std::stoul(value);
+            } else if (arg == "--files") {
+                options.torrent.file_count = std::stoul(value);
+            } else if (arg == "--latency") {
+                options.link.latency = std::chrono::milliseconds {
+                    std::stoll(value)
+                };
+            } else if (arg == "--bandwidth") {
+                options.link.bandwidth = std::stoul(value) * 1024;
+            } else if (arg == "--jitter") {
+                options.jitter = std::chrono::milliseconds {std::stoll(value)};
+            } else if (arg == "--loss") {
+                options.link.loss = std::stod(value);
+            } else if (arg == "--random-seed") {
+                options.random_seed = std::stoull(value);
+            } else if (arg == "--client-threads") {
+                options.client_threads = std::stoul(value);
+            } else if (arg == "--swarm-threads") {
+                options.swarm_threads = std::stoul(value);
+            } else if (arg == "--timeout") {
+                options.timeout = std::chrono::seconds {std::stoll(value)};
+            } else if (arg == "--work-dir") {
+                options.work_directory = value;
+            } else if (arg == "--json") {
+                json_path = value;
+            } else if (arg == "--trace") {
+                torrent::trace::start(value);
+            } else {
+                print_usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        print_usage();
+        return 1;
+    }
+
+    if (!verbose) {
+        torrent::log::set_level(torrent::log::Level::warning);
+    }
+
+    SwarmResult result;
+    try {
+        result = simulated ? run_simulated_swarm(options) : run_swarm(options);
+    } catch (const std::exception& exception) {
+        std::cerr << "Could not run the swarm: " << exception.what() << '\n';
+        return 1;
+    }
+
+    std::cerr << (result.completed ? "Completed" : "Did not complete")
+              << " in " << result.seconds << " s"
+              << (simulated ? " of virtual time, " : ", ")
+              << result.bytes_per_second() / (1 << 20) << " MiB/s, "
+              << result.client_cpu_seconds_per_gib() << " CPU s/GiB, peak RSS "
+              << result.peak_rss_bytes / (1 << 20) << " MiB\n";
+    for (const auto& peer : result.peers) {
+        std::cerr << "  seed " << peer.seed_index << ": "
+                  << peer.bytes_per_second / (1 << 20) << " MiB/s\n";
+    }
+
+    if (json_path == "-") {
+        result.write_json(std::cout);
+    } else if (!json_path.empty()) {
+        std::ofstream file {json_path, std::ios::trunc};
+        result.write_json(file);
+        if (!file) {
+            std::cerr << "Could not write " << json_path << '\n';
+            return 1;
+        }
+    }
+    return result.completed ? 0 : 2;
+}
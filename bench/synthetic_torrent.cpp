@@ -0,0 +1,117 @@
+#include "synthetic_torrent.hpp"
+
+#include <openssl/sha.h>
+
+#include <fstream>
+#include <stdexcept>
+
+#include "bencode_writer.hpp"
+
+namespace torrent::bench {
+
+namespace {
+
+using Element = BencodeParser::Element;
+
+Element make_integer(std::size_t value) {
+    return Element {
+        Element::Type {static_cast<BencodeParser::Integer>(value)}
+    };
+}
+
+Element make_string(std::string value) {
+    return Element {Element::Type {std::move(value)}};
+}
+
+} // namespace
+
+std::string SyntheticTorrent::make_piece() const {
+    std::string piece(piece_length, '\0');
+    // Anything but zeros, so the data doesn't look like a sparse file.
+    for (std::size_t i = 0; i < piece.size(); ++i) {
+        piece[i] = static_cast<char>((i * 31 + 7) & 0xff);
+    }
+    return piece;
+}
+
+std::string SyntheticTorrent::make_torrent() const {
+    if (piece_count == 0 || file_count == 0 || piece_length == 0) {
+        throw std::runtime_error("Invalid synthetic torrent parameters");
+    }
+    const auto piece = make_piece();
+    unsigned char hash[SHA_DIGEST_LENGTH];
+    SHA1(
+        reinterpret_cast<const unsigned char*>(piece.data()),
+        piece.size(),
+        hash
+    );
+    std::string hashes;
+    hashes.reserve(piece_count * SHA_DIGEST_LENGTH);
+    for (std::size_t i = 0; i < piece_count; ++i) {
+        hashes.append(reinterpret_cast<const char*>(hash), SHA_DIGEST_LENGTH);
+    }
+
+    const auto total_length = piece_count * piece_length;
+    BencodeParser::Dictionary info;
+    info["name"] = make_string(name);
+    info["piece length"] = make_integer(piece_length);
+    info["pieces"] = make_string(std::move(hashes));
+    if (file_count == 1) {
+        info["length"] = make_integer(total_length);
+    } else {
+        BencodeParser::List files;
+        files.reserve(file_count);
+        for (std::size_t i = 0; i < file_count; ++i) {
+            const auto length = total_length / file_count
+                + (i < total_length % file_count ? 1 : 0);
+            BencodeParser::List path;
+            path.push_back(make_string("directory" + std::to_string(i % 16)));
+            path.push_back(make_string("file" + std::to_string(i) + ".bin"));
+
+            BencodeParser::Dictionary file;
+            file["length"] = make_integer(length);
+            file["path"] = Element {Element::Type {std::move(path)}};
+            files.push_back(Element {Element::Type {std::move(file)}});
+        }
+        info["files"] = Element {Element::Type {std::move(files)}};
+    }
+
+    BencodeParser::Dictionary torrent;
+    torrent["announce"] = make_string(announce);
+    torrent["info"] = Element {Element::Type {std::move(info)}};
+    return BencodeWriter::encode(Element {Element::Type {std::move(torrent)}}
+    );
+}
+
+std::filesystem::path SyntheticTorrent::write_torrent_file(
+    const std::filesystem::path& directory
+) const {
+    const auto path =
+        directory / (name + "-" + std::to_string(piece_count) + ".torrent");
+    std::ofstream file {path, std::ios::binary | std::ios::trunc};
+    const auto content = make_torrent();
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    if (!file) {
+        throw std::runtime_error(
+            "Could not write the torrent file " + path.string()
+        );
+    }
+    return path;
+}
+
+void SyntheticTorrent::write_data_file(
+    const std::filesystem::path& path
+) const {
+    std::ofstream file {path, std::ios::binary | std::ios::trunc};
+    const auto piece = make_piece();
+    for (std::size_t i = 0; i < piece_count && file; ++i) {
+        file.write(piece.data(), static_cast<std::streamsize>(piece.size()));
+    }
+    if (!file) {
+        throw std::runtime_error(
+            "Could not write the data file " + path.string()
+        );
+    }
+}
+
+} // namespace torrent::bench
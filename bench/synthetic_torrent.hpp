@@ -0,0 +1,54 @@
+#ifndef TORRENT_BENCH_SYNTHETIC_TORRENT_HPP
+#define TORRENT_BENCH_SYNTHETIC_TORRENT_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "metadata.hpp"
+
+namespace torrent::bench {
+
+/*
+ * Parameters of a generated torrent.
+ * The data of every piece is the same, so a single piece buffer
+ *      can be used to feed any piece to the client.
+ * */
+struct SyntheticTorrent {
+    std::size_t piece_count = 1;
+    std::size_t piece_length = 1 << 18;
+    std::size_t file_count = 1;
+    std::string name = "synthetic";
+    std::string announce = "http://127.0.0.1:6969/announce";
+
+    /*
+     * Returns the content of every piece, except that the last piece
+     *      is cut short if the total length is not a multiple of it.
+     * */
+    std::string make_piece() const;
+
+    /*
+     * Returns the .torrent file in bencode.
+     * Files split the total length evenly.
+     * */
+    std::string make_torrent() const;
+
+    /*
+     * Writes the .torrent file into the directory.
+     * @return Path of the written file.
+     * */
+    std::filesystem::path write_torrent_file(
+        const std::filesystem::path& directory =
+            std::filesystem::temp_directory_path()
+    ) const;
+
+    /*
+     * Writes the data of the whole torrent into a single file,
+     *      as the client stores it while downloading.
+     * */
+    void write_data_file(const std::filesystem::path& path) const;
+};
+
+} // namespace torrent::bench
+
+#endif
@@ -0,0 +1,66 @@
+#include "bencode_reader.hpp"
+#include "bencode_writer.hpp"
+#include "benchmark.hpp"
+#include "http_tracker.hpp"
+
+namespace torrent::bench {
+
+namespace {
+
+/*
+ * Returns an HTTP tracker response with peer_count compact peers.
+ * */
+std::string make_response(std::size_t peer_count) {
+    std::string peers(peer_count * 6, '\0');
+    for (std::size_t i = 0; i < peers.size(); ++i) {
+        peers[i] = static_cast<char>(i * 13);
+    }
+    std::string response(
+        1 + BencodeWriter::string_size("complete")
+            + BencodeWriter::integer_size(100)
+            + BencodeWriter::string_size("incomplete")
+            + BencodeWriter::integer_size(10)
+            + BencodeWriter::string_size("interval")
+            + BencodeWriter::integer_size(1800)
+            + BencodeWriter::string_size("peers")
+            + BencodeWriter::string_size(peers) + 1,
+        '\0'
+    );
+    BencodeWriter writer {std::span<char> {response}};
+    writer.write_dictionary_begin();
+    writer.write_string("complete");
+    writer.write_integer(100);
+    writer.write_string("incomplete");
+    writer.write_integer(10);
+    writer.write_string("interval");
+    writer.write_integer(1800);
+    writer.write_string("peers");
+    writer.write_string(peers);
+    writer.write_end();
+    return response;
+}
+
+void add_response(Runner& runner, std::size_t peer_count) {
+    runner.add(
+        "tracker/http_response/" + std::to_string(peer_count),
+        [=](State& state) {
+            const auto response = make_response(peer_count);
+            state.set_bytes_per_op(response.size());
+            state.run([&] {
+                TrackerResponseHandler handler;
+                BencodeReader reader {handler};
+                reader.feed(response);
+                do_not_optimize(handler);
+            });
+        }
+    );
+}
+
+} // namespace
+
+void add_tracker_benchmarks(Runner& runner) {
+    add_response(runner, 50);
+    add_response(runner, 1000);
+}
+
+} // namespace torrent::bench
@@ -0,0 +1,50 @@
+include(CheckIPOSupported)
+
+option(TORRENT_ENABLE_LTO "Enable link time optimization in release builds" ON)
+set(TORRENT_PGO "OFF" CACHE STRING "Profile guided optimization: OFF, GENERATE or USE")
+set_property(CACHE TORRENT_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(TORRENT_PGO_DIR "${CMAKE_BINARY_DIR}/pgo" CACHE PATH "Directory of the PGO profiles")
+
+if(TORRENT_ENABLE_LTO)
+    check_ipo_supported(RESULT TORRENT_IPO_SUPPORTED OUTPUT TORRENT_IPO_OUTPUT LANGUAGES CXX)
+    if(NOT TORRENT_IPO_SUPPORTED)
+        message(WARNING "LTO is not supported: ${TORRENT_IPO_OUTPUT}")
+    endif()
+endif()
+
+# Release flow with PGO:
+#   1. Configure with -DTORRENT_PGO=GENERATE, build and run a typical workload
+#      (e.g. the benchmarks). With clang, merge the raw profiles into
+#      ${TORRENT_PGO_DIR}/default.profdata with llvm-profdata.
+#   2. Reconfigure with -DTORRENT_PGO=USE and build again.
+function(enable_optimizations target)
+    if(TORRENT_ENABLE_LTO AND TORRENT_IPO_SUPPORTED)
+        set_target_properties(
+            ${target} PROPERTIES
+            INTERPROCEDURAL_OPTIMIZATION_RELEASE ON
+            INTERPROCEDURAL_OPTIMIZATION_RELWITHDEBINFO ON
+        )
+    endif()
+
+    if(TORRENT_PGO STREQUAL "GENERATE")
+        if(CMAKE_CXX_COMPILER_ID MATCHES ".*Clang")
+            set(PGO_FLAGS "-fprofile-instr-generate=${TORRENT_PGO_DIR}/%p.profraw")
+        else()
+            set(PGO_FLAGS "-fprofile-generate=${TORRENT_PGO_DIR}" "-fprofile-update=atomic")
+        endif()
+    elseif(TORRENT_PGO STREQUAL "USE")
+        if(CMAKE_CXX_COMPILER_ID MATCHES ".*Clang")
+            set(PGO_FLAGS "-fprofile-instr-use=${TORRENT_PGO_DIR}/default.profdata")
+        else()
+            # Code that the workload didn't run is still optimized normally.
+            set(PGO_FLAGS "-fprofile-use=${TORRENT_PGO_DIR}" "-fprofile-partial-training" "-Wno-missing-profile")
+        endif()
+    elseif(NOT TORRENT_PGO STREQUAL "OFF")
+        message(FATAL_ERROR "Unknown TORRENT_PGO value: ${TORRENT_PGO}")
+    endif()
+
+    if(PGO_FLAGS)
+        target_compile_options(${target} PRIVATE ${PGO_FLAGS})
+        target_link_options(${target} PRIVATE ${PGO_FLAGS})
+    endif()
+endfunction()
@@ -1,6 +1,9 @@
 #ifndef TORRENT_ASYNC_FILE_HPP
 #define TORRENT_ASYNC_FILE_HPP
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <boost/asio.hpp>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/file_base.hpp>
@@ -73,6 +76,17 @@ class AsyncFile {
         file.async_write_some_at(offset, buffer, callback);
     }
 
+    /*
+     * Writes all of the buffers one after another, starting at the offset.
+     * */
+    void async_write_at(
+        std::uint64_t offset,
+        const auto& buffers,
+        auto callback
+    ) {
+        asio::async_write_at(file, offset, buffers, callback);
+    }
+
     std::uint64_t size() {
         return file.size();
     }
@@ -81,6 +95,24 @@ class AsyncFile {
         file.resize(new_size);
     }
 
+    /*
+     * Allocates the disk blocks of the range without changing the size.
+     * @return False if the file system can't allocate up front.
+     * */
+    bool allocate(std::uint64_t offset, std::uint64_t length) {
+    #ifdef __linux__
+        return ::fallocate(
+                   file.native_handle(),
+                   0,
+                   static_cast<off_t>(offset),
+                   static_cast<off_t>(length)
+               )
+            == 0;
+    #else
+        return false;
+    #endif
+    }
+
   private:
     asio::random_access_file file;
 };
@@ -161,6 +193,22 @@ class AsyncFile {
         callback(boost::system::error_code(), buffer.size());
     }
 
+    /*
+     * Writes all of the buffers one after another, starting at the offset.
+     * */
+    void async_write_at(
+        std::uint64_t offset,
+        const auto& buffers,
+        auto callback
+    ) {
+        std::size_t written = 0;
+        for (const asio::const_buffer& buffer : buffers) {
+            this->write_some_at(offset + written, buffer);
+            written += buffer.size();
+        }
+        callback(boost::system::error_code(), written);
+    }
+
     std::uint64_t size() {
         std::scoped_lock<std::mutex> sl {mutex};
         file.seekg(0, std::ios::seekdir::end);
@@ -171,6 +219,31 @@ class AsyncFile {
         std::filesystem::resize_file(file_path, new_size);
     }
 
+    /*
+     * Allocates the disk blocks of the range without changing the size.
+     * @return False if the file system can't allocate up front.
+     * */
+    bool allocate(std::uint64_t offset, std::uint64_t length) {
+    #ifdef __linux__
+        // The stream doesn't expose its descriptor.
+        const int descriptor = ::open(file_path.c_str(), O_WRONLY);
+        if (descriptor < 0) {
+            return false;
+        }
+        const bool allocated = ::fallocate(
+                                   descriptor,
+                                   0,
+                                   static_cast<off_t>(offset),
+                                   static_cast<off_t>(length)
+                               )
+            == 0;
+        ::close(descriptor);
+        return allocated;
+    #else
+        return false;
+    #endif
+    }
+
   private:
     asio::io_context& io_context;
 
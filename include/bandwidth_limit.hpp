@@ -0,0 +1,74 @@
+#ifndef TORRENT_BANDWIDTH_LIMIT_HPP
+#define TORRENT_BANDWIDTH_LIMIT_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace torrent {
+
+/*
+ * Limits a transfer rate with a token bucket.
+ * The bucket holds up to a second of bytes. Transfers that don't fit
+ *      still take their bytes, which puts the bucket in debt, and
+ *      are told how long to wait until the debt is paid. So transfers
+ *      are delayed in the order they reserve, and big blocks don't starve.
+ * One limit can be shared by the peers of many torrents.
+ * */
+class BandwidthLimit {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    BandwidthLimit() : last_refill(Clock::now()) {}
+
+    /*
+     * Sets the limit in bytes per second. Zero means unlimited.
+     * */
+    void set_rate(std::size_t bytes_per_second) {
+        std::scoped_lock<std::mutex> lock {mutex};
+        rate = bytes_per_second;
+        tokens = static_cast<double>(rate);
+        last_refill = Clock::now();
+    }
+
+    std::size_t get_rate() {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return rate;
+    }
+
+    /*
+     * Takes the bytes from the bucket.
+     * @return How long to wait before transferring them.
+     * */
+    std::chrono::nanoseconds reserve(std::size_t bytes) {
+        std::scoped_lock<std::mutex> lock {mutex};
+        if (rate == 0) {
+            return std::chrono::nanoseconds::zero();
+        }
+        const auto now = Clock::now();
+        const auto elapsed =
+            std::chrono::duration<double>(now - last_refill).count();
+        last_refill = now;
+        tokens = std::min(
+            static_cast<double>(rate),
+            tokens + elapsed * static_cast<double>(rate)
+        );
+        tokens -= static_cast<double>(bytes);
+        if (tokens >= 0.0) {
+            return std::chrono::nanoseconds::zero();
+        }
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::duration<double>(-tokens / static_cast<double>(rate))
+        );
+    }
+
+  private:
+    std::mutex mutex;
+    std::size_t rate = 0;
+    double tokens = 0.0;
+    Clock::time_point last_refill;
+};
+
+} // namespace torrent
+#endif
@@ -55,33 +55,33 @@ class BencodeParser {
             return std::get<T>(value);
         }
 
-        std::string to_bencode() const {
-            std::stringstream stream;
-            element_to_bencode(*this, stream);
-            return stream.str();
-        }
+        /*
+         * Encodes the element with a BencodeWriter.
+         * The output is allocated once with the precomputed size.
+         * */
+        std::string to_bencode() const;
 
         std::string to_json() const {
-            std::stringstream stream;
-            element_to_json(*this, stream);
-            return stream.str();
+            std::string result;
+            element_to_json(*this, result);
+            return result;
         }
 
       private:
-        static void convert_to_valid_json(
-            const std::string& str,
-            std::stringstream& stream
-        );
-
         static void
-        element_to_json(const Element& element, std::stringstream& stream);
+        convert_to_valid_json(const std::string& str, std::string& output);
+
         static void
-        element_to_bencode(const Element& element, std::stringstream& stream);
+        element_to_json(const Element& element, std::string& output);
     };
 
   private:
     Element element;
 
+    // Raw bencode of the top level "info" dictionary.
+    std::string info_bencode;
+    std::size_t depth = 0;
+
   public:
     BencodeParser(std::unique_ptr<std::basic_istream<char>>&& input_stream) :
         stream(std::move(input_stream)) {}
@@ -101,6 +101,20 @@ class BencodeParser {
         return element;
     }
 
+    /*
+     * Returns the raw bytes of the top level "info" dictionary exactly as
+     *      they appeared in the input. Empty if the input had none.
+     * Hashing these bytes gives the info hash without re-encoding
+     *      the parsed element, and they can be served to peers as is.
+     * */
+    const std::string& get_info_bencode() const {
+        return info_bencode;
+    }
+
+    std::string& get_info_bencode() {
+        return info_bencode;
+    }
+
     /*
      * Consumes the inner stream until eof.
      * It should only be called once after the constructor.
@@ -113,6 +127,16 @@ class BencodeParser {
     Element parse_string();
     Element parse_list();
     Element parse_dictionary();
+
+    /*
+     * Copies the input bytes in range [start, end) into the output.
+     * Leaves the output empty if the stream is not seekable.
+     * */
+    void record_span(
+        std::istream::pos_type start,
+        std::istream::pos_type end,
+        std::string& output
+    );
 };
 
 } // namespace torrent
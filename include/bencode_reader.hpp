@@ -0,0 +1,144 @@
+#ifndef TORRENT_BENCODE_READER_HPP
+#define TORRENT_BENCODE_READER_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bencode_parser.hpp"
+
+namespace torrent {
+
+/*
+ * An event driven bencode parser that accepts its input in chunks.
+ * Unlike BencodeParser it does not build an element tree,
+ *      every value is reported to a Handler as soon as it is complete.
+ * Parsing can be suspended at any byte and resumed with the next chunk,
+ *      so network input can be consumed as it arrives with bounded memory.
+ * */
+class BencodeReader {
+  public:
+    using Integer = BencodeParser::Integer;
+
+    /*
+     * Receives the parsing events.
+     * Every function has an empty default so handlers only
+     *      override the events they are interested in.
+     * */
+    class Handler {
+      public:
+        virtual ~Handler() {}
+
+        virtual void on_integer(Integer) {}
+
+        /*
+         * Called with a complete byte string.
+         * The view is only valid during the call.
+         * */
+        virtual void on_string(std::string_view) {}
+
+        /*
+         * Called instead of on_string for the keys of a dictionary.
+         * */
+        virtual void on_key(std::string_view) {}
+
+        virtual void on_list_begin() {}
+
+        virtual void on_dictionary_begin() {}
+
+        /*
+         * Called when the last opened list or dictionary ends.
+         * */
+        virtual void on_end() {}
+    };
+
+    /*
+     * Limits enforced while parsing.
+     * Exceeding any of them throws, which makes the reader safe
+     *      to use with untrusted input.
+     * */
+    struct Limits {
+        std::size_t max_depth = 32;
+        std::size_t max_string_length = 1 << 20;
+        std::size_t max_total_length = 1 << 24;
+    };
+
+    BencodeReader(Handler& handler_ref) : BencodeReader(handler_ref, {}) {}
+
+    BencodeReader(Handler& handler_ref, Limits reader_limits) :
+        handler(handler_ref),
+        limits(reader_limits) {}
+
+    /*
+     * Parses the next chunk of the input.
+     * Stops after a complete top level value has been read.
+     * @return Number of bytes consumed from the chunk. It is less than
+     *      the chunk size only if the top level value ended in the chunk.
+     * @throws std::runtime_error If the input is invalid or exceeds the limits.
+     * */
+    std::size_t feed(std::string_view chunk);
+
+    /*
+     * Returns true after a complete top level value has been read.
+     * */
+    bool is_complete() const {
+        return state == State::Complete;
+    }
+
+    /*
+     * Prepares the reader for a new value.
+     * Handler and limits stay the same.
+     * */
+    void reset();
+
+  private:
+    enum class State {
+        Value, // Expecting the start of a value.
+        Integer, // Reading the digits of an integer.
+        StringLength, // Reading the length prefix of a byte string.
+        StringBody, // Reading the content of a byte string.
+        Complete,
+    };
+
+    enum class Container : std::uint8_t {
+        List,
+        Dictionary,
+    };
+
+    void begin_value(char c);
+    void end_value();
+    void emit_string(std::string_view value);
+    void push(Container container);
+
+    /*
+     * Returns true if the next string in the current dictionary is a key.
+     * */
+    bool expecting_key() const {
+        return !stack.empty() && stack.back() == Container::Dictionary
+            && !key_read;
+    }
+
+  private:
+    Handler& handler;
+    Limits limits;
+
+    State state = State::Value;
+    std::vector<Container> stack;
+    // Whether the key of the current dictionary entry was read.
+    bool key_read = false;
+
+    std::size_t total_length = 0;
+
+    // Integer and string length parsing.
+    Integer number = 0;
+    bool negative = false;
+    std::size_t digits = 0;
+
+    // Byte strings that span multiple chunks are collected here.
+    std::string pending;
+    std::size_t string_length = 0;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,112 @@
+#ifndef TORRENT_BENCODE_WRITER_HPP
+#define TORRENT_BENCODE_WRITER_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bencode_parser.hpp"
+
+namespace torrent {
+
+/*
+ * Writes bencode directly into a caller provided buffer.
+ * The encoded size of every value can be computed beforehand with
+ *      the static *_size functions, so the output can be allocated
+ *      once (or written straight into a send buffer) without any streams.
+ * Values can either be written from an Element tree or one by one,
+ *      which avoids building a tree for outgoing messages altogether.
+ * https://www.bittorrent.org/beps/bep_0003.html#bencoding
+ * */
+class BencodeWriter {
+  public:
+    using Element = BencodeParser::Element;
+    using Integer = BencodeParser::Integer;
+
+    BencodeWriter(std::span<char> output) :
+        begin(output.data()),
+        current(output.data()),
+        end(output.data() + output.size()) {}
+
+    BencodeWriter(std::span<std::uint8_t> output) :
+        BencodeWriter(std::span<char> {
+            reinterpret_cast<char*>(output.data()),
+            output.size()
+        }) {}
+
+    /* Size calculations */
+
+    /*
+     * Returns the encoded size of an integer. "i<value>e"
+     * */
+    static std::size_t integer_size(Integer value);
+
+    /*
+     * Returns the encoded size of a byte string. "<length>:<value>"
+     * */
+    static std::size_t string_size(std::string_view value);
+
+    /*
+     * Returns the encoded size of the whole element tree.
+     * */
+    static std::size_t encoded_size(const Element& element);
+
+    /* Writers */
+
+    void write_integer(Integer value);
+    void write_string(std::string_view value);
+
+    /*
+     * Begins a list or a dictionary.
+     * Every begin must be matched with a call to write_end.
+     * Dictionary keys must be written with write_string in sorted order.
+     * */
+    void write_list_begin();
+    void write_dictionary_begin();
+    void write_end();
+
+    /*
+     * Writes the whole element tree.
+     * */
+    void write(const Element& element);
+
+    /*
+     * Returns the number of bytes written so far.
+     * */
+    std::size_t size() const {
+        return static_cast<std::size_t>(current - begin);
+    }
+
+    /* Helpers */
+
+    /*
+     * Encodes the element into a string with a single allocation.
+     * */
+    static std::string encode(const Element& element);
+
+    /*
+     * Appends the encoded element to the end of the output vector.
+     * The vector grows only once.
+     * */
+    static void
+    encode_into(const Element& element, std::vector<std::uint8_t>& output);
+
+  private:
+    /*
+     * Throws if the buffer can't hold length more bytes.
+     * */
+    void reserve(std::size_t length);
+
+    void write_char(char c);
+    void write_number(Integer value);
+
+  private:
+    char* begin;
+    char* current;
+    char* end;
+};
+
+} // namespace torrent
+#endif
@@ -5,11 +5,23 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ssl.hpp>
 #include <cstdint>
+#include <filesystem>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
+#include "bandwidth_limit.hpp"
+#include "file_pool.hpp"
 #include "metadata.hpp"
+#include "metrics.hpp"
+#include "metrics_server.hpp"
 #include "peer_manager.hpp"
+#include "range_server.hpp"
 #include "tracker_manager.hpp"
+#include "transport.hpp"
+#include "web_seed.hpp"
 
 namespace torrent {
 
@@ -17,14 +29,48 @@ namespace asio = boost::asio;
 using namespace boost::asio::ip;
 using tcp = boost::asio::ip::tcp;
 
-class Client {
+/*
+ * Downloads a torrent. Must be owned by a shared_ptr. Its handlers only
+ *      hold it weakly, so it can be destroyed while they are pending
+ *      and the io_context can be shared with other clients.
+ * */
+class Client: public std::enable_shared_from_this<Client> {
   private:
     std::string peer_id;
     std::shared_ptr<Metadata> metadata;
 
     std::shared_ptr<Pieces> pieces;
-    std::unique_ptr<TrackerManager> tracker_manager;
-    std::unique_ptr<PeerManager> peer_manager;
+    std::shared_ptr<SessionMetrics> metrics;
+    std::shared_ptr<Transport> transport;
+    std::shared_ptr<TrackerManager> tracker_manager;
+    std::shared_ptr<PeerManager> peer_manager;
+    std::shared_ptr<RangeServer> range_server;
+    std::shared_ptr<MetricsServer> metrics_server;
+    std::vector<std::shared_ptr<WebSeed>> web_seeds;
+    std::optional<std::uint16_t> range_server_port;
+    std::optional<std::uint16_t> metrics_server_port;
+    std::filesystem::path download_directory = ".";
+    bool extract_files = true;
+    Pieces::Allocation allocation = Pieces::Allocation::Sparse;
+    std::shared_ptr<FilePool> file_pool;
+
+    std::shared_ptr<BandwidthLimit> download_limit;
+    std::shared_ptr<BandwidthLimit> upload_limit;
+    EncryptionPolicy encryption = EncryptionPolicy::Disabled;
+
+    // Priorities set before the metadata is ready are applied with it.
+    std::mutex priority_mutex;
+    std::unordered_map<std::size_t, Priority> file_priorities;
+    Priority default_file_priority = Priority::Normal;
+
+    struct StreamPosition {
+        std::size_t file_index;
+        std::size_t offset;
+        std::size_t bytes_per_second;
+    };
+    // Applied when the metadata gets ready if it is set before that.
+    std::mutex stream_mutex;
+    std::optional<StreamPosition> stream_position;
 
     static constexpr std::uint16_t DEFAULT_PORT = 8000;
 
@@ -34,8 +80,12 @@ class Client {
         asio::ssl::context& ssl_context,
         std::uint16_t port = DEFAULT_PORT
     );
-    // Object must be pinned to its memory address because
-    //      Peers contain a reference to it.
+
+    /*
+     * Stops the client. Pending operations are aborted.
+     * */
+    ~Client();
+
     Client(const Client&) = delete;
     const Client& operator=(const Client&) = delete;
 
@@ -46,8 +96,10 @@ class Client {
      * But it will not do any networking because its async.
      * Should only be called once after the constructor.
      * @param torrent Either a path to a .torrent file or a magnet link as a string.
+     * @return False if the torrent could not be started, the error is logged
+     *      and whatever was started is stopped again.
      * */
-    void start(const std::string_view torrent);
+    bool start(const std::string_view torrent);
 
     /*
      * Waits until the client is finished downloading.
@@ -61,6 +113,150 @@ class Client {
      * */
     void stop();
 
+    /*
+     * Sets the download priority of a file in the torrent.
+     * Files are indexed in the order they appear in the torrent.
+     * Is thread safe to call from other threads, also while downloading.
+     * */
+    void set_file_priority(std::size_t file_index, Priority priority);
+
+    /*
+     * Sets the priority of the files that are not given a priority
+     *      with set_file_priority. Should be called before start().
+     * Setting it to Priority::Skip downloads only the selected files.
+     * */
+    void set_default_file_priority(Priority priority) {
+        default_file_priority = priority;
+    }
+
+    /*
+     * Downloads the pieces after the read position first so the file
+     *      can be consumed before the torrent is complete.
+     * Pieces are given deadlines as if the file is read at bytes_per_second,
+     *      and pieces close to their deadline are requested from
+     *      the fastest peers. Can be called again to seek.
+     * Is thread safe to call from other threads.
+     * @param offset Read position in bytes relative to the start of the file.
+     * */
+    void set_stream_position(
+        std::size_t file_index,
+        std::size_t offset,
+        std::size_t bytes_per_second = DEFAULT_STREAM_RATE
+    );
+
+    /*
+     * Stops streaming. Is thread safe to call from other threads.
+     * */
+    void clear_stream_position();
+
+    static constexpr std::size_t DEFAULT_STREAM_RATE = 1 << 20;
+
+    /*
+     * Reads a byte range of a file in the torrent into the buffer async.
+     * Waits until the pieces covering the range are downloaded and verified.
+     * The buffer must stay valid until on_finish is called.
+     * @param on_finish Signature should be on_finish(const asio::error_code& error_code, std::size_t bytes_read).
+     *      Reads past the end of the file are shortened.
+     * */
+    void async_read(
+        std::size_t file_index,
+        std::size_t offset,
+        asio::mutable_buffer buffer,
+        Pieces::ReadHandler on_finish
+    );
+
+    /*
+     * Blocking version of async_read.
+     * Must not be called from the threads running the io_context.
+     * @throws boost::system::system_error if the read fails.
+     * */
+    std::size_t read(
+        std::size_t file_index,
+        std::size_t offset,
+        asio::mutable_buffer buffer
+    );
+
+    /*
+     * Serves the files over HTTP on the loopback interface while downloading.
+     * Should be called before start(). See RangeServer.
+     * */
+    void set_range_server_port(std::uint16_t server_port) {
+        range_server_port = server_port;
+    }
+
+    /*
+     * Serves the session metrics over HTTP on the loopback interface
+     *      in the Prometheus text format. Should be called before start().
+     * See MetricsServer.
+     * */
+    void set_metrics_server_port(std::uint16_t server_port) {
+        metrics_server_port = server_port;
+    }
+
+    /*
+     * Sets the directory the torrent is downloaded to.
+     * Should be called before start(). Defaults to the working directory.
+     * */
+    void set_download_directory(std::filesystem::path directory) {
+        download_directory = std::move(directory);
+    }
+
+    /*
+     * Sets whether the files are extracted once the torrent is complete.
+     *      Otherwise the torrent stays in a single download file.
+     * Should be called before start().
+     * */
+    void set_extract_files(bool extract) {
+        extract_files = extract;
+    }
+
+    /*
+     * Sets how the disk space of the download is allocated.
+     * Should be called before start(). Defaults to sparse.
+     * */
+    void set_allocation(Pieces::Allocation mode) {
+        allocation = mode;
+    }
+
+    /*
+     * Opens the files through the pool, which can be shared with
+     *      other clients. Should be called before start().
+     * */
+    void set_file_pool(std::shared_ptr<FilePool> pool) {
+        file_pool = std::move(pool);
+    }
+
+    /*
+     * Limits the download and upload rates of the peers. The limits can
+     *      be shared with other clients, and their rates changed
+     *      at any time. Should be called before start().
+     * @param download, upload Can be nullptr for no limit.
+     * */
+    void set_bandwidth_limits(
+        std::shared_ptr<BandwidthLimit> download,
+        std::shared_ptr<BandwidthLimit> upload
+    ) {
+        download_limit = std::move(download);
+        upload_limit = std::move(upload);
+    }
+
+    /*
+     * Sets whether the peer connections are encrypted.
+     * Should be called before start(). Defaults to disabled.
+     * */
+    void set_encryption(EncryptionPolicy policy) {
+        encryption = policy;
+    }
+
+    /*
+     * Sets the transport the peers and the trackers connect through.
+     * Should be called before start(). Defaults to TcpTransport.
+     * Web seeds and the range server always use TCP.
+     * */
+    void set_transport(std::shared_ptr<Transport> client_transport) {
+        transport = std::move(client_transport);
+    }
+
   public:
     /*
      * Returns a const reference to the peer id of the Client object.
@@ -78,11 +274,62 @@ class Client {
 
     /*
      * Returns the port that Client is using to listen incoming peers.
+     * If the client was given port zero, this is the port picked
+     *      for it once it is started.
      * */
     std::uint16_t get_port() const {
         return port;
     }
 
+    /*
+     * Returns the statistics of the session. Counting starts with
+     *      the construction of the client.
+     * */
+    const SessionMetrics& get_metrics() const {
+        return *metrics;
+    }
+
+    /*
+     * A snapshot of the download. Taken from atomic counters and the
+     *      picker, so it can be taken often without slowing the download.
+     * */
+    struct Stats {
+        std::string name;
+        std::size_t total_length = 0;
+        std::size_t left = 0;
+        std::size_t downloaded = 0;
+        std::size_t uploaded = 0;
+        std::size_t piece_count = 0;
+        std::size_t pieces_done = 0;
+        std::vector<PeerManager::PeerInfo> peers;
+        // Empty until the metadata is ready.
+        std::vector<PiecePicker::PieceInfo> pieces;
+    };
+
+    Stats get_stats() const;
+
+    /*
+     * Returns the statistics of the connected peers.
+     * Empty if the client is not started.
+     * */
+    std::vector<PeerManager::PeerInfo> get_peer_infos() const {
+        if (!peer_manager) {
+            return {};
+        }
+        return peer_manager->get_peer_infos();
+    }
+
+  private:
+    /*
+     * Starts downloading once the files of the torrent are known.
+     * */
+    void on_metadata_ready();
+
+    /*
+     * Passes the stream position to Pieces. stream_mutex should be locked.
+     * */
+    void apply_stream_position();
+
   private:
     asio::io_context& io_context;
     asio::ssl::context& ssl_context;
@@ -0,0 +1,109 @@
+#ifndef TORRENT_CONTROL_SERVER_HPP
+#define TORRENT_CONTROL_SERVER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "json.hpp"
+#include "session.hpp"
+
+namespace torrent {
+
+namespace asio = boost::asio;
+
+/*
+ * Controls a Session through a Unix domain socket.
+ * Every line sent to the socket is a JSON-RPC 2.0 request, and every
+ *      request with an id is answered with a line. Requests of
+ *      a connection are handled in order.
+ * Methods:
+ *      add {source, directory}         -> {id}
+ *      remove {id}, pause {id}, resume {id}
+ *      set_limits {download, upload}   -> {download, upload}
+ *      set_file_priority {id, file, priority}
+ *      list                            -> [torrent]
+ *      stats {id}                      -> torrent with peers
+ *      shutdown
+ * Rates are in bytes per second, priorities are
+ *      "skip", "low", "normal" or "high".
+ * See: https://www.jsonrpc.org/specification
+ * */
+class ControlServer {
+  public:
+    using protocol = asio::local::stream_protocol;
+
+    ControlServer(
+        asio::io_context& io_context_ref,
+        std::filesystem::path socket_path,
+        Session& session_ref
+    );
+
+    ControlServer(const ControlServer&) = delete;
+    const ControlServer& operator=(const ControlServer&) = delete;
+
+    /*
+     * Creates the socket and starts accepting connections.
+     * A socket file left over from an earlier run is replaced.
+     * Only the owner of the process can connect.
+     * @throws boost::system::system_error if the socket can't be created.
+     * */
+    void start();
+
+    /*
+     * Stops accepting connections and removes the socket file.
+     * */
+    void stop();
+
+    /*
+     * Called after the shutdown request is answered,
+     *      or right away if it is a notification.
+     * */
+    void set_on_shutdown(std::function<void()> handler) {
+        on_shutdown = std::move(handler);
+    }
+
+    struct Response {
+        // The response line without the newline.
+        // Empty if the request is a notification.
+        std::string line;
+        // Whether the request asked the daemon to shut down.
+        bool shutdown = false;
+    };
+
+    /*
+     * Handles a request line.
+     * */
+    Response handle(std::string_view line);
+
+  private:
+    class Connection;
+
+    void accept();
+
+    /*
+     * Calls the method.
+     * @throws RpcError or std::runtime_error If the call fails.
+     * */
+    Json call(std::string_view method, const Json& params);
+
+    Json to_json(const Session::Status& status, bool with_peers) const;
+
+  private:
+    asio::io_context& io_context;
+    protocol::acceptor acceptor;
+    std::filesystem::path path;
+    Session& session;
+
+    std::function<void()> on_shutdown;
+
+    static constexpr std::size_t MAX_REQUEST_LENGTH = 1 << 16;
+};
+
+} // namespace torrent
+#endif
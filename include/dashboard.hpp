@@ -0,0 +1,90 @@
+#ifndef TORRENT_DASHBOARD_HPP
+#define TORRENT_DASHBOARD_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "client.hpp"
+
+namespace torrent {
+
+namespace asio = boost::asio;
+
+/*
+ * Draws the state of the download on the terminal with ANSI escape codes.
+ * Shows the progress, the rates and the ETA, a map of the pieces
+ *      with their availability, and the peers sorted by download rate.
+ * Every frame is drawn from Client::get_stats, so the dashboard
+ *      never holds a lock the download needs.
+ * The log is written to the stderr, so it should be redirected
+ *      or turned down while the dashboard is shown.
+ * */
+class Dashboard {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    Dashboard(
+        asio::io_context& io_context,
+        const Client& client_ref,
+        std::ostream& output_ref = std::cout
+    ) :
+        client(client_ref),
+        output(output_ref),
+        timer(io_context) {}
+
+    Dashboard(const Dashboard&) = delete;
+    Dashboard& operator=(const Dashboard&) = delete;
+
+    /*
+     * Starts drawing a frame every REFRESH_INTERVAL.
+     * */
+    void start();
+
+    /*
+     * Stops drawing and leaves the last frame on the terminal.
+     * */
+    void stop();
+
+    /*
+     * Draws a frame of the given terminal size.
+     * */
+    std::string
+    render(const Client::Stats& stats, std::size_t columns, std::size_t rows);
+
+    static constexpr auto REFRESH_INTERVAL = std::chrono::milliseconds(500);
+
+  private:
+    void schedule();
+    void draw();
+
+    /*
+     * Updates the smoothed global rates from the totals of the stats.
+     * */
+    void update_rates(const Client::Stats& stats);
+
+  private:
+    const Client& client;
+    std::ostream& output;
+    asio::steady_timer timer;
+
+    std::mutex mutex;
+    bool running = false;
+
+    // Global rates are measured between the frames.
+    Clock::time_point last_frame;
+    std::size_t last_downloaded = 0;
+    std::size_t last_uploaded = 0;
+    double download_rate = 0.0;
+    double upload_rate = 0.0;
+
+    static constexpr double SMOOTHING = 0.3;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,195 @@
+#ifndef TORRENT_ENCRYPTED_STREAM_HPP
+#define TORRENT_ENCRYPTED_STREAM_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "rc4.hpp"
+#include "transport.hpp"
+
+namespace torrent {
+
+enum class EncryptionPolicy {
+    Disabled, // Plain BitTorrent only.
+    Enabled, // Connects encrypted, accepts both.
+    Forced, // Only RC4 encrypted connections, both ways.
+};
+
+/*
+ * A Stream that runs the Message Stream Encryption handshake before
+ *      anything else, then encrypts the traffic with RC4.
+ * Outgoing connections do the handshake in async_connect, so the peer
+ *      only sees a connected stream once it is done. Incoming ones do it
+ *      on the first read or write, and tell plain BitTorrent handshakes
+ *      apart from encrypted ones.
+ * Received bytes are decrypted in the buffer of the reader, and
+ *      async_write_some_in_place encrypts the buffer of the writer,
+ *      so the payload is never copied.
+ * See: https://wiki.vuze.com/w/Message_Stream_Encryption
+ * */
+class EncryptedStream: public Stream {
+  public:
+    enum class Role {
+        Initiator,
+        Responder,
+    };
+
+    /*
+     * @param skey The info hash of the torrent. Both sides must know it.
+     * */
+    EncryptedStream(
+        asio::io_context& io_context_ref,
+        std::unique_ptr<Stream> inner_stream,
+        Role stream_role,
+        std::string skey,
+        EncryptionPolicy encryption_policy
+    );
+
+    void async_connect(const tcp::endpoint& endpoint, ConnectHandler handler)
+        override;
+
+    void async_read_some(asio::mutable_buffer buffer, IoHandler handler)
+        override;
+
+    /*
+     * Encrypts a copy of the buffer. Writes all of it before calling the
+     *      handler, so the rest of the key stream stays in order.
+     * */
+    void async_write_some(asio::const_buffer buffer, IoHandler handler)
+        override;
+
+    /*
+     * Encrypts the buffer in place and writes all of it.
+     * */
+    void async_write_some_in_place(
+        asio::mutable_buffer buffer,
+        IoHandler handler
+    ) override;
+
+    void close() override {
+        inner->close();
+    }
+
+    tcp::endpoint remote_endpoint() const override {
+        return inner->remote_endpoint();
+    }
+
+    /*
+     * Returns true once the handshake picked RC4 for the payload.
+     * */
+    bool is_encrypted() const {
+        return encrypted;
+    }
+
+  private:
+    enum class State {
+        Waiting, // Handshake is not started.
+        Handshaking,
+        Done,
+        Failed,
+    };
+
+    using Operation =
+        std::function<void(const boost::system::error_code& error)>;
+
+    struct PendingWrite {
+        asio::const_buffer buffer; // Already encrypted.
+        IoHandler handler;
+    };
+
+    /*
+     * Runs the operation once the handshake is done, with the error
+     *      of the handshake if it failed.
+     * The first operation on a responder starts the handshake.
+     * */
+    void wait_handshake(Operation operation);
+
+    // Steps of the handshake, in the order they run.
+    void start_initiator();
+    void send_initiator_request();
+    void read_initiator_select(std::size_t position);
+    void start_responder();
+    void send_responder_key();
+    void read_responder_request(std::size_t position);
+    void send_responder_select(std::uint32_t select, std::size_t decrypted);
+
+    /*
+     * Reads from the remote until the input has at least size bytes.
+     * */
+    void read_input(std::size_t size, std::function<void()> then);
+
+    /*
+     * Looks for the pattern in the input after the offset.
+     * Fails the handshake if it doesn't start before the limit.
+     * @param then Called with the position of the pattern.
+     * */
+    void find_input(
+        std::size_t offset,
+        std::vector<std::uint8_t> pattern,
+        std::size_t limit,
+        std::function<void(std::size_t)> then
+    );
+
+    /*
+     * Writes all of the buffer to the remote.
+     * */
+    void write_all(asio::const_buffer buffer, IoHandler handler);
+
+    /*
+     * Writes the first of the queued writes.
+     * */
+    void write_next();
+
+    /*
+     * Derives the RC4 keys from the shared secret.
+     * */
+    void create_ciphers(std::vector<std::uint8_t> shared_secret);
+
+    /*
+     * Starts the waiting operations.
+     * @param decrypted Length of the input that is already plaintext.
+     * */
+    void finish(std::uint32_t select, std::size_t decrypted);
+
+    void fail(const boost::system::error_code& error);
+
+  private:
+    static constexpr std::size_t READ_LENGTH = 1024;
+
+    asio::io_context& io_context;
+    std::unique_ptr<Stream> inner;
+    const Role role;
+    const std::string skey;
+    const EncryptionPolicy policy;
+
+    std::mutex mutex;
+    State state = State::Waiting;
+    boost::system::error_code failure;
+    std::vector<Operation> waiting;
+    ConnectHandler on_connect;
+
+    // Writes go out one at a time, so the remote gets the cipher text
+    //      in the order it was encrypted.
+    std::deque<PendingWrite> writes;
+    bool writing = false;
+
+    std::vector<std::uint8_t> private_key;
+    std::vector<std::uint8_t> secret;
+
+    // Bytes read during the handshake. Once it is done, the payload
+    //      that came with it, decrypted.
+    std::vector<std::uint8_t> input;
+    std::optional<Rc4> encryptor;
+    std::optional<Rc4> decryptor;
+    bool encrypted = false;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,108 @@
+#ifndef TORRENT_FILE_POOL_HPP
+#define TORRENT_FILE_POOL_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "async_file.hpp"
+
+namespace torrent {
+
+namespace asio = boost::asio;
+
+/*
+ * Keeps a bounded number of files open. Opening a file over the limit
+ *      closes the least recently used one, so torrents with many files
+ *      don't run out of descriptors, and the files in use are not
+ *      opened again for every block.
+ * A file stays open while someone holds it, so the limit is exceeded
+ *      when every open file is in use. Holders keep the file for the
+ *      length of an operation.
+ * Users of a path, like the Pieces of a torrent, retain it for as long as
+ *      they use it. The path is only forgotten once every user released
+ *      it, so a torrent that is removed and added again doesn't lose
+ *      the file of its new instance to the old one.
+ * Thread safe. The torrents of a session share one pool.
+ * */
+class FilePool {
+  public:
+    enum class Mode {
+        ReadOnly,
+        ReadWrite, // Creates the file if it doesn't exist.
+    };
+
+    explicit FilePool(std::size_t max_open_files = DEFAULT_MAX_OPEN) :
+        max_open(max_open_files) {}
+
+    FilePool(const FilePool&) = delete;
+    FilePool& operator=(const FilePool&) = delete;
+
+    /*
+     * Returns the file, opening it if it is not open.
+     * A file that is open read only is opened again to write it.
+     * @param io_context Context of the operations on the file. Every user
+     *      of a path should give the same one.
+     * @throws std::runtime_error If the file can't be opened.
+     * */
+    std::shared_ptr<AsyncFile> open(
+        asio::io_context& io_context,
+        const std::filesystem::path& path,
+        Mode mode
+    );
+
+    /*
+     * Registers a user of the path.
+     * */
+    void retain(const std::filesystem::path& path);
+
+    /*
+     * Releases a user of the path. Once the path has no users the file
+     *      is forgotten, and it is closed once its holders release it.
+     * Should be called before the io_context of the file is destroyed.
+     * */
+    void release(const std::filesystem::path& path);
+
+    /*
+     * Changes the limit. Files over it are closed as they are released.
+     * */
+    void set_max_open(std::size_t max_open_files);
+
+    std::size_t get_open_count() const {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return entries.size();
+    }
+
+  private:
+    struct Entry {
+        std::string path;
+        Mode mode;
+        std::shared_ptr<AsyncFile> file;
+    };
+
+    /*
+     * Closes the least recently used files that nobody holds
+     *      until there is room for one more.
+     * mutex should be locked before calling this.
+     * */
+    void make_room();
+
+  private:
+    static constexpr std::size_t DEFAULT_MAX_OPEN = 512;
+
+    mutable std::mutex mutex;
+    std::size_t max_open;
+    // The most recently used file is at the front.
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    // Number of users of every retained path.
+    std::unordered_map<std::string, std::size_t> users;
+};
+
+} // namespace torrent
+#endif
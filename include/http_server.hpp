@@ -0,0 +1,163 @@
+#ifndef TORRENT_HTTP_SERVER_HPP
+#define TORRENT_HTTP_SERVER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace torrent {
+
+namespace asio = boost::asio;
+namespace http = boost::beast::http;
+namespace beast = boost::beast;
+using tcp = boost::asio::ip::tcp;
+
+/*
+ * A small HTTP/1.1 server that only listens on the loopback interface.
+ * Requests are passed to the handler with the session they came from.
+ *      The handler answers with one of the send functions of the session,
+ *      possibly later from another thread.
+ * Connections are kept alive if the client asks for it.
+ * Must be owned by a shared_ptr, the pending accept keeps it alive.
+ * */
+class HttpServer: public std::enable_shared_from_this<HttpServer> {
+  public:
+    using Request = http::request<http::empty_body>;
+    class Session;
+    using Handler =
+        std::function<void(const Request&, std::shared_ptr<Session>)>;
+
+    /*
+     * @param port Port to listen on. Zero picks a free port.
+     * */
+    HttpServer(
+        asio::io_context& io_context_ref,
+        std::uint16_t port,
+        Handler request_handler
+    );
+
+    HttpServer(const HttpServer&) = delete;
+    const HttpServer& operator=(const HttpServer&) = delete;
+
+    /*
+     * Starts accepting connections.
+     * @throws boost::system::system_error if the port can't be bound.
+     * */
+    void start();
+
+    /*
+     * Stops accepting new connections.
+     * */
+    void stop();
+
+    /*
+     * Returns the port the server is listening on.
+     * */
+    std::uint16_t get_port() const {
+        return acceptor.local_endpoint().port();
+    }
+
+  private:
+    void accept();
+
+  private:
+    asio::io_context& io_context;
+    tcp::acceptor acceptor;
+    std::uint16_t port;
+    Handler handler;
+};
+
+/*
+ * A connection to the HttpServer.
+ * */
+class HttpServer::Session: public std::enable_shared_from_this<Session> {
+  public:
+    /*
+     * Fills the buffer with the body bytes starting at the given position.
+     * Must call on_read once the buffer is filled.
+     * */
+    using BodyReader = std::function<void(
+        std::size_t position,
+        asio::mutable_buffer buffer,
+        std::function<void(const boost::system::error_code&)> on_read
+    )>;
+
+    Session(tcp::socket socket, Handler request_handler) :
+        stream(std::move(socket)),
+        handler(std::move(request_handler)) {}
+
+    std::shared_ptr<Session> get_ptr() {
+        return shared_from_this();
+    }
+
+    /*
+     * Starts reading requests.
+     * */
+    void start();
+
+    /*
+     * Sends a response with the whole body in memory.
+     * */
+    void send(
+        http::status status,
+        const std::string& content_type,
+        std::string body,
+        const std::vector<std::pair<http::field, std::string>>& fields = {}
+    );
+
+    /*
+     * Sends a response whose body is produced in chunks by the reader.
+     *      Only one chunk is kept in memory, so large bodies can be
+     *      streamed while they are still being downloaded.
+     * @param response Status and the header fields of the response.
+     * @param content_length Length of the whole body.
+     * */
+    void send_stream(
+        http::response<http::buffer_body> response,
+        std::size_t content_length,
+        BodyReader reader
+    );
+
+  private:
+    void read_request();
+    void write_chunk(std::size_t position);
+    void on_chunk_read(
+        const boost::system::error_code& read_error,
+        std::size_t position,
+        std::size_t length
+    );
+    void on_response_sent(const beast::error_code& error);
+    void close();
+
+  private:
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    Handler handler;
+
+    std::optional<http::request_parser<http::empty_body>> parser;
+    bool keep_alive = false;
+
+    // State of the response that is being streamed.
+    http::response<http::buffer_body> stream_response;
+    std::optional<http::response_serializer<http::buffer_body>> serializer;
+    std::size_t stream_length = 0;
+    BodyReader stream_reader;
+    std::vector<std::uint8_t> chunk;
+
+    static constexpr std::size_t CHUNK_LENGTH = 1 << 18;
+    static constexpr std::size_t MAX_HEADER_LENGTH = 1 << 13;
+    static constexpr auto REQUEST_TIMEOUT = std::chrono::seconds(30);
+};
+
+} // namespace torrent
+#endif
@@ -15,16 +15,17 @@
 #include <boost/beast.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/endian/conversion.hpp>
-#include <boost/log/sources/record_ostream.hpp>
-#include <boost/log/trivial.hpp>
 #include <boost/url.hpp>
+#include <chrono>
 #include <concepts>
 #include <cstddef>
 #include <exception>
 #include <memory>
+#include <optional>
 #include <variant>
 
-#include "bencode_parser.hpp"
+#include "bencode_reader.hpp"
+#include "log.hpp"
 #include "tracker.hpp"
 
 namespace torrent {
@@ -34,6 +35,58 @@ namespace beast = boost::beast;
 namespace asio = boost::asio;
 using namespace boost::asio::ip;
 
+/*
+ * Collects the fields we use from a tracker response while it is parsed.
+ * See: https://www.bittorrent.org/beps/bep_0003.html#trackers
+ * */
+class TrackerResponseHandler: public BencodeReader::Handler {
+  public:
+    void on_integer(BencodeReader::Integer value) override {
+        if (depth == 1 && key == "interval") {
+            interval = value;
+        }
+    }
+
+    void on_string(std::string_view value) override {
+        if (depth != 1) {
+            return;
+        }
+        if (key == "peers") {
+            peers = std::string {value};
+        } else if (key == "failure reason") {
+            failure_reason = value;
+        }
+    }
+
+    void on_key(std::string_view value) override {
+        if (depth == 1) {
+            key = value;
+        }
+    }
+
+    void on_list_begin() override {
+        depth += 1;
+    }
+
+    void on_dictionary_begin() override {
+        depth += 1;
+    }
+
+    void on_end() override {
+        depth -= 1;
+    }
+
+  public:
+    std::optional<BencodeReader::Integer> interval;
+    // Peers in the compact format.
+    std::optional<std::string> peers;
+    std::string failure_reason;
+
+  private:
+    std::size_t depth = 0;
+    std::string key; // Last key of the top level dictionary.
+};
+
 template<typename StreamType>
 concept StreamTypeConcept = std::same_as<StreamType, tcp::socket>
     || std::same_as<StreamType, asio::ssl::stream<tcp::socket>>;
@@ -51,11 +104,11 @@ class BasicHttpTracker: public Tracker {
   public:
     BasicHttpTracker(
         Private,
-        TrackerManager& tracker_manager_ref,
+        std::weak_ptr<TrackerManager> tracker_manager_ptr,
         asio::io_context& io_context_ref,
         StreamType&& input_stream
     ) :
-        Tracker(tracker_manager_ref),
+        Tracker(std::move(tracker_manager_ptr)),
         stream(std::forward<StreamType>(input_stream)),
         timer(io_context_ref),
         resolver(io_context_ref) {}
@@ -63,13 +116,13 @@ class BasicHttpTracker: public Tracker {
     ~BasicHttpTracker() {}
 
     static std::shared_ptr<Tracker> create(
-        TrackerManager& tracker_manager,
+        std::weak_ptr<TrackerManager> tracker_manager,
         asio::io_context& io_context,
         StreamType&& stream
     ) {
         return std::make_shared<BasicHttpTracker<StreamType>>(
             Private {},
-            tracker_manager,
+            std::move(tracker_manager),
             io_context,
             std::forward<StreamType>(stream)
         );
@@ -93,7 +146,7 @@ class BasicHttpTracker: public Tracker {
             url.port(),
             [self = get_ptr()](auto error, auto endpoints) {
                 if (error) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << *self << " could not resolve the given url: "
                         << error.message();
                     return self->on_disconnect();
@@ -105,6 +158,15 @@ class BasicHttpTracker: public Tracker {
         );
     }
 
+    void stop() override {
+        asio::post(timer.get_executor(), [self = get_ptr()] {
+            self->timer.cancel();
+            self->resolver.cancel();
+            beast::error_code ignored;
+            beast::get_lowest_layer(self->stream).close(ignored);
+        });
+    }
+
   private:
     void connect(const tcp::resolver::results_type& endpoints);
 
@@ -113,16 +175,20 @@ class BasicHttpTracker: public Tracker {
      * */
     void fetch_peers() {
         request = {http::verb::get, url.encoded_target(), 11};
-        request.set(http::field::host, url.host());
+        request.set(
+            http::field::host,
+            std::string {url.encoded_host_and_port()}
+        );
         request.set(http::field::close, "close");
         request.set(http::field::accept, "*/*");
+        request_time = std::chrono::steady_clock::now();
 
         http::async_write(
             stream,
             request,
             [self = get_ptr()](std::error_code error, std::size_t) {
                 if (error) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << *self << " could not fetch peers" << error.message();
                     return self->on_disconnect();
                 }
@@ -133,114 +199,123 @@ class BasicHttpTracker: public Tracker {
     /*
      * Listen a HTTP packet from the tracker. 
      * Tracker should give the list of peers in bencode format.
+     * The body is parsed chunk by chunk while it is being received.
      * */
     void listen_packet() {
-        http::async_read(
+        parser.emplace();
+        parser->body_limit(MAX_RESPONSE_LENGTH);
+        response_handler = {};
+        reader.reset();
+
+        http::async_read_header(
             stream,
             buffer,
-            response,
-            [self = get_ptr()](std::error_code error, std::size_t bytes_read) {
+            *parser,
+            [self = get_ptr()](beast::error_code error, std::size_t) {
                 if (error) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << "Error while listening a packet from " << *self
                         << ": " << error.message();
                     return self->on_disconnect();
                 }
+                self->listen_body();
+            }
+        );
+    }
 
-                BOOST_LOG_TRIVIAL(info)
-                    << "Read a " << bytes_read
-                    << " bytes long http response from  the " << *self;
-                try {
-                    BencodeParser input_parser(
-                        std::make_unique<std::stringstream>(self->response.body(
-                        ))
-                    );
-                    input_parser.parse();
-
-                    auto element = input_parser.get();
-                    auto dict = element.get<BencodeParser::Dictionary>();
-                    BencodeParser::Dictionary::iterator interval_element,
-                        peers_element;
-
-                    if ((interval_element = dict.find("interval")) == dict.end()
-                        || (peers_element = dict.find("peers")) == dict.end()) {
-                        BOOST_LOG_TRIVIAL(error)
-                            << "Received an invalid bencode string from the "
-                            << *self;
-                        return self->on_disconnect();
-                    }
-
-                    if (!std::holds_alternative<BencodeParser::Integer>(
-                            interval_element->second.value
-                        )
-                        || !std::holds_alternative<BencodeParser::String>(
-                            peers_element->second.value
-                        )) {
-                        BOOST_LOG_TRIVIAL(error)
-                            << "Received an invalid bencode string from the "
-                            << *self;
-                        return self->on_disconnect();
-                    }
+    /*
+     * Reads the next chunk of the body and feeds it to the bencode reader.
+     * */
+    void listen_body() {
+        auto& body = parser->get().body();
+        body.data = body_buffer.data();
+        body.size = body_buffer.size();
 
-                    // Interval tells us how often we should
-                    //      fetch the peer list again from the tracker
-                    const std::size_t interval = static_cast<std::size_t>(
-                        interval_element->second.get<BencodeParser::Integer>()
-                    );
-                    // Add peers
-                    auto peer_string =
-                        peers_element->second.get<BencodeParser::String>();
-                    std::array<std::uint8_t, 4> ip;
-                    for (std::size_t i = 0; i + 6 <= peer_string.size();
-                         i += 6) {
-                        std::copy(
-                            peer_string.begin()
-                                + static_cast<std::ptrdiff_t>(i),
-                            peer_string.begin() + static_cast<std::ptrdiff_t>(i)
-                                + 4,
-                            ip.begin()
-                        );
-                        std::uint16_t port =
-                            static_cast<std::uint16_t>(
-                                static_cast<std::uint16_t>(peer_string[i + 5])
-                                << 8
-                            )
-                            | static_cast<std::uint16_t>(peer_string[i + 4]);
-                        // Port is always big endian. So convert it to the native
-                        auto endpoint = tcp::endpoint {
-                            address_v4(ip),
-                            boost::endian::big_to_native(port)
-                        };
-
-                        self->on_new_peer(std::move(endpoint));
-                    }
-                    BOOST_LOG_TRIVIAL(info)
-                        << "Fetched " << (peer_string.size() / 6) << " peers";
-
-                    self->timer.expires_after(asio::chrono::seconds(interval));
-                    self->timer.async_wait([self](auto wait_error) {
-                        if (wait_error) {
-                            BOOST_LOG_TRIVIAL(error)
-                                << *self << " error in async_wait"
-                                << wait_error.message();
-                            return;
-                        }
-                        // Fetch the peer list again.
-                        self->fetch_peers(
-                        ); // Request peer list from the tracker.
-                        self->listen_packet(); // Listen response.
-                    });
+        http::async_read(
+            stream,
+            buffer,
+            *parser,
+            [self = get_ptr()](beast::error_code error, std::size_t) {
+                if (error == http::error::need_buffer) {
+                    // Body buffer is full. Not an actual error.
+                    error = {};
+                }
+                if (error) {
+                    TORRENT_LOG(error)
+                        << "Error while listening a packet from " << *self
+                        << ": " << error.message();
+                    return self->on_disconnect();
+                }
 
+                const auto chunk_length = self->body_buffer.size()
+                    - self->parser->get().body().size;
+                try {
+                    self->reader.feed({self->body_buffer.data(), chunk_length});
                 } catch (const std::exception& exception) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << "Error while parsing the message from " << *self
                         << ": " << exception.what();
                     return self->on_disconnect();
                 }
+
+                if (!self->parser->is_done()) {
+                    return self->listen_body(); // Read the rest of the body.
+                }
+                self->on_response();
             }
         );
     }
 
+    /*
+     * Handles a completely received tracker response.
+     * */
+    void on_response() {
+        if (!reader.is_complete()) {
+            TORRENT_LOG(error)
+                << "Received an incomplete bencode string from the " << *this;
+            return on_disconnect();
+        }
+        if (!response_handler.failure_reason.empty()) {
+            TORRENT_LOG(error)
+                << *this << " responded with a failure: "
+                << response_handler.failure_reason;
+            return on_disconnect();
+        }
+        if (!response_handler.interval.has_value()
+            || !response_handler.peers.has_value()) {
+            TORRENT_LOG(error)
+                << "Received an invalid bencode string from the " << *this;
+            return on_disconnect();
+        }
+
+        TORRENT_LOG(info) << "Read a http response from the " << *this;
+        on_round_trip(request_time);
+
+        // Interval tells us how often we should
+        //      fetch the peer list again from the tracker
+        const std::size_t interval =
+            static_cast<std::size_t>(response_handler.interval.value());
+        // Add peers
+        const auto& peer_string = response_handler.peers.value();
+        for (auto& endpoint : parse_compact_peers(peer_string)) {
+            on_new_peer(std::move(endpoint));
+        }
+        TORRENT_LOG(info)
+            << "Fetched " << (peer_string.size() / 6) << " peers";
+
+        timer.expires_after(asio::chrono::seconds(interval));
+        timer.async_wait([self = get_ptr()](auto wait_error) {
+            if (wait_error) {
+                TORRENT_LOG(error)
+                    << *self << " error in async_wait" << wait_error.message();
+                return;
+            }
+            // Fetch the peer list again.
+            self->fetch_peers(); // Request peer list from the tracker.
+            self->listen_packet(); // Listen response.
+        });
+    }
+
   private:
     boost::url url;
 
@@ -251,7 +326,21 @@ class BasicHttpTracker: public Tracker {
 
     tcp::resolver resolver;
     http::request<http::string_body> request;
-    http::response<http::string_body> response;
+    std::chrono::steady_clock::time_point request_time;
+
+    // Tracker responses are parsed while they are received.
+    static constexpr std::size_t MAX_RESPONSE_LENGTH = 1 << 22;
+    static constexpr std::size_t BODY_CHUNK_LENGTH = 4096;
+
+    std::optional<http::response_parser<http::buffer_body>> parser;
+    std::array<char, BODY_CHUNK_LENGTH> body_buffer;
+    TrackerResponseHandler response_handler;
+    BencodeReader reader {
+        response_handler,
+        {.max_depth = 8,
+         .max_string_length = MAX_RESPONSE_LENGTH,
+         .max_total_length = MAX_RESPONSE_LENGTH}
+    };
 };
 
 using HttpTracker = BasicHttpTracker<tcp::socket>;
@@ -264,7 +353,7 @@ inline void HttpTracker::connect(const tcp::resolver::results_type& endpoints) {
         endpoints,
         [self = get_ptr()](auto error, auto) {
             if (error) {
-                BOOST_LOG_TRIVIAL(error) << "Could not connect to the " << *self
+                TORRENT_LOG(error) << "Could not connect to the " << *self
                                          << ": " << error.message();
                 return self->on_disconnect();
             }
@@ -283,7 +372,7 @@ inline void HttpsTracker::connect(const tcp::resolver::results_type& endpoints
         endpoints,
         [self = get_ptr()](auto error, auto) {
             if (error) {
-                BOOST_LOG_TRIVIAL(error) << "Could not connect to the " << *self
+                TORRENT_LOG(error) << "Could not connect to the " << *self
                                          << ": " << error.message();
                 return self->on_disconnect();
             }
@@ -293,7 +382,7 @@ inline void HttpsTracker::connect(const tcp::resolver::results_type& endpoints
                     self->stream.native_handle(),
                     self->url.host().data()
                 )) {
-                BOOST_LOG_TRIVIAL(error)
+                TORRENT_LOG(error)
                     << "SNI Hostname could not be set: " << ::ERR_get_error();
                 return self->on_disconnect();
             }
@@ -303,7 +392,7 @@ inline void HttpsTracker::connect(const tcp::resolver::results_type& endpoints
                 asio::ssl::stream_base::client,
                 [self](const auto& handshake_error) {
                     if (handshake_error) {
-                        BOOST_LOG_TRIVIAL(error)
+                        TORRENT_LOG(error)
                             << "Could not ssl handshake with the " << *self
                             << ": " << handshake_error.message();
                         return self->on_disconnect();
@@ -0,0 +1,110 @@
+#ifndef TORRENT_JSON_HPP
+#define TORRENT_JSON_HPP
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace torrent {
+
+/*
+ * A JSON value, used by the control socket of the daemon.
+ * Integers are kept apart from doubles so ids and byte counts
+ *      don't lose precision.
+ * See: https://www.rfc-editor.org/rfc/rfc8259
+ * */
+class Json {
+  public:
+    using Array = std::vector<Json>;
+    using Object = std::map<std::string, Json, std::less<>>;
+    using Value = std::variant<
+        std::nullptr_t,
+        bool,
+        std::int64_t,
+        double,
+        std::string,
+        Array,
+        Object>;
+
+    Json() : value(nullptr) {}
+
+    Json(std::nullptr_t) : value(nullptr) {}
+
+    Json(bool boolean) : value(boolean) {}
+
+    template<std::integral T>
+        requires(!std::same_as<T, bool>)
+    Json(T integer) : value(static_cast<std::int64_t>(integer)) {}
+
+    Json(double number) : value(number) {}
+
+    Json(std::string string) : value(std::move(string)) {}
+
+    Json(std::string_view string) : value(std::string {string}) {}
+
+    Json(const char* string) : value(std::string {string}) {}
+
+    Json(Array array) : value(std::move(array)) {}
+
+    Json(Object object) : value(std::move(object)) {}
+
+    template<typename T>
+    bool is() const {
+        return std::holds_alternative<T>(value);
+    }
+
+    /*
+     * @throws std::runtime_error If the value is of another type.
+     * */
+    template<typename T>
+    const T& get() const {
+        if (const auto* result = std::get_if<T>(&value)) {
+            return *result;
+        }
+        throw std::runtime_error("Unexpected JSON type.");
+    }
+
+    template<typename T>
+    T& get() {
+        if (auto* result = std::get_if<T>(&value)) {
+            return *result;
+        }
+        throw std::runtime_error("Unexpected JSON type.");
+    }
+
+    /*
+     * Returns the member of an object with the key.
+     * @return nullptr if this is not an object or it has no such member.
+     * */
+    const Json* find(std::string_view key) const;
+
+    /*
+     * @throws std::runtime_error If the text is not a single valid value.
+     * */
+    static Json parse(std::string_view text);
+
+    /*
+     * Writes the value without any whitespace.
+     * */
+    std::string dump() const {
+        std::string output;
+        dump(output);
+        return output;
+    }
+
+    void dump(std::string& output) const;
+
+  private:
+    Value value;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,296 @@
+#ifndef TORRENT_LOG_HPP
+#define TORRENT_LOG_HPP
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Levels below this are removed at compile time, 0 is trace and 5 is fatal.
+ * Debug builds keep the debug messages, release builds start from info.
+ * */
+#ifndef TORRENT_LOG_MIN_LEVEL
+    #ifdef NDEBUG
+        #define TORRENT_LOG_MIN_LEVEL 2
+    #else
+        #define TORRENT_LOG_MIN_LEVEL 1
+    #endif
+#endif
+
+namespace torrent::log {
+
+enum class Level : int { trace, debug, info, warning, error, fatal };
+
+constexpr bool is_compiled(Level level) {
+    return static_cast<int>(level) >= TORRENT_LOG_MIN_LEVEL;
+}
+
+namespace detail {
+inline std::atomic<int> min_level = 0;
+} // namespace detail
+
+/*
+ * Messages below the level are dropped at runtime.
+ * Defaults to logging every level that is compiled in.
+ * */
+inline void set_level(Level level) {
+    detail::min_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+inline bool is_enabled(Level level) {
+    return static_cast<int>(level)
+        >= detail::min_level.load(std::memory_order_relaxed);
+}
+
+/*
+ * Blocks until the messages logged so far are written.
+ * */
+void flush();
+
+/*
+ * Whether a value is copied into the message and formatted by the
+ *      logging thread. Other values are formatted into a string by the
+ *      caller. Specialize it for cheap to copy types with an operator<<.
+ * Types can also give a cheap to copy stand-in for themselves with a
+ *      to_log_value function found by ADL, the stand-in is always copied.
+ * */
+template<typename T>
+inline constexpr bool is_deferred =
+    std::is_arithmetic_v<T> || std::is_same_v<T, std::string>;
+
+template<>
+inline constexpr bool is_deferred<boost::asio::ip::address> = true;
+template<>
+inline constexpr bool is_deferred<boost::asio::ip::address_v4> = true;
+template<>
+inline constexpr bool is_deferred<boost::asio::ip::address_v6> = true;
+template<>
+inline constexpr bool is_deferred<boost::asio::ip::tcp::endpoint> = true;
+template<>
+inline constexpr bool is_deferred<boost::asio::ip::udp::endpoint> = true;
+
+template<typename T>
+concept HasLogValue = requires(const T& value) { to_log_value(value); };
+
+/*
+ * Lets a few messages of a call site through every second and counts
+ *      the rest, so a repeating error doesn't flood the log.
+ * */
+class RateLimiter {
+  public:
+    bool allow() {
+        const auto now = std::chrono::steady_clock::now()
+                             .time_since_epoch()
+                             .count();
+        auto start = window_start.load(std::memory_order_relaxed);
+        if (now - start >= WINDOW.count()
+            && window_start.compare_exchange_strong(
+                start,
+                now,
+                std::memory_order_relaxed
+            )) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        if (count.fetch_add(1, std::memory_order_relaxed) < BURST) {
+            return true;
+        }
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /*
+     * Returns the number of messages dropped since the last call.
+     * */
+    std::uint64_t take_suppressed() {
+        return suppressed.exchange(0, std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr std::uint32_t BURST = 20;
+    static constexpr std::chrono::steady_clock::duration WINDOW =
+        std::chrono::seconds(1);
+
+    std::atomic<std::chrono::steady_clock::rep> window_start = 0;
+    std::atomic<std::uint32_t> count = 0;
+    std::atomic<std::uint64_t> suppressed = 0;
+};
+
+/*
+ * A message in the queue of the logging thread.
+ * The operands are stored one after another in a fixed buffer, each
+ *      with the functions that format and destroy it. Operands that
+ *      don't fit are formatted into the overflow string by the caller,
+ *      manipulators don't apply to them.
+ * */
+class Record {
+  public:
+    Record() = default;
+    Record(const Record&) = delete;
+    Record& operator=(const Record&) = delete;
+
+    ~Record() {
+        clear();
+    }
+
+    template<typename T>
+    void push(const T& value) {
+        if constexpr (std::is_function_v<T>) {
+            // Manipulators like std::hex.
+            store(&value);
+        } else if constexpr (std::is_array_v<T>) {
+            // Character arrays are expected to be string literals.
+            store(static_cast<const char*>(value));
+        } else if constexpr (std::is_same_v<T, const char*>
+                             || std::is_same_v<T, char*>
+                             || std::is_same_v<T, std::string_view>) {
+            store(std::string {value});
+        } else if constexpr (HasLogValue<T>) {
+            store(to_log_value(value));
+        } else if constexpr (is_deferred<T>) {
+            store(value);
+        } else {
+            std::ostringstream stream;
+            stream << value;
+            store(std::move(stream).str());
+        }
+    }
+
+    /*
+     * Writes the message without the prefix.
+     * */
+    void format(std::ostream& os) const;
+
+    /*
+     * Destroys the operands so the record can be reused.
+     * */
+    void clear();
+
+  public:
+    Level level = Level::info;
+    std::chrono::system_clock::time_point time;
+    std::thread::id thread;
+    std::uint64_t suppressed = 0; // Messages of the call site dropped before.
+
+  private:
+    friend class Logger;
+
+    // Functions of the stored type, shared by its operands.
+    struct OperandType {
+        void (*format)(const std::byte* value, std::ostream& os);
+        void (*destroy)(std::byte* value);
+    };
+
+    template<typename T>
+    static constexpr OperandType operand_type = {
+        [](const std::byte* pointer, std::ostream& os) {
+            os << *std::launder(reinterpret_cast<const T*>(pointer));
+        },
+        [](std::byte* pointer) {
+            std::launder(reinterpret_cast<T*>(pointer))->~T();
+        }
+    };
+
+    struct Operand {
+        const OperandType* type;
+        std::uint16_t value_offset;
+        std::uint16_t end_offset; // Where the next operand starts.
+    };
+
+    template<typename T>
+    void store(T value) {
+        static_assert(alignof(T) <= alignof(std::max_align_t));
+        const auto operand_offset = align(used, alignof(Operand));
+        const auto value_offset =
+            align(operand_offset + sizeof(Operand), alignof(T));
+        if (!overflow.empty() || value_offset + sizeof(T) > OPERANDS_LENGTH) {
+            std::ostringstream stream;
+            stream << value;
+            overflow += std::move(stream).str();
+            return;
+        }
+        new (operands + value_offset) T(std::move(value));
+        new (operands + operand_offset) Operand {
+            &operand_type<T>,
+            static_cast<std::uint16_t>(value_offset),
+            static_cast<std::uint16_t>(value_offset + sizeof(T))
+        };
+        used = static_cast<std::uint16_t>(value_offset + sizeof(T));
+        operand_count += 1;
+    }
+
+    static constexpr std::size_t align(std::size_t offset, std::size_t to) {
+        return (offset + to - 1) / to * to;
+    }
+
+    static constexpr std::size_t OPERANDS_LENGTH = 320;
+
+    std::atomic<std::size_t> sequence = 0; // State of the slot in the queue.
+    std::size_t position = 0;
+    std::uint16_t used = 0;
+    std::uint16_t operand_count = 0;
+    alignas(std::max_align_t) std::byte operands[OPERANDS_LENGTH];
+    std::string overflow;
+};
+
+/*
+ * Builds a message in place in the queue and publishes it once
+ *      the statement ends. Messages are dropped if the queue is full.
+ * */
+class Line {
+  public:
+    Line(Level level, RateLimiter& limiter);
+    ~Line();
+
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+
+    template<typename T>
+    Line& operator<<(const T& value) {
+        if (record != nullptr) {
+            record->push(value);
+        }
+        return *this;
+    }
+
+  private:
+    Record* record;
+};
+
+} // namespace torrent::log
+
+/*
+ * Logs a message at the level, used like a stream:
+ *      TORRENT_LOG(info) << "Connected to " << endpoint;
+ * The operands are only evaluated if the message is logged.
+ * The message is written by a background thread, see log.cpp.
+ * */
+#define TORRENT_LOG(severity)                                                  \
+    if constexpr (!::torrent::log::is_compiled(                                \
+                      ::torrent::log::Level::severity                          \
+                  )) {                                                         \
+    } else if (!::torrent::log::is_enabled(::torrent::log::Level::severity)) { \
+    } else if (auto& torrent_log_limiter =                                     \
+                   []() -> ::torrent::log::RateLimiter& {                      \
+                       static ::torrent::log::RateLimiter limiter;             \
+                       return limiter;                                         \
+                   }();                                                        \
+               !torrent_log_limiter.allow()) {                                 \
+    } else                                                                     \
+        ::torrent::log::Line(                                                  \
+            ::torrent::log::Level::severity,                                   \
+            torrent_log_limiter                                                \
+        )
+
+#endif
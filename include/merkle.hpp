@@ -0,0 +1,105 @@
+#ifndef TORRENT_MERKLE_HPP
+#define TORRENT_MERKLE_HPP
+
+#include <openssl/sha.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace torrent {
+
+using Sha256Hash = std::array<std::uint8_t, 32>;
+
+/*
+ * Leaves of the BitTorrent v2 merkle trees are the hashes of 16 KiB blocks.
+ * See: https://www.bittorrent.org/beps/bep_0052.html
+ * */
+inline constexpr std::size_t MERKLE_LEAF_LENGTH = 1 << 14;
+
+inline Sha256Hash sha256(std::string_view data) {
+    Sha256Hash hash;
+    SHA256(
+        reinterpret_cast<const unsigned char*>(data.data()),
+        data.size(),
+        hash.data()
+    );
+    return hash;
+}
+
+/*
+ * Returns the smallest power of two that is not smaller than the value.
+ * */
+std::size_t next_power_of_two(std::size_t value);
+
+/*
+ * Returns the hash of a parent node.
+ * */
+Sha256Hash merkle_parent(const Sha256Hash& left, const Sha256Hash& right);
+
+/*
+ * Returns the leaf hashes of the data. The last block can be shorter.
+ * */
+std::vector<Sha256Hash> merkle_leaves(std::string_view data);
+
+/*
+ * Returns the root of a tree whose leaves are all the pad hash.
+ * @param leaf_count A power of two.
+ * */
+Sha256Hash merkle_pad(std::size_t leaf_count, const Sha256Hash& pad = {});
+
+/*
+ * Returns the root of the tree with the given leaves.
+ * Leaves past the given ones are the pad hash, zero unless given.
+ * @param leaf_count Width of the tree, a power of two not smaller
+ *      than the number of leaves.
+ * */
+Sha256Hash merkle_root(
+    std::span<const Sha256Hash> leaves,
+    std::size_t leaf_count,
+    const Sha256Hash& pad = {}
+);
+
+/*
+ * A merkle tree with all of its layers, used to answer hash requests.
+ * Layer 0 is the leaves and the last layer is the root.
+ * */
+class MerkleTree {
+  public:
+    MerkleTree(
+        std::span<const Sha256Hash> leaves,
+        std::size_t leaf_count,
+        const Sha256Hash& pad = {}
+    );
+
+    const Sha256Hash& get_root() const {
+        return layers.back().front();
+    }
+
+    std::size_t get_layer_count() const {
+        return layers.size();
+    }
+
+    std::span<const Sha256Hash> get_layer(std::size_t layer) const {
+        return layers[layer];
+    }
+
+    /*
+     * Returns the uncle hashes that prove the node up to the root,
+     *      starting from the sibling of the node.
+     * @param max_count Stops after this many hashes.
+     * */
+    std::vector<Sha256Hash> get_proof(
+        std::size_t layer,
+        std::size_t index,
+        std::size_t max_count
+    ) const;
+
+  private:
+    std::vector<std::vector<Sha256Hash>> layers;
+};
+
+} // namespace torrent
+#endif
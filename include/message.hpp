@@ -26,18 +26,31 @@ class Message {
         Piece = 7,
         Cancel = 8,
         InvalidMessage,
+        // BitTorrent v2, see: https://www.bittorrent.org/beps/bep_0052.html
+        HashRequest = 21,
+        Hashes = 22,
+        HashReject = 23,
     };
 
+    /*
+     * Returns the Id, or Id::InvalidMessage if it is not one we know.
+     * */
+    static Id to_valid_id(Id id) {
+        const auto value = static_cast<std::uint8_t>(id);
+        if (value <= static_cast<std::uint8_t>(Id::InvalidMessage)
+            || (value >= static_cast<std::uint8_t>(Id::HashRequest)
+                && value <= static_cast<std::uint8_t>(Id::HashReject))) {
+            return id;
+        }
+        return Id::InvalidMessage;
+    }
+
     /*
      * Creates a Message object from given Id and payload.
      * */
     template<typename Iterator>
     Message(Id message_id, Iterator it, std::size_t payload_length) :
-        id(message_id) {
-        if (static_cast<std::uint8_t>(id)
-            > static_cast<std::uint8_t>(Id::InvalidMessage)) {
-            id = Id::InvalidMessage;
-        }
+        id(to_valid_id(message_id)) {
 
         payload.resize(payload_length);
         std::copy(
@@ -51,11 +64,7 @@ class Message {
      * Creates a Message object from given bytes.
      * */
     Message(const std::vector<std::uint8_t>& bytes) :
-        id(static_cast<Id>(bytes[0])) {
-        if (static_cast<std::uint8_t>(id)
-            > static_cast<std::uint8_t>(Id::InvalidMessage)) {
-            id = Id::InvalidMessage;
-        }
+        id(to_valid_id(static_cast<Id>(bytes[0]))) {
         payload.resize(bytes.size() - 1);
         std::copy(bytes.begin() + 1, bytes.end(), payload.begin());
     }
@@ -65,13 +74,8 @@ class Message {
      * Moves the given payload.
      * */
     Message(Id message_id, std::vector<std::uint8_t> payload_bytes) :
-        id(message_id),
-        payload(std::move(payload_bytes)) {
-        if (static_cast<std::uint8_t>(id)
-            > static_cast<std::uint8_t>(Id::InvalidMessage)) {
-            id = Id::InvalidMessage;
-        }
-    }
+        id(to_valid_id(message_id)),
+        payload(std::move(payload_bytes)) {}
 
     /*
      * Creates a message with no payload.
@@ -94,49 +98,93 @@ class Message {
         return payload;
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const Message& message) {
-        os << "Message{ id: ";
-        switch (message.id) {
-            case Id::Choke:
-                os << "Choke";
-                break;
-            case Id::Unchoke:
-                os << "Unchoke";
-                break;
-            case Id::Interested:
-                os << "Interested";
-                break;
-            case Id::NotInterested:
-                os << "NotInterested";
-                break;
-            case Id::Have:
-                os << "Have, piece index: " << message.get_int(0);
-                break;
-            case Id::Bitfield:
-                os << "Bitfield, bitfield: std::uint8_t["
-                   << message.payload.size() << "]";
-                break;
-            case Id::Request:
-                os << "Request, index: " << message.get_int(0)
-                   << ", begin: " << message.get_int(1)
-                   << ", length: " << message.get_int(2);
-                break;
-            case Id::Piece:
-                os << "Piece, index: " << message.get_int(0)
-                   << ", begin: " << message.get_int(1)
-                   << ", block: std::uint8_t[" << message.payload.size() << "]";
-                break;
-            case Id::Cancel:
-                os << "Cancel, index: " << message.get_int(0)
-                   << ", begin: " << message.get_int(1)
-                   << ", length: " << message.get_int(2);
-                break;
-            case Id::InvalidMessage:
-                os << "Invalid, listen port: " << message.get_int(0);
-                break;
+    /*
+     * The part of a message that is printed. Small enough to copy,
+     *      so it can be logged after the message is sent.
+     * */
+    struct Summary {
+        Id id;
+        std::size_t payload_size;
+        std::array<std::uint32_t, 3> ints; // First integers of the payload.
+
+        friend std::ostream&
+        operator<<(std::ostream& os, const Summary& summary) {
+            os << "Message{ id: ";
+            switch (summary.id) {
+                case Id::Choke:
+                    os << "Choke";
+                    break;
+                case Id::Unchoke:
+                    os << "Unchoke";
+                    break;
+                case Id::Interested:
+                    os << "Interested";
+                    break;
+                case Id::NotInterested:
+                    os << "NotInterested";
+                    break;
+                case Id::Have:
+                    os << "Have, piece index: " << summary.ints[0];
+                    break;
+                case Id::Bitfield:
+                    os << "Bitfield, bitfield: std::uint8_t["
+                       << summary.payload_size << "]";
+                    break;
+                case Id::Request:
+                    os << "Request, index: " << summary.ints[0]
+                       << ", begin: " << summary.ints[1]
+                       << ", length: " << summary.ints[2];
+                    break;
+                case Id::Piece:
+                    os << "Piece, index: " << summary.ints[0]
+                       << ", begin: " << summary.ints[1]
+                       << ", block: std::uint8_t[" << summary.payload_size
+                       << "]";
+                    break;
+                case Id::Cancel:
+                    os << "Cancel, index: " << summary.ints[0]
+                       << ", begin: " << summary.ints[1]
+                       << ", length: " << summary.ints[2];
+                    break;
+                case Id::InvalidMessage:
+                    os << "Invalid, listen port: " << summary.ints[0];
+                    break;
+                // These start with a pieces root, not with integers.
+                case Id::HashRequest:
+                    os << "HashRequest";
+                    break;
+                case Id::Hashes:
+                    os << "Hashes, payload: std::uint8_t["
+                       << summary.payload_size << "]";
+                    break;
+                case Id::HashReject:
+                    os << "HashReject";
+                    break;
+            }
+            os << " }";
+            return os;
+        }
+    };
+
+    Summary get_summary() const {
+        Summary summary {id, payload.size(), {}};
+        for (std::size_t i = 0;
+             i < summary.ints.size() && (i + 1) * 4 <= payload.size();
+             ++i) {
+            summary.ints[i] = get_int(i);
         }
-        os << " }";
-        return os;
+        return summary;
+    }
+
+    /*
+     * Messages are logged by their summary, see log.hpp.
+     * */
+    friend Summary to_log_value(const Message& message) {
+        return message.get_summary();
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Message& message) {
+        return os << message.get_summary();
     }
 
     /*
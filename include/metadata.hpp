@@ -1,26 +1,37 @@
 #ifndef TORRENT_METADATA_HPP
 #define TORRENT_METADATA_HPP
 
+#include <array>
+#include <atomic>
 #include <boost/url/urls.hpp>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <span>
 #include <string_view>
 #include <utility>
 #include <vector>
 
 #include "bencode_parser.hpp"
+#include "merkle.hpp"
+#include "sha1.hpp"
 
 namespace torrent {
 
 /*
  * A thread safe class to maintain metadata information of the torrent.
+ * Info fields are immutable once the Metadata is ready.
  * This info might come from a .torrent file or a magnet link.
  * Magnet links will give only a small part of this required metadata, 
  *      client should fetch it through peers later on. 
  * See metadata exchange extension: https://www.bittorrent.org/beps/bep_0009.html
+ * BitTorrent v2 and hybrid torrents are supported. Their pieces never
+ *      span two files, and every piece has the root of a SHA-256
+ *      merkle tree over its 16 KiB blocks.
+ * See: https://www.bittorrent.org/beps/bep_0052.html
  * */
 class Metadata: public std::enable_shared_from_this<Metadata> {
   private:
@@ -65,10 +76,20 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
      * Loads the info directory to this Metadata object.
      * Can be called after constructing the object.
      * Function will set ready to true and call on_ready_callback.
+     * Must only be called once. Info fields can't change after this call.
      * @param info The info directory to fill the Metadata object.
-     * @param info_hash The SHA1 hash of the given info directory.
+     * @param info_bencode The info directory exactly as it was received.
+     *      The info hash is the SHA1 of these bytes.
+     * @param piece_layers The piece layers of a v2 torrent, keyed by
+     *      the pieces roots of the files. Without them hybrid torrents
+     *      are checked with SHA1 only.
+     * @throws std::runtime_error If the info directory is invalid.
      * */
-    void load_info(BencodeParser::Element info, std::string info_hash);
+    void load_info(
+        BencodeParser::Element info,
+        std::string info_bencode,
+        BencodeParser::Dictionary piece_layers = {}
+    );
 
     std::shared_ptr<Metadata> get_ptr() {
         return shared_from_this();
@@ -80,8 +101,16 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
     /*
      * Returns the info hash by getting the SHA1 of the given 
      *    info directory in bencoded format.
+     * @param info_bencode Original bytes of the info directory.
+     *      Re-encoding a parsed directory is not guaranteed to give
+     *      the same bytes, so the hash should be taken over the source.
      * */
-    static std::string get_info_hash(const BencodeParser::Element& info);
+    static std::string get_info_hash(std::string_view info_bencode);
+
+    /*
+     * Returns the SHA-256 of the info directory in bencoded format.
+     * */
+    static std::string get_info_hash_v2(std::string_view info_bencode);
 
   public:
     /* BEP9 Extension(See: https://www.bittorrent.org/beps/bep_0009.html) */
@@ -90,8 +119,7 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
      * Returns true if the torrent is ready to download.
      * */
     bool is_ready() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return ready;
+        return ready.load(std::memory_order_acquire);
     }
 
     /*
@@ -100,7 +128,7 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
      * */
     void on_ready(std::function<void()> callback) {
         std::unique_lock<std::mutex> lock {mutex};
-        if (ready) {
+        if (is_ready()) {
             lock.unlock();
             callback();
         } else {
@@ -113,7 +141,9 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
      * */
     void wait() {
         std::unique_lock<std::mutex> lock {ready_cv_mutex};
-        ready_cv.wait(lock, [self = get_ptr()] { return self->ready; });
+        ready_cv.wait(lock, [self = get_ptr()] {
+            return self->is_ready() || self->stopped;
+        });
     }
 
     /*
@@ -121,46 +151,75 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
      * */
     void stop() {
         std::scoped_lock<std::mutex> lock {ready_cv_mutex};
-        ready = true;
+        stopped = true;
         ready_cv.notify_all();
     }
 
   private:
-    bool ready = false;
+    // Every info field below is written once before ready is set.
+    // After that Metadata is immutable and the getters don't need a lock.
+    std::atomic<bool> ready = false;
     std::optional<std::function<void()>> on_ready_callback;
 
+    bool stopped = false;
     std::condition_variable ready_cv;
     std::mutex ready_cv_mutex;
 
   public:
     /* Getters */
     const std::string& get_info_hash() const {
-        std::scoped_lock<std::mutex> lock {mutex};
         return info_hash;
     }
 
+    /*
+     * Returns the SHA-256 of the info directory. Empty for v1 torrents.
+     * Peers and trackers of pure v2 torrents get the first 20 bytes of it
+     *      as the info hash.
+     * */
+    const std::string& get_info_hash_v2() const {
+        return info_hash_v2;
+    }
+
+    /*
+     * Returns the info directory in bencoded format as it was received.
+     * Used while serving the metadata to the peers(BEP9).
+     * */
+    const std::string& get_info_bencode() const {
+        return info_bencode;
+    }
+
     const auto& get_trackers() const {
-        std::scoped_lock<std::mutex> lock {mutex};
         return trackers;
     }
 
+    /*
+     * Returns true if the info directory has no files list.
+     * Multi file torrents are downloaded into a folder named after the torrent.
+     * */
+    bool is_single_file() const {
+        return single_file;
+    }
+
+    /*
+     * Returns the web seed urls(BEP19).
+     * */
+    const auto& get_web_seeds() const {
+        return web_seeds;
+    }
+
     const std::string& get_name() const {
-        std::scoped_lock<std::mutex> lock {mutex};
         return name;
     }
 
     const std::string& get_file_name() const {
-        std::scoped_lock<std::mutex> lock {mutex};
         return file_name;
     }
 
     std::size_t get_piece_length() const {
-        std::scoped_lock<std::mutex> lock {mutex};
         return piece_length;
     }
 
     std::size_t get_total_length() const {
-        std::scoped_lock<std::mutex> lock {mutex};
         return total_length;
     }
 
@@ -170,50 +229,139 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
      *      second is the path value of the file.
      * */
     const auto& get_files() const {
-        std::scoped_lock<std::mutex> lock {mutex};
         return files;
     }
 
-    const std::string& get_pieces() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return pieces;
+    /*
+     * Returns the offset of the file in the torrent.
+     * Files are laid out one after another in the order of get_files().
+     * */
+    std::size_t get_file_offset(std::size_t file_index) const {
+        return file_offsets[file_index];
     }
 
-    std::size_t get_downloaded() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return downloaded;
+    /*
+     * Returns the index of the file that contains the given offset.
+     * Runs in O(log n) over the file offsets.
+     * @param offset An offset smaller than get_total_length().
+     * */
+    std::size_t get_file_index(std::size_t offset) const;
+
+    /*
+     * Returns true if the file only aligns the next file to a piece(BEP47).
+     * Pad files are zeros, they are not extracted.
+     * */
+    bool is_pad_file(std::size_t file_index) const {
+        return pad_files[file_index];
     }
 
-    std::size_t get_uploaded() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return uploaded;
+    /*
+     * Returns true if the pieces are checked with the merkle trees.
+     * */
+    bool has_v2() const {
+        return !piece_hashes_v2.empty();
     }
 
-    std::size_t get_left() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return left;
+    /*
+     * Returns the root of the merkle tree of the file.
+     * Zero for pad files and empty files.
+     * */
+    const Sha256Hash& get_pieces_root(std::size_t file_index) const {
+        return pieces_roots[file_index];
+    }
+
+    /*
+     * Returns the index of the file with the pieces root,
+     *      get_files().size() if there is none.
+     * */
+    std::size_t find_file(const Sha256Hash& pieces_root) const;
+
+    /*
+     * Returns the roots of the piece subtrees of the file.
+     * Files are piece aligned in v2, so they are consecutive pieces.
+     * */
+    std::span<const Sha256Hash> get_piece_layer(std::size_t file_index) const;
+
+    /*
+     * Returns the tree above the piece layer of the file, built once when
+     *      the piece layers are loaded. Hash requests are answered from it.
+     * @return nullptr for pad and empty files, or without v2 hashes.
+     * */
+    const MerkleTree* get_piece_layer_tree(std::size_t file_index) const;
+
+    /*
+     * Returns the root of the merkle tree of the blocks of the piece.
+     * For files not longer than a piece it is the pieces root of the file.
+     * */
+    const Sha256Hash& get_piece_hash_v2(std::size_t piece_index) const {
+        return piece_hashes_v2[piece_index];
+    }
+
+    /*
+     * Returns the number of the leaves under the root of the piece.
+     * Blocks past the end of the file are zero leaves.
+     * */
+    std::size_t get_piece_leaf_count(std::size_t piece_index) const;
+
+    /*
+     * Returns the bytes of the piece that belong to its file.
+     * Same as get_piece_size, except it leaves out the pad files.
+     * */
+    std::size_t get_piece_data_size(std::size_t piece_index) const;
+
+    /*
+     * Returns the SHA1 hashes of the pieces.
+     * */
+    std::span<const Sha1Hash> get_piece_hashes() const {
+        return piece_hashes;
+    }
+
+    const Sha1Hash& get_piece_hash(std::size_t piece_index) const {
+        return piece_hashes[piece_index];
     }
 
     std::size_t get_piece_count() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return pieces.size() / 20;
+        return piece_count;
     }
 
-    std::size_t get_pieces_done() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return pieces_done;
+    /*
+     * Returns the length of the given piece.
+     * The last piece can be a little bit shorter than usual pieces.
+     * Pieces of pure v2 torrents end with their files, and the gaps
+     *      between the files are never sent.
+     * */
+    std::size_t get_piece_size(std::size_t piece_index) const {
+        if (piece_hashes.empty()) {
+            return get_piece_data_size(piece_index);
+        }
+        if (piece_index == piece_count - 1) {
+            return total_length - piece_index * piece_length;
+        }
+        return piece_length;
     }
 
     std::size_t get_block_count() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        return piece_length / BLOCK_LENGTH;
+        return block_count;
+    }
+
+    std::size_t get_downloaded() const {
+        return downloaded.load(std::memory_order_relaxed);
+    }
+
+    std::size_t get_uploaded() const {
+        return uploaded.load(std::memory_order_relaxed);
+    }
+
+    std::size_t get_left() const {
+        return left.load(std::memory_order_relaxed);
+    }
+
+    std::size_t get_pieces_done() const {
+        return pieces_done.load(std::memory_order_relaxed);
     }
 
     bool is_file_complete() const {
-        std::scoped_lock<std::mutex> lock {mutex};
-        auto piece_count =
-            (total_length / piece_length) + (total_length % piece_length != 0);
-        return piece_count == pieces_done;
+        return piece_count == pieces_done.load(std::memory_order_acquire);
     }
 
   public:
@@ -226,53 +374,76 @@ class Metadata: public std::enable_shared_from_this<Metadata> {
      * @param 
      * */
     void on_piece_complete(std::size_t piece_index) {
-        std::scoped_lock<std::mutex> lock {mutex};
-        const auto piece_count = pieces.size() / 20;
-        pieces_done += 1;
-        if (piece_index == piece_count - 1) {
-            // The last pieces can be a little bit shorter than usual pieces.
-            left -= total_length - (piece_count - 1) * piece_length;
-        } else {
-            left -= piece_length;
-        }
+        left.fetch_sub(get_piece_size(piece_index), std::memory_order_relaxed);
+        pieces_done.fetch_add(1, std::memory_order_acq_rel);
     }
 
     /*
      * Increases the member downloaded with the given amount.
      * */
     void increase_downloaded(std::size_t bytes_downloaded) {
-        std::scoped_lock<std::mutex> lock {mutex};
-        downloaded += bytes_downloaded;
+        downloaded.fetch_add(bytes_downloaded, std::memory_order_relaxed);
     }
 
     /*
      * Function will increase the uploaded amount by the given parameter.
      * */
     void increase_uploaded(std::size_t bytes_uploaded) {
-        std::scoped_lock<std::mutex> lock {mutex};
-        uploaded += bytes_uploaded;
+        uploaded.fetch_add(bytes_uploaded, std::memory_order_relaxed);
     }
 
   private:
+    /*
+     * Reads the file tree of a v2 info directory.
+     * Pure v2 torrents get their files from it, with a pad file after
+     *      every file that doesn't end at a piece.
+     * */
+    void load_file_tree(BencodeParser::Dictionary& info, bool has_v1);
+
+    /*
+     * Checks the piece layers against the pieces roots and
+     *      stores the root of every piece.
+     * @return False if the layer of a file is missing.
+     * */
+    bool load_piece_layers(BencodeParser::Dictionary& piece_layers);
+
+  private:
+    // Guards the on ready callback.
     mutable std::mutex mutex;
 
     std::string info_hash;
+    std::string info_hash_v2;
+    std::string info_bencode;
     std::vector<std::string> trackers; // A list of tracker URIs;
+    std::vector<std::string> web_seeds; // A list of web seed URLs.
 
     std::string name; // Name of the torrent.
     std::string
         file_name; // Name of the file we will write to while downloading.
     std::size_t piece_length = 0;
     std::size_t total_length = 0;
+    std::size_t block_count = 0;
     std::vector<std::pair<std::size_t, std::string>> files;
-
-    std::string pieces;
-
-    std::size_t downloaded = 0;
-    std::size_t uploaded = 0;
-    std::size_t left = 0;
-
-    std::size_t pieces_done = 0;
+    std::vector<bool> pad_files;
+    std::vector<Sha256Hash> pieces_roots;
+    bool single_file = true;
+    // Prefix sums of the file lengths. Has files.size() + 1 elements.
+    std::vector<std::size_t> file_offsets;
+
+    std::size_t piece_count = 0;
+    std::vector<Sha1Hash> piece_hashes; // Empty for pure v2 torrents.
+    std::vector<Sha256Hash> piece_hashes_v2; // Empty if checked with SHA1.
+    // Trees of the piece layers by file, empty if checked with SHA1.
+    std::vector<std::optional<MerkleTree>> piece_layer_trees;
+
+    // Transfer counters are updated for every block from every thread.
+    // Keep them on their own cache lines, away from the read mostly fields.
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> downloaded = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> uploaded = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> left = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> pieces_done = 0;
 };
 
 } // namespace torrent
@@ -0,0 +1,255 @@
+#ifndef TORRENT_METRICS_HPP
+#define TORRENT_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace torrent {
+
+namespace metrics_detail {
+
+static constexpr std::size_t SHARD_COUNT = 16;
+static constexpr std::size_t CACHE_LINE = 64;
+
+/*
+ * Returns the shard of the calling thread.
+ * Threads are given the shards in turns, so the threads running the
+ *      io_context rarely share a cache line when they update a metric.
+ * */
+inline std::size_t get_thread_shard() {
+    static std::atomic<std::size_t> next_shard = 0;
+    thread_local const std::size_t shard =
+        next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return shard;
+}
+
+} // namespace metrics_detail
+
+/*
+ * A value that only goes up, like the number of bytes downloaded.
+ * Every thread adds to its own shard with a relaxed atomic operation,
+ *      so it can be updated for every block. Reading sums the shards.
+ * */
+class Counter {
+  public:
+    void add(std::uint64_t value = 1) {
+        shards[metrics_detail::get_thread_shard()].value.fetch_add(
+            value,
+            std::memory_order_relaxed
+        );
+    }
+
+    std::uint64_t get() const {
+        std::uint64_t total = 0;
+        for (const auto& shard : shards) {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+  private:
+    struct alignas(metrics_detail::CACHE_LINE) Shard {
+        std::atomic<std::uint64_t> value = 0;
+    };
+    std::array<Shard, metrics_detail::SHARD_COUNT> shards;
+};
+
+/*
+ * A value that goes up and down, like the number of connected peers.
+ * */
+class Gauge {
+  public:
+    void set(std::int64_t new_value) {
+        value.store(new_value, std::memory_order_relaxed);
+    }
+
+    void add(std::int64_t amount = 1) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void sub(std::int64_t amount = 1) {
+        value.fetch_sub(amount, std::memory_order_relaxed);
+    }
+
+    std::int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<std::int64_t> value = 0;
+};
+
+/*
+ * Counts the observed values in buckets, like the latencies of requests.
+ * Buckets are given by their upper bounds in increasing order,
+ *      a last bucket without a bound holds everything bigger.
+ * Observing is lock free and sharded like the Counter.
+ * */
+class Histogram {
+  public:
+    explicit Histogram(std::vector<double> upper_bounds);
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void observe(double value);
+
+    /*
+     * Observes a duration in seconds.
+     * */
+    template<typename Rep, typename Period>
+    void observe(std::chrono::duration<Rep, Period> duration) {
+        observe(std::chrono::duration<double>(duration).count());
+    }
+
+    struct Snapshot {
+        // Number of observations in every bucket. Not cumulative.
+        std::vector<std::uint64_t> counts;
+        double sum = 0.0;
+    };
+
+    Snapshot get() const;
+
+    const std::vector<double>& get_upper_bounds() const {
+        return upper_bounds;
+    }
+
+  private:
+    struct alignas(metrics_detail::CACHE_LINE) Shard {
+        std::atomic<double> sum = 0.0;
+    };
+
+    std::vector<double> upper_bounds;
+    // One more than the bounds, the last one has no bound.
+    std::unique_ptr<Counter[]> buckets;
+    std::array<Shard, metrics_detail::SHARD_COUNT> sums;
+};
+
+/*
+ * Owns the metrics and writes them in the Prometheus text format.
+ * Metrics with the same name are a family, and are told apart by labels.
+ * Registering is locked and meant to be done up front. The returned
+ *      references stay valid as long as the registry.
+ * See: https://prometheus.io/docs/instrumenting/exposition_formats/
+ * */
+class MetricsRegistry {
+  public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    /*
+     * Registering the same name with the same labels again returns
+     *      the same metric.
+     * @throws std::runtime_error If the name is registered with another type.
+     * */
+    Counter& add_counter(
+        const std::string& name,
+        const std::string& help,
+        const Labels& labels = {}
+    );
+
+    Gauge& add_gauge(
+        const std::string& name,
+        const std::string& help,
+        const Labels& labels = {}
+    );
+
+    Histogram& add_histogram(
+        const std::string& name,
+        const std::string& help,
+        std::vector<double> upper_bounds,
+        const Labels& labels = {}
+    );
+
+    /*
+     * Returns every metric in the Prometheus text exposition format.
+     * */
+    std::string to_prometheus() const;
+
+  private:
+    using Metric = std::variant<
+        std::unique_ptr<Counter>,
+        std::unique_ptr<Gauge>,
+        std::unique_ptr<Histogram>>;
+
+    struct Family {
+        std::string help;
+        std::size_t type; // Index of the alternative in Metric.
+        std::vector<std::pair<Labels, Metric>> metrics;
+    };
+
+    /*
+     * Returns the metric with the labels. Creates it if it doesn't exist.
+     * mutex should be locked before calling this.
+     * */
+    Metric& find_metric(
+        const std::string& name,
+        const std::string& help,
+        std::size_t type,
+        const Labels& labels,
+        const std::function<Metric()>& create
+    );
+
+  private:
+    mutable std::mutex mutex;
+    // Ordered so the output is stable.
+    std::map<std::string, Family> families;
+};
+
+/*
+ * Statistics of a download session, registered under the torrent_ prefix.
+ * Shared by the parts of the client that update them.
+ * */
+class SessionMetrics {
+  public:
+    SessionMetrics();
+
+    SessionMetrics(const SessionMetrics&) = delete;
+    SessionMetrics& operator=(const SessionMetrics&) = delete;
+
+    std::string to_prometheus() const {
+        return registry.to_prometheus();
+    }
+
+  private:
+    MetricsRegistry registry;
+
+  public:
+    Counter& downloaded_bytes;
+    Counter& uploaded_bytes;
+    Counter& pieces_completed;
+    Counter& hash_failures;
+
+    // From the piece being assigned to a peer until it passes SHA1.
+    Histogram& piece_seconds;
+    // From a block being requested until it arrives.
+    Histogram& request_seconds;
+    // From an announce being sent until the tracker answers.
+    Histogram& tracker_seconds;
+
+    // Reads and writes submitted to the file that are not complete.
+    Gauge& disk_queue_depth;
+    // Bytes of the block and piece buffers held by the disk operations.
+    Gauge& disk_buffer_bytes;
+
+    // Number of peers in every state, indexed by Peer::State.
+    //      Peers in the Disconnected state are still connecting.
+    static constexpr std::size_t PEER_STATE_COUNT = 5;
+    std::array<Gauge*, PEER_STATE_COUNT> peers;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,59 @@
+#ifndef TORRENT_METRICS_SERVER_HPP
+#define TORRENT_METRICS_SERVER_HPP
+
+#include <cstdint>
+#include <memory>
+
+#include "http_server.hpp"
+#include "metrics.hpp"
+
+namespace torrent {
+
+/*
+ * Serves the session metrics over HTTP on the loopback interface.
+ * GET /metrics returns them in the Prometheus text format,
+ *      so the client can be scraped while it is downloading.
+ * Must be owned by a shared_ptr, like RangeServer.
+ * */
+class MetricsServer: public std::enable_shared_from_this<MetricsServer> {
+  public:
+    MetricsServer(
+        asio::io_context& io_context_ref,
+        std::uint16_t server_port,
+        std::shared_ptr<SessionMetrics> metrics_ptr
+    );
+
+    /*
+     * @throws boost::system::system_error if the port can't be bound.
+     * */
+    void start();
+
+    void stop() {
+        if (server) {
+            server->stop();
+        }
+    }
+
+    /*
+     * Should be called after start().
+     * */
+    std::uint16_t get_port() const {
+        return server->get_port();
+    }
+
+  private:
+    void on_request(
+        const HttpServer::Request& request,
+        std::shared_ptr<HttpServer::Session> session
+    );
+
+  private:
+    std::shared_ptr<SessionMetrics> metrics;
+
+    asio::io_context& io_context;
+    std::uint16_t port;
+    std::shared_ptr<HttpServer> server;
+};
+
+} // namespace torrent
+#endif
@@ -5,16 +5,25 @@
 #include <boost/asio/ip/address_v4.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/dynamic_bitset.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cctype>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <sstream>
+#include <utility>
 #include <vector>
 
 #include "bitfield.hpp"
+#include "log.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
+#include "rate_meter.hpp"
+#include "transport.hpp"
 
 namespace torrent {
 
@@ -33,36 +42,36 @@ class Peer: public std::enable_shared_from_this<Peer> {
         DownloadingPiece
     };
 
+    /*
+     * The peer does nothing until it is owned by a shared_ptr and
+     *      started, since its handlers hold it by one. Outgoing peers
+     *      start with connect(), accepted ones by moving them to
+     *      State::Connected, see PeerManager::add_incoming.
+     * @param peer_stream Either connected by the acceptor,
+     *      or to be connected to the endpoint with connect().
+     * */
     Peer(
-        PeerManager& peer_manager_ref,
+        std::shared_ptr<PeerManager> peer_manager_ptr,
         asio::io_context& io_context_ref,
+        std::unique_ptr<Stream> peer_stream,
+        std::unique_ptr<Timer> peer_timer,
         tcp::endpoint peer_endpoint
     ) :
         io_context(io_context_ref),
-        socket(io_context_ref),
+        stream(std::move(peer_stream)),
         endpoint(std::move(peer_endpoint)),
-        peer_manager(peer_manager_ref),
-        timer(io_context_ref) {}
-
-    Peer(
-        PeerManager& peer_manager_ref,
-        asio::io_context& io_context_ref,
-        tcp::socket peer_socket
-    ) :
-        io_context(io_context_ref),
-        socket(std::move(peer_socket)),
-        endpoint(socket.remote_endpoint()),
-        peer_manager(peer_manager_ref),
-        timer(io_context_ref) {
-        change_state(State::Connected);
-    }
+        peer_manager(std::move(peer_manager_ptr)),
+        timer(std::move(peer_timer)) {}
 
     Peer(Peer&& peer) :
         io_context(peer.io_context),
-        socket(std::move(peer.socket)),
+        stream(std::move(peer.stream)),
         endpoint(std::move(peer.endpoint)),
         peer_manager(peer.peer_manager),
-        timer(io_context) {}
+        state_gauge(std::exchange(peer.state_gauge, nullptr)),
+        timer(std::move(peer.timer)) {}
+
+    ~Peer();
 
     Peer(const Peer&) = delete;
     const Peer& operator=(const Peer&) = delete;
@@ -73,22 +82,58 @@ class Peer: public std::enable_shared_from_this<Peer> {
 
     void connect();
 
-    friend std::ostream& operator<<(std::ostream& os, const Peer& peer) {
-        os << "Peer{ ";
-        if (!peer.remote_peer_id.empty()) {
-            for (const auto c : peer.remote_peer_id) {
-                if (std::isprint(c)) {
-                    os << c;
-                } else {
-                    os << "\\x" << std::hex << static_cast<int>(c);
+    /*
+     * Closes the connection. The peer gets removed once its
+     *      pending operations fail.
+     * */
+    void disconnect() {
+        asio::post(io_context, [self = get_ptr()] { self->stream->close(); });
+    }
+
+    /*
+     * What identifies the peer in the log. Copied so the peer can be
+     *      logged without formatting it on the calling thread.
+     * */
+    struct LogName {
+        tcp::endpoint endpoint;
+        std::array<char, 20> peer_id;
+        bool has_peer_id;
+
+        friend std::ostream& operator<<(std::ostream& os, const LogName& name) {
+            os << "Peer{ ";
+            if (name.has_peer_id) {
+                for (const auto c : name.peer_id) {
+                    if (std::isprint(c)) {
+                        os << c;
+                    } else {
+                        os << "\\x" << std::hex << static_cast<int>(c);
+                    }
                 }
+                os << std::dec;
+            } else {
+                os << name.endpoint;
             }
-            os << std::dec;
-        } else {
-            os << peer.endpoint;
+            os << " }";
+            return os;
         }
-        os << " }";
-        return os;
+    };
+
+    LogName get_log_name() const {
+        LogName name {endpoint, {}, !remote_peer_id.empty()};
+        std::copy_n(
+            remote_peer_id.begin(),
+            std::min(remote_peer_id.size(), name.peer_id.size()),
+            name.peer_id.begin()
+        );
+        return name;
+    }
+
+    friend LogName to_log_value(const Peer& peer) {
+        return peer.get_log_name();
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Peer& peer) {
+        return os << peer.get_log_name();
     }
 
     std::string to_string() const {
@@ -109,10 +154,25 @@ class Peer: public std::enable_shared_from_this<Peer> {
         return endpoint;
     }
 
+    /*
+     * Returns the rate we are downloading from this peer in bytes per second.
+     * */
+    std::size_t get_download_rate() {
+        return download_rate.get_rate();
+    }
+
     friend class PeerManager;
 
   private:
+    using Clock = std::chrono::steady_clock;
+
     void change_state(State new_state);
+
+    /*
+     * Moves the peer to the gauge of its state in the metrics.
+     * */
+    void set_state_gauge(Gauge* gauge);
+
     void listen_peer();
     void listen_message();
 
@@ -121,13 +181,13 @@ class Peer: public std::enable_shared_from_this<Peer> {
 
     template<typename... Func>
     void send_message(Message message, Func... func) {
-        std::string message_str = message.to_string();
+        const auto summary = message.get_summary();
         auto buffer_ptr =
             std::make_shared<std::vector<std::uint8_t>>(message.into_bytes());
 
         send_message_impl(
             std::move(buffer_ptr),
-            std::move(message_str),
+            summary,
             0,
             func...
         );
@@ -136,38 +196,38 @@ class Peer: public std::enable_shared_from_this<Peer> {
     template<typename... Func>
     void send_message_impl(
         std::shared_ptr<std::vector<std::uint8_t>> buffer_ptr,
-        std::string message_str,
+        Message::Summary summary,
         std::size_t start,
         Func... func
     ) {
-        socket.async_send(
+        // The buffer is ours, so an encrypted stream can encrypt it in place.
+        stream->async_write_some_in_place(
             asio::buffer(
                 buffer_ptr->data() + start,
                 buffer_ptr->size() - start
             ),
             [self = get_ptr(),
              buffer_ptr,
-             str = std::move(message_str),
+             summary,
+             start,
              func...](const auto& error, const auto bytes_send) {
                 if (error) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << "Error while sending a message to " << *self << ": "
                         << error.message();
-                } else if (buffer_ptr->size() != bytes_send) {
+                } else if (buffer_ptr->size() != start + bytes_send) {
                     // Message is not sent fully.
                     // Send the remaining part of the message.
                     self->send_message_impl(
                         std::move(buffer_ptr),
-                        std::move(str),
-                        bytes_send,
+                        summary,
+                        start + bytes_send,
                         func...
                     );
                 } else {
                 // Sent the message.
-#ifndef NDEBUG
-                    BOOST_LOG_TRIVIAL(debug)
-                        << "Sent " << str << " to " << *self;
-#endif
+                    TORRENT_LOG(debug)
+                        << "Sent " << summary << " to " << *self;
                     (func(self), ...);
                 }
             }
@@ -175,12 +235,41 @@ class Peer: public std::enable_shared_from_this<Peer> {
     }
 
     void on_message(Message message);
+
+    /*
+     * Requests the blocks of the current piece in batches.
+     * Blocks that are already written are skipped, so a piece that
+     *      lost some bad blocks only gets those downloaded again.
+     * */
     void send_requests();
+
+    /*
+     * Asks the peer for the leaf hashes of a v2 piece.
+     * */
+    void send_hash_request(std::size_t piece_index);
+
+    /*
+     * Answers a hash request with the hashes of a layer of a file tree.
+     * Served are whole pieces of the leaf layer of the pieces we have,
+     *      and ranges of the piece layer. Others are rejected.
+     * */
+    void on_hash_request(const Message& message);
+
+    /*
+     * Adds the leaf hashes a peer sent for one of our hash requests.
+     * */
+    void on_hashes(const Message& message);
+
+    /*
+     * Reads the requested block from the disk and sends it to the peer.
+     * */
+    void
+    send_block(std::uint32_t index, std::uint32_t begin, std::uint32_t length);
     void assign_piece();
 
   private:
     asio::io_context& io_context;
-    tcp::socket socket;
+    std::unique_ptr<Stream> stream;
     tcp::endpoint endpoint;
 
     std::vector<std::uint8_t> buffer;
@@ -189,30 +278,47 @@ class Peer: public std::enable_shared_from_this<Peer> {
     std::string remote_peer_id;
 
     State state = State::Disconnected;
-    PeerManager& peer_manager;
+    // Kept alive until the handlers of the peer are called.
+    std::shared_ptr<PeerManager> peer_manager;
     PieceIndex current_piece_index;
 
     std::mutex mutex;
     std::size_t current_block = 0;
     std::size_t piece_received = 0;
+    std::size_t requests_sent = 0; // Requests in the current batch.
+
+    RateMeter download_rate;
+    RateMeter upload_rate;
+
+    Gauge* state_gauge = nullptr;
+    Clock::time_point piece_start; // When the current piece was assigned.
+    Clock::time_point request_time; // When the last requests were sent.
 
     // Constants
     static constexpr std::size_t REQUEST_COUNT_PER_CALL = 6;
     static constexpr std::size_t MAX_MESSAGE_LENGTH = 1 << 17;
+    // Pieces root and the four integers that start the hash messages.
+    static constexpr std::size_t HASH_HEADER_LENGTH = 48;
+    static constexpr std::size_t MAX_HASH_COUNT = 512;
 
-    asio::steady_timer timer;
+    std::unique_ptr<Timer> timer;
 
   private:
-    bool am_choking = true;
-    bool am_interested = false;
-    bool peer_choking = true;
-    bool peer_interested = false;
+    // Atomic so the statistics can be read from other threads.
+    std::atomic<bool> am_choking = true;
+    std::atomic<bool> am_interested = false;
+    std::atomic<bool> peer_choking = true;
+    std::atomic<bool> peer_interested = false;
 
     bool handshook = false;
+    // Set in the reserved bytes of its handshake, see BEP52.
+    std::atomic<bool> supports_v2 = false;
 
     // Bitfield of the remote peer.
     // Ours is stored in pieces and shared among peers.
     std::unique_ptr<Bitfield> peer_bitfield;
+    // Whether peer_bitfield is counted in the availability of the picker.
+    std::atomic<bool> availability_counted = false;
 };
 
 } // namespace torrent
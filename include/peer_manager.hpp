@@ -3,28 +3,95 @@
 
 #include <boost/lockfree/queue.hpp>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "bandwidth_limit.hpp"
+#include "encrypted_stream.hpp"
 #include "peer.hpp"
 #include "pieces.hpp"
+#include "transport.hpp"
 
 namespace torrent {
 
-class PeerManager {
+/*
+ * Owns the peers of a torrent. Peers keep their manager alive while
+ *      their handlers are pending, so it is created through create().
+ * */
+class PeerManager: public std::enable_shared_from_this<PeerManager> {
+  private:
+    struct Private {
+        explicit Private() = default;
+    };
+
   public:
     PeerManager(
+        Private,
         asio::io_context& io_context_ref,
+        std::shared_ptr<Transport> transport_ptr,
         std::uint16_t port,
         std::shared_ptr<Pieces> pieces_ptr,
         std::shared_ptr<Metadata> metadata_ptr
     ) :
         pieces(std::move(pieces_ptr)),
         metadata(std::move(metadata_ptr)),
+        metrics(pieces->metrics),
         io_context(io_context_ref),
-        acceptor(io_context, tcp::endpoint(tcp::v4(), port)),
-        new_peer_socket(io_context) {}
+        transport(std::move(transport_ptr)),
+        acceptor(transport->create_acceptor(port)) {}
+
+    static std::shared_ptr<PeerManager> create(
+        asio::io_context& io_context,
+        std::shared_ptr<Transport> transport,
+        std::uint16_t port,
+        std::shared_ptr<Pieces> pieces,
+        std::shared_ptr<Metadata> metadata
+    ) {
+        auto manager = std::make_shared<PeerManager>(
+            Private {},
+            io_context,
+            std::move(transport),
+            port,
+            std::move(pieces),
+            std::move(metadata)
+        );
+        // Pieces may call them after the manager is gone.
+        manager->pieces->set_on_piece_failed(
+            [weak = manager->weak_from_this()](
+                std::size_t piece_index,
+                const auto& sources
+            ) {
+                if (const auto self = weak.lock()) {
+                    self->on_hash_failure(piece_index, sources);
+                }
+            }
+        );
+        manager->pieces->set_on_hashes_needed(
+            [weak = manager->weak_from_this()](std::size_t piece_index) {
+                if (const auto self = weak.lock()) {
+                    self->request_hashes(piece_index);
+                }
+            }
+        );
+        return manager;
+    }
+
+    /*
+     * Pieces outlives us through its disk operations and the web seeds,
+     *      so the handlers pointing to this are removed from it.
+     * */
+    ~PeerManager() {
+        pieces->set_on_piece_failed(nullptr);
+        pieces->set_on_hashes_needed(nullptr);
+    }
+
+    PeerManager(const PeerManager&) = delete;
+    PeerManager& operator=(const PeerManager&) = delete;
 
     /*
      * Creates a new peer with the given endpoint if it does not already exist.
@@ -44,19 +111,140 @@ class PeerManager {
 
     /*
      * Other peers might try to connect with us. Accept them through this function.
+     * The handshake should be calculated before calling this.
      * */
     void accept_new_peers();
 
     void on_handshake(Peer& peer);
 
+    /*
+     * Blames the peers that sent a piece which failed the hash check.
+     * A peer that sent the whole piece alone gets a strike, and is banned
+     *      after MAX_HASH_FAILURES strikes.
+     * If several peers sent blocks of it we can't tell who is at fault,
+     *      so they are all put on parole. Peers on parole download
+     *      every piece alone until one of them passes.
+     * */
+    void on_hash_failure(
+        std::size_t piece_index,
+        const std::vector<address>& sources
+    );
+
+    /*
+     * Asks a v2 peer that has the piece for the leaf hashes of its blocks.
+     * */
+    void request_hashes(std::size_t piece_index);
+
+    /*
+     * Must be called when a peer sends a piece that passes the hash check.
+     * */
+    void on_piece_passed(const address& peer_address);
+
+    bool is_on_parole(const address& peer_address) {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return parole.contains(peer_address);
+    }
+
+    bool is_banned(const address& peer_address) {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return banned.contains(peer_address);
+    }
+
+    /*
+     * Limits the rates of all the peers. A limit can be shared with
+     *      other torrents. Should be called before any peer is added.
+     * @param download, upload Can be nullptr for no limit.
+     * */
+    void set_bandwidth_limits(
+        std::shared_ptr<BandwidthLimit> download,
+        std::shared_ptr<BandwidthLimit> upload
+    ) {
+        download_limit = std::move(download);
+        upload_limit = std::move(upload);
+    }
+
+    /*
+     * Sets whether the connections are encrypted with MSE.
+     * Should be called before any peer is added.
+     * */
+    void set_encryption(EncryptionPolicy policy) {
+        encryption = policy;
+    }
+
+    /*
+     * Calls the handler once the bytes fit in the download limit.
+     * Right away if they already fit.
+     * */
+    void throttle_download(std::size_t bytes, std::function<void()> handler) {
+        throttle(download_limit.get(), bytes, std::move(handler));
+    }
+
+    /*
+     * Calls the handler once the bytes fit in the upload limit.
+     * Right away if they already fit.
+     * */
+    void throttle_upload(std::size_t bytes, std::function<void()> handler) {
+        throttle(upload_limit.get(), bytes, std::move(handler));
+    }
+
   private:
     void send_all_messages();
 
+    void throttle(
+        BandwidthLimit* limit,
+        std::size_t bytes,
+        std::function<void()> handler
+    );
+
+    /*
+     * Starts a peer on a connection accepted from a remote peer.
+     * */
+    void add_incoming(std::unique_ptr<Stream> stream);
+
+    /*
+     * Puts the stream under MSE unless the encryption is disabled.
+     * */
+    std::unique_ptr<Stream>
+    wrap_stream(std::unique_ptr<Stream> stream, EncryptedStream::Role role);
+
+    /*
+     * Disconnects every peer with the address and refuses them later on.
+     * mutex should be locked before calling this.
+     * */
+    void ban(const address& peer_address);
+
   public:
+    /*
+     * Transfer statistics of a connected peer.
+     * */
+    struct PeerInfo {
+        tcp::endpoint endpoint;
+        std::size_t downloaded; // Total bytes received from the peer.
+        std::size_t download_rate; // Bytes per second.
+        std::size_t uploaded; // Total bytes sent to the peer.
+        std::size_t upload_rate; // Bytes per second.
+        bool am_choking;
+        bool am_interested;
+        bool peer_choking;
+        bool peer_interested;
+    };
+
+    /*
+     * Returns the statistics of the peers we are connected to.
+     * */
+    std::vector<PeerInfo> get_peer_infos();
+
     std::size_t peer_count() const {
         return peers.size();
     }
 
+    /*
+     * Returns the port the incoming peers are accepted on.
+     * */
+    std::uint16_t get_port() const {
+        return acceptor->get_port();
+    }
+
     const auto& get_handshake() {
         return handshake;
     }
@@ -66,23 +254,36 @@ class PeerManager {
     }
 
     /*
-     * Deletes all peers and drops connections.
+     * Deletes all peers, drops connections and stops accepting new peers.
+     * Peers added after this are ignored.
      * */
     void stop() {
         std::scoped_lock<std::mutex> lock {mutex};
+        stopped = true;
+        acceptor->close();
+        for (const auto& [endpoint, peer] : peers) {
+            peer->disconnect();
+        }
         peers.clear();
     }
 
   public:
     std::shared_ptr<Pieces> pieces;
     std::shared_ptr<Metadata> metadata;
+    // Same as the metrics of the pieces.
+    std::shared_ptr<SessionMetrics> metrics;
 
   private:
     asio::io_context& io_context;
-    tcp::acceptor acceptor;
-    tcp::socket new_peer_socket;
+    std::shared_ptr<Transport> transport;
+    std::unique_ptr<Acceptor> acceptor;
+
+    std::shared_ptr<BandwidthLimit> download_limit;
+    std::shared_ptr<BandwidthLimit> upload_limit;
+    EncryptionPolicy encryption = EncryptionPolicy::Disabled;
 
     std::mutex mutex;
+    bool stopped = false;
 
     static constexpr std::size_t HANDSHAKE_SIZE = 68;
     std::array<std::uint8_t, HANDSHAKE_SIZE> handshake;
@@ -90,6 +291,13 @@ class PeerManager {
     int active_peers = 0;
 
     std::unordered_map<tcp::endpoint, std::shared_ptr<Peer>> peers;
+
+    // Hash failures are tracked by address, so reconnecting doesn't help.
+    std::unordered_map<address, std::size_t> hash_failures;
+    std::unordered_set<address> parole;
+    std::unordered_set<address> banned;
+
+    static constexpr std::size_t MAX_HASH_FAILURES = 3;
 };
 } // namespace torrent
 
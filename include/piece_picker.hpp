@@ -0,0 +1,240 @@
+#ifndef TORRENT_PIECE_PICKER_HPP
+#define TORRENT_PIECE_PICKER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "bitfield.hpp"
+
+namespace torrent {
+
+/*
+ * Download priority of a file or a piece.
+ * Pieces with a higher priority are picked first.
+ * Skipped pieces are never picked.
+ * */
+enum class Priority : std::uint8_t {
+    Skip = 0,
+    Low = 1,
+    Normal = 2,
+    High = 3,
+};
+
+/*
+ * A thread safe class that decides which piece a peer should download next.
+ * Our own Bitfield only holds the pieces we have,
+ *      while the picker also knows which pieces are being downloaded
+ *      and which of them we actually want.
+ * */
+class PiecePicker {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    PiecePicker(std::size_t piece_count) :
+        pieces(piece_count),
+        wanted_left(piece_count) {}
+
+    /*
+     * Assigns the most important available piece regarding the peer_bitfield.
+     * Pieces with a deadline are picked first, earliest deadline first.
+     *      Urgent ones are only given to the fastest peers, and they may be
+     *      assigned to a second fast peer if the deadline is close.
+     * Otherwise among pieces with the same priority the first one is picked.
+     * Other peers may not assign themselfs this piece until it gets unassigned.
+     * @param peer_bitfield Bitfield of the peer.
+     * @param peer_rate Download rate of the peer in bytes per second.
+     * @param exclusive Only assign pieces nobody else is downloading,
+     *      and don't let others join. Used for peers on parole.
+     * @return A piece index. Empty if it can't find any valid piece.
+     * */
+    PieceIndex assign_piece(
+        Bitfield& peer_bitfield,
+        std::size_t peer_rate = 0,
+        bool exclusive = false
+    );
+
+    /*
+     * Assigns the given piece if nobody is downloading it and we want it.
+     * Used to extend a download to the following pieces.
+     * @return True if the piece is assigned.
+     * */
+    bool try_assign(std::size_t piece_index);
+
+    /*
+     * Must be called if there was an error while downloading the piece.
+     * It will unassign the piece so it can be picked again.
+     * Should be called once for every assignment of the piece.
+     * */
+    void piece_failed(PieceIndex piece_index);
+
+    /*
+     * Must be called when the piece fails the hash check.
+     * From now on the piece is downloaded by a single peer at a time,
+     *      so the peer that sends bad data can be found.
+     * The peers downloading it should still call piece_failed.
+     * */
+    void set_hash_failed(std::size_t piece_index);
+
+    /*
+     * Must be called once every block of the piece is written.
+     * The piece is not assigned again while its hash is checked,
+     *      even if the peers downloading it call piece_failed.
+     * */
+    void set_checking(std::size_t piece_index);
+
+    /*
+     * Must be called when the check of the piece fails, after
+     *      set_hash_failed if the hash was wrong.
+     * The piece can be assigned again once its peers let it go.
+     * */
+    void set_check_failed(std::size_t piece_index);
+
+    /*
+     * Sets the time the piece is needed by. Used for streaming.
+     * The deadline is removed when the piece is downloaded.
+     * */
+    void set_deadline(std::size_t piece_index, Clock::time_point deadline);
+
+    /*
+     * Removes every deadline. Pieces are picked by their priority again.
+     * */
+    void clear_deadlines();
+
+    /*
+     * Marks the piece as downloaded and verified.
+     * The piece will not be assignable anymore.
+     * @return True if this was the last piece we wanted.
+     *      Only one call returns true even if pieces finish concurrently.
+     * */
+    bool set_have(std::size_t piece_index);
+
+    /*
+     * Sets the priority of the pieces in range [first_piece, last_piece].
+     * */
+    void set_priority(
+        std::size_t first_piece,
+        std::size_t last_piece,
+        Priority priority
+    );
+
+    Priority get_priority(std::size_t piece_index);
+
+    /*
+     * Returns true if every piece we want is downloaded.
+     * */
+    bool is_complete() {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return wanted_left == 0;
+    }
+
+    /*
+     * Returns the number of wanted pieces that are not downloaded yet.
+     * */
+    std::size_t get_wanted_left() {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return wanted_left;
+    }
+
+    /*
+     * Counts the pieces of a peer in their availability.
+     * Must be undone with remove_peer once the peer is gone.
+     * */
+    void add_peer(Bitfield& peer_bitfield);
+
+    void remove_peer(Bitfield& peer_bitfield);
+
+    /*
+     * Counts a piece a peer announced with a Have message.
+     * */
+    void add_have(std::size_t piece_index);
+
+    enum class PieceStatus : std::uint8_t {
+        Missing,
+        Downloading,
+        Have,
+        Skipped,
+    };
+
+    struct PieceInfo {
+        PieceStatus status;
+        std::uint16_t availability; // Number of peers that have the piece.
+    };
+
+    /*
+     * Returns the status of every piece.
+     * */
+    std::vector<PieceInfo> get_piece_infos();
+
+  private:
+    enum class State : std::uint8_t {
+        Missing,
+        Assigned,
+        Checking, // Every block is written, the hash is being checked.
+        Have,
+    };
+
+    struct Piece {
+        State state = State::Missing;
+        Priority priority = Priority::Normal;
+        // Number of peers downloading this piece.
+        // Still counted while the piece is checked.
+        std::uint8_t assigned = 0;
+        // Assigned to a peer on parole. Nobody else may download it.
+        bool exclusive = false;
+        // Failed the hash check before. Never downloaded by two peers.
+        bool hash_failed = false;
+        // Number of connected peers that have this piece.
+        std::uint16_t availability = 0;
+    };
+
+    static bool is_wanted(const Piece& piece) {
+        return piece.priority != Priority::Skip && piece.state != State::Have;
+    }
+
+    /*
+     * Picks the piece with the earliest deadline the peer can download.
+     * Does not use any locks.
+     * */
+    PieceIndex assign_deadline_piece(
+        const std::vector<std::uint8_t>& peer_vec,
+        std::size_t peer_rate,
+        bool exclusive
+    );
+
+    /*
+     * Adds the amount to the availability of the pieces the peer has.
+     * */
+    void add_availability(Bitfield& peer_bitfield, int amount);
+
+    static bool has_piece(
+        const std::vector<std::uint8_t>& peer_vec,
+        std::size_t piece_index
+    ) {
+        return (peer_vec[piece_index / 8] >> (7 - (piece_index % 8))) & 1;
+    }
+
+    // Pieces closer than this to their deadline are urgent.
+    static constexpr auto URGENT_WINDOW = std::chrono::seconds(3);
+    // How many peers may download an urgent piece at the same time.
+    static constexpr std::uint8_t MAX_ASSIGNED = 2;
+
+  private:
+    std::vector<Piece> pieces;
+
+    // Number of pieces that are not skipped and not downloaded.
+    std::size_t wanted_left;
+
+    // Piece index to deadline. Only holds pieces that are not downloaded.
+    std::map<std::size_t, Clock::time_point> deadlines;
+
+    // Rate of the fastest peer seen recently, decays on every assignment.
+    std::size_t fastest_rate = 0;
+
+    std::mutex mutex;
+};
+
+} // namespace torrent
+#endif
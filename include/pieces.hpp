@@ -7,17 +7,30 @@
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/file_base.hpp>
 #include <boost/asio/io_context.hpp>
-#include <boost/log/trivial.hpp>
 #include <boost/uuid/detail/sha1.hpp>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "async_file.hpp"
 #include "bitfield.hpp"
+#include "file_pool.hpp"
+#include "log.hpp"
+#include "merkle.hpp"
 #include "metadata.hpp"
+#include "metrics.hpp"
+#include "piece_picker.hpp"
+#include "trace.hpp"
 
 namespace torrent {
 
@@ -33,23 +46,68 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
     };
 
   public:
+    /*
+     * Result of writing a block.
+     * */
+    enum class BlockResult {
+        Written, // Piece is not complete yet.
+        PieceComplete, // Last block is written and the piece passed SHA1.
+        PieceFailed, // Last block is written and the piece failed SHA1.
+        BlockFailed, // Block failed its trusted v2 leaf hash, not written.
+    };
+
+    /*
+     * How the disk space of the download file is allocated.
+     * */
+    enum class Allocation {
+        // Blocks are allocated as they are written. Random writes of
+        //      16 KiB blocks fragment the file on most file systems.
+        Sparse,
+        // The whole file is allocated up front, skipped files too.
+        Full,
+        // Runs of ALLOCATION_EXTENT bytes are allocated when a piece
+        //      in them is first written.
+        Extents,
+    };
+
+    using BlockSource = asio::ip::address;
+
+    using ReadHandler =
+        std::function<void(const boost::system::error_code&, std::size_t)>;
+    using WriteHandler = ReadHandler;
+
     Pieces(
         Private,
         asio::io_context& io_context_ref,
-        std::shared_ptr<Metadata> metadata_ptr
+        std::shared_ptr<Metadata> metadata_ptr,
+        std::shared_ptr<SessionMetrics> metrics_ptr
     ) :
-        file(io_context_ref),
+        metrics(std::move(metrics_ptr)),
+        io_context(io_context_ref),
+        write_timer(io_context_ref),
         metadata(std::move(metadata_ptr)) {}
 
+    ~Pieces() {
+        if (!file_path.empty()) {
+            file_pool->release(file_path);
+        }
+    }
+
     /*
      * Creates a new Pieces object with given metadata. 
+     * @param metrics Disk and hash statistics are counted in it.
      * */
-    static std::shared_ptr<Pieces>
-    create(asio::io_context& io_context, std::shared_ptr<Metadata> metadata) {
+    static std::shared_ptr<Pieces> create(
+        asio::io_context& io_context,
+        std::shared_ptr<Metadata> metadata,
+        std::shared_ptr<SessionMetrics> metrics =
+            std::make_shared<SessionMetrics>()
+    ) {
         return std::make_shared<Pieces>(
             Private {},
             io_context,
-            std::move(metadata)
+            std::move(metadata),
+            std::move(metrics)
         );
     }
 
@@ -67,18 +125,86 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
      * Opens the output file if it exists and runs a SHA1 checksum over it.
      * Creates it if it does not.
      * Metadata should be ready before this function gets called.
+     * @param priorities Download priorities of the files in the torrent.
+     *      Missing values default to Priority::Normal.
+     * */
+    void init_file(std::vector<Priority> priorities = {});
+
+    /*
+     * Returns true once init_file created the picker and opened the file.
+     * Other threads check this before they touch the picker.
      * */
-    void init_file();
+    bool is_initialized() const {
+        return initialized.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Sets the directory the torrent is downloaded and extracted to.
+     * Should be called before init_file. Defaults to the working directory.
+     * */
+    void set_download_directory(std::filesystem::path directory) {
+        download_directory = std::move(directory);
+    }
+
+    /*
+     * Sets whether the files are extracted from the download file
+     *      once the torrent is complete. Should be called before init_file.
+     * */
+    void set_extract_files(bool extract) {
+        extract_files = extract;
+    }
+
+    /*
+     * Sets the pool the file is opened through. Torrents that share
+     *      a pool share its limit of open files.
+     * Should be called before init_file. Defaults to a pool of its own.
+     * */
+    void set_file_pool(std::shared_ptr<FilePool> pool) {
+        file_pool = std::move(pool);
+    }
+
+    /*
+     * Sets how the disk space is allocated. Should be called before
+     *      init_file. File systems without fallocate fall back to sparse.
+     * */
+    void set_allocation(Allocation mode) {
+        allocation = mode;
+    }
+
+    /*
+     * Changes the priority of a file while downloading.
+     * Pieces that only overlap skipped files are not downloaded,
+     *      and skipped files are not extracted.
+     * */
+    void set_file_priority(std::size_t file_index, Priority priority);
+
+    /*
+     * Starts streaming from the given offset of the torrent.
+     * The pieces after the offset get deadlines as if they were consumed
+     *      at bytes_per_second starting from now. The window moves forward
+     *      as the pieces get downloaded.
+     * Calling it again moves the read position, e.g. after a seek.
+     * */
+    void set_stream_position(std::size_t offset, std::size_t bytes_per_second);
+
+    /*
+     * Stops streaming. Pieces are picked by their priorities again.
+     * */
+    void clear_stream_position();
 
     /*
      * Writes given block to the file async.
+     * The source of every block is remembered until the piece is checked,
+     *      so the peers that sent a bad piece can be found.
+     * @param source Address of the peer that sent the block.
      * @param on_finish A function that will be called when
-     *      the operation finishes. Signature should be on_finish(const asio::error_code& error_code, bool piece_complete).
+     *      the operation finishes. Signature should be on_finish(const asio::error_code& error_code, BlockResult result).
      * */
     void write_block_async(
         std::uint32_t piece_index,
         std::uint32_t begin,
         std::vector<std::uint8_t> payload,
+        BlockSource source,
         const auto on_finish
     ) {
         if (piece_index >= piece_count || begin > piece_length) {
@@ -90,34 +216,141 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
 
         const std::size_t block_size = payload_ptr->size() - 8;
 
-        file.async_write_some_at(
+        allocate_range(piece_index * piece_length + begin, block_size);
+        trace::Span span {"disk_write_submit", piece_index};
+        const auto submitted = trace::now();
+        start_disk_operation(payload_ptr->size());
+        queue_write(
             piece_index * piece_length + begin,
             asio::buffer(payload_ptr->data() + 8, block_size),
-            [=, this](const auto& error_code, std::size_t bytes_transferred) {
+            [=, this, self = get_ptr()](
+                const auto& error_code,
+                std::size_t bytes_transferred
+            ) {
+                trace::record_async("disk_write", submitted, piece_index);
+                finish_disk_operation(payload_ptr->size());
                 if (error_code) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << "Error while writing to the file: "
                         << error_code.message();
-                    on_finish(error_code, false);
-                } else {
-                    assert(bytes_transferred == block_size);
-                    // The last pieces can be a little bit shorter than usual pieces.
-                    // Check either this is the last block or the last block of the file.
-                    // We can do this because our client will always
-                    //   request blocks from start to end.
-                    if (begin + block_size >= piece_length
-                        || (piece_index * piece_length) + begin + block_size
-                            >= file.size()) {
-                        // Run an SHA1 check for this piece.
-                        check_sha1_piece_async(piece_index, on_finish);
-                    } else {
-                        on_finish(error_code, false);
+                    on_finish(error_code, BlockResult::Written);
+                    return;
+                }
+                assert(bytes_transferred == block_size);
+                const std::string_view block {
+                    reinterpret_cast<const char*>(payload_ptr->data() + 8),
+                    block_size
+                };
+                // The piece is checked once all of its blocks are written,
+                //      whichever order they arrive in.
+                switch (add_block(piece_index, begin, block, source)) {
+                    case BlockStatus::Missing:
+                        on_finish(error_code, BlockResult::Written);
+                        return;
+                    case BlockStatus::Bad:
+                        on_finish(error_code, BlockResult::BlockFailed);
+                        return;
+                    case BlockStatus::Complete:
+                        break;
+                }
+                if (metadata->has_v2()) {
+                    // Leaves are hashed as the blocks arrive,
+                    //      so the piece is not read back.
+                    if (check_piece_leaves(piece_index)) {
+                        take_block_sources(piece_index);
+                        on_finish(error_code, BlockResult::PieceComplete);
+                        return;
                     }
+                    on_hash_failure(piece_index);
+                    on_finish(error_code, BlockResult::PieceFailed);
+                    return;
                 }
+                // Run an SHA1 check for this piece.
+                check_sha1_piece_async(
+                    piece_index,
+                    [=, this](const auto& check_error, bool sha1_passed) {
+                        if (sha1_passed) {
+                            take_block_sources(piece_index);
+                            on_finish(check_error, BlockResult::PieceComplete);
+                            return;
+                        }
+                        if (!check_error) {
+                            on_hash_failure(piece_index);
+                        } else {
+                            // Could not read it back, download it again.
+                            take_block_sources(piece_index);
+                            picker->set_check_failed(piece_index);
+                        }
+                        on_finish(check_error, BlockResult::PieceFailed);
+                    }
+                );
             }
         );
     }
 
+    /*
+     * Sets a handler to be called when a downloaded piece fails the hash check.
+     * @param func Takes the piece index and the addresses of the peers
+     *      that sent its blocks.
+     * */
+    void set_on_piece_failed(
+        std::function<void(std::size_t, const std::vector<BlockSource>&)> func
+    ) {
+        std::scoped_lock<std::mutex> lock {block_mutex};
+        on_piece_failed = std::move(func);
+    }
+
+    /*
+     * Sets a handler to be called when a v2 piece fails and the hashes of
+     *      its blocks should be requested from the peers.
+     * Once they are added with add_block_hashes, every block of the piece
+     *      is checked as it arrives and only the bad blocks are downloaded
+     *      again.
+     * */
+    void set_on_hashes_needed(std::function<void(std::size_t)> func) {
+        std::scoped_lock<std::mutex> lock {block_mutex};
+        on_hashes_needed = std::move(func);
+    }
+
+    /*
+     * Adds the leaf hashes of a v2 piece received from a peer.
+     * @param hashes All the leaves under the root of the piece.
+     * @return False if they don't match the root of the piece.
+     * */
+    bool
+    add_block_hashes(std::size_t piece_index, std::vector<Sha256Hash> hashes);
+
+    /*
+     * Returns true if the block of a piece being downloaded is written.
+     * Peers skip these blocks while requesting the piece.
+     * */
+    bool has_block(std::size_t piece_index, std::size_t block_index);
+
+    /*
+     * Reads a piece we have and hashes its blocks, to serve hash requests.
+     * @param on_finish Gets the leaf hashes of the piece, without the pad.
+     * */
+    void hash_blocks_async(
+        std::size_t piece_index,
+        std::function<void(
+            const boost::system::error_code&,
+            std::vector<Sha256Hash>
+        )> on_finish
+    );
+
+    /*
+     * Verifies a whole piece that is in memory and writes it to the file.
+     * Nothing is written if the SHA1 check fails.
+     * The piece must stay valid until on_finish is called.
+     * @param on_finish A function that will be called when the operation finishes.
+     *      Signature should be on_finish(const asio::error_code& error_code, bool sha1_passed).
+     * */
+    void write_piece_async(
+        std::size_t piece_index,
+        asio::const_buffer piece,
+        std::function<void(const boost::system::error_code&, bool)> on_finish
+    );
+
     /*
      * Reads given block from the file async.
      * @param on_finish A function that will be called when
@@ -137,12 +370,18 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
         auto buffer_ptr =
             std::make_shared<std::vector<std::uint8_t>>(length + 8);
 
-        file.async_read_some_at(
+        start_disk_operation(buffer_ptr->size());
+        auto file = get_file();
+        file->async_read_some_at(
             piece_index * piece_length + begin,
             asio::buffer(buffer_ptr->data() + 8, length),
-            [=](const auto& error_code, std::size_t bytes_transferred) {
+            [=, this, self = get_ptr(), held_file = file](
+                const auto& error_code,
+                std::size_t bytes_transferred
+            ) {
+                finish_disk_operation(buffer_ptr->size());
                 if (error_code) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << "Error while reading from the file: "
                         << error_code.message();
                 } else {
@@ -165,10 +404,36 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
     std::vector<std::uint8_t>
     read_some_at(std::size_t offset, std::size_t length) {
         std::vector<std::uint8_t> buffer(length, 0);
-        file.read_some_at(offset, asio::buffer(buffer));
+        get_file()->read_some_at(offset, asio::buffer(buffer));
         return buffer;
     }
 
+    /*
+     * Reads a byte range of the torrent into the buffer async.
+     * Waits until every piece covering the range is downloaded and verified.
+     *      Missing pieces are requested before anything else,
+     *      even if they belong to a skipped file.
+     * Reads of missing pieces fail with operation_aborted after stop().
+     * The buffer must stay valid until on_finish is called.
+     * @param offset Offset in bytes relative to the start of the torrent.
+     * @param on_finish A function that will be called when the range is read.
+     *      Signature should be on_finish(const asio::error_code& error_code, std::size_t bytes_read).
+     *      Reads past the end of the torrent are shortened.
+     * */
+    void async_read(
+        std::size_t offset,
+        asio::mutable_buffer buffer,
+        ReadHandler on_finish
+    );
+
+    /*
+     * Blocking version of async_read.
+     * Must not be called from the threads running the io_context.
+     * @throws boost::system::system_error if the read fails.
+     * @return Number of bytes read.
+     * */
+    std::size_t read(std::size_t offset, asio::mutable_buffer buffer);
+
     /*
      * Waits until the file is downloaded.
      * */
@@ -179,7 +444,57 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
      * */
     void stop();
 
-  public:
+    /*
+     * Checks SHA1 for the given piece.
+     * Only needs the metadata, the piece is not written anywhere.
+     * @return Returns true if piece passed SHA1 check, false if not.
+     * */
+    bool
+    check_sha1_piece(std::size_t piece_index, const std::string_view piece);
+
+    /*
+     * Checks the piece with its merkle root if the torrent has v2 hashes,
+     *      with SHA1 otherwise.
+     * */
+    bool check_piece(std::size_t piece_index, const std::string_view piece);
+
+    /*
+     * A block write waiting in the queue, see queue_write.
+     * */
+    struct PendingWrite {
+        std::uint64_t offset;
+        asio::const_buffer buffer;
+        WriteHandler handler;
+    };
+
+    // Most writes that are merged into one vectored write.
+    static constexpr std::size_t MAX_WRITE_RUN_BUFFERS = 64;
+
+    /*
+     * Sorts the writes by offset and splits them into runs of contiguous
+     *      writes. Writes to the same offset keep their order.
+     * @return Runs of at most MAX_WRITE_RUN_BUFFERS writes, by offset.
+     * */
+    static std::vector<std::vector<PendingWrite>>
+    make_write_runs(std::vector<PendingWrite> writes);
+
+    // Large enough that the file system finds contiguous space for it.
+    static constexpr std::size_t ALLOCATION_EXTENT = 1 << 24;
+
+    /*
+     * Marks the extents the range falls in as allocated.
+     * @param allocated_extents Whether each extent of the file is allocated.
+     *      Extents past its end are ignored.
+     * @return Offsets and lengths of the extents that were not allocated
+     *      yet. The last extent of the file ends with it.
+     * */
+    static std::vector<std::pair<std::size_t, std::size_t>> take_extents(
+        std::vector<bool>& allocated_extents,
+        std::size_t offset,
+        std::size_t length,
+        std::size_t file_length
+    );
+
   private:
     /* Private helper functions. */
 
@@ -190,14 +505,24 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
      *      signature should be "on_finish(const asio::error_code& error_code, bool sha1_passed)"
      * */
     void check_sha1_piece_async(std::size_t piece_index, const auto on_finish) {
-        auto buffer_ptr = std::make_shared<std::string>(piece_length, '\0');
+        // Last pieces can be shorter then usual.
+        auto buffer_ptr = std::make_shared<std::string>(
+            metadata->get_piece_size(piece_index),
+            '\0'
+        );
 
-        file.async_read_some_at(
+        start_disk_operation(buffer_ptr->size());
+        auto file = get_file();
+        file->async_read_some_at(
             piece_index * piece_length,
             asio::buffer(*buffer_ptr),
-            [=, this](const auto& error_code, std::size_t) {
+            [=, this, self = get_ptr(), held_file = file](
+                const auto& error_code,
+                std::size_t
+            ) {
+                finish_disk_operation(buffer_ptr->size());
                 if (error_code) {
-                    BOOST_LOG_TRIVIAL(error)
+                    TORRENT_LOG(error)
                         << "Error while reading from the file: "
                         << error_code.message();
                     on_finish(error_code, false);
@@ -213,11 +538,21 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
     }
 
     /*
-     * Checks SHA1 for the given piece.
-     * @return Returns true if piece passed SHA1 check, false if not.
+     * Counts a read or write submitted to the file, and the bytes
+     *      of the buffer it holds until it completes.
+     * Buffers owned by the caller are not counted.
      * */
-    bool
-    check_sha1_piece(std::size_t piece_index, const std::string_view piece);
+    void start_disk_operation(std::size_t buffer_length = 0) {
+        metrics->disk_queue_depth.add();
+        metrics->disk_buffer_bytes.add(static_cast<std::int64_t>(buffer_length)
+        );
+    }
+
+    void finish_disk_operation(std::size_t buffer_length = 0) {
+        metrics->disk_queue_depth.sub();
+        metrics->disk_buffer_bytes.sub(static_cast<std::int64_t>(buffer_length)
+        );
+    }
 
     /*
      * Checks sha1 of pieces starting in range of [start_piece, end_piece).
@@ -246,15 +581,193 @@ class Pieces: public std::enable_shared_from_this<Pieces> {
     );
     void extract_torrent();
 
+    /*
+     * Recalculates the priorities of the pieces that overlap with the file.
+     * */
+    void update_file_pieces(std::size_t file_index);
+
+    enum class BlockStatus {
+        Missing, // Piece has blocks that are not written yet.
+        Complete, // This was the last block of the piece.
+        Bad, // Block does not match the trusted leaf hash.
+    };
+
+    /*
+     * Remembers which peer sent the block, and its leaf hash for v2.
+     * */
+    BlockStatus add_block(
+        std::size_t piece_index,
+        std::size_t begin,
+        std::string_view block,
+        const BlockSource& source
+    );
+
+    /*
+     * Checks the leaves of the written blocks against the root of the piece.
+     * */
+    bool check_piece_leaves(std::size_t piece_index);
+
+    /*
+     * Returns the sources of the blocks of the piece and forgets them.
+     * */
+    std::vector<BlockSource> take_block_sources(std::size_t piece_index);
+
+    /*
+     * Makes the piece downloadable again and reports the peers that sent it.
+     * */
+    void on_hash_failure(std::size_t piece_index);
+
+    /*
+     * Starts the reads whose pieces are all downloaded.
+     * */
+    void wake_reads();
+
+    /*
+     * Reads until the buffer is full. The file may return less bytes
+     *      than requested in a single read.
+     * */
+    void read_range_async(
+        std::size_t offset,
+        asio::mutable_buffer buffer,
+        std::size_t bytes_read,
+        ReadHandler on_finish
+    );
+
+    /*
+     * Writes until the whole buffer is written.
+     * */
+    void write_range_async(
+        std::size_t offset,
+        asio::const_buffer buffer,
+        std::function<void(const boost::system::error_code&)> on_finish
+    );
+
+    /*
+     * Queues a block write. Writes are issued right away while few are
+     *      in flight. Once the disk falls behind, they wait for it,
+     *      at most WRITE_WINDOW, and go out together, see flush_writes.
+     * The buffer must stay valid until the handler is called.
+     * */
+    void queue_write(
+        std::uint64_t offset,
+        asio::const_buffer buffer,
+        WriteHandler handler
+    );
+
+    /*
+     * Issues the queued writes sorted by offset. Contiguous writes are
+     *      merged into a single vectored write, so the disk gets a few
+     *      large sequential writes instead of many random blocks.
+     * */
+    void flush_writes();
+
+    /*
+     * Writes contiguous blocks with one vectored write.
+     * */
+    void write_run(std::vector<PendingWrite> run);
+
+    /*
+     * Gives deadlines to the missing pieces in the stream window.
+     * stream_mutex should be locked before calling this.
+     * */
+    void update_stream_deadlines();
+
+    /*
+     * Returns the download file, opened to write it unless the wanted
+     *      pieces are complete.
+     * @throws std::runtime_error If the file can't be opened.
+     * */
+    std::shared_ptr<AsyncFile> get_file() {
+        return file_pool->open(
+            io_context,
+            file_path,
+            picker->is_complete() ? FilePool::Mode::ReadOnly
+                                  : FilePool::Mode::ReadWrite
+        );
+    }
+
+    /*
+     * Allocates the extents the range falls in, unless they already are.
+     * Does nothing unless the allocation is Allocation::Extents.
+     * */
+    void allocate_range(std::size_t offset, std::size_t length);
+
   public:
     std::unique_ptr<Bitfield> bitfield;
+    std::unique_ptr<PiecePicker> picker;
+    std::shared_ptr<SessionMetrics> metrics;
 
   private:
-    AsyncFile file;
+    asio::io_context& io_context;
+    std::shared_ptr<FilePool> file_pool = std::make_shared<FilePool>();
+    std::filesystem::path file_path;
+    std::atomic<bool> initialized = false;
 
     std::size_t piece_count;
     std::size_t piece_length;
 
+    std::filesystem::path download_directory = ".";
+    bool extract_files = true;
+
+    Allocation allocation = Allocation::Sparse;
+    std::mutex allocation_mutex;
+    // Empty unless the file is allocated in extents.
+    std::vector<bool> allocated_extents;
+
+    std::mutex priority_mutex;
+    std::vector<Priority> file_priorities;
+
+    struct Stream {
+        std::size_t offset;
+        std::size_t bytes_per_second;
+        PiecePicker::Clock::time_point start_time;
+    };
+    std::mutex stream_mutex;
+    std::optional<Stream> stream;
+
+    // Blocks of a piece that is being downloaded.
+    struct PartialPiece {
+        std::vector<BlockSource> sources;
+        std::vector<Sha256Hash> leaves; // Only hashed for v2.
+        std::vector<bool> written;
+        std::size_t written_count = 0;
+    };
+    std::mutex block_mutex;
+    std::unordered_map<std::size_t, PartialPiece> partial_pieces;
+    // Leaf hashes from the peers, for the v2 pieces that failed.
+    std::unordered_map<std::size_t, std::vector<Sha256Hash>> trusted_leaves;
+    std::function<void(std::size_t, const std::vector<BlockSource>&)>
+        on_piece_failed;
+    std::function<void(std::size_t)> on_hashes_needed;
+
+    struct PendingRead {
+        std::size_t first_piece;
+        std::size_t last_piece;
+        std::size_t offset;
+        asio::mutable_buffer buffer;
+        ReadHandler on_finish;
+    };
+    std::mutex read_mutex;
+    std::vector<PendingRead> pending_reads;
+    // Missing pieces don't arrive after stop(), so reads of them fail.
+    bool reads_stopped = false;
+
+    std::mutex write_mutex;
+    std::vector<PendingWrite> pending_writes;
+    std::size_t pending_write_bytes = 0;
+    std::size_t writes_in_flight = 0;
+    // Bounds the wait of a queued write if the disk is slow.
+    asio::steady_timer write_timer;
+    bool write_timer_armed = false;
+
+    static constexpr std::chrono::milliseconds WRITE_WINDOW {5};
+    // Writes beyond this are queued until one completes.
+    static constexpr std::size_t MAX_WRITES_IN_FLIGHT = 4;
+    static constexpr std::size_t MAX_PENDING_WRITE_BYTES = 1 << 24;
+
+    // Number of pieces after the read position that get a deadline.
+    static constexpr std::size_t STREAM_WINDOW_PIECES = 16;
+
     bool running = true;
     std::mutex running_cv_mutex;
     std::condition_variable running_cv;
@@ -0,0 +1,84 @@
+#ifndef TORRENT_RANGE_SERVER_HPP
+#define TORRENT_RANGE_SERVER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "http_server.hpp"
+#include "metadata.hpp"
+#include "pieces.hpp"
+
+namespace torrent {
+
+/*
+ * Serves the files of the torrent over HTTP on the loopback interface
+ *      while they are being downloaded.
+ * GET / lists the files, GET /<file index> returns the file.
+ *      Single byte ranges are supported so media players can seek.
+ * Responses wait for the pieces they cover to be downloaded.
+ * Must be owned by a shared_ptr. The connections only hold it weakly,
+ *      so it can be destroyed while they are open.
+ * */
+class RangeServer: public std::enable_shared_from_this<RangeServer> {
+  public:
+    RangeServer(
+        asio::io_context& io_context_ref,
+        std::uint16_t server_port,
+        std::shared_ptr<Metadata> metadata_ptr,
+        std::shared_ptr<Pieces> pieces_ptr
+    );
+
+    /*
+     * @throws boost::system::system_error if the port can't be bound.
+     * */
+    void start();
+
+    void stop() {
+        if (server) {
+            server->stop();
+        }
+    }
+
+    /*
+     * Should be called after start().
+     * */
+    std::uint16_t get_port() const {
+        return server->get_port();
+    }
+
+    /*
+     * Parses the value of a Range header.
+     * Only a single range is supported.
+     * @param length Length of the whole resource.
+     * @return First and last byte of the range, both inclusive.
+     *      Empty if the range is invalid or can't be satisfied.
+     * */
+    static std::optional<std::pair<std::size_t, std::size_t>>
+    parse_range(std::string_view range, std::size_t length);
+
+  private:
+    void on_request(
+        const HttpServer::Request& request,
+        std::shared_ptr<HttpServer::Session> session
+    );
+
+    void send_file(
+        const HttpServer::Request& request,
+        std::shared_ptr<HttpServer::Session> session,
+        std::size_t file_index
+    );
+
+  private:
+    std::shared_ptr<Metadata> metadata;
+    std::shared_ptr<Pieces> pieces;
+
+    asio::io_context& io_context;
+    std::uint16_t port;
+    std::shared_ptr<HttpServer> server;
+};
+
+} // namespace torrent
+#endif
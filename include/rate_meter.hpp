@@ -0,0 +1,69 @@
+#ifndef TORRENT_RATE_METER_HPP
+#define TORRENT_RATE_METER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace torrent {
+
+/*
+ * Measures a transfer rate in bytes per second.
+ * Adding bytes is a single relaxed atomic operation so it can be
+ *      called for every block. The rate is smoothed and only
+ *      recalculated when it is read, at most once per interval.
+ * */
+class RateMeter {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    RateMeter() : last_sample(Clock::now()) {}
+
+    void add(std::size_t bytes) {
+        total.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /*
+     * Returns the total number of bytes added.
+     * */
+    std::size_t get_total() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * Returns the smoothed rate in bytes per second.
+     * */
+    std::size_t get_rate() {
+        std::scoped_lock<std::mutex> lock {mutex};
+        const auto now = Clock::now();
+        const auto elapsed =
+            std::chrono::duration<double>(now - last_sample).count();
+        if (elapsed < SAMPLE_INTERVAL) {
+            return static_cast<std::size_t>(rate);
+        }
+        const auto current_total = get_total();
+        const auto sample =
+            static_cast<double>(current_total - last_total) / elapsed;
+        // Exponential moving average. Reacts within a few samples.
+        rate = rate * (1.0 - SMOOTHING) + sample * SMOOTHING;
+
+        last_total = current_total;
+        last_sample = now;
+        return static_cast<std::size_t>(rate);
+    }
+
+  private:
+    static constexpr double SAMPLE_INTERVAL = 1.0; // In seconds.
+    static constexpr double SMOOTHING = 0.5;
+
+    std::atomic<std::size_t> total = 0;
+
+    std::mutex mutex;
+    Clock::time_point last_sample;
+    std::size_t last_total = 0;
+    double rate = 0.0;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,69 @@
+#ifndef TORRENT_RC4_HPP
+#define TORRENT_RC4_HPP
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+namespace torrent {
+
+/*
+ * The RC4 stream cipher of Message Stream Encryption.
+ * Encrypting and decrypting are the same operation, done in place.
+ * Not secure on its own. MSE only uses it to hide the traffic,
+ *      and drops the first bytes of the key stream as it requires.
+ * See: https://en.wikipedia.org/wiki/RC4
+ * */
+class Rc4 {
+  public:
+    explicit Rc4(std::span<const std::uint8_t> key) {
+        for (std::size_t k = 0; k < state.size(); ++k) {
+            state[k] = static_cast<std::uint8_t>(k);
+        }
+        std::uint8_t y = 0;
+        for (std::size_t k = 0; k < state.size(); ++k) {
+            y = static_cast<std::uint8_t>(y + state[k] + key[k % key.size()]);
+            std::swap(state[k], state[y]);
+        }
+    }
+
+    /*
+     * Encrypts or decrypts the data in place.
+     * */
+    void process(std::uint8_t* data, std::size_t length) {
+        // Work on locals so the compiler keeps them in registers.
+        auto x = i;
+        auto y = j;
+        for (std::size_t k = 0; k < length; ++k) {
+            x = static_cast<std::uint8_t>(x + 1);
+            const auto a = state[x];
+            y = static_cast<std::uint8_t>(y + a);
+            const auto b = state[y];
+            state[x] = b;
+            state[y] = a;
+            data[k] ^= state[static_cast<std::uint8_t>(a + b)];
+        }
+        i = x;
+        j = y;
+    }
+
+    /*
+     * Drops bytes of the key stream.
+     * */
+    void discard(std::size_t length) {
+        std::array<std::uint8_t, 256> buffer {};
+        for (; length > buffer.size(); length -= buffer.size()) {
+            process(buffer.data(), buffer.size());
+        }
+        process(buffer.data(), length);
+    }
+
+  private:
+    std::array<std::uint8_t, 256> state;
+    std::uint8_t i = 0;
+    std::uint8_t j = 0;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,181 @@
+#ifndef TORRENT_SESSION_HPP
+#define TORRENT_SESSION_HPP
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ssl.hpp>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bandwidth_limit.hpp"
+#include "client.hpp"
+#include "file_pool.hpp"
+
+namespace torrent {
+
+namespace asio = boost::asio;
+
+/*
+ * Runs many torrents in one process. The SSL context, the rate limits
+ *      and the pool of open files are shared, so a torrent doesn't pay
+ *      for them when it is added.
+ * All the torrents run on one io_context and its pool of threads.
+ *      Handlers only hold a client weakly, so a torrent can be removed
+ *      without waiting for them or stopping the others.
+ * Pausing destroys the client but keeps the torrent. Resuming starts
+ *      a new client, which checks the pieces that are already on the disk.
+ * All functions are thread safe.
+ * */
+class Session {
+  public:
+    using Id = std::uint64_t;
+
+    /*
+     * @param thread_count Number of threads that run all the torrents.
+     * */
+    explicit Session(
+        asio::ssl::context& ssl_context_ref,
+        std::size_t thread_count = std::thread::hardware_concurrency()
+    );
+
+    ~Session();
+
+    Session(const Session&) = delete;
+    const Session& operator=(const Session&) = delete;
+
+    /*
+     * Starts downloading a torrent.
+     * @param source Either a path to a .torrent file or a magnet link.
+     * @throws std::runtime_error If the torrent can't be started.
+     * */
+    Id add(std::string source, std::filesystem::path directory);
+
+    /*
+     * Stops the torrent and forgets it. Downloaded files are kept.
+     * @throws std::runtime_error If there is no torrent with the id.
+     * */
+    void remove(Id id);
+
+    /*
+     * Stops the torrent. Does nothing if it is already paused.
+     * @throws std::runtime_error If there is no torrent with the id.
+     * */
+    void pause(Id id);
+
+    /*
+     * Starts a paused torrent again. Does nothing if it is running.
+     * @throws std::runtime_error If there is no torrent with the id
+     *      or it can't be started.
+     * */
+    void resume(Id id);
+
+    /*
+     * Sets the priority of a file. Kept while the torrent is paused.
+     * @throws std::runtime_error If there is no torrent with the id.
+     * */
+    void set_file_priority(Id id, std::size_t file_index, Priority priority);
+
+    /*
+     * Limits the total rates of all the torrents in bytes per second.
+     * Zero means unlimited.
+     * */
+    void set_rate_limits(std::size_t download, std::size_t upload) {
+        download_limit->set_rate(download);
+        upload_limit->set_rate(upload);
+    }
+
+    std::size_t get_download_limit() const {
+        return download_limit->get_rate();
+    }
+
+    std::size_t get_upload_limit() const {
+        return upload_limit->get_rate();
+    }
+
+    struct Status {
+        Id id;
+        std::string source;
+        std::filesystem::path directory;
+        bool paused;
+        // Only the totals are filled while the torrent is paused.
+        Client::Stats stats;
+    };
+
+    /*
+     * Returns the status of every torrent without the peers and the pieces.
+     * */
+    std::vector<Status> list();
+
+    /*
+     * @throws std::runtime_error If there is no torrent with the id.
+     * */
+    Status get_status(Id id);
+
+    /*
+     * Stops every torrent and the threads. Called by the destructor.
+     * */
+    void stop();
+
+    // How long the handlers get to finish when the session stops.
+    static constexpr auto DRAIN_TIMEOUT = std::chrono::seconds(5);
+
+  private:
+    struct Torrent {
+        std::string source;
+        std::filesystem::path directory;
+        std::unordered_map<std::size_t, Priority> file_priorities;
+        // Empty while paused.
+        std::shared_ptr<Client> client;
+        // Set while a client is started without the mutex locked.
+        bool starting = false;
+        // Last stats of the client, shown while it is paused.
+        Client::Stats stats;
+    };
+
+    /*
+     * Creates and starts a client for the torrent.
+     * @throws std::runtime_error If the client can't be started.
+     * */
+    std::shared_ptr<Client> start_client(const Torrent& torrent);
+
+    /*
+     * Runs the io_context until the session is stopped.
+     * */
+    void run();
+
+    /*
+     * mutex should be locked before calling this.
+     * @throws std::runtime_error If there is no torrent with the id.
+     * */
+    Torrent& get_torrent(Id id);
+
+    Status get_status(Id id, Torrent& torrent, bool with_details);
+
+  private:
+    asio::ssl::context& ssl_context;
+
+    std::shared_ptr<BandwidthLimit> download_limit;
+    std::shared_ptr<BandwidthLimit> upload_limit;
+    std::shared_ptr<FilePool> file_pool;
+
+    // Declared before the torrents, so the clients are destroyed first.
+    asio::io_context io_context;
+    // Keeps the threads running while there are no torrents.
+    asio::executor_work_guard<asio::io_context::executor_type> work;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::map<Id, Torrent> torrents;
+    Id next_id = 1;
+};
+
+} // namespace torrent
+#endif
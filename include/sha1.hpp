@@ -0,0 +1,29 @@
+#ifndef TORRENT_SHA1_HPP
+#define TORRENT_SHA1_HPP
+
+#include <openssl/sha.h>
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace torrent {
+
+using Sha1Hash = std::array<std::uint8_t, 20>;
+
+/*
+ * Hashes a piece. Used both to check the pieces and to create torrents,
+ *      so both get the fastest SHA1 OpenSSL has for the CPU.
+ * */
+inline Sha1Hash sha1(std::string_view data) {
+    Sha1Hash hash;
+    SHA1(
+        reinterpret_cast<const unsigned char*>(data.data()),
+        data.size(),
+        hash.data()
+    );
+    return hash;
+}
+
+} // namespace torrent
+#endif
@@ -0,0 +1,285 @@
+#ifndef TORRENT_SIMULATED_NETWORK_HPP
+#define TORRENT_SIMULATED_NETWORK_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "transport.hpp"
+
+namespace torrent {
+
+namespace asio = boost::asio;
+using namespace boost::asio::ip;
+
+/*
+ * Conditions of the link between a simulated host and the network.
+ * Data between two hosts is delayed by the links of both of them.
+ * */
+struct SimulatedLink {
+    std::chrono::microseconds latency {0}; // One way delay.
+    std::chrono::microseconds jitter {0}; // Random extra delay up to this.
+    std::size_t bandwidth = 0; // Bytes per second each way. Zero is unlimited.
+    double loss = 0.0; // Probability that a packet is lost.
+};
+
+/*
+ * A network of hosts that lives in memory and runs on a virtual clock.
+ * Clients are put on it by giving them the transport of a host, see
+ *      Client::set_transport. Connections, timers and announces
+ *      of the clients then happen in virtual time, which only moves
+ *      once the io_context has nothing left to do at the current time.
+ *      So a download that would take hours takes as long as the CPU
+ *      needs to process it, and runs with the same seed are repeatable.
+ * Trackers of every announce url are replaced by a single tracker that
+ *      knows every host that announced the same info hash.
+ * The io_context must only be run through run_until and run_for,
+ *      from a single thread.
+ * */
+class SimulatedNetwork: public std::enable_shared_from_this<SimulatedNetwork> {
+  private:
+    struct Private {
+        explicit Private() = default;
+    };
+
+  public:
+    using Duration = std::chrono::nanoseconds;
+
+    SimulatedNetwork(
+        Private,
+        asio::io_context& io_context_ref,
+        std::uint64_t seed
+    ) :
+        io_context(io_context_ref),
+        random_engine(seed) {}
+
+    SimulatedNetwork(const SimulatedNetwork&) = delete;
+    SimulatedNetwork& operator=(const SimulatedNetwork&) = delete;
+
+    /*
+     * @param seed Seed of the random numbers deciding jitter and losses.
+     * */
+    static std::shared_ptr<SimulatedNetwork>
+    create(asio::io_context& io_context, std::uint64_t seed = 1) {
+        return std::make_shared<SimulatedNetwork>(Private {}, io_context, seed);
+    }
+
+    /*
+     * Adds a host with the given address to the network.
+     * @return Transport to give to the client running on the host.
+     * @throws std::runtime_error If the address is taken.
+     * */
+    std::shared_ptr<Transport>
+    add_host(const address_v4& host_address, const SimulatedLink& link);
+
+    /*
+     * Runs until done returns true, the virtual time reaches the limit,
+     *      or nothing is left to do.
+     * Real asynchronous work, like reading the disk, is given io_grace
+     *      of wall time to finish before the virtual time moves on.
+     * @return Whether done returned true.
+     * */
+    bool run_until(const std::function<bool()>& done, Duration limit);
+
+    /*
+     * Runs for the given virtual time.
+     * */
+    void run_for(Duration duration) {
+        run_until([] { return false; }, now() + duration);
+    }
+
+    /*
+     * Drops everything that is scheduled. Handlers waiting for the
+     *      network are destroyed without being called, and later
+     *      operations do nothing. Must be called once the clients are
+     *      stopped, because the handlers own the streams and timers
+     *      that keep the network alive. Poll the io_context afterwards
+     *      so the handlers already posted to it finish.
+     * */
+    void stop();
+
+    /*
+     * Returns the virtual time since the network was created.
+     * */
+    Duration now() const {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return current_time;
+    }
+
+    /*
+     * Returns the bytes delivered between hosts so far.
+     * */
+    std::size_t get_delivered_bytes() const {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return delivered_bytes;
+    }
+
+    void set_io_grace(std::chrono::microseconds grace) {
+        io_grace = grace;
+    }
+
+  private:
+    friend class SimulatedTransport;
+    friend class SimulatedStream;
+    friend class SimulatedAcceptor;
+    friend class SimulatedTimer;
+    friend class SimulatedTracker;
+
+    struct Host {
+        address_v4 address;
+        SimulatedLink link;
+        // The links send the data at their bandwidth one after another.
+        Duration upload_free {0};
+        Duration download_free {0};
+        std::uint16_t next_port = 49152;
+    };
+
+    /*
+     * One end of a connection.
+     * */
+    struct Socket {
+        Host* host = nullptr;
+        tcp::endpoint local;
+        tcp::endpoint remote;
+        std::weak_ptr<Socket> peer;
+
+        std::string inbound;
+        std::size_t inbound_offset = 0;
+        // Data arrives in order, so it never arrives before this.
+        Duration last_arrival {0};
+        bool eof = false;
+        bool closed = false;
+
+        Stream::ConnectHandler connect_handler;
+        asio::mutable_buffer read_buffer;
+        Stream::IoHandler read_handler;
+    };
+
+    struct Listener {
+        tcp::endpoint endpoint;
+        std::vector<std::shared_ptr<Socket>> backlog;
+        Acceptor::AcceptHandler accept_handler;
+        bool closed = false;
+    };
+
+    struct Event {
+        Duration time;
+        std::uint64_t sequence; // Events at the same time run in order.
+        std::function<void()> function;
+
+        bool operator>(const Event& other) const {
+            if (time != other.time) {
+                return time > other.time;
+            }
+            return sequence > other.sequence;
+        }
+    };
+
+    // Called by the streams, acceptors and timers.
+    std::shared_ptr<Socket> open_socket(Host& host);
+    std::shared_ptr<Listener> listen(Host& host, std::uint16_t port);
+    void connect(
+        const std::shared_ptr<Socket>& socket,
+        const tcp::endpoint& endpoint,
+        Stream::ConnectHandler handler
+    );
+    void read(
+        const std::shared_ptr<Socket>& socket,
+        asio::mutable_buffer buffer,
+        Stream::IoHandler handler
+    );
+    void write(
+        const std::shared_ptr<Socket>& socket,
+        asio::const_buffer buffer,
+        Stream::IoHandler handler
+    );
+    void close(const std::shared_ptr<Socket>& socket);
+    void accept(
+        const std::shared_ptr<Listener>& listener,
+        Acceptor::AcceptHandler handler
+    );
+    void close(const std::shared_ptr<Listener>& listener);
+
+    /*
+     * Registers the endpoint in the swarm of the info hash.
+     * @return The other endpoints in the swarm.
+     * */
+    std::vector<tcp::endpoint>
+    announce(const std::string& info_hash, const tcp::endpoint& endpoint);
+
+    // The functions below expect the mutex to be locked.
+
+    /*
+     * Runs the function at the virtual time.
+     * */
+    void schedule(Duration time, std::function<void()> function);
+
+    /*
+     * Returns the delay of a packet between two hosts,
+     *      including jitter and the retransmission of lost packets.
+     * */
+    Duration get_delay(const Host& from, const Host& to, std::size_t bytes);
+
+    void close_socket(const std::shared_ptr<Socket>& socket);
+
+    /*
+     * Completes the pending read if there is data or the remote closed.
+     * */
+    void complete_read(Socket& socket);
+
+    /*
+     * Completes the pending connect.
+     * */
+    void complete_connect(Socket& socket, boost::system::error_code error);
+
+    /*
+     * Hands a waiting connection to the pending accept.
+     * */
+    void complete_accept(Listener& listener);
+
+    /*
+     * Completes the timer wait with the id if it is still pending.
+     * */
+    void complete_wait(std::uint64_t id, boost::system::error_code error);
+
+  private:
+    asio::io_context& io_context;
+    std::chrono::microseconds io_grace {200};
+
+    mutable std::mutex mutex;
+    bool stopped = false;
+    Duration current_time {0};
+    std::uint64_t next_sequence = 0;
+    // A min heap on the event time.
+    std::vector<Event> events;
+    std::mt19937_64 random_engine;
+    std::size_t delivered_bytes = 0;
+
+    // Pending waits of the timers.
+    std::uint64_t next_wait_id = 0;
+    std::unordered_map<std::uint64_t, Timer::WaitHandler> waits;
+
+    std::unordered_map<address_v4::uint_type, std::unique_ptr<Host>> hosts;
+    std::unordered_map<tcp::endpoint, std::shared_ptr<Listener>> listeners;
+    std::unordered_map<std::string, std::vector<tcp::endpoint>> swarms;
+
+    // Writes longer than this are split into several packets.
+    static constexpr std::size_t MAX_PACKET_LENGTH = 1 << 16;
+    // Loss is decided for every MTU bytes of a packet.
+    static constexpr std::size_t MTU = 1460;
+    static constexpr Duration MIN_RETRANSMISSION_TIMEOUT =
+        std::chrono::milliseconds {200};
+};
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef TORRENT_TORRENT_CREATOR_HPP
+#define TORRENT_TORRENT_CREATOR_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "sha1.hpp"
+
+namespace torrent {
+
+/*
+ * Creates a .torrent file from a file or a directory.
+ * Directories are walked recursively and their files are sorted
+ *      by path, so the same directory always gives the same torrent.
+ * Pieces are hashed by many threads. Every thread takes a run of
+ *      consecutive pieces and reads it with a single large read,
+ *      so the disk sees long sequential reads.
+ * See: https://www.bittorrent.org/beps/bep_0003.html#metainfo-files
+ * */
+class TorrentCreator {
+  public:
+    /*
+     * Called after every run of pieces with the number of bytes hashed.
+     * Called from the hashing threads.
+     * */
+    using ProgressHandler =
+        std::function<void(std::size_t hashed, std::size_t total)>;
+
+    /*
+     * Collects the files under the path.
+     * @throws std::runtime_error If there are no files under the path.
+     * */
+    explicit TorrentCreator(std::filesystem::path root_path);
+
+    /*
+     * Zero picks a piece length for the total length of the files.
+     * Otherwise it must be a power of two and at least 16 KiB.
+     * */
+    void set_piece_length(std::size_t length) {
+        piece_length = length;
+    }
+
+    /*
+     * Trackers are announced to in the order they are added.
+     * */
+    void add_tracker(std::string url) {
+        trackers.push_back(std::move(url));
+    }
+
+    void add_web_seed(std::string url) {
+        web_seeds.push_back(std::move(url));
+    }
+
+    void set_comment(std::string text) {
+        comment = std::move(text);
+    }
+
+    /*
+     * Private torrents only get peers from their trackers.
+     * See: https://www.bittorrent.org/beps/bep_0027.html
+     * */
+    void set_private(bool is_private) {
+        private_torrent = is_private;
+    }
+
+    void set_thread_count(std::size_t count) {
+        thread_count = count;
+    }
+
+    void set_on_progress(ProgressHandler handler) {
+        on_progress = std::move(handler);
+    }
+
+    /*
+     * Hashes the files and returns the torrent in bencode.
+     * @throws std::runtime_error If a file can't be read or its
+     *      length changes while it is hashed.
+     * */
+    std::string create();
+
+    /*
+     * Returns the smallest power of two piece length that keeps the
+     *      number of pieces under TARGET_PIECE_COUNT, between
+     *      MIN_PIECE_LENGTH and MAX_PIECE_LENGTH.
+     * */
+    static std::size_t choose_piece_length(std::size_t total_length);
+
+    std::size_t get_total_length() const {
+        return total_length;
+    }
+
+    /*
+     * Returns the length the pieces are hashed with.
+     * */
+    std::size_t get_piece_length() const {
+        return piece_length == 0 ? choose_piece_length(total_length)
+                                 : piece_length;
+    }
+
+    static constexpr std::size_t MIN_PIECE_LENGTH = 1 << 14;
+    static constexpr std::size_t MAX_PIECE_LENGTH = 1 << 24;
+    static constexpr std::size_t TARGET_PIECE_COUNT = 2048;
+
+    // Pieces are read in runs of about this many bytes.
+    static constexpr std::size_t READ_LENGTH = 1 << 24;
+
+  private:
+    /*
+     * Hashes the pieces and returns them concatenated.
+     * */
+    std::string hash_pieces(std::size_t length);
+
+  private:
+    std::filesystem::path root;
+    // Lengths and paths relative to the root, in the order of the torrent.
+    std::vector<std::pair<std::size_t, std::filesystem::path>> files;
+    std::size_t total_length = 0;
+
+    std::size_t piece_length = 0;
+    std::vector<std::string> trackers;
+    std::vector<std::string> web_seeds;
+    std::string comment;
+    bool private_torrent = false;
+    std::size_t thread_count = std::thread::hardware_concurrency();
+    ProgressHandler on_progress;
+};
+
+} // namespace torrent
+#endif
@@ -0,0 +1,123 @@
+#ifndef TORRENT_TRACE_HPP
+#define TORRENT_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+
+/*
+ * Spans of the hot paths, kept in memory and written in the Chrome trace
+ *      event format. The file can be opened in chrome://tracing or
+ *      https://ui.perfetto.dev to see where the time goes.
+ * Every thread records into its own ring buffer, so only the latest
+ *      events of a thread are kept and recording never allocates.
+ * Tracing is off until start is called. Until then a span costs a single
+ *      relaxed load, so the spans stay in the release builds.
+ * See: https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ * */
+namespace torrent::trace {
+
+using Clock = std::chrono::steady_clock;
+
+// Used when an event has no argument.
+inline constexpr std::int64_t NO_ARG = std::numeric_limits<std::int64_t>::min();
+
+namespace detail {
+inline std::atomic<bool> enabled = false;
+} // namespace detail
+
+inline bool is_enabled() {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/*
+ * Starts recording the spans. They are written to the path when dump
+ *      is called and once the program exits.
+ * */
+void start(std::string path);
+
+/*
+ * Stops recording. The recorded events are kept until the next dump.
+ * */
+void stop();
+
+/*
+ * Writes the events recorded so far to the path given to start.
+ * Events are not cleared, so a later dump covers them again
+ *      if they are not overwritten by then.
+ * @return false if tracing was never started or the file can't be written.
+ * */
+bool dump();
+
+/*
+ * Writes the events recorded so far as Chrome trace JSON.
+ * */
+void dump(std::ostream& os);
+
+/*
+ * Returns the current time if tracing is enabled, an empty time point
+ *      otherwise. Used to start a span that ends in another handler.
+ * */
+inline Clock::time_point now() {
+    return is_enabled() ? Clock::now() : Clock::time_point {};
+}
+
+/*
+ * Records a span that ran on the calling thread.
+ * @param name Must be a string literal.
+ * */
+void record(
+    const char* name,
+    Clock::time_point start,
+    Clock::time_point end,
+    std::int64_t arg = NO_ARG
+);
+
+/*
+ * Records a span that started in another handler, like a disk write
+ *      from the submit until the completion. Shown on its own track since
+ *      it can overlap the other spans of the thread.
+ * Nothing is recorded if start is empty, see now.
+ * @param name Must be a string literal.
+ * */
+void record_async(
+    const char* name,
+    Clock::time_point start,
+    std::int64_t arg = NO_ARG
+);
+
+/*
+ * Records the time from its construction until it goes out of scope:
+ *      trace::Span span {"sha1_verify", piece_index};
+ * */
+class Span {
+  public:
+    explicit Span(const char* span_name, std::int64_t span_arg = NO_ARG) {
+        if (is_enabled()) {
+            name = span_name;
+            arg = span_arg;
+            start = Clock::now();
+        }
+    }
+
+    ~Span() {
+        if (name != nullptr) {
+            record(name, start, Clock::now(), arg);
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+  private:
+    const char* name = nullptr; // Null if tracing was disabled.
+    std::int64_t arg = NO_ARG;
+    Clock::time_point start;
+};
+
+} // namespace torrent::trace
+
+#endif
@@ -4,7 +4,10 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/url/urls.hpp>
+#include <chrono>
 #include <memory>
+#include <string_view>
+#include <vector>
 
 namespace torrent {
 using namespace boost::asio::ip;
@@ -13,7 +16,8 @@ class TrackerManager;
 
 class Tracker: public std::enable_shared_from_this<Tracker> {
   public:
-    Tracker(TrackerManager& manager) : tracker_manager(manager) {}
+    Tracker(std::weak_ptr<TrackerManager> manager) :
+        tracker_manager(std::move(manager)) {}
 
     Tracker(const Tracker&) = delete;
     Tracker& operator=(const Tracker&) = delete;
@@ -23,14 +27,30 @@ class Tracker: public std::enable_shared_from_this<Tracker> {
     /*
      * Creates a Tracker object. 
      * Tracker will use either UDP or HTTP/HTTPs protocols appropriately.
-     * @param client A reference to Client object.
+     * @param tracker_manager The manager that will own the tracker.
      * @param announce Announce string acquired from the .torrent file.
      * */
-    static std::shared_ptr<Tracker>
-    create_tracker(TrackerManager& tracker_manager, std::string announce);
+    static std::shared_ptr<Tracker> create_tracker(
+        const std::shared_ptr<TrackerManager>& tracker_manager,
+        std::string announce
+    );
+
+    /*
+     * Returns the peers of a compact peer list. Every peer is six bytes,
+     *      the IPv4 address and the port, both big endian.
+     * Trailing bytes that are not a whole peer are ignored.
+     * */
+    static std::vector<tcp::endpoint>
+    parse_compact_peers(std::string_view peers);
 
     virtual void initiate_connection(boost::url tracker_url) = 0;
 
+    /*
+     * Cancels the pending operations. The tracker is destroyed once
+     *      their handlers are called.
+     * */
+    virtual void stop() = 0;
+
     friend std::ostream& operator<<(std::ostream& os, const Tracker& tracker) {
         os << "Tracker{ " << tracker.announce << " }";
         return os;
@@ -40,10 +60,18 @@ class Tracker: public std::enable_shared_from_this<Tracker> {
     void on_disconnect();
     void on_new_peer(tcp::endpoint endpoint);
 
+    /*
+     * Records the latency of a request that was answered.
+     * @param sent When the request was sent.
+     * */
+    void on_round_trip(std::chrono::steady_clock::time_point sent);
+
   protected:
     std::string announce;
 
-    TrackerManager& tracker_manager;
+    // The manager owns the tracker. It is gone once the client is,
+    //      while the handlers of the tracker may still be pending.
+    std::weak_ptr<TrackerManager> tracker_manager;
 };
 
 } // namespace torrent
@@ -2,29 +2,39 @@
 #define TORRENT_TRACKER_MANAGER_HPP
 
 #include <boost/asio/ssl.hpp>
-#include <boost/log/trivial.hpp>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
 
+#include "log.hpp"
 #include "metadata.hpp"
+#include "metrics.hpp"
 #include "tracker.hpp"
+#include "transport.hpp"
 
 namespace torrent {
 namespace asio = boost::asio;
 
-class TrackerManager {
+/*
+ * Owns the trackers of a torrent. Must be owned by a shared_ptr,
+ *      the trackers are created with a reference to it.
+ * */
+class TrackerManager: public std::enable_shared_from_this<TrackerManager> {
   public:
     TrackerManager(
         asio::io_context& io_context_ref,
         asio::ssl::context& ssl_context_ref,
+        std::shared_ptr<Transport> transport_ptr,
         std::uint16_t listen_port,
         std::string client_peer_id,
-        std::shared_ptr<Metadata> metadata_ptr
+        std::shared_ptr<Metadata> metadata_ptr,
+        std::shared_ptr<SessionMetrics> metrics_ptr
     ) :
         metadata(std::move(metadata_ptr)),
+        metrics(std::move(metrics_ptr)),
         io_context(io_context_ref),
         ssl_context(ssl_context_ref),
+        transport(std::move(transport_ptr)),
         port(listen_port),
         peer_id(std::move(client_peer_id)) {}
 
@@ -36,7 +46,7 @@ class TrackerManager {
      * */
     void add(std::string announce) {
         std::scoped_lock<std::mutex> lock {mutex};
-        auto tracker = Tracker::create_tracker(*this, announce);
+        auto tracker = transport->create_tracker(shared_from_this(), announce);
         if (tracker) {
             trackers.emplace(std::move(announce), std::move(tracker));
         }
@@ -52,7 +62,7 @@ class TrackerManager {
             return;
         }
 
-        BOOST_LOG_TRIVIAL(info)
+        TORRENT_LOG(info)
             << "Tracker count: " << trackers.size() - 1
             << ", Connection lost with " << *tracker_it->second;
 
@@ -60,10 +70,13 @@ class TrackerManager {
     }
 
     /*
-     * Stops the trackers by deleting all of them.
+     * Stops the trackers and deletes all of them.
      * */
     void stop() {
         std::scoped_lock<std::mutex> lock {mutex};
+        for (const auto& [announce, tracker] : trackers) {
+            tracker->stop();
+        }
         trackers.clear();
     }
 
@@ -76,6 +89,7 @@ class TrackerManager {
 
   public:
     std::shared_ptr<Metadata> metadata;
+    std::shared_ptr<SessionMetrics> metrics;
 
     const std::string& get_peer_id() const {
         return peer_id;
@@ -88,6 +102,7 @@ class TrackerManager {
   private:
     asio::io_context& io_context;
     asio::ssl::context& ssl_context;
+    std::shared_ptr<Transport> transport;
     std::uint16_t port;
     std::string peer_id;
     friend class Tracker;
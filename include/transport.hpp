@@ -0,0 +1,167 @@
+#ifndef TORRENT_TRANSPORT_HPP
+#define TORRENT_TRANSPORT_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace torrent {
+
+namespace asio = boost::asio;
+using namespace boost::asio::ip;
+
+class Tracker;
+class TrackerManager;
+
+/*
+ * A connection to a remote peer.
+ * Mirrors the part of tcp::socket the peers use, so the network
+ *      under them can be replaced. Handlers are never called
+ *      from inside the function that started the operation.
+ * */
+class Stream {
+  public:
+    using ConnectHandler =
+        std::function<void(const boost::system::error_code& error)>;
+    using IoHandler = std::function<
+        void(const boost::system::error_code& error, std::size_t bytes)>;
+
+    virtual ~Stream() {}
+
+    virtual void
+    async_connect(const tcp::endpoint& endpoint, ConnectHandler handler) = 0;
+
+    /*
+     * Reads at least one byte into the buffer, or fails with eof
+     *      once the remote closed the connection.
+     * */
+    virtual void
+    async_read_some(asio::mutable_buffer buffer, IoHandler handler) = 0;
+
+    /*
+     * Writes some of the buffer. Might write less than the whole buffer.
+     * */
+    virtual void
+    async_write_some(asio::const_buffer buffer, IoHandler handler) = 0;
+
+    /*
+     * Same as async_write_some, but the stream may change the buffer
+     *      while writing it, e.g. to encrypt it without a copy.
+     * The buffer must not be read again after this call.
+     * */
+    virtual void
+    async_write_some_in_place(asio::mutable_buffer buffer, IoHandler handler) {
+        async_write_some(buffer, std::move(handler));
+    }
+
+    /*
+     * Closes the connection. Pending operations fail with operation_aborted.
+     * */
+    virtual void close() = 0;
+
+    virtual tcp::endpoint remote_endpoint() const = 0;
+};
+
+/*
+ * Accepts the connections of remote peers.
+ * */
+class Acceptor {
+  public:
+    using AcceptHandler = std::function<void(
+        const boost::system::error_code& error,
+        std::unique_ptr<Stream> stream
+    )>;
+
+    virtual ~Acceptor() {}
+
+    virtual void async_accept(AcceptHandler handler) = 0;
+
+    /*
+     * Stops accepting. A pending accept fails with operation_aborted.
+     * */
+    virtual void close() = 0;
+
+    virtual std::uint16_t get_port() const = 0;
+};
+
+/*
+ * A timer on the clock of the transport.
+ * */
+class Timer {
+  public:
+    using WaitHandler =
+        std::function<void(const boost::system::error_code& error)>;
+
+    virtual ~Timer() {}
+
+    /*
+     * Sets the expiry time. Cancels the pending waits.
+     * */
+    virtual void expires_after(std::chrono::nanoseconds duration) = 0;
+
+    virtual void async_wait(WaitHandler handler) = 0;
+
+    /*
+     * Pending waits fail with operation_aborted.
+     * */
+    virtual void cancel() = 0;
+};
+
+/*
+ * Creates the connections, timers and trackers of a client.
+ * TcpTransport uses the operating system. Tests and benchmarks
+ *      can give the client a SimulatedNetwork instead.
+ * */
+class Transport {
+  public:
+    virtual ~Transport() {}
+
+    virtual std::unique_ptr<Stream> create_stream() = 0;
+
+    /*
+     * Listens on the port. Port zero picks a free port.
+     * @throws boost::system::system_error If the port is taken.
+     * */
+    virtual std::unique_ptr<Acceptor> create_acceptor(std::uint16_t port) = 0;
+
+    virtual std::unique_ptr<Timer> create_timer() = 0;
+
+    /*
+     * Creates a tracker for the announce url and starts announcing.
+     * @return nullptr if the announce url is not supported.
+     * */
+    virtual std::shared_ptr<Tracker> create_tracker(
+        const std::shared_ptr<TrackerManager>& tracker_manager,
+        std::string announce
+    ) = 0;
+};
+
+/*
+ * Transport over the TCP/IP stack of the operating system.
+ * */
+class TcpTransport: public Transport {
+  public:
+    explicit TcpTransport(asio::io_context& io_context_ref) :
+        io_context(io_context_ref) {}
+
+    std::unique_ptr<Stream> create_stream() override;
+    std::unique_ptr<Acceptor> create_acceptor(std::uint16_t port) override;
+    std::unique_ptr<Timer> create_timer() override;
+    std::shared_ptr<Tracker> create_tracker(
+        const std::shared_ptr<TrackerManager>& tracker_manager,
+        std::string announce
+    ) override;
+
+  private:
+    asio::io_context& io_context;
+};
+
+} // namespace torrent
+
+#endif
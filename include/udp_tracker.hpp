@@ -27,10 +27,10 @@ class UdpTracker: public Tracker {
   public:
     UdpTracker(
         Private,
-        TrackerManager& tracker_manager_ref,
+        std::weak_ptr<TrackerManager> tracker_manager_ptr,
         asio::io_context& io_context_ref
     ) :
-        Tracker(tracker_manager_ref),
+        Tracker(std::move(tracker_manager_ptr)),
         state(State::Disconnected),
         connection_id_timer(io_context_ref),
         interval_timer(io_context_ref, std::chrono::steady_clock::now()),
@@ -40,11 +40,13 @@ class UdpTracker: public Tracker {
 
     ~UdpTracker() {}
 
-    static std::shared_ptr<Tracker>
-    create(TrackerManager& tracker_manager, asio::io_context& io_context) {
+    static std::shared_ptr<Tracker> create(
+        std::weak_ptr<TrackerManager> tracker_manager,
+        asio::io_context& io_context
+    ) {
         return std::make_shared<UdpTracker>(
             Private {},
-            tracker_manager,
+            std::move(tracker_manager),
             io_context
         );
     }
@@ -55,6 +57,8 @@ class UdpTracker: public Tracker {
 
     void initiate_connection(boost::url tracker_url) override;
 
+    void stop() override;
+
   private:
     enum class State {
         Connected,
@@ -0,0 +1,576 @@
+#ifndef TORRENT_WEB_SEED_HPP
+#define TORRENT_WEB_SEED_HPP
+
+#include <boost/asio.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/url.hpp>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bitfield.hpp"
+#include "http_tracker.hpp"
+#include "log.hpp"
+#include "metadata.hpp"
+#include "pieces.hpp"
+#include "rate_meter.hpp"
+
+namespace torrent {
+
+namespace http = boost::beast::http;
+namespace beast = boost::beast;
+namespace asio = boost::asio;
+using namespace boost::asio::ip;
+
+/*
+ * A web seed is a HTTP server that has every piece of the torrent.
+ * See: https://www.bittorrent.org/beps/bep_0019.html
+ * It downloads spans of consecutive pieces assigned by the PiecePicker
+ *      with HTTP/1.1 range requests over a single kept alive connection.
+ *      Requests of the next span are sent before the current one is read.
+ * */
+class WebSeed: public std::enable_shared_from_this<WebSeed> {
+  public:
+    WebSeed(
+        asio::io_context& io_context_ref,
+        asio::ssl::context& ssl_context_ref,
+        boost::url seed_url,
+        std::shared_ptr<Metadata> metadata_ptr,
+        std::shared_ptr<Pieces> pieces_ptr
+    );
+
+    WebSeed(const WebSeed&) = delete;
+    WebSeed& operator=(const WebSeed&) = delete;
+
+    virtual ~WebSeed() {}
+
+    /*
+     * Creates a WebSeed that uses HTTP or HTTPS appropriately.
+     * Metadata should be ready before calling this function.
+     * @return nullptr if the url is invalid or has an unknown scheme.
+     * */
+    static std::shared_ptr<WebSeed> create(
+        asio::io_context& io_context,
+        asio::ssl::context& ssl_context,
+        const std::string& url,
+        std::shared_ptr<Metadata> metadata,
+        std::shared_ptr<Pieces> pieces
+    );
+
+    /*
+     * Connects to the server and starts downloading.
+     * */
+    virtual void start() = 0;
+
+    /*
+     * Closes the connection and gives the assigned pieces back.
+     * */
+    virtual void stop() = 0;
+
+    /*
+     * Returns the download rate of this web seed in bytes per second.
+     * */
+    std::size_t get_download_rate() {
+        return download_rate.get_rate();
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const WebSeed& web_seed) {
+        os << "WebSeed{ " << web_seed.url.buffer() << " }";
+        return os;
+    }
+
+  protected:
+    /*
+     * Part of a span that is in a single file.
+     * Every range is fetched with one request.
+     * */
+    struct FileRange {
+        std::size_t file_index;
+        std::size_t file_offset; // Offset of the range in the file.
+        std::size_t length;
+        std::size_t span_offset; // Offset of the range in the span data.
+    };
+
+    /*
+     * Consecutive pieces downloaded together.
+     * */
+    struct Span {
+        std::size_t first_piece;
+        std::size_t piece_count;
+        std::vector<std::uint8_t> data;
+        std::vector<FileRange> ranges;
+        std::size_t next_range = 0; // Range of the next response.
+    };
+
+    /*
+     * Assigns consecutive pieces from the picker.
+     * @return nullptr if there is nothing to download.
+     * */
+    std::shared_ptr<Span> assign_span();
+
+    /*
+     * Verifies the pieces of a downloaded span and writes them.
+     * */
+    void on_span_complete(std::shared_ptr<Span> span);
+
+    /*
+     * Gives the pieces of the span back to the picker.
+     * */
+    void release_span(const Span& span);
+
+    http::request<http::empty_body> make_request(const FileRange& range) const;
+
+  protected:
+    asio::strand<asio::io_context::executor_type> strand;
+    asio::ssl::context& ssl_context;
+
+    boost::url url;
+    // Request targets of the files. See BEP19 for how they are formed.
+    std::vector<std::string> file_targets;
+
+    std::shared_ptr<Metadata> metadata;
+    std::shared_ptr<Pieces> pieces;
+
+    // A web seed has every piece.
+    std::unique_ptr<Bitfield> seed_bitfield;
+    RateMeter download_rate;
+
+    std::atomic<std::size_t> failed_pieces = 0;
+
+    static constexpr std::size_t SPAN_LENGTH = 1 << 22;
+    // Number of spans that are requested at the same time.
+    static constexpr std::size_t PIPELINE_DEPTH = 2;
+    // Servers with corrupt files are dropped.
+    static constexpr std::size_t MAX_FAILED_PIECES = 8;
+    static constexpr std::size_t MAX_RECONNECTS = 5;
+};
+
+/*
+ * A WebSeed abstraction that uses HTTP/HTTPS protocol.
+ * Every member is only accessed from the strand.
+ * */
+template<StreamTypeConcept StreamType>
+class BasicWebSeed: public WebSeed {
+  private:
+    struct Private {
+        explicit Private() = default;
+    };
+
+  public:
+    BasicWebSeed(
+        Private,
+        asio::io_context& io_context_ref,
+        asio::ssl::context& ssl_context_ref,
+        boost::url seed_url,
+        std::shared_ptr<Metadata> metadata_ptr,
+        std::shared_ptr<Pieces> pieces_ptr
+    ) :
+        WebSeed(
+            io_context_ref,
+            ssl_context_ref,
+            std::move(seed_url),
+            std::move(metadata_ptr),
+            std::move(pieces_ptr)
+        ),
+        resolver(strand),
+        timer(strand) {}
+
+    static std::shared_ptr<WebSeed> create(
+        asio::io_context& io_context,
+        asio::ssl::context& ssl_context,
+        boost::url url,
+        std::shared_ptr<Metadata> metadata,
+        std::shared_ptr<Pieces> pieces
+    ) {
+        return std::make_shared<BasicWebSeed<StreamType>>(
+            Private {},
+            io_context,
+            ssl_context,
+            std::move(url),
+            std::move(metadata),
+            std::move(pieces)
+        );
+    }
+
+    std::shared_ptr<BasicWebSeed<StreamType>> get_ptr() {
+        return std::dynamic_pointer_cast<BasicWebSeed<StreamType>>(
+            shared_from_this()
+        );
+    }
+
+    void start() override {
+        asio::dispatch(strand, [self = get_ptr()] { self->resolve(); });
+    }
+
+    void stop() override {
+        asio::dispatch(strand, [self = get_ptr()] {
+            self->stopped = true;
+            self->timer.cancel();
+            self->close();
+        });
+    }
+
+  private:
+    void resolve() {
+        if (stopped) {
+            return;
+        }
+        const auto service = url.has_port() ? url.port() : url.scheme();
+        resolver.async_resolve(
+            url.host(),
+            service,
+            [self = get_ptr()](const auto& error, auto endpoints) {
+                if (error) {
+                    TORRENT_LOG(error)
+                        << *self << " could not resolve the given url: "
+                        << error.message();
+                    return self->on_error(self->connection_id);
+                }
+                self->connect(endpoints);
+            }
+        );
+    }
+
+    void connect(const tcp::resolver::results_type& endpoints);
+
+    void on_connected() {
+        TORRENT_LOG(info) << "Connected to " << *this;
+        fill_pipeline();
+    }
+
+    /*
+     * Requests new spans until the pipeline is full.
+     * */
+    void fill_pipeline() {
+        if (stopped) {
+            return;
+        }
+        while (spans.size() < PIPELINE_DEPTH) {
+            auto span = assign_span();
+            if (!span) {
+                break;
+            }
+            for (const auto& range : span->ranges) {
+                write_queue.push_back(make_request(range));
+            }
+            spans.push_back(std::move(span));
+        }
+        if (!writing && !write_queue.empty()) {
+            write_next();
+        }
+        if (!reading && !spans.empty()) {
+            read_response();
+        }
+        if (spans.empty()) {
+            // Nothing to download right now. Check again later.
+            timer.expires_after(asio::chrono::seconds(10));
+            timer.async_wait(
+                [self = get_ptr(), id = connection_id](const auto& error) {
+                    if (!error && id == self->connection_id) {
+                        self->fill_pipeline();
+                    }
+                }
+            );
+        }
+    }
+
+    /*
+     * Sends the queued requests one after another.
+     * */
+    void write_next() {
+        writing = true;
+        http::async_write(
+            *stream,
+            write_queue.front(),
+            [self = get_ptr(),
+             id = connection_id](const beast::error_code& error, std::size_t) {
+                if (id != self->connection_id) {
+                    return; // Connection is already closed.
+                }
+                if (error) {
+                    TORRENT_LOG(error)
+                        << "Error while sending a request to " << *self << ": "
+                        << error.message();
+                    return self->on_error(id);
+                }
+                self->write_queue.pop_front();
+                if (self->write_queue.empty()) {
+                    self->writing = false;
+                } else {
+                    self->write_next();
+                }
+            }
+        );
+    }
+
+    /*
+     * Reads the response of the next range of the first span.
+     * */
+    void read_response() {
+        reading = true;
+        const auto& span = spans.front();
+        const auto& range = span->ranges[span->next_range];
+
+        parser.emplace();
+        parser->body_limit(range.length);
+        http::async_read_header(
+            *stream,
+            buffer,
+            *parser,
+            [self = get_ptr(),
+             id = connection_id](const beast::error_code& error, std::size_t) {
+                if (id != self->connection_id) {
+                    return;
+                }
+                if (error) {
+                    TORRENT_LOG(error)
+                        << "Error while reading a response from " << *self
+                        << ": " << error.message();
+                    return self->on_error(id);
+                }
+                if (!self->is_valid_response()) {
+                    // Retrying would not help.
+                    self->stopped = true;
+                    return self->on_error(id);
+                }
+                self->read_body(0);
+            }
+        );
+    }
+
+    /*
+     * Checks the status of the response header.
+     * */
+    bool is_valid_response() {
+        const auto& span = spans.front();
+        const auto& range = span->ranges[span->next_range];
+        const auto status = parser->get().result();
+        if (status == http::status::partial_content) {
+            return true;
+        }
+        const auto file_length = metadata->get_files()[range.file_index].first;
+        if (status == http::status::ok && range.file_offset == 0
+            && range.length == file_length) {
+            // Server ignored the range but sent the whole file, which we asked.
+            return true;
+        }
+        TORRENT_LOG(error) << *this << " responded with "
+                                 << parser->get().result_int() << ".";
+        return false;
+    }
+
+    /*
+     * Reads the body straight into the span data.
+     * */
+    void read_body(std::size_t received) {
+        const auto& span = spans.front();
+        const auto& range = span->ranges[span->next_range];
+
+        auto& body = parser->get().body();
+        body.data = span->data.data() + range.span_offset + received;
+        body.size = range.length - received;
+        http::async_read(
+            *stream,
+            buffer,
+            *parser,
+            [self = get_ptr(), id = connection_id, received](
+                beast::error_code error,
+                std::size_t
+            ) {
+                if (id != self->connection_id) {
+                    return;
+                }
+                if (error == http::error::need_buffer) {
+                    // Buffer is full. Not an actual error.
+                    error = {};
+                }
+                if (error) {
+                    TORRENT_LOG(error)
+                        << "Error while reading a response from " << *self
+                        << ": " << error.message();
+                    return self->on_error(id);
+                }
+                const auto& front = self->spans.front();
+                const auto length = front->ranges[front->next_range].length;
+                const auto total = length - self->parser->get().body().size;
+                self->download_rate.add(total - received);
+                self->metadata->increase_downloaded(total - received);
+
+                if (!self->parser->is_done()) {
+                    if (total == length) {
+                        TORRENT_LOG(error)
+                            << *self << " sent more than requested.";
+                        return self->on_error(id);
+                    }
+                    return self->read_body(total);
+                }
+                if (total != length) {
+                    TORRENT_LOG(error)
+                        << *self << " sent less than requested.";
+                    return self->on_error(id);
+                }
+                self->on_response();
+            }
+        );
+    }
+
+    void on_response() {
+        const bool keep_alive = parser->get().keep_alive();
+        auto& span = spans.front();
+        span->next_range += 1;
+        if (span->next_range == span->ranges.size()) {
+            auto complete_span = std::move(span);
+            spans.pop_front();
+            on_span_complete(std::move(complete_span));
+            reconnects = 0;
+        }
+        if (!keep_alive) {
+            // Server closes the connection after this response.
+            // Requests that are already sent will not be answered.
+            return on_error(connection_id);
+        }
+        reading = false;
+        fill_pipeline();
+    }
+
+    /*
+     * Closes the connection and reconnects after a while.
+     * */
+    void on_error(std::size_t id) {
+        if (id != connection_id) {
+            return;
+        }
+        close();
+        reconnects += 1;
+        if (stopped || reconnects > MAX_RECONNECTS
+            || failed_pieces >= MAX_FAILED_PIECES) {
+            TORRENT_LOG(error) << "Giving up on " << *this;
+            stopped = true;
+            return;
+        }
+        timer.expires_after(asio::chrono::seconds(5 * reconnects));
+        timer.async_wait([self = get_ptr()](const auto& error) {
+            if (!error) {
+                self->resolve();
+            }
+        });
+    }
+
+    /*
+     * Closes the connection and gives back every piece in the pipeline.
+     * */
+    void close() {
+        // Handlers of the old connection ignore their results.
+        connection_id += 1;
+        if (stream.has_value()) {
+            boost::system::error_code error;
+            beast::get_lowest_layer(*stream).close(error);
+        }
+        for (const auto& span : spans) {
+            release_span(*span);
+        }
+        spans.clear();
+        write_queue.clear();
+        writing = false;
+        reading = false;
+    }
+
+  private:
+    tcp::resolver resolver;
+    asio::steady_timer timer;
+
+    std::optional<StreamType> stream;
+    beast::flat_buffer buffer;
+    std::optional<http::response_parser<http::buffer_body>> parser;
+
+    std::deque<std::shared_ptr<Span>> spans;
+    std::deque<http::request<http::empty_body>> write_queue;
+
+    bool writing = false;
+    bool reading = false;
+    bool stopped = false;
+
+    std::size_t connection_id = 0;
+    std::size_t reconnects = 0;
+};
+
+using HttpWebSeed = BasicWebSeed<tcp::socket>;
+using HttpsWebSeed = BasicWebSeed<asio::ssl::stream<tcp::socket>>;
+
+template<>
+inline void HttpWebSeed::connect(const tcp::resolver::results_type& endpoints) {
+    stream.emplace(strand);
+    asio::async_connect(
+        *stream,
+        endpoints,
+        [self = get_ptr(), id = connection_id](auto error, auto) {
+            if (id != self->connection_id) {
+                return;
+            }
+            if (error) {
+                TORRENT_LOG(error) << "Could not connect to the " << *self
+                                         << ": " << error.message();
+                return self->on_error(id);
+            }
+            self->on_connected();
+        }
+    );
+}
+
+template<>
+inline void HttpsWebSeed::connect(const tcp::resolver::results_type& endpoints
+) {
+    stream.emplace(strand, ssl_context);
+    asio::async_connect(
+        stream->lowest_layer(),
+        endpoints,
+        [self = get_ptr(), id = connection_id](auto error, auto) {
+            if (id != self->connection_id) {
+                return;
+            }
+            if (error) {
+                TORRENT_LOG(error) << "Could not connect to the " << *self
+                                         << ": " << error.message();
+                return self->on_error(id);
+            }
+            // Set SNI Hostname (many hosts need this to handshake successfully)
+            const std::string host = self->url.host();
+            if (!SSL_set_tlsext_host_name(
+                    self->stream->native_handle(),
+                    host.c_str()
+                )) {
+                TORRENT_LOG(error)
+                    << "SNI Hostname could not be set: " << ::ERR_get_error();
+                return self->on_error(id);
+            }
+            self->stream->async_handshake(
+                asio::ssl::stream_base::client,
+                [self, id](const auto& handshake_error) {
+                    if (id != self->connection_id) {
+                        return;
+                    }
+                    if (handshake_error) {
+                        TORRENT_LOG(error)
+                            << "Could not ssl handshake with the " << *self
+                            << ": " << handshake_error.message();
+                        return self->on_error(id);
+                    }
+                    self->on_connected();
+                }
+            );
+        }
+    );
+}
+
+} // namespace torrent
+#endif
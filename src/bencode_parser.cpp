@@ -1,14 +1,13 @@
 #include "bencode_parser.hpp"
 
-#include <iomanip>
+#include "bencode_writer.hpp"
 
 namespace torrent {
 
 void BencodeParser::Element::convert_to_valid_json(
     const std::string& str,
-    std::stringstream& stream
+    std::string& output
 ) {
-    bool not_valid = true;
     bool is_hex = false;
 
     for (const char c : str) {
@@ -16,25 +15,24 @@ void BencodeParser::Element::convert_to_valid_json(
             is_hex = true;
             break;
         }
-        if (c == '\\' || c == '"') {
-            not_valid = true;
-        }
     }
     if (is_hex) {
+        static constexpr std::string_view digits = "0123456789ABCDEF";
+        output.reserve(output.size() + str.size() * 3);
         for (const char c : str) {
-            stream << std::uppercase << std::setfill('0') << std::setw(2)
-                   << std::hex
-                   << static_cast<int>(static_cast<unsigned char>(c)) << ' ';
+            const auto byte = static_cast<unsigned char>(c);
+            output += digits[byte >> 4];
+            output += digits[byte & 0xF];
+            output += ' ';
         }
-    } else if (not_valid) {
+    } else {
+        output.reserve(output.size() + str.size());
         for (const char c : str) {
             if (c == '\\' || c == '"') {
-                stream << '\\';
+                output += '\\';
             }
-            stream << c;
+            output += c;
         }
-    } else {
-        stream << str;
     }
 }
 
@@ -48,75 +46,49 @@ overloaded(Ts...) -> overloaded<Ts...>;
 
 void BencodeParser::Element::element_to_json(
     const Element& element,
-    std::stringstream& stream
+    std::string& output
 ) {
     std::visit(
         overloaded {
-            [&](const Integer value) { stream << value; },
+            [&](const Integer value) { output += std::to_string(value); },
             [&](const String& value) {
-                stream << '"';
-                convert_to_valid_json(value, stream);
-                stream << '"';
+                output += '"';
+                convert_to_valid_json(value, output);
+                output += '"';
             },
             [&](const List& list) {
-                stream << '[';
+                output += '[';
                 for (std::size_t i = 0; i < list.size(); ++i) {
-                    element_to_json(list[i], stream);
+                    element_to_json(list[i], output);
                     if (i != list.size() - 1) {
-                        stream << ", ";
+                        output += ", ";
                     }
                 }
-                stream << ']';
+                output += ']';
             },
             [&](const Dictionary& dictionary) {
-                stream << '{';
+                output += '{';
 
-                for (auto it = dictionary.begin();;) {
-                    stream << '"' << it->first << "\":";
-                    element_to_json(it->second, stream);
+                for (auto it = dictionary.begin(); it != dictionary.end();) {
+                    output += '"';
+                    output += it->first;
+                    output += "\":";
+                    element_to_json(it->second, output);
                     ++it;
                     if (it != dictionary.end()) {
-                        stream << ", ";
-                    } else {
-                        break;
+                        output += ", ";
                     }
                 }
 
-                stream << '}';
+                output += '}';
             }
         },
         element.value
     );
 }
 
-void BencodeParser::Element::element_to_bencode(
-    const Element& element,
-    std::stringstream& stream
-) {
-    std::visit(
-        overloaded {
-            [&](const int value) { stream << 'i' << value << 'e'; },
-            [&](const std::string& value) {
-                stream << value.size() << ':' << value;
-            },
-            [&](const List& list) {
-                stream << 'l';
-                for (std::size_t i = 0; i < list.size(); ++i) {
-                    element_to_bencode(list[i], stream);
-                }
-                stream << 'e';
-            },
-            [&](const Dictionary& dictionary) {
-                stream << 'd';
-                for (const auto& pair : dictionary) {
-                    stream << pair.first.size() << ':' << pair.first; // key
-                    element_to_bencode(pair.second, stream); // value
-                }
-                stream << 'e';
-            }
-        },
-        element.value
-    );
+std::string BencodeParser::Element::to_bencode() const {
+    return BencodeWriter::encode(*this);
 }
 
 void BencodeParser::parse() {
@@ -193,6 +165,7 @@ BencodeParser::Element BencodeParser::parse_list() {
 
 BencodeParser::Element BencodeParser::parse_dictionary() {
     stream->get();
+    depth += 1;
     Dictionary dictionary;
     int next_char;
     while ((next_char = stream->peek()) != 'e') {
@@ -200,13 +173,42 @@ BencodeParser::Element BencodeParser::parse_dictionary() {
             throw std::runtime_error {"EOF while parsing."};
         }
         Element key = parse_string();
+        const auto& key_str = std::get<std::string>(key.value);
+
+        if (depth == 1 && key_str == "info") {
+            // Remember where the info dictionary starts and ends,
+            //      so its original bytes can be hashed later on.
+            const auto start = stream->tellg();
+            Element value = parse_next(static_cast<char>(stream->peek()));
+            record_span(start, stream->tellg(), info_bencode);
+            dictionary.emplace(key_str, std::move(value));
+            continue;
+        }
+
         Element value = parse_next(static_cast<char>(stream->peek()));
 
-        dictionary.emplace(std::get<std::string>(key.value), value);
+        dictionary.emplace(key_str, std::move(value));
     }
     stream->get(); // consume 'e'
+    depth -= 1;
 
     return Element {dictionary};
 }
 
+void BencodeParser::record_span(
+    std::istream::pos_type start,
+    std::istream::pos_type end,
+    std::string& output
+) {
+    if (start == std::istream::pos_type(-1)
+        || end == std::istream::pos_type(-1) || end < start) {
+        // The stream is not seekable. Leave the output empty.
+        return;
+    }
+    output.resize(static_cast<std::size_t>(end - start));
+    stream->seekg(start);
+    stream->read(output.data(), end - start);
+    stream->seekg(end);
+}
+
 } // namespace torrent
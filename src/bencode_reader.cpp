@@ -0,0 +1,187 @@
+#include "bencode_reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <stdexcept>
+
+namespace torrent {
+
+std::size_t BencodeReader::feed(std::string_view chunk) {
+    // Bytes past the total length limit are never read or buffered.
+    const auto input =
+        chunk.substr(0, limits.max_total_length - total_length);
+    std::size_t i = 0;
+    while (i < input.size() && state != State::Complete) {
+        const char c = input[i];
+        switch (state) {
+            case State::Value:
+                begin_value(c);
+                i += 1;
+                break;
+            case State::Integer:
+            case State::StringLength:
+                i += 1;
+                if (std::isdigit(static_cast<unsigned char>(c))) {
+                    if (digits == 1 && number == 0) {
+                        throw std::runtime_error {
+                            state == State::Integer
+                                ? "BencodeReader: integer has a leading zero."
+                                : "BencodeReader: string length has a leading "
+                                  "zero."
+                        };
+                    }
+                    const Integer digit = c - '0';
+                    if (number > (std::numeric_limits<Integer>::max() - digit)
+                            / 10) {
+                        throw std::runtime_error {
+                            "BencodeReader: integer overflow."
+                        };
+                    }
+                    number = number * 10 + digit;
+                    digits += 1;
+                } else if (state == State::Integer && c == '-' && digits == 0
+                           && !negative) {
+                    negative = true;
+                } else if (state == State::Integer && c == 'e' && digits != 0) {
+                    if (negative && number == 0) {
+                        throw std::runtime_error {
+                            "BencodeReader: integer is negative zero."
+                        };
+                    }
+                    handler.on_integer(negative ? -number : number);
+                    end_value();
+                } else if (state == State::StringLength && c == ':') {
+                    string_length = static_cast<std::size_t>(number);
+                    if (string_length > limits.max_string_length) {
+                        throw std::runtime_error {
+                            "BencodeReader: byte string is too long."
+                        };
+                    }
+                    pending.clear();
+                    if (string_length == 0) {
+                        emit_string({});
+                    } else {
+                        state = State::StringBody;
+                    }
+                } else {
+                    throw std::runtime_error {
+                        "BencodeReader: invalid character in a number."
+                    };
+                }
+                break;
+            case State::StringBody: {
+                const auto available = input.size() - i;
+                const auto needed = string_length - pending.size();
+                if (pending.empty() && available >= needed) {
+                    // The whole string is in this chunk. Don't copy it.
+                    i += needed;
+                    emit_string(input.substr(i - needed, needed));
+                    break;
+                }
+                const auto length = std::min(available, needed);
+                pending.append(input.substr(i, length));
+                i += length;
+                if (pending.size() == string_length) {
+                    emit_string(pending);
+                }
+                break;
+            }
+            case State::Complete:
+                break;
+        }
+    }
+
+    total_length += i;
+    if (state != State::Complete && input.size() < chunk.size()) {
+        throw std::runtime_error {"BencodeReader: input is too long."};
+    }
+    return i;
+}
+
+void BencodeReader::reset() {
+    state = State::Value;
+    stack.clear();
+    key_read = false;
+    total_length = 0;
+    pending.clear();
+}
+
+void BencodeReader::begin_value(char c) {
+    if (std::isdigit(static_cast<unsigned char>(c))) {
+        state = State::StringLength;
+        number = c - '0';
+        digits = 1;
+        return;
+    }
+    if (c == 'e') {
+        if (stack.empty() || (stack.back() == Container::Dictionary && key_read)
+        ) {
+            throw std::runtime_error {"BencodeReader: unexpected end."};
+        }
+        stack.pop_back();
+        handler.on_end();
+        end_value();
+        return;
+    }
+    if (expecting_key()) {
+        throw std::runtime_error {
+            "BencodeReader: dictionary keys must be byte strings."
+        };
+    }
+    switch (c) {
+        case 'i':
+            state = State::Integer;
+            number = 0;
+            digits = 0;
+            negative = false;
+            break;
+        case 'l':
+            push(Container::List);
+            handler.on_list_begin();
+            break;
+        case 'd':
+            push(Container::Dictionary);
+            handler.on_dictionary_begin();
+            break;
+        default:
+            throw std::runtime_error {
+                "BencodeReader: invalid input "
+                + std::to_string(static_cast<int>(c))
+            };
+    }
+}
+
+void BencodeReader::end_value() {
+    if (stack.empty()) {
+        state = State::Complete;
+        return;
+    }
+    if (stack.back() == Container::Dictionary) {
+        // The value of this entry is read. Next one starts with a key.
+        key_read = false;
+    }
+    state = State::Value;
+}
+
+void BencodeReader::emit_string(std::string_view value) {
+    if (expecting_key()) {
+        handler.on_key(value);
+        key_read = true;
+        state = State::Value;
+        return;
+    }
+    handler.on_string(value);
+    end_value();
+}
+
+void BencodeReader::push(Container container) {
+    if (stack.size() >= limits.max_depth) {
+        throw std::runtime_error {"BencodeReader: nesting is too deep."};
+    }
+    stack.push_back(container);
+    key_read = false;
+    state = State::Value;
+}
+
+} // namespace torrent
@@ -0,0 +1,141 @@
+#include "bencode_writer.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace torrent {
+
+static std::size_t digit_count(BencodeParser::Integer value) {
+    // Count the minus sign as a digit.
+    std::size_t count = value < 0 ? 2 : 1;
+    // Work with negative values so the minimum integer does not overflow.
+    if (value > 0) {
+        value = -value;
+    }
+    while (value <= -10) {
+        value /= 10;
+        count += 1;
+    }
+    return count;
+}
+
+std::size_t BencodeWriter::integer_size(Integer value) {
+    return digit_count(value) + 2; // 'i' and 'e'
+}
+
+std::size_t BencodeWriter::string_size(std::string_view value) {
+    return digit_count(static_cast<Integer>(value.size())) + 1 + value.size();
+}
+
+std::size_t BencodeWriter::encoded_size(const Element& element) {
+    if (const auto* value = std::get_if<Integer>(&element.value)) {
+        return integer_size(*value);
+    }
+    if (const auto* value = std::get_if<BencodeParser::String>(&element.value)
+    ) {
+        return string_size(*value);
+    }
+    if (const auto* list = std::get_if<BencodeParser::List>(&element.value)) {
+        std::size_t size = 2; // 'l' and 'e'
+        for (const auto& item : *list) {
+            size += encoded_size(item);
+        }
+        return size;
+    }
+    const auto& dictionary = element.get<BencodeParser::Dictionary>();
+    std::size_t size = 2; // 'd' and 'e'
+    for (const auto& [key, value] : dictionary) {
+        size += string_size(key) + encoded_size(value);
+    }
+    return size;
+}
+
+void BencodeWriter::write_integer(Integer value) {
+    write_char('i');
+    write_number(value);
+    write_char('e');
+}
+
+void BencodeWriter::write_string(std::string_view value) {
+    write_number(static_cast<Integer>(value.size()));
+    write_char(':');
+    reserve(value.size());
+    std::memcpy(current, value.data(), value.size());
+    current += value.size();
+}
+
+void BencodeWriter::write_list_begin() {
+    write_char('l');
+}
+
+void BencodeWriter::write_dictionary_begin() {
+    write_char('d');
+}
+
+void BencodeWriter::write_end() {
+    write_char('e');
+}
+
+void BencodeWriter::write(const Element& element) {
+    if (const auto* value = std::get_if<Integer>(&element.value)) {
+        write_integer(*value);
+    } else if (const auto* str =
+                   std::get_if<BencodeParser::String>(&element.value)) {
+        write_string(*str);
+    } else if (const auto* list =
+                   std::get_if<BencodeParser::List>(&element.value)) {
+        write_list_begin();
+        for (const auto& item : *list) {
+            write(item);
+        }
+        write_end();
+    } else {
+        write_dictionary_begin();
+        // std::map keeps the keys sorted as bencode requires.
+        for (const auto& [key, item] :
+             element.get<BencodeParser::Dictionary>()) {
+            write_string(key);
+            write(item);
+        }
+        write_end();
+    }
+}
+
+std::string BencodeWriter::encode(const Element& element) {
+    std::string result(encoded_size(element), '\0');
+    BencodeWriter writer {std::span<char> {result}};
+    writer.write(element);
+    return result;
+}
+
+void BencodeWriter::encode_into(
+    const Element& element,
+    std::vector<std::uint8_t>& output
+) {
+    const auto offset = output.size();
+    output.resize(offset + encoded_size(element));
+    BencodeWriter writer {std::span<std::uint8_t> {output}.subspan(offset)};
+    writer.write(element);
+}
+
+void BencodeWriter::reserve(std::size_t length) {
+    if (static_cast<std::size_t>(end - current) < length) {
+        throw std::runtime_error("BencodeWriter: output buffer is too small.");
+    }
+}
+
+void BencodeWriter::write_char(char c) {
+    reserve(1);
+    *current++ = c;
+}
+
+void BencodeWriter::write_number(Integer value) {
+    const auto [ptr, error] = std::to_chars(current, end, value);
+    if (error != std::errc {}) {
+        throw std::runtime_error("BencodeWriter: output buffer is too small.");
+    }
+    current = ptr;
+}
+
+} // namespace torrent
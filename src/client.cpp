@@ -2,7 +2,6 @@
 
 #include <openssl/sha.h>
 
-#include <boost/log/trivial.hpp>
 #include <boost/url/scheme.hpp>
 #include <cstdint>
 #include <memory>
@@ -10,6 +9,8 @@
 #include <sstream>
 #include <stdexcept>
 
+#include "log.hpp"
+
 namespace torrent {
 
 Client::Client(
@@ -17,6 +18,7 @@ Client::Client(
     asio::ssl::context& ssl_context_ref,
     std::uint16_t listen_port
 ) :
+    metrics(std::make_shared<SessionMetrics>()),
     io_context(io_context_ref),
     ssl_context(ssl_context_ref),
     port(listen_port) {
@@ -44,52 +46,255 @@ Client::Client(
             ss << "\\x" << static_cast<int>(c);
         }
     }
-    BOOST_LOG_TRIVIAL(info) << "Peer id: " << ss.str();
+    TORRENT_LOG(info) << "Peer id: " << ss.str();
+}
+
+Client::~Client() {
+    stop();
 }
 
-void Client::start(const std::string_view torrent) {
+bool Client::start(const std::string_view torrent) {
     try {
         // Create the metadata from the input.
         metadata = Metadata::create(torrent);
 
         // Pieces will manage piece IO for us.
-        pieces = Pieces::create(io_context, metadata);
+        pieces = Pieces::create(io_context, metadata, metrics);
+        pieces->set_download_directory(download_directory);
+        pieces->set_extract_files(extract_files);
+        pieces->set_allocation(allocation);
+        if (file_pool) {
+            pieces->set_file_pool(file_pool);
+        }
+
+        if (!transport) {
+            transport = std::make_shared<TcpTransport>(io_context);
+        }
 
         // Create managers.
-        peer_manager =
-            std::make_unique<PeerManager>(io_context, port, pieces, metadata);
-        tracker_manager = std::make_unique<TrackerManager>(
+        peer_manager = PeerManager::create(
+            io_context,
+            transport,
+            port,
+            pieces,
+            metadata
+        );
+        peer_manager->set_bandwidth_limits(download_limit, upload_limit);
+        peer_manager->set_encryption(encryption);
+        // Port zero picks a free port. Trackers need the actual one.
+        port = peer_manager->get_port();
+        tracker_manager = std::make_shared<TrackerManager>(
             io_context,
             ssl_context,
+            transport,
             port,
             peer_id,
-            metadata
+            metadata,
+            metrics
         );
 
+        if (range_server_port.has_value()) {
+            range_server = std::make_shared<RangeServer>(
+                io_context,
+                range_server_port.value(),
+                metadata,
+                pieces
+            );
+            range_server->start();
+        }
+        if (metrics_server_port.has_value()) {
+            metrics_server = std::make_shared<MetricsServer>(
+                io_context,
+                metrics_server_port.value(),
+                metrics
+            );
+            metrics_server->start();
+        }
+
         // Magnet links only carry enough information
         //      to fetch the info directory from other peers.
         // So we need to wait until all the information is gathered before downloading.
-        metadata->on_ready([this]() {
-            pieces->init_file(); // Initialize the file.
-            peer_manager->calculate_handshake(
-                metadata->get_info_hash(),
-                peer_id
-            );
+        metadata->on_ready([weak = weak_from_this()]() {
+            if (const auto self = weak.lock()) {
+                self->on_metadata_ready();
+            }
         });
 
         // Set a handler so when a new peer is fetched from
         //      the tracker it will be sent to the PeerManager.
-        tracker_manager->set_on_new_peer([this](auto endpoint) {
-            peer_manager->add(std::move(endpoint));
-        });
+        tracker_manager->set_on_new_peer(
+            [weak = std::weak_ptr {peer_manager}](auto endpoint) {
+                if (const auto manager = weak.lock()) {
+                    manager->add(std::move(endpoint));
+                }
+            }
+        );
 
         // Populate trackers from the tracker urls we got from the metadata.
         for (const auto& url : metadata->get_trackers()) {
             tracker_manager->add(url);
         }
     } catch (const std::runtime_error& e) {
-        BOOST_LOG_TRIVIAL(error) << "Fatal client error: " << e.what();
+        TORRENT_LOG(error) << "Fatal client error: " << e.what();
+        stop();
+        return false;
     }
+    return true;
+}
+
+void Client::on_metadata_ready() {
+    {
+        // Resolve the file priorities now that we know the files.
+        std::scoped_lock<std::mutex> lock {priority_mutex};
+        std::vector<Priority> priorities(
+            metadata->get_files().size(),
+            default_file_priority
+        );
+        for (const auto& [file_index, priority] : file_priorities) {
+            if (file_index >= priorities.size()) {
+                TORRENT_LOG(error)
+                    << "Ignoring the priority of file#" << file_index
+                    << ", the torrent has " << priorities.size()
+                    << " files.";
+                continue;
+            }
+            priorities[file_index] = priority;
+        }
+        pieces->init_file(std::move(priorities)); // Initialize it.
+    }
+    {
+        std::scoped_lock<std::mutex> lock {stream_mutex};
+        apply_stream_position();
+    }
+    peer_manager->calculate_handshake(metadata->get_info_hash(), peer_id);
+    peer_manager->accept_new_peers();
+
+    // Web seeds download from HTTP servers alongside the peers.
+    for (const auto& url : metadata->get_web_seeds()) {
+        auto web_seed = WebSeed::create(
+            io_context,
+            ssl_context,
+            url,
+            metadata,
+            pieces
+        );
+        if (web_seed) {
+            web_seed->start();
+            web_seeds.push_back(std::move(web_seed));
+        }
+    }
+}
+
+void Client::set_file_priority(std::size_t file_index, Priority priority) {
+    std::scoped_lock<std::mutex> lock {priority_mutex};
+    file_priorities[file_index] = priority;
+    if (metadata && metadata->is_ready() && pieces
+        && pieces->is_initialized()) {
+        pieces->set_file_priority(file_index, priority);
+    }
+}
+
+void Client::set_stream_position(
+    std::size_t file_index,
+    std::size_t offset,
+    std::size_t bytes_per_second
+) {
+    std::scoped_lock<std::mutex> lock {stream_mutex};
+    stream_position = StreamPosition {file_index, offset, bytes_per_second};
+    if (metadata && metadata->is_ready() && pieces
+        && pieces->is_initialized()) {
+        apply_stream_position();
+    }
+}
+
+void Client::clear_stream_position() {
+    std::scoped_lock<std::mutex> lock {stream_mutex};
+    stream_position.reset();
+    if (metadata && metadata->is_ready() && pieces
+        && pieces->is_initialized()) {
+        pieces->clear_stream_position();
+    }
+}
+
+void Client::apply_stream_position() {
+    if (!stream_position.has_value()) {
+        return;
+    }
+    const auto [file_index, offset, bytes_per_second] = stream_position.value();
+    const auto& files = metadata->get_files();
+    if (file_index >= files.size() || offset >= files[file_index].first) {
+        TORRENT_LOG(error)
+            << "Invalid stream position " << offset << " in file#"
+            << file_index << ".";
+        return;
+    }
+    pieces->set_stream_position(
+        metadata->get_file_offset(file_index) + offset,
+        bytes_per_second
+    );
+}
+
+void Client::async_read(
+    std::size_t file_index,
+    std::size_t offset,
+    asio::mutable_buffer buffer,
+    Pieces::ReadHandler on_finish
+) {
+    if (!metadata || !metadata->is_ready() || !pieces
+        || !pieces->is_initialized()
+        || file_index >= metadata->get_files().size()) {
+        on_finish(asio::error::invalid_argument, 0);
+        return;
+    }
+    const auto file_length = metadata->get_files()[file_index].first;
+    if (offset > file_length) {
+        on_finish(asio::error::invalid_argument, 0);
+        return;
+    }
+    // Don't read into the next file.
+    buffer = asio::buffer(buffer, file_length - offset);
+    pieces->async_read(
+        metadata->get_file_offset(file_index) + offset,
+        buffer,
+        std::move(on_finish)
+    );
+}
+
+std::size_t Client::read(
+    std::size_t file_index,
+    std::size_t offset,
+    asio::mutable_buffer buffer
+) {
+    if (!metadata || !metadata->is_ready() || !pieces
+        || !pieces->is_initialized()
+        || file_index >= metadata->get_files().size()
+        || offset > metadata->get_files()[file_index].first) {
+        throw boost::system::system_error(asio::error::invalid_argument);
+    }
+    const auto file_length = metadata->get_files()[file_index].first;
+    return pieces->read(
+        metadata->get_file_offset(file_index) + offset,
+        asio::buffer(buffer, file_length - offset)
+    );
+}
+
+Client::Stats Client::get_stats() const {
+    Stats stats;
+    stats.peers = get_peer_infos();
+    if (!metadata || !metadata->is_ready()) {
+        return stats;
+    }
+    stats.name = metadata->get_name();
+    stats.total_length = metadata->get_total_length();
+    stats.left = metadata->get_left();
+    stats.downloaded = metadata->get_downloaded();
+    stats.uploaded = metadata->get_uploaded();
+    stats.piece_count = metadata->get_piece_count();
+    stats.pieces_done = metadata->get_pieces_done();
+    if (pieces && pieces->is_initialized()) {
+        stats.pieces = pieces->picker->get_piece_infos();
+    }
+    return stats;
 }
 
 void Client::wait() {
@@ -114,7 +319,16 @@ void Client::stop() {
         tracker_manager->stop();
     }
     if (peer_manager) {
-        tracker_manager->stop();
+        peer_manager->stop();
+    }
+    if (range_server) {
+        range_server->stop();
+    }
+    if (metrics_server) {
+        metrics_server->stop();
+    }
+    for (const auto& web_seed : web_seeds) {
+        web_seed->stop();
     }
 }
 
@@ -0,0 +1,393 @@
+#include "control_server.hpp"
+
+#include <sys/stat.h>
+
+#include <istream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+
+#include "log.hpp"
+
+namespace torrent {
+
+namespace {
+
+// Error codes defined by JSON-RPC 2.0.
+constexpr int PARSE_ERROR = -32700;
+constexpr int INVALID_REQUEST = -32600;
+constexpr int METHOD_NOT_FOUND = -32601;
+constexpr int INVALID_PARAMS = -32602;
+// Start of the range left for the application.
+constexpr int SERVER_ERROR = -32000;
+
+struct RpcError {
+    int code;
+    std::string message;
+};
+
+const Json& get_param(const Json& params, std::string_view name) {
+    const auto* param = params.find(name);
+    if (param == nullptr) {
+        throw RpcError {
+            INVALID_PARAMS,
+            "Missing parameter: " + std::string {name}
+        };
+    }
+    return *param;
+}
+
+std::size_t to_unsigned(const Json& param, std::string_view name) {
+    if (!param.is<std::int64_t>() || param.get<std::int64_t>() < 0) {
+        throw RpcError {
+            INVALID_PARAMS,
+            std::string {name} + " should be a non-negative integer"
+        };
+    }
+    return static_cast<std::size_t>(param.get<std::int64_t>());
+}
+
+std::size_t get_unsigned(const Json& params, std::string_view name) {
+    return to_unsigned(get_param(params, name), name);
+}
+
+const std::string& get_string(const Json& params, std::string_view name) {
+    const auto& param = get_param(params, name);
+    if (!param.is<std::string>()) {
+        throw RpcError {
+            INVALID_PARAMS,
+            std::string {name} + " should be a string"
+        };
+    }
+    return param.get<std::string>();
+}
+
+Priority to_priority(std::string_view name) {
+    if (name == "skip") {
+        return Priority::Skip;
+    }
+    if (name == "low") {
+        return Priority::Low;
+    }
+    if (name == "normal") {
+        return Priority::Normal;
+    }
+    if (name == "high") {
+        return Priority::High;
+    }
+    throw RpcError {INVALID_PARAMS, "Unknown priority: " + std::string {name}};
+}
+
+Json make_response(const Json& id, std::string_view key, Json value) {
+    return Json::Object {
+        {"jsonrpc", "2.0"},
+        {"id", id},
+        {std::string {key}, std::move(value)}
+    };
+}
+
+Json make_error(const Json& id, int code, std::string message) {
+    return make_response(
+        id,
+        "error",
+        Json::Object {{"code", code}, {"message", std::move(message)}}
+    );
+}
+
+} // namespace
+
+/*
+ * A connection to the ControlServer. Reads a request line,
+ *      writes the response and then reads the next one.
+ * */
+class ControlServer::Connection:
+    public std::enable_shared_from_this<Connection> {
+  public:
+    Connection(ControlServer& server_ref, protocol::socket socket_value) :
+        server(server_ref),
+        socket(std::move(socket_value)),
+        buffer(MAX_REQUEST_LENGTH) {}
+
+    void read_request() {
+        asio::async_read_until(
+            socket,
+            buffer,
+            '\n',
+            [self = shared_from_this()](const auto& error, std::size_t) {
+                if (error) {
+                    // Closed, or the line is longer than MAX_REQUEST_LENGTH.
+                    return;
+                }
+                std::string line;
+                std::istream input {&self->buffer};
+                std::getline(input, line);
+                auto response = self->server.handle(line);
+                self->response = std::move(response.line);
+                self->shutdown = response.shutdown;
+                if (self->response.empty()) {
+                    // Notifications are not answered.
+                    if (!self->shutdown_if_requested()) {
+                        self->read_request();
+                    }
+                    return;
+                }
+                self->response += '\n';
+                self->write_response();
+            }
+        );
+    }
+
+  private:
+    void write_response() {
+        asio::async_write(
+            socket,
+            asio::buffer(response),
+            [self = shared_from_this()](const auto& error, std::size_t) {
+                if (self->shutdown_if_requested()) {
+                    return;
+                }
+                if (!error) {
+                    self->read_request();
+                }
+            }
+        );
+    }
+
+    /*
+     * Calls on_shutdown if the last request of this connection asked for it.
+     * */
+    bool shutdown_if_requested() {
+        if (!shutdown || !server.on_shutdown) {
+            return false;
+        }
+        server.on_shutdown();
+        return true;
+    }
+
+  private:
+    ControlServer& server;
+    protocol::socket socket;
+    asio::streambuf buffer;
+    std::string response;
+    bool shutdown = false;
+};
+
+ControlServer::ControlServer(
+    asio::io_context& io_context_ref,
+    std::filesystem::path socket_path,
+    Session& session_ref
+) :
+    io_context(io_context_ref),
+    acceptor(io_context_ref),
+    path(std::move(socket_path)),
+    session(session_ref) {}
+
+void ControlServer::start() {
+    std::error_code error;
+    if (std::filesystem::is_socket(path, error)) {
+        std::filesystem::remove(path, error);
+    }
+    const protocol::endpoint endpoint {path.string()};
+    acceptor.open(endpoint.protocol());
+    // Only the owner may connect. The socket is created with these
+    //      permissions, changing them after bind would leave a window.
+    const auto old_mask = ::umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    boost::system::error_code bind_error;
+    acceptor.bind(endpoint, bind_error);
+    ::umask(old_mask);
+    if (bind_error) {
+        throw boost::system::system_error(bind_error);
+    }
+    acceptor.listen();
+
+    TORRENT_LOG(info) << "Control socket listening on " << path;
+    accept();
+}
+
+void ControlServer::stop() {
+    boost::system::error_code error;
+    acceptor.close(error);
+    std::error_code remove_error;
+    std::filesystem::remove(path, remove_error);
+}
+
+void ControlServer::accept() {
+    acceptor.async_accept([this](const auto& error, protocol::socket socket) {
+        if (error) {
+            if (error != asio::error::operation_aborted) {
+                TORRENT_LOG(error)
+                    << "ControlServer: error while accepting: "
+                    << error.message();
+            }
+            return;
+        }
+        std::make_shared<Connection>(*this, std::move(socket))->read_request();
+        accept();
+    });
+}
+
+ControlServer::Response ControlServer::handle(std::string_view line) {
+    Json request;
+    try {
+        request = Json::parse(line);
+    } catch (const std::runtime_error& e) {
+        return {make_error(nullptr, PARSE_ERROR, e.what()).dump()};
+    }
+
+    const auto* id = request.find("id");
+    const auto* version = request.find("jsonrpc");
+    const auto* method = request.find("method");
+    const auto* params = request.find("params");
+    if (version == nullptr || !version->is<std::string>()
+        || version->get<std::string>() != "2.0" || method == nullptr
+        || !method->is<std::string>()
+        || (params != nullptr && !params->is<Json::Object>())) {
+        const auto response = make_error(
+            id == nullptr ? Json {} : *id,
+            INVALID_REQUEST,
+            "Invalid request"
+        );
+        return {response.dump()};
+    }
+
+    std::optional<Json> result;
+    std::optional<Json> error;
+    try {
+        result = call(
+            method->get<std::string>(),
+            params == nullptr ? Json {Json::Object {}} : *params
+        );
+    } catch (const RpcError& e) {
+        error = make_error(id == nullptr ? Json {} : *id, e.code, e.message);
+    } catch (const std::runtime_error& e) {
+        error = make_error(
+            id == nullptr ? Json {} : *id,
+            SERVER_ERROR,
+            e.what()
+        );
+    }
+    // The shutdown is left to the caller, after it answers the request.
+    const bool shutdown =
+        result.has_value() && method->get<std::string>() == "shutdown";
+    if (id == nullptr) {
+        return {{}, shutdown}; // A notification.
+    }
+    if (error.has_value()) {
+        return {error->dump()};
+    }
+    return {
+        make_response(*id, "result", std::move(result.value())).dump(),
+        shutdown
+    };
+}
+
+Json ControlServer::call(std::string_view method, const Json& params) {
+    if (method == "add") {
+        const auto* directory = params.find("directory");
+        if (directory != nullptr && !directory->is<std::string>()) {
+            throw RpcError {INVALID_PARAMS, "directory should be a string"};
+        }
+        const auto id = session.add(
+            get_string(params, "source"),
+            directory == nullptr ? "." : directory->get<std::string>()
+        );
+        return Json::Object {{"id", id}};
+    }
+    if (method == "remove") {
+        session.remove(get_unsigned(params, "id"));
+        return true;
+    }
+    if (method == "pause") {
+        session.pause(get_unsigned(params, "id"));
+        return true;
+    }
+    if (method == "resume") {
+        session.resume(get_unsigned(params, "id"));
+        return true;
+    }
+    if (method == "set_limits") {
+        // A missing limit is left as it is.
+        const auto* download = params.find("download");
+        const auto* upload = params.find("upload");
+        session.set_rate_limits(
+            download == nullptr ? session.get_download_limit()
+                                : to_unsigned(*download, "download"),
+            upload == nullptr ? session.get_upload_limit()
+                              : to_unsigned(*upload, "upload")
+        );
+        return Json::Object {
+            {"download", session.get_download_limit()},
+            {"upload", session.get_upload_limit()}
+        };
+    }
+    if (method == "set_file_priority") {
+        session.set_file_priority(
+            get_unsigned(params, "id"),
+            get_unsigned(params, "file"),
+            to_priority(get_string(params, "priority"))
+        );
+        return true;
+    }
+    if (method == "list") {
+        Json::Array torrents;
+        for (const auto& status : session.list()) {
+            torrents.push_back(to_json(status, false));
+        }
+        return torrents;
+    }
+    if (method == "stats") {
+        return to_json(
+            session.get_status(get_unsigned(params, "id")),
+            true
+        );
+    }
+    if (method == "shutdown") {
+        return true; // See handle.
+    }
+    throw RpcError {
+        METHOD_NOT_FOUND,
+        "Unknown method: " + std::string {method}
+    };
+}
+
+Json ControlServer::to_json(const Session::Status& status, bool with_peers)
+    const {
+    const auto& stats = status.stats;
+    Json::Object torrent {
+        {"id", status.id},
+        {"name", stats.name},
+        {"source", status.source},
+        {"directory", status.directory.string()},
+        {"paused", status.paused},
+        {"total_length", stats.total_length},
+        {"left", stats.left},
+        {"downloaded", stats.downloaded},
+        {"uploaded", stats.uploaded},
+        {"piece_count", stats.piece_count},
+        {"pieces_done", stats.pieces_done},
+        {"peer_count", stats.peers.size()}
+    };
+    if (!with_peers) {
+        return torrent;
+    }
+    Json::Array peers;
+    for (const auto& peer : stats.peers) {
+        std::ostringstream endpoint;
+        endpoint << peer.endpoint;
+        peers.push_back(Json::Object {
+            {"endpoint", endpoint.str()},
+            {"downloaded", peer.downloaded},
+            {"download_rate", peer.download_rate},
+            {"uploaded", peer.uploaded},
+            {"upload_rate", peer.upload_rate},
+            {"am_choking", peer.am_choking},
+            {"am_interested", peer.am_interested},
+            {"peer_choking", peer.peer_choking},
+            {"peer_interested", peer.peer_interested}
+        });
+    }
+    torrent.insert_or_assign("peers", std::move(peers));
+    return torrent;
+}
+
+} // namespace torrent
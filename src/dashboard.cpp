@@ -0,0 +1,322 @@
+#include "dashboard.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+#endif
+
+namespace torrent {
+
+namespace {
+
+constexpr std::string_view RESET = "\x1b[0m";
+constexpr std::string_view BOLD = "\x1b[1m";
+constexpr std::string_view DIM = "\x1b[2m";
+constexpr std::string_view RED = "\x1b[31m";
+constexpr std::string_view GREEN = "\x1b[32m";
+constexpr std::string_view YELLOW = "\x1b[33m";
+constexpr std::string_view CLEAR_LINE = "\x1b[K"; // Clears the rest of it.
+
+// Width of the labels before the piece map.
+constexpr std::size_t LABEL_WIDTH = 8;
+
+std::string format_bytes(double bytes) {
+    static constexpr std::array<std::string_view, 5> units =
+        {"B", "KiB", "MiB", "GiB", "TiB"};
+    std::size_t unit = 0;
+    while (bytes >= 1024.0 && unit + 1 < units.size()) {
+        bytes /= 1024.0;
+        unit += 1;
+    }
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << bytes << ' '
+        << units[unit];
+    return oss.str();
+}
+
+std::string format_duration(double seconds) {
+    if (seconds < 0.0 || seconds > 100.0 * 24 * 3600) {
+        return "--";
+    }
+    const auto total = static_cast<std::size_t>(seconds);
+    std::ostringstream oss;
+    if (total >= 3600) {
+        oss << total / 3600 << "h " << std::setw(2) << std::setfill('0')
+            << total % 3600 / 60 << 'm';
+    } else if (total >= 60) {
+        oss << total / 60 << "m " << std::setw(2) << std::setfill('0')
+            << total % 60 << 's';
+    } else {
+        oss << total << 's';
+    }
+    return oss.str();
+}
+
+/*
+ * Cuts the text so it fits in the width. Text is expected to be ASCII.
+ * */
+std::string fit(std::string text, std::size_t width) {
+    if (text.size() > width) {
+        text.resize(width);
+    }
+    return text;
+}
+
+/*
+ * Draws the pieces compressed into the given number of cells.
+ * The first line shows how much of every cell is downloaded, the second
+ *      one the least number of peers that have a missing piece in it.
+ *      Cells with a missing piece that no peer has are red.
+ * */
+void render_piece_map(
+    std::ostream& os,
+    const std::vector<PiecePicker::PieceInfo>& pieces,
+    std::size_t cells
+) {
+    using Status = PiecePicker::PieceStatus;
+
+    std::ostringstream progress;
+    std::ostringstream availability;
+    for (std::size_t cell = 0; cell < cells; ++cell) {
+        const auto begin = cell * pieces.size() / cells;
+        const auto end =
+            std::max(begin + 1, (cell + 1) * pieces.size() / cells);
+
+        std::size_t have = 0;
+        std::size_t wanted = 0;
+        bool downloading = false;
+        std::size_t least_available = SIZE_MAX;
+        for (std::size_t i = begin; i < end && i < pieces.size(); ++i) {
+            const auto& piece = pieces[i];
+            if (piece.status == Status::Skipped) {
+                continue;
+            }
+            wanted += 1;
+            if (piece.status == Status::Have) {
+                have += 1;
+                continue;
+            }
+            downloading = downloading || piece.status == Status::Downloading;
+            // A peer leaving while it sends a Have can briefly
+            //      wrap the count below zero.
+            const std::size_t available =
+                piece.availability > UINT16_MAX / 2 ? 0 : piece.availability;
+            least_available = std::min(least_available, available);
+        }
+
+        if (wanted == 0) {
+            progress << ' ';
+            availability << ' ';
+            continue;
+        }
+        if (have == wanted) {
+            progress << GREEN << "█" << RESET;
+            availability << ' ';
+            continue;
+        }
+        const bool stalled = least_available == 0;
+        progress << (stalled ? RED : downloading ? YELLOW : std::string_view {})
+                 << (have == 0              ? "·"
+                     : have * 2 < wanted    ? "░"
+                                            : "▒")
+                 << RESET;
+        if (least_available > 9) {
+            availability << '+';
+        } else {
+            availability << (stalled ? RED : DIM) << least_available << RESET;
+        }
+    }
+    os << std::left << std::setw(LABEL_WIDTH) << "Pieces" << progress.str()
+       << CLEAR_LINE << '\n'
+       << std::setw(LABEL_WIDTH) << "Avail" << availability.str()
+       << CLEAR_LINE << '\n'
+       << std::right;
+}
+
+/*
+ * Returns the size of the terminal, or 80x24 if it is not a terminal.
+ * */
+std::pair<std::size_t, std::size_t> get_terminal_size() {
+#ifndef _WIN32
+    winsize size {};
+    if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col != 0
+        && size.ws_row != 0) {
+        return {size.ws_col, size.ws_row};
+    }
+#endif
+    return {80, 24};
+}
+
+} // namespace
+
+void Dashboard::start() {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (running) {
+        return;
+    }
+    running = true;
+    last_frame = Clock::now();
+    // Hide the cursor and start from an empty screen.
+    output << "\x1b[?25l\x1b[2J" << std::flush;
+    schedule();
+}
+
+void Dashboard::stop() {
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        if (!running) {
+            return;
+        }
+        running = false;
+        timer.cancel();
+    }
+    draw(); // Leave the final state on the screen.
+    std::scoped_lock<std::mutex> lock {mutex};
+    output << "\x1b[?25h" << std::flush; // Show the cursor again.
+}
+
+void Dashboard::schedule() {
+    timer.expires_after(REFRESH_INTERVAL);
+    timer.async_wait([this](const auto& error) {
+        if (error) {
+            return;
+        }
+        draw();
+        std::scoped_lock<std::mutex> lock {mutex};
+        if (running) {
+            schedule();
+        }
+    });
+}
+
+void Dashboard::draw() {
+    const auto stats = client.get_stats();
+    const auto [columns, rows] = get_terminal_size();
+    std::scoped_lock<std::mutex> lock {mutex};
+    update_rates(stats);
+    // Drawn over the previous frame instead of clearing it, so it doesn't
+    //      flicker.
+    output << "\x1b[H" << render(stats, columns, rows) << "\x1b[J"
+           << std::flush;
+}
+
+void Dashboard::update_rates(const Client::Stats& stats) {
+    const auto now = Clock::now();
+    const auto elapsed = std::chrono::duration<double>(now - last_frame);
+    if (elapsed.count() <= 0.0) {
+        return;
+    }
+    // Totals can be behind the last frame if the metadata became ready.
+    const auto downloaded = static_cast<double>(
+        stats.downloaded - std::min(stats.downloaded, last_downloaded)
+    );
+    const auto uploaded = static_cast<double>(
+        stats.uploaded - std::min(stats.uploaded, last_uploaded)
+    );
+    download_rate = download_rate * (1.0 - SMOOTHING)
+        + downloaded / elapsed.count() * SMOOTHING;
+    upload_rate = upload_rate * (1.0 - SMOOTHING)
+        + uploaded / elapsed.count() * SMOOTHING;
+    last_frame = now;
+    last_downloaded = stats.downloaded;
+    last_uploaded = stats.uploaded;
+}
+
+std::string Dashboard::render(
+    const Client::Stats& stats,
+    std::size_t columns,
+    std::size_t rows
+) {
+    columns = std::max<std::size_t>(columns, LABEL_WIDTH + 10);
+    std::ostringstream os;
+
+    if (stats.piece_count == 0) {
+        os << BOLD << "Waiting for the metadata..." << RESET << CLEAR_LINE
+           << '\n'
+           << stats.peers.size() << " peers" << CLEAR_LINE << '\n';
+        return os.str();
+    }
+
+    const auto done = stats.total_length - stats.left;
+    const double progress = stats.total_length == 0
+        ? 1.0
+        : static_cast<double>(done) / static_cast<double>(stats.total_length);
+    std::ostringstream line;
+
+    os << BOLD << fit(stats.name, columns) << RESET << CLEAR_LINE << '\n';
+
+    line << std::fixed << std::setprecision(1) << progress * 100.0 << "%  "
+         << stats.pieces_done << '/' << stats.piece_count << " pieces  "
+         << format_bytes(static_cast<double>(done)) << " of "
+         << format_bytes(static_cast<double>(stats.total_length));
+    os << fit(line.str(), columns) << CLEAR_LINE << '\n';
+
+    line.str({});
+    const auto eta = stats.left == 0 ? std::string {"done"}
+        : download_rate < 1.0
+        ? std::string {"--"}
+        : format_duration(static_cast<double>(stats.left) / download_rate);
+    line << "Down " << format_bytes(download_rate) << "/s  Up "
+         << format_bytes(upload_rate) << "/s  ETA " << eta << "  "
+         << stats.peers.size() << " peers";
+    os << fit(line.str(), columns) << CLEAR_LINE << '\n';
+
+    if (!stats.pieces.empty()) {
+        render_piece_map(os, stats.pieces, columns - LABEL_WIDTH);
+    }
+    os << CLEAR_LINE << '\n';
+
+    // Peers table, the fastest ones first.
+    auto peers = stats.peers;
+    std::sort(peers.begin(), peers.end(), [](const auto& a, const auto& b) {
+        return a.download_rate > b.download_rate;
+    });
+    line.str({});
+    line << std::left << std::setw(24) << "Peer" << std::right << std::setw(12)
+         << "Down" << std::setw(12) << "Up" << std::setw(12) << "Received"
+         << std::setw(12) << "Sent" << "  Flags";
+    os << DIM << fit(line.str(), columns) << RESET << CLEAR_LINE << '\n';
+
+    // Lines used above, and one left empty so the terminal doesn't scroll.
+    const std::size_t used = stats.pieces.empty() ? 6 : 8;
+    const auto space = rows > used ? rows - used : 0;
+    const auto shown = peers.size() <= space ? peers.size()
+        : space == 0                         ? 0
+                                             : space - 1;
+    for (std::size_t i = 0; i < shown; ++i) {
+        const auto& peer = peers[i];
+        std::ostringstream endpoint;
+        endpoint << peer.endpoint;
+        line.str({});
+        line << std::left << std::setw(24) << fit(endpoint.str(), 23)
+             << std::right << std::setw(12)
+             << format_bytes(static_cast<double>(peer.download_rate)) + "/s"
+             << std::setw(12)
+             << format_bytes(static_cast<double>(peer.upload_rate)) + "/s"
+             << std::setw(12)
+             << format_bytes(static_cast<double>(peer.downloaded))
+             << std::setw(12)
+             << format_bytes(static_cast<double>(peer.uploaded)) << "  "
+             << (peer.am_choking ? 'c' : '.')
+             << (peer.am_interested ? 'i' : '.')
+             << (peer.peer_choking ? 'C' : '.')
+             << (peer.peer_interested ? 'I' : '.');
+        os << fit(line.str(), columns) << CLEAR_LINE << '\n';
+    }
+    if (shown < peers.size()) {
+        os << DIM << "... and " << peers.size() - shown << " more" << RESET
+           << CLEAR_LINE << '\n';
+    }
+    return os.str();
+}
+
+} // namespace torrent
@@ -0,0 +1,669 @@
+#include "encrypted_stream.hpp"
+
+#include <openssl/bn.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <array>
+#include <boost/asio/post.hpp>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+
+#include "log.hpp"
+#include "sha1.hpp"
+
+namespace torrent {
+
+namespace {
+
+// Diffie-Hellman group of MSE. Keys are 768 bits.
+constexpr std::string_view DH_PRIME =
+    "FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+    "020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+    "4FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563";
+constexpr unsigned long DH_GENERATOR = 2;
+constexpr std::size_t KEY_LENGTH = 96;
+
+constexpr std::size_t MAX_PAD_LENGTH = 512;
+constexpr std::size_t VC_LENGTH = 8; // Verification constant, all zeros.
+constexpr std::size_t HASH_LENGTH = 20;
+constexpr std::size_t RC4_DISCARD = 1024;
+
+constexpr std::uint32_t CRYPTO_PLAINTEXT = 0x01;
+constexpr std::uint32_t CRYPTO_RC4 = 0x02;
+
+// First bytes of a plain BitTorrent handshake.
+constexpr std::string_view PLAIN_HANDSHAKE = "\x13" "BitTorrent protocol";
+
+using BigNum = std::unique_ptr<BIGNUM, decltype(&BN_free)>;
+using BigNumContext = std::unique_ptr<BN_CTX, decltype(&BN_CTX_free)>;
+
+BigNum from_bytes(std::span<const std::uint8_t> bytes) {
+    return {
+        BN_bin2bn(bytes.data(), static_cast<int>(bytes.size()), nullptr),
+        BN_free
+    };
+}
+
+/*
+ * Returns base ^ exponent mod prime of the DH group as KEY_LENGTH bytes.
+ * @param base nullptr for the generator.
+ * */
+std::vector<std::uint8_t>
+dh_power(const BIGNUM* base, std::span<const std::uint8_t> exponent) {
+    BIGNUM* prime_ptr = nullptr;
+    BN_hex2bn(&prime_ptr, DH_PRIME.data());
+    BigNum prime {prime_ptr, BN_free};
+    BigNum generator {BN_new(), BN_free};
+    BN_set_word(generator.get(), DH_GENERATOR);
+    BigNumContext context {BN_CTX_new(), BN_CTX_free};
+    BigNum result {BN_new(), BN_free};
+    const auto power = from_bytes(exponent);
+    if (!prime || !generator || !context || !result || !power
+        || !BN_mod_exp(
+            result.get(),
+            base ? base : generator.get(),
+            power.get(),
+            prime.get(),
+            context.get()
+        )) {
+        throw std::runtime_error("Error while computing a DH key.");
+    }
+    std::vector<std::uint8_t> bytes(KEY_LENGTH);
+    BN_bn2binpad(result.get(), bytes.data(), static_cast<int>(bytes.size()));
+    return bytes;
+}
+
+std::vector<std::uint8_t> random_bytes(std::size_t length) {
+    std::vector<std::uint8_t> bytes(length);
+    if (length != 0
+        && RAND_bytes(bytes.data(), static_cast<int>(length)) != 1) {
+        throw std::runtime_error("Error while generating random bytes.");
+    }
+    return bytes;
+}
+
+/*
+ * Returns a random pad, at most MAX_PAD_LENGTH bytes long.
+ * */
+std::vector<std::uint8_t> random_pad() {
+    const auto length = random_bytes(2);
+    return random_bytes(
+        static_cast<std::size_t>(length[0] << 8 | length[1])
+        % (MAX_PAD_LENGTH + 1)
+    );
+}
+
+std::string_view as_view(std::span<const std::uint8_t> bytes) {
+    return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+/*
+ * Returns the SHA1 of the prefix followed by the data.
+ * */
+Sha1Hash hash(std::string_view prefix, std::string_view data) {
+    std::string input {prefix};
+    input += data;
+    return sha1(input);
+}
+
+std::uint32_t read_u16(const std::uint8_t* bytes) {
+    return static_cast<std::uint32_t>(bytes[0] << 8 | bytes[1]);
+}
+
+std::uint32_t read_u32(const std::uint8_t* bytes) {
+    return static_cast<std::uint32_t>(bytes[0]) << 24
+        | static_cast<std::uint32_t>(bytes[1]) << 16
+        | static_cast<std::uint32_t>(bytes[2]) << 8
+        | static_cast<std::uint32_t>(bytes[3]);
+}
+
+void append_u16(std::vector<std::uint8_t>& bytes, std::uint32_t value) {
+    bytes.push_back(static_cast<std::uint8_t>(value >> 8));
+    bytes.push_back(static_cast<std::uint8_t>(value));
+}
+
+void append_u32(std::vector<std::uint8_t>& bytes, std::uint32_t value) {
+    append_u16(bytes, value >> 16);
+    append_u16(bytes, value);
+}
+
+const boost::system::error_code protocol_error =
+    boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+
+} // namespace
+
+EncryptedStream::EncryptedStream(
+    asio::io_context& io_context_ref,
+    std::unique_ptr<Stream> inner_stream,
+    Role stream_role,
+    std::string stream_skey,
+    EncryptionPolicy encryption_policy
+) :
+    io_context(io_context_ref),
+    inner(std::move(inner_stream)),
+    role(stream_role),
+    skey(std::move(stream_skey)),
+    policy(encryption_policy) {}
+
+void EncryptedStream::async_connect(
+    const tcp::endpoint& endpoint,
+    ConnectHandler handler
+) {
+    inner->async_connect(
+        endpoint,
+        [this, handler = std::move(handler)](const auto& error) mutable {
+            if (error) {
+                return handler(error);
+            }
+            {
+                std::scoped_lock<std::mutex> lock {mutex};
+                state = State::Handshaking;
+                on_connect = std::move(handler);
+            }
+            start_initiator();
+        }
+    );
+}
+
+void EncryptedStream::async_read_some(
+    asio::mutable_buffer buffer,
+    IoHandler handler
+) {
+    wait_handshake([this, buffer, handler = std::move(handler)](
+                       const boost::system::error_code& error
+                   ) {
+        if (error) {
+            return asio::post(io_context, [handler, error] {
+                handler(error, 0);
+            });
+        }
+        if (!input.empty()) {
+            // Payload that came with the handshake. Already decrypted.
+            const auto length = std::min(input.size(), buffer.size());
+            std::memcpy(buffer.data(), input.data(), length);
+            input.erase(
+                input.begin(),
+                input.begin() + static_cast<std::ptrdiff_t>(length)
+            );
+            return asio::post(io_context, [handler, length] {
+                handler({}, length);
+            });
+        }
+        inner->async_read_some(
+            buffer,
+            [this, buffer, handler](const auto& read_error, const auto bytes) {
+                if (!read_error && encrypted) {
+                    decryptor->process(
+                        static_cast<std::uint8_t*>(buffer.data()),
+                        bytes
+                    );
+                }
+                handler(read_error, bytes);
+            }
+        );
+    });
+}
+
+void EncryptedStream::async_write_some(
+    asio::const_buffer buffer,
+    IoHandler handler
+) {
+    auto bytes = std::make_shared<std::vector<std::uint8_t>>(
+        static_cast<const std::uint8_t*>(buffer.data()),
+        static_cast<const std::uint8_t*>(buffer.data()) + buffer.size()
+    );
+    async_write_some_in_place(
+        asio::buffer(*bytes),
+        [bytes, handler = std::move(handler)](
+            const auto& error,
+            const auto length
+        ) { handler(error, length); }
+    );
+}
+
+void EncryptedStream::async_write_some_in_place(
+    asio::mutable_buffer buffer,
+    IoHandler handler
+) {
+    wait_handshake([this, buffer, handler = std::move(handler)](
+                       const boost::system::error_code& error
+                   ) {
+        if (error) {
+            return asio::post(io_context, [handler, error] {
+                handler(error, 0);
+            });
+        }
+        bool start = false;
+        {
+            // Encrypt in the order the writes go out.
+            std::scoped_lock<std::mutex> lock {mutex};
+            if (encrypted) {
+                encryptor->process(
+                    static_cast<std::uint8_t*>(buffer.data()),
+                    buffer.size()
+                );
+            }
+            writes.push_back({buffer, handler});
+            start = !writing;
+            writing = true;
+        }
+        if (start) {
+            write_next();
+        }
+    });
+}
+
+void EncryptedStream::wait_handshake(Operation operation) {
+    bool start = false;
+    bool ready = false;
+    boost::system::error_code error;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        switch (state) {
+            case State::Waiting:
+                if (role == Role::Responder) {
+                    state = State::Handshaking;
+                    start = true;
+                }
+                [[fallthrough]];
+            case State::Handshaking:
+                waiting.push_back(std::move(operation));
+                break;
+            case State::Done:
+                ready = true;
+                break;
+            case State::Failed:
+                ready = true;
+                error = failure;
+                break;
+        }
+    }
+    if (start) {
+        start_responder();
+    } else if (ready) {
+        operation(error);
+    }
+}
+
+void EncryptedStream::start_initiator() {
+    private_key = random_bytes(HASH_LENGTH);
+    auto message = std::make_shared<std::vector<std::uint8_t>>(
+        dh_power(nullptr, private_key)
+    );
+    const auto pad = random_pad();
+    message->insert(message->end(), pad.begin(), pad.end());
+
+    write_all(
+        asio::buffer(*message),
+        [this, message](const auto& error, const auto) {
+            if (error) {
+                return fail(error);
+            }
+            read_input(KEY_LENGTH, [this] { send_initiator_request(); });
+        }
+    );
+}
+
+void EncryptedStream::send_initiator_request() {
+    const auto remote_key = from_bytes({input.data(), KEY_LENGTH});
+    create_ciphers(dh_power(remote_key.get(), private_key));
+
+    auto message = std::make_shared<std::vector<std::uint8_t>>();
+    const auto req1 = hash("req1", as_view(secret));
+    const auto req2 = hash("req2", skey);
+    const auto req3 = hash("req3", as_view(secret));
+    message->insert(message->end(), req1.begin(), req1.end());
+    for (std::size_t i = 0; i < HASH_LENGTH; ++i) {
+        message->push_back(req2[i] ^ req3[i]);
+    }
+
+    const auto encrypted_start = message->size();
+    message->resize(message->size() + VC_LENGTH);
+    append_u32(
+        *message,
+        policy == EncryptionPolicy::Forced ? CRYPTO_RC4
+                                           : CRYPTO_RC4 | CRYPTO_PLAINTEXT
+    );
+    append_u16(*message, 0); // No padC.
+    append_u16(*message, 0); // No initial payload, the peer sends it.
+    encryptor->process(
+        message->data() + encrypted_start,
+        message->size() - encrypted_start
+    );
+
+    write_all(
+        asio::buffer(*message),
+        [this, message](const auto& error, const auto) {
+            if (error) {
+                return fail(error);
+            }
+            // The answer starts with the encrypted VC, after padB.
+            std::vector<std::uint8_t> vc(VC_LENGTH);
+            auto cipher = *decryptor;
+            cipher.process(vc.data(), vc.size());
+            find_input(
+                KEY_LENGTH,
+                std::move(vc),
+                KEY_LENGTH + MAX_PAD_LENGTH,
+                [this](std::size_t position) {
+                    read_initiator_select(position);
+                }
+            );
+        }
+    );
+}
+
+void EncryptedStream::read_initiator_select(std::size_t position) {
+    const auto select_start = position + VC_LENGTH;
+    read_input(select_start + 6, [this, position, select_start] {
+        // Move the key stream past the VC we already matched.
+        decryptor->process(input.data() + position, VC_LENGTH);
+        decryptor->process(input.data() + select_start, 6);
+        const auto select = read_u32(input.data() + select_start);
+        const auto pad_length = read_u16(input.data() + select_start + 4);
+        const auto offered = policy == EncryptionPolicy::Forced
+            ? CRYPTO_RC4
+            : CRYPTO_RC4 | CRYPTO_PLAINTEXT;
+        if (pad_length > MAX_PAD_LENGTH
+            || (select != CRYPTO_RC4 && select != CRYPTO_PLAINTEXT)
+            || !(select & offered)) {
+            return fail(protocol_error);
+        }
+        const auto end = select_start + 6 + pad_length;
+        read_input(end, [this, select, select_start, end] {
+            decryptor->process(
+                input.data() + select_start + 6,
+                end - select_start - 6
+            );
+            input.erase(
+                input.begin(),
+                input.begin() + static_cast<std::ptrdiff_t>(end)
+            );
+            finish(select, 0);
+        });
+    });
+}
+
+void EncryptedStream::start_responder() {
+    read_input(PLAIN_HANDSHAKE.size(), [this] {
+        if (as_view(input).starts_with(PLAIN_HANDSHAKE)) {
+            if (policy == EncryptionPolicy::Forced) {
+                TORRENT_LOG(info) << "Refused a plaintext connection from "
+                                  << inner->remote_endpoint();
+                return fail(protocol_error);
+            }
+            return finish(CRYPTO_PLAINTEXT, input.size());
+        }
+        read_input(KEY_LENGTH, [this] { send_responder_key(); });
+    });
+}
+
+void EncryptedStream::send_responder_key() {
+    private_key = random_bytes(HASH_LENGTH);
+    const auto remote_key = from_bytes({input.data(), KEY_LENGTH});
+    create_ciphers(dh_power(remote_key.get(), private_key));
+
+    auto message = std::make_shared<std::vector<std::uint8_t>>(
+        dh_power(nullptr, private_key)
+    );
+    const auto pad = random_pad();
+    message->insert(message->end(), pad.begin(), pad.end());
+
+    write_all(
+        asio::buffer(*message),
+        [this, message](const auto& error, const auto) {
+            if (error) {
+                return fail(error);
+            }
+            // The request starts with HASH('req1', S), after padA.
+            const auto req1 = hash("req1", as_view(secret));
+            find_input(
+                KEY_LENGTH,
+                {req1.begin(), req1.end()},
+                KEY_LENGTH + MAX_PAD_LENGTH,
+                [this](std::size_t position) {
+                    read_responder_request(position);
+                }
+            );
+        }
+    );
+}
+
+void EncryptedStream::read_responder_request(std::size_t position) {
+    const auto provide_start = position + 2 * HASH_LENGTH + VC_LENGTH;
+    read_input(provide_start + 6, [this, position, provide_start] {
+        // Only the torrent of this connection is served.
+        const auto req2 = hash("req2", skey);
+        const auto req3 = hash("req3", as_view(secret));
+        for (std::size_t i = 0; i < HASH_LENGTH; ++i) {
+            if ((input[position + HASH_LENGTH + i] ^ req3[i]) != req2[i]) {
+                return fail(protocol_error);
+            }
+        }
+        const auto vc_start = position + 2 * HASH_LENGTH;
+        decryptor->process(input.data() + vc_start, VC_LENGTH + 6);
+        const auto vc_end = input.begin()
+            + static_cast<std::ptrdiff_t>(vc_start + VC_LENGTH);
+        if (std::any_of(
+                input.begin() + static_cast<std::ptrdiff_t>(vc_start),
+                vc_end,
+                [](auto byte) { return byte != 0; }
+            )) {
+            return fail(protocol_error);
+        }
+        const auto provide = read_u32(input.data() + provide_start);
+        const auto pad_length = read_u16(input.data() + provide_start + 4);
+        if (pad_length > MAX_PAD_LENGTH) {
+            return fail(protocol_error);
+        }
+
+        std::uint32_t select = 0;
+        if ((provide & CRYPTO_RC4) && policy != EncryptionPolicy::Disabled) {
+            select = CRYPTO_RC4;
+        } else if ((provide & CRYPTO_PLAINTEXT)
+                   && policy != EncryptionPolicy::Forced) {
+            select = CRYPTO_PLAINTEXT;
+        } else {
+            return fail(protocol_error);
+        }
+
+        const auto ia_length_start = provide_start + 6 + pad_length;
+        read_input(
+            ia_length_start + 2,
+            [this, select, provide_start, ia_length_start] {
+                decryptor->process(
+                    input.data() + provide_start + 6,
+                    ia_length_start + 2 - provide_start - 6
+                );
+                const auto ia_start = ia_length_start + 2;
+                const auto ia_length = read_u16(input.data() + ia_length_start);
+                read_input(ia_start + ia_length, [=, this] {
+                    // The initial payload is always encrypted.
+                    decryptor->process(input.data() + ia_start, ia_length);
+                    input.erase(
+                        input.begin(),
+                        input.begin() + static_cast<std::ptrdiff_t>(ia_start)
+                    );
+                    send_responder_select(select, ia_length);
+                });
+            }
+        );
+    });
+}
+
+void EncryptedStream::send_responder_select(
+    std::uint32_t select,
+    std::size_t decrypted
+) {
+    auto message = std::make_shared<std::vector<std::uint8_t>>(VC_LENGTH);
+    append_u32(*message, select);
+    append_u16(*message, 0); // No padD.
+    encryptor->process(message->data(), message->size());
+
+    write_all(
+        asio::buffer(*message),
+        [this, message, select, decrypted](const auto& error, const auto) {
+            if (error) {
+                return fail(error);
+            }
+            finish(select, decrypted);
+        }
+    );
+}
+
+void EncryptedStream::read_input(
+    std::size_t size,
+    std::function<void()> then
+) {
+    if (input.size() >= size) {
+        return then();
+    }
+    const auto start = input.size();
+    input.resize(std::max(size, start + READ_LENGTH));
+    inner->async_read_some(
+        asio::buffer(input.data() + start, input.size() - start),
+        [this, start, size, then = std::move(then)](
+            const auto& error,
+            const auto bytes
+        ) {
+            input.resize(start + bytes);
+            if (error) {
+                return fail(error);
+            }
+            read_input(size, std::move(then));
+        }
+    );
+}
+
+void EncryptedStream::find_input(
+    std::size_t offset,
+    std::vector<std::uint8_t> pattern,
+    std::size_t limit,
+    std::function<void(std::size_t)> then
+) {
+    const auto found = std::search(
+        input.begin() + static_cast<std::ptrdiff_t>(offset),
+        input.end(),
+        pattern.begin(),
+        pattern.end()
+    );
+    const auto position = static_cast<std::size_t>(found - input.begin());
+    if (found != input.end() && position <= limit) {
+        return then(position);
+    }
+    if (input.size() >= limit + pattern.size()) {
+        return fail(protocol_error);
+    }
+    read_input(
+        input.size() + 1,
+        [this, offset, pattern = std::move(pattern), limit, then]() mutable {
+            find_input(offset, std::move(pattern), limit, std::move(then));
+        }
+    );
+}
+
+void EncryptedStream::write_all(asio::const_buffer buffer, IoHandler handler) {
+    inner->async_write_some(
+        buffer,
+        [this, buffer, handler = std::move(handler)](
+            const auto& error,
+            const auto bytes
+        ) mutable {
+            if (error || bytes == buffer.size()) {
+                return handler(error, bytes);
+            }
+            write_all(buffer + bytes, std::move(handler));
+        }
+    );
+}
+
+void EncryptedStream::write_next() {
+    asio::const_buffer buffer;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        buffer = writes.front().buffer;
+    }
+    write_all(buffer, [this](const auto& error, const auto) {
+        PendingWrite done;
+        bool more = false;
+        {
+            std::scoped_lock<std::mutex> lock {mutex};
+            done = std::move(writes.front());
+            writes.pop_front();
+            more = !writes.empty();
+            writing = more;
+        }
+        done.handler(error, error ? 0 : done.buffer.size());
+        if (more) {
+            write_next();
+        }
+    });
+}
+
+void EncryptedStream::create_ciphers(std::vector<std::uint8_t> shared_secret) {
+    secret = std::move(shared_secret);
+    std::string key_input {as_view(secret)};
+    key_input += skey;
+    const auto key_a = hash("keyA", key_input);
+    const auto key_b = hash("keyB", key_input);
+    const bool initiator = role == Role::Initiator;
+    encryptor.emplace(initiator ? key_a : key_b);
+    decryptor.emplace(initiator ? key_b : key_a);
+    encryptor->discard(RC4_DISCARD);
+    decryptor->discard(RC4_DISCARD);
+}
+
+void EncryptedStream::finish(std::uint32_t select, std::size_t decrypted) {
+    encrypted = select == CRYPTO_RC4;
+    if (encrypted) {
+        decryptor->process(
+            input.data() + decrypted,
+            input.size() - decrypted
+        );
+    }
+    TORRENT_LOG(debug) << "Connection with " << inner->remote_endpoint()
+                       << (encrypted ? " is encrypted" : " is plaintext");
+
+    std::vector<Operation> operations;
+    ConnectHandler handler;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        state = State::Done;
+        operations = std::move(waiting);
+        handler = std::move(on_connect);
+    }
+    if (handler) {
+        handler({});
+    }
+    for (auto& operation : operations) {
+        operation({});
+    }
+}
+
+void EncryptedStream::fail(const boost::system::error_code& error) {
+    TORRENT_LOG(debug) << "Encryption handshake with "
+                       << inner->remote_endpoint()
+                       << " failed: " << error.message();
+
+    std::vector<Operation> operations;
+    ConnectHandler handler;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        state = State::Failed;
+        failure = error;
+        operations = std::move(waiting);
+        handler = std::move(on_connect);
+    }
+    inner->close();
+    if (handler) {
+        handler(error);
+    }
+    for (auto& operation : operations) {
+        operation(error);
+    }
+}
+
+} // namespace torrent
@@ -0,0 +1,86 @@
+#include "file_pool.hpp"
+
+#include <stdexcept>
+
+#include "log.hpp"
+
+namespace torrent {
+
+std::shared_ptr<AsyncFile> FilePool::open(
+    asio::io_context& io_context,
+    const std::filesystem::path& path,
+    Mode mode
+) {
+    const auto key = path.string();
+    std::scoped_lock<std::mutex> lock {mutex};
+    const auto index_it = index.find(key);
+    if (index_it != index.end()) {
+        const auto entry = index_it->second;
+        // Move it to the front, it is the most recently used now.
+        entries.splice(entries.begin(), entries, entry);
+        if (entry->mode == Mode::ReadWrite || mode == Mode::ReadOnly) {
+            return entry->file;
+        }
+        // Holders of the read only file keep it until they are done.
+        entries.erase(entry);
+        index.erase(index_it);
+    }
+
+    make_room();
+    auto file = std::make_shared<AsyncFile>(io_context);
+    file->open(
+        key,
+        AsyncFileOpenMode::Binary
+            | (mode == Mode::ReadWrite ? AsyncFileOpenMode::ReadWrite
+                                       : AsyncFileOpenMode::ReadOnly)
+    );
+    if (!file->is_open()) {
+        throw std::runtime_error("Error while opening the file " + key + ".");
+    }
+    entries.push_front({key, mode, file});
+    index[key] = entries.begin();
+    return file;
+}
+
+void FilePool::retain(const std::filesystem::path& path) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    users[path.string()] += 1;
+}
+
+void FilePool::release(const std::filesystem::path& path) {
+    const auto key = path.string();
+    std::scoped_lock<std::mutex> lock {mutex};
+    const auto users_it = users.find(key);
+    if (users_it != users.end() && --users_it->second != 0) {
+        return; // Still in use.
+    }
+    if (users_it != users.end()) {
+        users.erase(users_it);
+    }
+    const auto index_it = index.find(key);
+    if (index_it == index.end()) {
+        return;
+    }
+    entries.erase(index_it->second);
+    index.erase(index_it);
+}
+
+void FilePool::set_max_open(std::size_t max_open_files) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    max_open = max_open_files;
+}
+
+void FilePool::make_room() {
+    auto entry = entries.end();
+    while (entries.size() >= max_open && entry != entries.begin()) {
+        --entry;
+        // The pool is the only holder, so no operation is using it.
+        if (entry->file.use_count() == 1) {
+            TORRENT_LOG(debug) << "Closing the file " << entry->path;
+            index.erase(entry->path);
+            entry = entries.erase(entry);
+        }
+    }
+}
+
+} // namespace torrent
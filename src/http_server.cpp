@@ -0,0 +1,214 @@
+#include "http_server.hpp"
+
+#include "log.hpp"
+
+namespace torrent {
+
+HttpServer::HttpServer(
+    asio::io_context& io_context_ref,
+    std::uint16_t port_value,
+    Handler request_handler
+) :
+    io_context(io_context_ref),
+    acceptor(io_context_ref),
+    port(port_value),
+    handler(std::move(request_handler)) {}
+
+void HttpServer::start() {
+    // Only serve the local machine.
+    const tcp::endpoint endpoint {asio::ip::address_v4::loopback(), port};
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(asio::socket_base::reuse_address(true));
+    acceptor.bind(endpoint);
+    acceptor.listen();
+
+    TORRENT_LOG(info)
+        << "HTTP server listening on " << acceptor.local_endpoint();
+    accept();
+}
+
+void HttpServer::stop() {
+    boost::system::error_code error;
+    acceptor.close(error);
+}
+
+void HttpServer::accept() {
+    acceptor.async_accept(
+        asio::make_strand(io_context),
+        [self = shared_from_this()](const auto& error, tcp::socket socket) {
+            if (error) {
+                if (error != asio::error::operation_aborted) {
+                    TORRENT_LOG(error)
+                        << "HttpServer: error while accepting: "
+                        << error.message();
+                }
+                return;
+            }
+            std::make_shared<Session>(std::move(socket), self->handler)
+                ->start();
+            self->accept();
+        }
+    );
+}
+
+void HttpServer::Session::start() {
+    read_request();
+}
+
+void HttpServer::Session::read_request() {
+    parser.emplace();
+    parser->header_limit(MAX_HEADER_LENGTH);
+
+    stream.expires_after(REQUEST_TIMEOUT);
+    http::async_read(
+        stream,
+        buffer,
+        *parser,
+        [self = get_ptr()](const beast::error_code& error, std::size_t) {
+            if (error) {
+                // Also happens when the client closes a kept alive connection.
+                self->close();
+                return;
+            }
+            // Responses may take a long time when waiting for pieces.
+            self->stream.expires_never();
+
+            const auto& request = self->parser->get();
+            self->keep_alive = request.keep_alive();
+            self->handler(request, self);
+        }
+    );
+}
+
+void HttpServer::Session::send(
+    http::status status,
+    const std::string& content_type,
+    std::string body,
+    const std::vector<std::pair<http::field, std::string>>& fields
+) {
+    auto response =
+        std::make_shared<http::response<http::string_body>>(status, 11);
+    response->set(http::field::server, "torrent");
+    response->set(http::field::content_type, content_type);
+    for (const auto& [field, value] : fields) {
+        response->set(field, value);
+    }
+    response->keep_alive(keep_alive);
+    response->body() = std::move(body);
+    response->prepare_payload();
+
+    http::async_write(
+        stream,
+        *response,
+        [self = get_ptr(), response](const beast::error_code& error, auto) {
+            self->on_response_sent(error);
+        }
+    );
+}
+
+void HttpServer::Session::send_stream(
+    http::response<http::buffer_body> response,
+    std::size_t content_length,
+    BodyReader reader
+) {
+    stream_response = std::move(response);
+    stream_response.set(http::field::server, "torrent");
+    stream_response.keep_alive(keep_alive);
+    stream_response.content_length(content_length);
+    stream_response.body().data = nullptr;
+    stream_response.body().more = true;
+
+    stream_length = content_length;
+    stream_reader = std::move(reader);
+    chunk.resize(std::min(CHUNK_LENGTH, content_length));
+
+    serializer.emplace(stream_response);
+    http::async_write_header(
+        stream,
+        *serializer,
+        [self = get_ptr()](const beast::error_code& error, auto) {
+            if (error) {
+                self->close();
+                return;
+            }
+            self->write_chunk(0);
+        }
+    );
+}
+
+void HttpServer::Session::write_chunk(std::size_t position) {
+    if (position == stream_length) {
+        // Every chunk is sent. Finish the message.
+        stream_response.body().data = nullptr;
+        stream_response.body().more = false;
+        http::async_write(
+            stream,
+            *serializer,
+            [self = get_ptr()](const beast::error_code& error, auto) {
+                self->stream_reader = nullptr;
+                self->on_response_sent(error);
+            }
+        );
+        return;
+    }
+
+    const auto length = std::min(chunk.size(), stream_length - position);
+    stream_reader(
+        position,
+        asio::buffer(chunk.data(), length),
+        [self = get_ptr(), position, length](const auto& read_error) {
+            // The reader may finish on any thread. Continue on the strand.
+            asio::post(self->stream.get_executor(), [=] {
+                self->on_chunk_read(read_error, position, length);
+            });
+        }
+    );
+}
+
+void HttpServer::Session::on_chunk_read(
+    const boost::system::error_code& read_error,
+    std::size_t position,
+    std::size_t length
+) {
+    if (read_error) {
+        TORRENT_LOG(error)
+            << "HttpServer: error while reading the body: "
+            << read_error.message();
+        // Headers are already sent. Nothing to do but closing.
+        close();
+        return;
+    }
+    auto& body = stream_response.body();
+    body.data = chunk.data();
+    body.size = length;
+    body.more = true;
+    http::async_write(
+        stream,
+        *serializer,
+        [self = get_ptr(),
+         position,
+         length](const beast::error_code& error, auto) {
+            // need_buffer means the chunk is written.
+            if (error && error != http::error::need_buffer) {
+                self->close();
+                return;
+            }
+            self->write_chunk(position + length);
+        }
+    );
+}
+
+void HttpServer::Session::on_response_sent(const beast::error_code& error) {
+    if (error || !keep_alive) {
+        close();
+        return;
+    }
+    read_request();
+}
+
+void HttpServer::Session::close() {
+    boost::system::error_code error;
+    stream.socket().shutdown(tcp::socket::shutdown_send, error);
+}
+
+} // namespace torrent
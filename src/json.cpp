@@ -0,0 +1,379 @@
+#include "json.hpp"
+
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+
+namespace torrent {
+
+namespace {
+
+/*
+ * Recursive descent parser over the text.
+ * */
+class JsonParser {
+  public:
+    explicit JsonParser(std::string_view input) : text(input) {}
+
+    Json parse_document() {
+        auto result = parse_value(0);
+        skip_whitespace();
+        if (position != text.size()) {
+            fail("Unexpected data after the value");
+        }
+        return result;
+    }
+
+  private:
+    // Deeper documents are rejected so the stack can't overflow.
+    static constexpr std::size_t MAX_DEPTH = 64;
+
+    [[noreturn]] void fail(std::string_view reason) const {
+        throw std::runtime_error(
+            "Invalid JSON at offset " + std::to_string(position) + ": "
+            + std::string {reason}
+        );
+    }
+
+    void skip_whitespace() {
+        while (position < text.size()
+               && (text[position] == ' ' || text[position] == '\t'
+                   || text[position] == '\n' || text[position] == '\r')) {
+            position += 1;
+        }
+    }
+
+    char peek() {
+        skip_whitespace();
+        if (position == text.size()) {
+            fail("Unexpected end");
+        }
+        return text[position];
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            fail(std::string {"Expected '"} + c + "'");
+        }
+        position += 1;
+    }
+
+    void expect_literal(std::string_view literal) {
+        if (text.substr(position, literal.size()) != literal) {
+            fail("Unknown literal");
+        }
+        position += literal.size();
+    }
+
+    Json parse_value(std::size_t depth) {
+        if (depth > MAX_DEPTH) {
+            fail("Too deep");
+        }
+        switch (peek()) {
+            case '{':
+                return parse_object(depth);
+            case '[':
+                return parse_array(depth);
+            case '"':
+                return parse_string();
+            case 't':
+                expect_literal("true");
+                return true;
+            case 'f':
+                expect_literal("false");
+                return false;
+            case 'n':
+                expect_literal("null");
+                return nullptr;
+            default:
+                return parse_number();
+        }
+    }
+
+    Json parse_object(std::size_t depth) {
+        expect('{');
+        Json::Object object;
+        if (peek() == '}') {
+            position += 1;
+            return object;
+        }
+        while (true) {
+            if (peek() != '"') {
+                fail("Expected a key");
+            }
+            auto key = parse_string();
+            expect(':');
+            object.insert_or_assign(std::move(key), parse_value(depth + 1));
+            if (peek() == ',') {
+                position += 1;
+                continue;
+            }
+            expect('}');
+            return object;
+        }
+    }
+
+    Json parse_array(std::size_t depth) {
+        expect('[');
+        Json::Array array;
+        if (peek() == ']') {
+            position += 1;
+            return array;
+        }
+        while (true) {
+            array.push_back(parse_value(depth + 1));
+            if (peek() == ',') {
+                position += 1;
+                continue;
+            }
+            expect(']');
+            return array;
+        }
+    }
+
+    std::uint32_t parse_hex4() {
+        if (position + 4 > text.size()) {
+            fail("Short unicode escape");
+        }
+        std::uint32_t result = 0;
+        const auto [end, error] = std::from_chars(
+            text.data() + position,
+            text.data() + position + 4,
+            result,
+            16
+        );
+        if (error != std::errc {} || end != text.data() + position + 4) {
+            fail("Invalid unicode escape");
+        }
+        position += 4;
+        return result;
+    }
+
+    static void append_utf8(std::string& output, std::uint32_t code_point) {
+        if (code_point < 0x80) {
+            output += static_cast<char>(code_point);
+        } else if (code_point < 0x800) {
+            output += static_cast<char>(0xC0 | (code_point >> 6));
+            output += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else if (code_point < 0x10000) {
+            output += static_cast<char>(0xE0 | (code_point >> 12));
+            output += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            output += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else {
+            output += static_cast<char>(0xF0 | (code_point >> 18));
+            output += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            output += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            output += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    std::string parse_string() {
+        expect('"');
+        std::string result;
+        while (true) {
+            if (position == text.size()) {
+                fail("Unterminated string");
+            }
+            const char c = text[position++];
+            if (c == '"') {
+                return result;
+            }
+            if (static_cast<unsigned char>(c) < 0x20) {
+                fail("Control character in a string");
+            }
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (position == text.size()) {
+                fail("Unterminated escape");
+            }
+            switch (text[position++]) {
+                case '"':
+                    result += '"';
+                    break;
+                case '\\':
+                    result += '\\';
+                    break;
+                case '/':
+                    result += '/';
+                    break;
+                case 'b':
+                    result += '\b';
+                    break;
+                case 'f':
+                    result += '\f';
+                    break;
+                case 'n':
+                    result += '\n';
+                    break;
+                case 'r':
+                    result += '\r';
+                    break;
+                case 't':
+                    result += '\t';
+                    break;
+                case 'u': {
+                    auto code_point = parse_hex4();
+                    if (code_point >= 0xD800 && code_point < 0xDC00
+                        && text.substr(position, 2) == "\\u") {
+                        // Characters outside the basic plane
+                        //      are escaped as surrogate pairs.
+                        position += 2;
+                        const auto low = parse_hex4();
+                        if (low < 0xDC00 || low >= 0xE000) {
+                            fail("Invalid surrogate pair");
+                        }
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10)
+                            + (low - 0xDC00);
+                    }
+                    append_utf8(result, code_point);
+                    break;
+                }
+                default:
+                    fail("Unknown escape");
+            }
+        }
+    }
+
+    Json parse_number() {
+        const auto start = position;
+        bool is_integer = true;
+        while (position < text.size()) {
+            const char c = text[position];
+            if (c == '.' || c == 'e' || c == 'E') {
+                is_integer = false;
+            } else if (!(std::isdigit(static_cast<unsigned char>(c)) || c == '-'
+                         || c == '+')) {
+                break;
+            }
+            position += 1;
+        }
+        const auto* first = text.data() + start;
+        const auto* last = text.data() + position;
+        if (first == last) {
+            fail("Unexpected character");
+        }
+        if (is_integer) {
+            std::int64_t integer = 0;
+            const auto [end, error] = std::from_chars(first, last, integer);
+            if (error == std::errc {} && end == last) {
+                return integer;
+            }
+            // Too big for an integer, read it as a double.
+        }
+        double number = 0.0;
+        const auto [end, error] = std::from_chars(first, last, number);
+        if (error != std::errc {} || end != last) {
+            fail("Invalid number");
+        }
+        return number;
+    }
+
+  private:
+    std::string_view text;
+    std::size_t position = 0;
+};
+
+void dump_string(std::string_view string, std::string& output) {
+    static constexpr std::string_view hex = "0123456789abcdef";
+    output += '"';
+    for (const auto c : string) {
+        switch (c) {
+            case '"':
+                output += "\\\"";
+                break;
+            case '\\':
+                output += "\\\\";
+                break;
+            case '\n':
+                output += "\\n";
+                break;
+            case '\r':
+                output += "\\r";
+                break;
+            case '\t':
+                output += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    output += "\\u00";
+                    output += hex[static_cast<unsigned char>(c) >> 4];
+                    output += hex[static_cast<unsigned char>(c) & 0xF];
+                } else {
+                    output += c;
+                }
+        }
+    }
+    output += '"';
+}
+
+} // namespace
+
+const Json* Json::find(std::string_view key) const {
+    const auto* object = std::get_if<Object>(&value);
+    if (object == nullptr) {
+        return nullptr;
+    }
+    const auto it = object->find(key);
+    return it == object->end() ? nullptr : &it->second;
+}
+
+Json Json::parse(std::string_view text) {
+    return JsonParser {text}.parse_document();
+}
+
+void Json::dump(std::string& output) const {
+    std::visit(
+        [&output](const auto& element) {
+            using T = std::decay_t<decltype(element)>;
+            if constexpr (std::is_same_v<T, std::nullptr_t>) {
+                output += "null";
+            } else if constexpr (std::is_same_v<T, bool>) {
+                output += element ? "true" : "false";
+            } else if constexpr (std::is_same_v<T, std::int64_t>) {
+                output += std::to_string(element);
+            } else if constexpr (std::is_same_v<T, double>) {
+                if (!std::isfinite(element)) {
+                    output += "null"; // JSON has no infinities.
+                    return;
+                }
+                std::array<char, 32> buffer;
+                const auto [end, error] = std::to_chars(
+                    buffer.data(),
+                    buffer.data() + buffer.size(),
+                    element
+                );
+                output.append(buffer.data(), end);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                dump_string(element, output);
+            } else if constexpr (std::is_same_v<T, Array>) {
+                output += '[';
+                for (std::size_t i = 0; i < element.size(); ++i) {
+                    if (i != 0) {
+                        output += ',';
+                    }
+                    element[i].dump(output);
+                }
+                output += ']';
+            } else {
+                output += '{';
+                bool first = true;
+                for (const auto& [key, member] : element) {
+                    if (!first) {
+                        output += ',';
+                    }
+                    first = false;
+                    dump_string(key, output);
+                    output += ':';
+                    member.dump(output);
+                }
+                output += '}';
+            }
+        },
+        value
+    );
+}
+
+} // namespace torrent
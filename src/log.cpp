@@ -0,0 +1,275 @@
+#include "log.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace torrent::log {
+
+namespace {
+
+constexpr std::array<std::string_view, 6> level_names =
+    {"trace", "debug", "info", "warning", "error", "fatal"};
+
+/*
+ * Writes the record as a line in the format Boost.Log used:
+ *      [time] [thread] [level] message
+ * */
+void write_line(std::ostream& os, const Record& record) {
+    const auto time = std::chrono::system_clock::to_time_t(record.time);
+    const auto microseconds =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            record.time.time_since_epoch()
+        )
+        % std::chrono::seconds(1);
+    std::tm calendar;
+    localtime_r(&time, &calendar);
+    os << '[' << std::put_time(&calendar, "%Y-%m-%d %H:%M:%S") << '.'
+       << std::setfill('0') << std::setw(6) << microseconds.count()
+       << std::setfill(' ') << "] [" << record.thread << "] ["
+       << std::setw(7) << std::left
+       << level_names[static_cast<std::size_t>(record.level)] << std::right
+       << "] ";
+    record.format(os);
+    if (record.suppressed != 0) {
+        os << " (" << record.suppressed << " similar messages suppressed)";
+    }
+    os << '\n';
+}
+
+} // namespace
+
+/*
+ * Owns the queue of the records and the thread that writes them.
+ * The queue is a bounded multi producer queue where every slot has a
+ *      sequence number, so producers only contend on the enqueue position.
+ *      See: https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ * Once the program exits the records are written by the callers.
+ * */
+class Logger {
+  public:
+    Logger() : records(CAPACITY) {
+        for (std::size_t i = 0; i < CAPACITY; ++i) {
+            records[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        thread = std::thread {[this] { run(); }};
+    }
+
+    static Logger& get() {
+        // Never destroyed so the messages logged while other static
+        //      objects are destroyed are not lost.
+        static Logger* logger = [] {
+            auto* instance = new Logger;
+            std::atexit([] { get().shutdown(); });
+            return instance;
+        }();
+        return *logger;
+    }
+
+    /*
+     * Reserves a record to fill in.
+     * @return nullptr if the queue is full.
+     * */
+    Record* claim() {
+        if (stopped.load(std::memory_order_acquire)) {
+            thread_local Record record;
+            record.clear();
+            record.position = SYNCHRONOUS;
+            return &record;
+        }
+        auto position = enqueue_position.load(std::memory_order_relaxed);
+        while (true) {
+            auto& record = records[position & (CAPACITY - 1)];
+            const auto sequence =
+                record.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence)
+                - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (enqueue_position.compare_exchange_weak(
+                        position,
+                        position + 1,
+                        std::memory_order_relaxed
+                    )) {
+                    record.position = position;
+                    return &record;
+                }
+            } else if (difference < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /*
+     * Hands the filled record to the logging thread.
+     * */
+    void publish(Record& record) {
+        if (record.position == SYNCHRONOUS) {
+            std::scoped_lock<std::mutex> lock {output_mutex};
+            write_line(std::clog, record);
+            std::clog.flush();
+            record.clear();
+            return;
+        }
+        const bool urgent = record.level >= Level::error;
+        record.sequence.store(record.position + 1, std::memory_order_release);
+        if (urgent) {
+            wake_cv.notify_one();
+        }
+    }
+
+    void flush() {
+        const auto target = enqueue_position.load(std::memory_order_relaxed);
+        wake_cv.notify_one();
+        while (!stopped.load(std::memory_order_acquire)
+               && dequeue_position.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::scoped_lock<std::mutex> lock {output_mutex};
+        std::clog.flush();
+    }
+
+  private:
+    void run() {
+        std::ostringstream stream;
+        while (true) {
+            const bool stopping = stopping_flag.load(std::memory_order_acquire);
+            const auto written = drain(stream);
+            if (written == 0) {
+                if (stopping) {
+                    return;
+                }
+                std::unique_lock<std::mutex> lock {wake_mutex};
+                wake_cv.wait_for(lock, IDLE_WAIT);
+            }
+        }
+    }
+
+    /*
+     * Writes the records that are published.
+     * @return Number of records written.
+     * */
+    std::size_t drain(std::ostringstream& stream) {
+        std::size_t written = 0;
+        stream.str({});
+        auto position = dequeue_position.load(std::memory_order_relaxed);
+        while (written < MAX_BATCH) {
+            auto& record = records[position & (CAPACITY - 1)];
+            if (record.sequence.load(std::memory_order_acquire)
+                != position + 1) {
+                break; // Empty, or the next record is still being filled.
+            }
+            // Manipulators of the previous record don't carry over.
+            stream.flags(std::ios_base::dec | std::ios_base::skipws);
+            stream.fill(' ');
+            write_line(stream, record);
+            record.clear();
+            record.sequence.store(
+                position + CAPACITY,
+                std::memory_order_release
+            );
+            position += 1;
+            dequeue_position.store(position, std::memory_order_release);
+            written += 1;
+        }
+        const auto dropped_count =
+            dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped_count != 0) {
+            stream << "Dropped " << dropped_count
+                   << " log messages, the queue was full.\n";
+        }
+        if (written != 0 || dropped_count != 0) {
+            std::scoped_lock<std::mutex> lock {output_mutex};
+            std::clog << std::move(stream).str();
+            std::clog.flush();
+        }
+        return written;
+    }
+
+    /*
+     * Writes what is left and lets the callers write from now on.
+     * */
+    void shutdown() {
+        stopping_flag.store(true, std::memory_order_release);
+        wake_cv.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        stopped.store(true, std::memory_order_release);
+    }
+
+  private:
+    static constexpr std::size_t CAPACITY = 1 << 12; // Power of two.
+    static constexpr std::size_t MAX_BATCH = 256;
+    static constexpr std::size_t SYNCHRONOUS = ~std::size_t {0};
+    static constexpr auto IDLE_WAIT = std::chrono::milliseconds(10);
+
+    std::vector<Record> records;
+    alignas(64) std::atomic<std::size_t> enqueue_position = 0;
+    alignas(64) std::atomic<std::size_t> dequeue_position = 0;
+    std::atomic<std::size_t> dropped = 0;
+
+    std::atomic<bool> stopping_flag = false;
+    std::atomic<bool> stopped = false;
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::mutex output_mutex;
+    std::thread thread;
+};
+
+void Record::format(std::ostream& os) const {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < operand_count; ++i) {
+        const auto* operand = std::launder(reinterpret_cast<const Operand*>(
+            operands + align(offset, alignof(Operand))
+        ));
+        operand->type->format(operands + operand->value_offset, os);
+        offset = operand->end_offset;
+    }
+    os << overflow;
+}
+
+void Record::clear() {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < operand_count; ++i) {
+        auto* operand = std::launder(reinterpret_cast<Operand*>(
+            operands + align(offset, alignof(Operand))
+        ));
+        offset = operand->end_offset;
+        operand->type->destroy(operands + operand->value_offset);
+    }
+    used = 0;
+    operand_count = 0;
+    overflow.clear();
+    suppressed = 0;
+}
+
+Line::Line(Level level, RateLimiter& limiter) :
+    record(Logger::get().claim()) {
+    if (record != nullptr) {
+        record->level = level;
+        record->time = std::chrono::system_clock::now();
+        record->thread = std::this_thread::get_id();
+        record->suppressed = limiter.take_suppressed();
+    }
+}
+
+Line::~Line() {
+    if (record != nullptr) {
+        Logger::get().publish(*record);
+    }
+}
+
+void flush() {
+    Logger::get().flush();
+}
+
+} // namespace torrent::log
@@ -3,21 +3,199 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/ssl/verify_mode.hpp>
 #include <boost/bind/bind.hpp>
-#include <boost/log/trivial.hpp>
+#include <charconv>
+#include <csignal>
 #include <exception>
+#include <fstream>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 #include "client.hpp"
+#include "control_server.hpp"
+#include "dashboard.hpp"
+#include "log.hpp"
+#include "session.hpp"
+#include "torrent_creator.hpp"
+#include "trace.hpp"
 
 namespace asio = boost::asio;
 
+/*
+ * Writes the trace every time the signal arrives.
+ * */
+void wait_trace_signal(asio::signal_set& signals) {
+    signals.async_wait([&signals](const auto& error, int) {
+        if (error) {
+            return;
+        }
+        torrent::trace::dump();
+        wait_trace_signal(signals);
+    });
+}
+
+/*
+ * Parses a decimal number that is the whole text.
+ * @return Empty if the text is not a number or it is over max_value.
+ * */
+std::optional<std::size_t> parse_number(
+    std::string_view text,
+    std::size_t max_value = std::numeric_limits<std::size_t>::max()
+) {
+    std::size_t number = 0;
+    const auto* end = text.data() + text.size();
+    const auto [last, error] = std::from_chars(text.data(), end, number);
+    if (error != std::errc {} || last != end || number > max_value) {
+        return std::nullopt;
+    }
+    return number;
+}
+
+/*
+ * Runs the torrents added through the control socket until
+ *      it is asked to shut down, or SIGINT or SIGTERM arrives.
+ * */
+int run_daemon(const char* socket_path) {
+    asio::io_context io_context;
+    asio::ssl::context ssl_context(asio::ssl::context::tls_client);
+    ssl_context.set_default_verify_paths();
+    torrent::Session session {ssl_context};
+    torrent::ControlServer server {io_context, socket_path, session};
+
+    asio::signal_set signals(io_context, SIGINT, SIGTERM);
+    const auto shutdown = [&server, &io_context, &signals]() {
+        TORRENT_LOG(info) << "Shutting down.";
+        server.stop();
+        signals.cancel();
+        io_context.stop();
+    };
+    signals.async_wait([shutdown](const auto& error, int) {
+        if (!error) {
+            shutdown();
+        }
+    });
+    server.set_on_shutdown(shutdown);
+    try {
+        server.start();
+    } catch (const boost::system::system_error& error) {
+        TORRENT_LOG(error)
+            << "Could not create the control socket: " << error.what();
+        return -1;
+    }
+
+    // Requests block while torrents are stopped, so they get a few threads.
+    std::vector<std::thread> thread_pool;
+    for (std::size_t i = 0; i < 4; ++i) {
+        thread_pool.emplace_back([&io_context]() { io_context.run(); });
+    }
+    for (auto& thread : thread_pool) {
+        thread.join();
+    }
+    session.stop();
+    return 0;
+}
+
+/*
+ * Creates a .torrent file from the file or the directory in argv[2].
+ * */
+int run_create(const int argc, const char* argv[]) {
+    if (argc < 3) {
+        TORRENT_LOG(error) << "Usage: torrent create <path> [options]";
+        return -1;
+    }
+    try {
+        torrent::TorrentCreator creator {argv[2]};
+        std::filesystem::path output =
+            std::filesystem::absolute(argv[2]).lexically_normal();
+        if (!output.has_filename()) {
+            output = output.parent_path();
+        }
+        output = output.filename().string() + ".torrent";
+
+        for (int i = 3; i < argc; ++i) {
+            const std::string_view option = argv[i];
+            if (option == "--private") {
+                creator.set_private(true);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                TORRENT_LOG(error) << "Missing the value of " << option;
+                return -1;
+            }
+            const char* value = argv[++i];
+            if (option == "--output") {
+                output = value;
+            } else if (option == "--tracker") {
+                creator.add_tracker(value);
+            } else if (option == "--web-seed") {
+                creator.add_web_seed(value);
+            } else if (option == "--comment") {
+                creator.set_comment(value);
+            } else if (option == "--piece-length") {
+                // In KiB.
+                const auto length = parse_number(
+                    value,
+                    std::numeric_limits<std::size_t>::max() / 1024
+                );
+                if (!length.has_value()) {
+                    TORRENT_LOG(error) << "Invalid piece length: " << value;
+                    return -1;
+                }
+                creator.set_piece_length(length.value() * 1024);
+            } else if (option == "--threads") {
+                const auto count = parse_number(value);
+                if (!count.has_value()) {
+                    TORRENT_LOG(error) << "Invalid thread count: " << value;
+                    return -1;
+                }
+                creator.set_thread_count(count.value());
+            } else {
+                TORRENT_LOG(error) << "Unknown option: " << option;
+                return -1;
+            }
+        }
+
+        TORRENT_LOG(info) << "Hashing " << creator.get_total_length()
+                          << " bytes in pieces of "
+                          << creator.get_piece_length() << " bytes.";
+        const auto torrent = creator.create();
+        std::ofstream file {output, std::ios::binary | std::ios::trunc};
+        file.write(
+            torrent.data(),
+            static_cast<std::streamsize>(torrent.size())
+        );
+        if (!file) {
+            TORRENT_LOG(error) << "Could not write " << output;
+            return -1;
+        }
+        TORRENT_LOG(info) << "Created " << output;
+    } catch (const std::exception& e) {
+        TORRENT_LOG(error) << "Could not create the torrent: " << e.what();
+        return -1;
+    }
+    return 0;
+}
+
 int main(const int argc, const char* argv[]) {
     if (argc < 2) {
         return -1;
     }
+    if (std::string_view {argv[1]} == "--daemon") {
+        if (argc != 3) {
+            TORRENT_LOG(error) << "Usage: torrent --daemon <socket path>";
+            return -1;
+        }
+        return run_daemon(argv[2]);
+    }
+    if (std::string_view {argv[1]} == "create") {
+        return run_create(argc, argv);
+    }
     auto start = std::chrono::steady_clock::now(); // Start the timer.
 
     asio::io_context io_context;
@@ -26,8 +204,117 @@ int main(const int argc, const char* argv[]) {
     ); // Create the ssl context.
     ssl_context.set_default_verify_paths();
     auto client = std::make_shared<torrent::Client>(io_context, ssl_context);
+    asio::signal_set trace_signals(io_context);
+
+    bool show_dashboard = false;
+    for (int i = 2; i < argc; ++i) {
+        const std::string_view option = argv[i];
+        if (option == "--dashboard") {
+            // Draw the progress on the terminal instead of logging it.
+            show_dashboard = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            TORRENT_LOG(error) << "Missing the value of " << option;
+            return -1;
+        }
+        const char* value = argv[++i];
+        if (option == "--only") {
+            // Download only the given comma separated file indices.
+            client->set_default_file_priority(torrent::Priority::Skip);
+            std::stringstream indices {value};
+            std::string index;
+            while (std::getline(indices, index, ',')) {
+                const auto file_index = parse_number(index);
+                if (!file_index.has_value()) {
+                    TORRENT_LOG(error) << "Invalid file index: " << index;
+                    return -1;
+                }
+                client->set_file_priority(
+                    file_index.value(),
+                    torrent::Priority::Normal
+                );
+            }
+        } else if (option == "--stream") {
+            // Download the given file in order so it can be played early.
+            const auto file_index = parse_number(value);
+            if (!file_index.has_value()) {
+                TORRENT_LOG(error) << "Invalid file index: " << value;
+                return -1;
+            }
+            client->set_stream_position(file_index.value(), 0);
+        } else if (option == "--serve") {
+            // Serve the files on localhost while downloading.
+            const auto port =
+                parse_number(value, std::numeric_limits<std::uint16_t>::max());
+            if (!port.has_value()) {
+                TORRENT_LOG(error) << "Invalid port: " << value;
+                return -1;
+            }
+            client->set_range_server_port(
+                static_cast<std::uint16_t>(port.value())
+            );
+        } else if (option == "--metrics") {
+            // Serve Prometheus metrics on localhost while downloading.
+            const auto port =
+                parse_number(value, std::numeric_limits<std::uint16_t>::max());
+            if (!port.has_value()) {
+                TORRENT_LOG(error) << "Invalid port: " << value;
+                return -1;
+            }
+            client->set_metrics_server_port(
+                static_cast<std::uint16_t>(port.value())
+            );
+        } else if (option == "--trace") {
+            // Record the hot paths, written at exit and on SIGUSR1.
+            torrent::trace::start(value);
+            trace_signals.add(SIGUSR1);
+            wait_trace_signal(trace_signals);
+        } else if (option == "--allocation") {
+            // Allocate the disk space: sparse, full or extents.
+            const std::string_view mode = value;
+            if (mode == "sparse") {
+                client->set_allocation(torrent::Pieces::Allocation::Sparse);
+            } else if (mode == "full") {
+                client->set_allocation(torrent::Pieces::Allocation::Full);
+            } else if (mode == "extents") {
+                client->set_allocation(torrent::Pieces::Allocation::Extents);
+            } else {
+                TORRENT_LOG(error) << "Unknown allocation: " << mode;
+                return -1;
+            }
+        } else if (option == "--encryption") {
+            // Encrypt the peer connections: disabled, enabled or forced.
+            const std::string_view policy = value;
+            if (policy == "disabled") {
+                client->set_encryption(torrent::EncryptionPolicy::Disabled);
+            } else if (policy == "enabled") {
+                client->set_encryption(torrent::EncryptionPolicy::Enabled);
+            } else if (policy == "forced") {
+                client->set_encryption(torrent::EncryptionPolicy::Forced);
+            } else {
+                TORRENT_LOG(error) << "Unknown encryption policy: " << policy;
+                return -1;
+            }
+        } else {
+            TORRENT_LOG(error) << "Unknown option: " << option;
+            return -1;
+        }
+    }
 
-    client->start(argv[1]);
+    std::optional<torrent::Dashboard> dashboard;
+    if (show_dashboard) {
+        // Only warnings and errors are logged, to the stderr.
+        torrent::log::set_level(torrent::log::Level::warning);
+        dashboard.emplace(io_context, *client);
+    }
+
+    if (!client->start(argv[1])) {
+        return -1;
+    }
+    if (dashboard) {
+        dashboard->start();
+    }
     std::vector<std::thread> thread_pool;
 
     for (std::size_t i = 0; i < std::thread::hardware_concurrency(); ++i) {
@@ -35,7 +322,7 @@ int main(const int argc, const char* argv[]) {
             try {
                 io_context.run();
             } catch (const std::exception& exception) {
-                BOOST_LOG_TRIVIAL(error)
+                TORRENT_LOG(error)
                     << "Fatal error running the client: " << exception.what();
                 client->stop(); // Stop waiting and close the program.
             }
@@ -43,6 +330,9 @@ int main(const int argc, const char* argv[]) {
     }
     // Wait until the client is finished.
     client->wait();
+    if (dashboard) {
+        dashboard->stop();
+    }
 
     // Stop the context and the worker threads.
     io_context.stop();
@@ -55,6 +345,6 @@ int main(const int argc, const char* argv[]) {
     auto elapsed =
         std::chrono::duration_cast<std::chrono::seconds>(end - start);
 
-    BOOST_LOG_TRIVIAL(info) << "Finished downloading the file in "
+    TORRENT_LOG(info) << "Finished downloading the file in "
                             << elapsed.count() << " seconds.";
 }
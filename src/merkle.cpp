@@ -0,0 +1,97 @@
+#include "merkle.hpp"
+
+#include <cstring>
+
+namespace torrent {
+
+std::size_t next_power_of_two(std::size_t value) {
+    std::size_t result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+Sha256Hash merkle_parent(const Sha256Hash& left, const Sha256Hash& right) {
+    std::array<std::uint8_t, 2 * sizeof(Sha256Hash)> pair;
+    std::memcpy(pair.data(), left.data(), left.size());
+    std::memcpy(pair.data() + left.size(), right.data(), right.size());
+    Sha256Hash hash;
+    SHA256(pair.data(), pair.size(), hash.data());
+    return hash;
+}
+
+std::vector<Sha256Hash> merkle_leaves(std::string_view data) {
+    std::vector<Sha256Hash> leaves;
+    leaves.reserve((data.size() + MERKLE_LEAF_LENGTH - 1) / MERKLE_LEAF_LENGTH);
+    for (std::size_t offset = 0; offset < data.size();
+         offset += MERKLE_LEAF_LENGTH) {
+        leaves.push_back(sha256(data.substr(offset, MERKLE_LEAF_LENGTH)));
+    }
+    return leaves;
+}
+
+Sha256Hash merkle_pad(std::size_t leaf_count, const Sha256Hash& pad) {
+    auto hash = pad;
+    for (; leaf_count > 1; leaf_count /= 2) {
+        hash = merkle_parent(hash, hash);
+    }
+    return hash;
+}
+
+Sha256Hash merkle_root(
+    std::span<const Sha256Hash> leaves,
+    std::size_t leaf_count,
+    const Sha256Hash& pad
+) {
+    if (leaves.empty()) {
+        return merkle_pad(leaf_count, pad);
+    }
+    // Hash a layer at a time in place. Nodes past the given leaves
+    //      are all the same, so only one of them is kept per layer.
+    std::vector<Sha256Hash> layer {leaves.begin(), leaves.end()};
+    auto layer_pad = pad;
+    for (; leaf_count > 1; leaf_count /= 2) {
+        const auto parent_count = (layer.size() + 1) / 2;
+        for (std::size_t i = 0; i < parent_count; ++i) {
+            const auto& right =
+                2 * i + 1 < layer.size() ? layer[2 * i + 1] : layer_pad;
+            layer[i] = merkle_parent(layer[2 * i], right);
+        }
+        layer.resize(parent_count);
+        layer_pad = merkle_parent(layer_pad, layer_pad);
+    }
+    return layer.front();
+}
+
+MerkleTree::MerkleTree(
+    std::span<const Sha256Hash> leaves,
+    std::size_t leaf_count,
+    const Sha256Hash& pad
+) {
+    layers.emplace_back(leaves.begin(), leaves.end());
+    layers.back().resize(leaf_count, pad);
+    while (layers.back().size() > 1) {
+        const auto& layer = layers.back();
+        std::vector<Sha256Hash> parents(layer.size() / 2);
+        for (std::size_t i = 0; i < parents.size(); ++i) {
+            parents[i] = merkle_parent(layer[2 * i], layer[2 * i + 1]);
+        }
+        layers.push_back(std::move(parents));
+    }
+}
+
+std::vector<Sha256Hash> MerkleTree::get_proof(
+    std::size_t layer,
+    std::size_t index,
+    std::size_t max_count
+) const {
+    std::vector<Sha256Hash> proof;
+    for (; layer + 1 < layers.size() && proof.size() < max_count; ++layer) {
+        proof.push_back(layers[layer][index ^ 1]);
+        index /= 2;
+    }
+    return proof;
+}
+
+} // namespace torrent
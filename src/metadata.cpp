@@ -2,14 +2,16 @@
 
 #include <openssl/sha.h> // For SHA1
 
-#include <boost/log/trivial.hpp>
+#include <algorithm>
 #include <boost/url/urls.hpp>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
 
 #include "bencode_parser.hpp"
+#include "log.hpp"
 
 namespace torrent {
 
@@ -18,21 +20,11 @@ Metadata::from_torrent_file(const std::string_view path) {
     auto metadata = std::make_shared<Metadata>(Private {});
     BencodeParser bencode_parser {path};
     bencode_parser.parse();
-    BOOST_LOG_TRIVIAL(info) << "Parsed the .torrent file: " << path;
+    TORRENT_LOG(info) << "Parsed the .torrent file: " << path;
 
     auto& dictionary =
         std::get<BencodeParser::Dictionary>(bencode_parser.get().value);
 
-    auto& info = dictionary["info"];
-    auto info_hash = get_info_hash(info);
-
-    // Load the info directory.
-    metadata->load_info(std::move(info), std::move(info_hash));
-
-    BOOST_LOG_TRIVIAL(info)
-        << "File length: " << metadata->total_length
-        << ", piece_length: " << metadata->piece_length << ".";
-
     // Get the announces.
     BencodeParser::Dictionary::iterator announce_element;
     if ((announce_element = dictionary.find("announce")) != dictionary.end()) {
@@ -50,30 +42,91 @@ Metadata::from_torrent_file(const std::string_view path) {
                 );
             }
         }
-    } else if ((announce_element = dictionary.find("url-list"))
-               != dictionary.end()) {
-        // More about url-list: https://www.bittorrent.org/beps/bep_0019.html
-        // TODO
-        throw std::runtime_error("Metadata: url-list unimplemented");
-    } else {
+    }
+
+    // Web seeds, see: https://www.bittorrent.org/beps/bep_0019.html
+    // url-list is either a single url or a list of urls.
+    const auto url_list = dictionary.find("url-list");
+    if (url_list != dictionary.end()) {
+        auto& value = url_list->second.value;
+        if (auto* url = std::get_if<BencodeParser::String>(&value)) {
+            metadata->web_seeds.emplace_back(std::move(*url));
+        } else if (auto* list = std::get_if<BencodeParser::List>(&value)) {
+            for (auto& element : *list) {
+                metadata->web_seeds.emplace_back(
+                    std::move(element.get<BencodeParser::String>())
+                );
+            }
+        }
+        // Empty urls are used to mean no web seeds.
+        std::erase(metadata->web_seeds, "");
+    }
+
+    if (metadata->trackers.empty() && metadata->web_seeds.empty()) {
         throw std::runtime_error(
             "Could not create the metadata, invalid .torrent file"
         );
     }
 
+    auto& info = dictionary["info"];
+    auto& info_bencode = bencode_parser.get_info_bencode();
+    if (info_bencode.empty()) {
+        // Parser could not record the original bytes. Fall back to encoding.
+        info_bencode = info.to_bencode();
+    }
+
+    // Piece layers of v2 torrents are outside of the info directory.
+    BencodeParser::Dictionary piece_layers;
+    const auto piece_layers_element = dictionary.find("piece layers");
+    if (piece_layers_element != dictionary.end()) {
+        piece_layers = std::move(
+            piece_layers_element->second.get<BencodeParser::Dictionary>()
+        );
+    }
+
+    // Load the info directory.
+    // This must be the last step because Metadata is immutable after it.
+    metadata->load_info(
+        std::move(info),
+        std::move(info_bencode),
+        std::move(piece_layers)
+    );
+
+    TORRENT_LOG(info)
+        << "File length: " << metadata->total_length
+        << ", piece_length: " << metadata->piece_length << ".";
+
     return metadata;
 }
 
 void Metadata::load_info(
     BencodeParser::Element info_element,
-    std::string info_hash_param
+    std::string info_bencode_param,
+    BencodeParser::Dictionary piece_layers
 ) {
-    std::unique_lock<std::mutex> lock {mutex};
-
-    info_hash = std::move(info_hash_param);
+    if (is_ready()) {
+        throw std::runtime_error("Metadata: info directory is already loaded");
+    }
 
     auto& info = info_element.get<BencodeParser::Dictionary>();
 
+    const auto meta_version = info.find("meta version");
+    const bool has_v2_info = meta_version != info.end()
+        && meta_version->second.get<BencodeParser::Integer>() == 2;
+    const bool has_v1_info = info.find("pieces") != info.end();
+    if (!has_v1_info && !has_v2_info) {
+        throw std::runtime_error("Metadata: info directory has no pieces");
+    }
+
+    // Hybrid torrents are found by their v1 info hash.
+    info_hash = has_v1_info
+        ? get_info_hash(info_bencode_param)
+        : get_info_hash_v2(info_bencode_param).substr(0, 20);
+    if (has_v2_info) {
+        info_hash_v2 = get_info_hash_v2(info_bencode_param);
+    }
+    info_bencode = std::move(info_bencode_param);
+
     name = info["name"].get<std::string>();
     // BitTorrent also supports donwloading multiple files under a folder.
     // But we will always download the torrent to a single file.
@@ -82,11 +135,31 @@ void Metadata::load_info(
     piece_length = static_cast<std::size_t>(
         info["piece length"].get<BencodeParser::Integer>()
     );
+    if (piece_length == 0
+        || (has_v2_info
+            && (piece_length < BLOCK_LENGTH
+                || (piece_length & (piece_length - 1)) != 0))) {
+        throw std::runtime_error("Metadata: invalid piece length");
+    }
+    block_count = (piece_length + BLOCK_LENGTH - 1) / BLOCK_LENGTH;
     total_length = 0;
-    pieces = std::move(info["pieces"].get<std::string>());
 
-    if (info.find("files") != info.end()) {
+    if (has_v1_info) {
+        // Store the piece hashes as fixed size arrays, not one long string.
+        const auto& pieces = info["pieces"].get<std::string>();
+        if (pieces.size() % sizeof(Sha1Hash) != 0) {
+            throw std::runtime_error("Metadata: invalid pieces length");
+        }
+        piece_hashes.resize(pieces.size() / sizeof(Sha1Hash));
+        std::memcpy(piece_hashes.data(), pieces.data(), pieces.size());
+    }
+
+    if (!has_v1_info) {
+        // Pure v2 torrents only have the file tree.
+        load_file_tree(info, false);
+    } else if (info.find("files") != info.end()) {
         // Multiple file mode.
+        single_file = false;
         for (auto& element :
              info["files"].get<BencodeParser::List>()) { // Iterate the files.
             auto& file = element.get<BencodeParser::Dictionary>();
@@ -101,6 +174,13 @@ void Metadata::load_info(
                  file_dict["path"].get<BencodeParser::List>()) {
                 path += '/' + path_element.get<BencodeParser::String>();
             }
+            // Pad files have a "p" in their attributes(BEP47).
+            const auto attr = file_dict.find("attr");
+            pad_files.push_back(
+                attr != file_dict.end()
+                && attr->second.get<BencodeParser::String>().find('p')
+                    != std::string::npos
+            );
             // Add a new file.
             files.emplace_back(file_length, std::move(path));
             total_length += file_length;
@@ -110,15 +190,277 @@ void Metadata::load_info(
         auto file_length = info["length"].get<BencodeParser::Integer>();
         total_length = static_cast<std::size_t>(file_length);
         files.emplace_back(file_length, name);
+        pad_files.push_back(false);
+    }
+
+    // Precompute where every file starts for offset to file lookups.
+    file_offsets.reserve(files.size() + 1);
+    file_offsets.push_back(0);
+    for (const auto& [length, path] : files) {
+        file_offsets.push_back(file_offsets.back() + length);
     }
 
-    left = total_length;
+    piece_count = (total_length + piece_length - 1) / piece_length;
+    if (has_v1_info && piece_count != piece_hashes.size()) {
+        throw std::runtime_error("Metadata: invalid number of pieces");
+    }
 
-    ready = true;
-    if (on_ready_callback.has_value()) {
-        lock.unlock();
-        on_ready_callback.value()();
+    if (has_v2_info) {
+        if (has_v1_info) {
+            // The files of the file tree must match the files list.
+            load_file_tree(info, true);
+        }
+        if (!load_piece_layers(piece_layers)) {
+            if (!has_v1_info) {
+                throw std::runtime_error("Metadata: missing piece layers");
+            }
+            TORRENT_LOG(warning)
+                << "Metadata: missing piece layers, pieces are checked "
+                   "with SHA1.";
+            piece_hashes_v2.clear();
+            piece_layer_trees.clear();
+        }
     }
+
+    // Pieces of pure v2 torrents don't have the pad bytes.
+    std::size_t left_length = total_length;
+    if (!has_v1_info) {
+        left_length = 0;
+        for (std::size_t i = 0; i < piece_count; ++i) {
+            left_length += get_piece_size(i);
+        }
+    }
+    left.store(left_length, std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock {mutex};
+
+    // Publish the info fields. Readers that see ready also see the fields.
+    ready.store(true, std::memory_order_release);
+    auto callback = std::move(on_ready_callback);
+    on_ready_callback.reset();
+    lock.unlock();
+
+    {
+        std::scoped_lock<std::mutex> cv_lock {ready_cv_mutex};
+        ready_cv.notify_all();
+    }
+
+    if (callback.has_value()) {
+        callback.value()();
+    }
+}
+
+std::size_t Metadata::get_file_index(std::size_t offset) const {
+    // First file that starts after the offset, the one before it contains it.
+    const auto it =
+        std::upper_bound(file_offsets.begin(), file_offsets.end(), offset);
+    return static_cast<std::size_t>(it - file_offsets.begin()) - 1;
+}
+
+
+namespace {
+
+struct TreeFile {
+    std::string path;
+    std::size_t length;
+    Sha256Hash pieces_root;
+};
+
+/*
+ * Collects the files under the node of a file tree in order.
+ * Properties of a file are under an empty key in its node.
+ * */
+void collect_tree_files(
+    BencodeParser::Dictionary& node,
+    const std::string& path,
+    std::vector<TreeFile>& tree_files
+) {
+    for (auto& [key, child] : node) {
+        auto& child_node = child.get<BencodeParser::Dictionary>();
+        if (!key.empty()) {
+            collect_tree_files(child_node, path + '/' + key, tree_files);
+            continue;
+        }
+        TreeFile file {path, 0, {}};
+        file.length = static_cast<std::size_t>(
+            child_node["length"].get<BencodeParser::Integer>()
+        );
+        if (file.length != 0) {
+            const auto& root = child_node["pieces root"].get<std::string>();
+            if (root.size() != file.pieces_root.size()) {
+                throw std::runtime_error("Metadata: invalid pieces root");
+            }
+            std::memcpy(file.pieces_root.data(), root.data(), root.size());
+        }
+        tree_files.push_back(std::move(file));
+    }
+}
+
+} // namespace
+
+void Metadata::load_file_tree(BencodeParser::Dictionary& info, bool has_v1) {
+    std::vector<TreeFile> tree_files;
+    collect_tree_files(
+        info["file tree"].get<BencodeParser::Dictionary>(),
+        "",
+        tree_files
+    );
+    if (tree_files.empty()) {
+        throw std::runtime_error("Metadata: file tree is empty");
+    }
+    const bool single_tree_file =
+        tree_files.size() == 1 && tree_files.front().path == '/' + name;
+
+    if (!has_v1) {
+        single_file = single_tree_file;
+        for (std::size_t i = 0; i < tree_files.size(); ++i) {
+            auto& file = tree_files[i];
+            total_length += file.length;
+            files.emplace_back(
+                file.length,
+                single_file ? name : std::move(file.path)
+            );
+            pad_files.push_back(false);
+            pieces_roots.push_back(file.pieces_root);
+
+            // Start the next file at a piece.
+            const auto remainder = total_length % piece_length;
+            if (i + 1 < tree_files.size() && remainder != 0) {
+                const auto pad_length = piece_length - remainder;
+                total_length += pad_length;
+                files.emplace_back(
+                    pad_length,
+                    "/.pad/" + std::to_string(pad_length)
+                );
+                pad_files.push_back(true);
+                pieces_roots.emplace_back();
+            }
+        }
+        return;
+    }
+
+    // The files of a hybrid torrent are in the same order in both.
+    pieces_roots.resize(files.size());
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        if (pad_files[i]) {
+            continue;
+        }
+        const auto& [length, path] = files[i];
+        if (next == tree_files.size()
+            || tree_files[next].path != (single_file ? '/' + path : path)
+            || tree_files[next].length != length) {
+            throw std::runtime_error(
+                "Metadata: file tree does not match the files"
+            );
+        }
+        pieces_roots[i] = tree_files[next++].pieces_root;
+    }
+    if (next != tree_files.size() || single_file != single_tree_file) {
+        throw std::runtime_error(
+            "Metadata: file tree does not match the files"
+        );
+    }
+}
+
+bool Metadata::load_piece_layers(BencodeParser::Dictionary& piece_layers) {
+    piece_hashes_v2.resize(piece_count);
+    piece_layer_trees.resize(files.size());
+    // The layers are padded with the roots of pieces of zero leaves.
+    const auto piece_pad = merkle_pad(piece_length / BLOCK_LENGTH);
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        const auto length = files[i].first;
+        if (pad_files[i] || length == 0) {
+            continue;
+        }
+        if (file_offsets[i] % piece_length != 0) {
+            throw std::runtime_error(
+                "Metadata: files of v2 torrents must start at a piece"
+            );
+        }
+        const auto first_piece = file_offsets[i] / piece_length;
+        const auto& root = pieces_roots[i];
+        if (length <= piece_length) {
+            // The whole file is a single piece.
+            piece_hashes_v2[first_piece] = root;
+            piece_layer_trees[i].emplace(std::span {&root, 1}, 1);
+            continue;
+        }
+        const auto layer =
+            piece_layers.find(std::string {root.begin(), root.end()});
+        if (layer == piece_layers.end()) {
+            return false;
+        }
+        const auto& hashes = layer->second.get<std::string>();
+        const auto count = (length + piece_length - 1) / piece_length;
+        if (hashes.size() != count * sizeof(Sha256Hash)) {
+            throw std::runtime_error("Metadata: invalid piece layer length");
+        }
+        std::memcpy(
+            piece_hashes_v2.data() + first_piece,
+            hashes.data(),
+            hashes.size()
+        );
+        const auto file_layer =
+            std::span {piece_hashes_v2}.subspan(first_piece, count);
+        auto& tree = piece_layer_trees[i].emplace(
+            file_layer,
+            next_power_of_two(count),
+            piece_pad
+        );
+        if (tree.get_root() != root) {
+            throw std::runtime_error(
+                "Metadata: piece layer does not match the pieces root"
+            );
+        }
+    }
+    return true;
+}
+
+std::size_t Metadata::find_file(const Sha256Hash& pieces_root) const {
+    // Only used for the hash requests, which are rare.
+    const auto it =
+        std::find(pieces_roots.begin(), pieces_roots.end(), pieces_root);
+    if (it == pieces_roots.end() || pieces_root == Sha256Hash {}) {
+        return files.size();
+    }
+    return static_cast<std::size_t>(it - pieces_roots.begin());
+}
+
+std::span<const Sha256Hash>
+Metadata::get_piece_layer(std::size_t file_index) const {
+    const auto length = files[file_index].first;
+    if (!has_v2() || pad_files[file_index] || length == 0) {
+        return {};
+    }
+    return std::span {piece_hashes_v2}.subspan(
+        file_offsets[file_index] / piece_length,
+        (length + piece_length - 1) / piece_length
+    );
+}
+
+const MerkleTree*
+Metadata::get_piece_layer_tree(std::size_t file_index) const {
+    if (file_index >= piece_layer_trees.size()
+        || !piece_layer_trees[file_index]) {
+        return nullptr;
+    }
+    return &*piece_layer_trees[file_index];
+}
+
+std::size_t Metadata::get_piece_leaf_count(std::size_t piece_index) const {
+    const auto file_index = get_file_index(piece_index * piece_length);
+    const auto length = files[file_index].first;
+    if (length > piece_length) {
+        return piece_length / BLOCK_LENGTH;
+    }
+    return next_power_of_two((length + BLOCK_LENGTH - 1) / BLOCK_LENGTH);
+}
+
+std::size_t Metadata::get_piece_data_size(std::size_t piece_index) const {
+    const auto start = piece_index * piece_length;
+    const auto file_end = file_offsets[get_file_index(start) + 1];
+    return std::min({start + piece_length, total_length, file_end}) - start;
 }
 
 std::shared_ptr<Metadata> Metadata::from_magnet(const boost::url_view url) {
@@ -147,49 +489,47 @@ std::shared_ptr<Metadata> Metadata::from_magnet(const boost::url_view url) {
             metadata->trackers.emplace_back(static_cast<std::string>(param.value
             ));
         } else if (param.key == "ws") { // Web Seed
-            // Unimplemented
-            BOOST_LOG_TRIVIAL(info)
-                << "Metadata magnet link " << param.key
-                << " not supported with value: " << param.value;
+            metadata->web_seeds.emplace_back(static_cast<std::string>(param.value
+            ));
         } else if (param.key == "as") { // Acceptable Source
             // Unimplemented
-            BOOST_LOG_TRIVIAL(info)
+            TORRENT_LOG(info)
                 << "Metadata magnet link " << param.key
                 << " not supported with value: " << param.value;
         } else if (param.key == "xs") { // eXact Source
             // Unimplemented
-            BOOST_LOG_TRIVIAL(info)
+            TORRENT_LOG(info)
                 << "Metadata magnet link " << param.key
                 << " not supported with value: " << param.value;
         } else if (param.key == "kt") { // Keyword Topic
             // Unimplemented
-            BOOST_LOG_TRIVIAL(info)
+            TORRENT_LOG(info)
                 << "Metadata magnet link " << param.key
                 << " not supported with value: " << param.value;
         } else if (param.key == "mt") { // Manifest Topic
             // Unimplemented
-            BOOST_LOG_TRIVIAL(info)
+            TORRENT_LOG(info)
                 << "Metadata magnet link " << param.key
                 << " not supported with value: " << param.value;
         } else if (param.key == "so") { // Select Only
             // Unimplemented Unimplemented
-            BOOST_LOG_TRIVIAL(info)
+            TORRENT_LOG(info)
                 << "Metadata magnet link " << param.key
                 << " not supported with value: " << param.value;
         } else if (param.key == "x.pe ") { // PEer
             // Unimplemented
-            BOOST_LOG_TRIVIAL(info)
+            TORRENT_LOG(info)
                 << "Metadata magnet link " << param.key
                 << " not supported with value: " << param.value;
         } else {
-            BOOST_LOG_TRIVIAL(info)
+            TORRENT_LOG(info)
                 << "Metadata magnet link unknown parameter: " << param.key;
         }
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Parsed the magnet link.";
+    TORRENT_LOG(info) << "Parsed the magnet link.";
 
-    metadata->left = metadata->total_length;
+    metadata->left.store(metadata->total_length, std::memory_order_relaxed);
 
     return metadata;
 }
@@ -202,9 +542,8 @@ std::shared_ptr<Metadata> Metadata::create(const std::string_view torrent) {
     return from_torrent_file(torrent);
 }
 
-std::string Metadata::get_info_hash(const BencodeParser::Element& info) {
+std::string Metadata::get_info_hash(std::string_view info_bencode) {
     std::string info_hash(20, '\0');
-    auto info_bencode = info.to_bencode();
     // Calculate the SHA1 from the info directory.
     SHA1(
         reinterpret_cast<const unsigned char*>(info_bencode.data()),
@@ -214,8 +553,12 @@ std::string Metadata::get_info_hash(const BencodeParser::Element& info) {
     return info_hash;
 }
 
+std::string Metadata::get_info_hash_v2(std::string_view info_bencode) {
+    const auto hash = sha256(info_bencode);
+    return {hash.begin(), hash.end()};
+}
+
 std::ostream& operator<<(std::ostream& os, const Metadata& metadata) {
-    std::scoped_lock<std::mutex> lock {metadata.mutex};
     os << "Metadata{";
     os << "\n  info_hash: " << metadata.info_hash;
     os << "\n  trackers: std::vector{";
@@ -232,11 +575,12 @@ std::ostream& operator<<(std::ostream& os, const Metadata& metadata) {
         os << "\n    length:" << file.first << ", name: " << file.second;
     }
     os << (metadata.files.empty() ? "  }" : "\n  }");
-    os << "\n  pieces: std::string[" << metadata.pieces.size() << "]";
-    os << "\n  downloaded: " << metadata.downloaded;
-    os << "\n  uploaded: " << metadata.uploaded;
-    os << "\n  left: " << metadata.left;
-    os << "\n  pieces_done: " << metadata.pieces_done;
+    os << "\n  pieces: std::vector<Sha1Hash>[" << metadata.piece_hashes.size()
+       << "]";
+    os << "\n  downloaded: " << metadata.get_downloaded();
+    os << "\n  uploaded: " << metadata.get_uploaded();
+    os << "\n  left: " << metadata.get_left();
+    os << "\n  pieces_done: " << metadata.get_pieces_done();
     os << "\n}";
 
     return os;
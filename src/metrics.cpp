@@ -0,0 +1,301 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <string_view>
+
+namespace torrent {
+
+namespace {
+
+/*
+ * Appends a number the way Prometheus reads it.
+ * */
+void append_number(std::string& output, double value) {
+    if (std::isinf(value)) {
+        output += value > 0 ? "+Inf" : "-Inf";
+        return;
+    }
+    if (std::isnan(value)) {
+        output += "NaN";
+        return;
+    }
+    std::array<char, 32> buffer;
+    const auto [end, error] =
+        std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    output.append(buffer.data(), end);
+}
+
+void append_number(std::string& output, std::uint64_t value) {
+    output += std::to_string(value);
+}
+
+void append_number(std::string& output, std::int64_t value) {
+    output += std::to_string(value);
+}
+
+/*
+ * Appends the labels in braces, with an extra label if it is given.
+ * Nothing is appended if there are no labels.
+ * */
+void append_labels(
+    std::string& output,
+    const MetricsRegistry::Labels& labels,
+    const std::pair<std::string, std::string>* extra = nullptr
+) {
+    if (labels.empty() && extra == nullptr) {
+        return;
+    }
+    const auto append_label = [&output](const auto& label) {
+        output += label.first;
+        output += "=\"";
+        // Label values escape backslashes, quotes and new lines.
+        for (const auto c : label.second) {
+            if (c == '\\' || c == '"') {
+                output += '\\';
+                output += c;
+            } else if (c == '\n') {
+                output += "\\n";
+            } else {
+                output += c;
+            }
+        }
+        output += '"';
+    };
+    output += '{';
+    for (std::size_t i = 0; i < labels.size(); ++i) {
+        if (i != 0) {
+            output += ',';
+        }
+        append_label(labels[i]);
+    }
+    if (extra != nullptr) {
+        if (!labels.empty()) {
+            output += ',';
+        }
+        append_label(*extra);
+    }
+    output += '}';
+}
+
+} // namespace
+
+Histogram::Histogram(std::vector<double> bounds) :
+    upper_bounds(std::move(bounds)),
+    buckets(std::make_unique<Counter[]>(upper_bounds.size() + 1)) {
+    if (!std::is_sorted(upper_bounds.begin(), upper_bounds.end())) {
+        throw std::runtime_error("Histogram bounds must be increasing.");
+    }
+}
+
+void Histogram::observe(double value) {
+    // The first bucket whose bound is not smaller than the value.
+    const auto bucket = static_cast<std::size_t>(
+        std::lower_bound(upper_bounds.begin(), upper_bounds.end(), value)
+        - upper_bounds.begin()
+    );
+    buckets[bucket].add();
+    sums[metrics_detail::get_thread_shard()].sum.fetch_add(
+        value,
+        std::memory_order_relaxed
+    );
+}
+
+Histogram::Snapshot Histogram::get() const {
+    Snapshot snapshot;
+    snapshot.counts.reserve(upper_bounds.size() + 1);
+    for (std::size_t i = 0; i <= upper_bounds.size(); ++i) {
+        snapshot.counts.push_back(buckets[i].get());
+    }
+    for (const auto& shard : sums) {
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+MetricsRegistry::Metric& MetricsRegistry::find_metric(
+    const std::string& name,
+    const std::string& help,
+    std::size_t type,
+    const Labels& labels,
+    const std::function<Metric()>& create
+) {
+    auto [family_it, inserted] = families.try_emplace(name);
+    auto& family = family_it->second;
+    if (inserted) {
+        family.help = help;
+        family.type = type;
+    } else if (family.type != type) {
+        throw std::runtime_error(
+            "Metric " + name + " is already registered with another type."
+        );
+    }
+    for (auto& [metric_labels, metric] : family.metrics) {
+        if (metric_labels == labels) {
+            return metric;
+        }
+    }
+    family.metrics.emplace_back(labels, create());
+    return family.metrics.back().second;
+}
+
+Counter& MetricsRegistry::add_counter(
+    const std::string& name,
+    const std::string& help,
+    const Labels& labels
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    auto& metric = find_metric(name, help, 0, labels, [] {
+        return std::make_unique<Counter>();
+    });
+    return *std::get<0>(metric);
+}
+
+Gauge& MetricsRegistry::add_gauge(
+    const std::string& name,
+    const std::string& help,
+    const Labels& labels
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    auto& metric = find_metric(name, help, 1, labels, [] {
+        return std::make_unique<Gauge>();
+    });
+    return *std::get<1>(metric);
+}
+
+Histogram& MetricsRegistry::add_histogram(
+    const std::string& name,
+    const std::string& help,
+    std::vector<double> upper_bounds,
+    const Labels& labels
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    auto& metric = find_metric(name, help, 2, labels, [&upper_bounds] {
+        return std::make_unique<Histogram>(std::move(upper_bounds));
+    });
+    return *std::get<2>(metric);
+}
+
+std::string MetricsRegistry::to_prometheus() const {
+    static constexpr std::array<std::string_view, 3> type_names = {
+        "counter",
+        "gauge",
+        "histogram"
+    };
+
+    std::scoped_lock<std::mutex> lock {mutex};
+    std::string output;
+    for (const auto& [name, family] : families) {
+        output += "# HELP " + name + " " + family.help + "\n";
+        output += "# TYPE " + name + " ";
+        output += type_names[family.type];
+        output += '\n';
+
+        for (const auto& [labels, metric] : family.metrics) {
+            if (const auto* counter = std::get_if<0>(&metric)) {
+                output += name;
+                append_labels(output, labels);
+                output += ' ';
+                append_number(output, (*counter)->get());
+                output += '\n';
+            } else if (const auto* gauge = std::get_if<1>(&metric)) {
+                output += name;
+                append_labels(output, labels);
+                output += ' ';
+                append_number(output, (*gauge)->get());
+                output += '\n';
+            } else if (const auto* histogram = std::get_if<2>(&metric)) {
+                const auto snapshot = (*histogram)->get();
+                const auto& bounds = (*histogram)->get_upper_bounds();
+                // Buckets are cumulative in the exposition format.
+                std::uint64_t count = 0;
+                for (std::size_t i = 0; i < snapshot.counts.size(); ++i) {
+                    count += snapshot.counts[i];
+                    std::string bound;
+                    append_number(
+                        bound,
+                        i < bounds.size() ? bounds[i] : HUGE_VAL
+                    );
+                    const std::pair<std::string, std::string> le {"le", bound};
+                    output += name + "_bucket";
+                    append_labels(output, labels, &le);
+                    output += ' ';
+                    append_number(output, count);
+                    output += '\n';
+                }
+                output += name + "_sum";
+                append_labels(output, labels);
+                output += ' ';
+                append_number(output, snapshot.sum);
+                output += '\n';
+                output += name + "_count";
+                append_labels(output, labels);
+                output += ' ';
+                append_number(output, count);
+                output += '\n';
+            }
+        }
+    }
+    return output;
+}
+
+SessionMetrics::SessionMetrics() :
+    downloaded_bytes(registry.add_counter(
+        "torrent_downloaded_bytes_total",
+        "Bytes of blocks received from the peers."
+    )),
+    uploaded_bytes(registry.add_counter(
+        "torrent_uploaded_bytes_total",
+        "Bytes of blocks sent to the peers."
+    )),
+    pieces_completed(registry.add_counter(
+        "torrent_pieces_completed_total",
+        "Pieces downloaded from the peers that passed SHA1."
+    )),
+    hash_failures(registry.add_counter(
+        "torrent_hash_failures_total",
+        "Pieces that failed SHA1."
+    )),
+    piece_seconds(registry.add_histogram(
+        "torrent_piece_download_seconds",
+        "Time from a piece being assigned to a peer until it passes SHA1.",
+        {0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120}
+    )),
+    request_seconds(registry.add_histogram(
+        "torrent_request_seconds",
+        "Time from a block being requested until it arrives.",
+        {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10}
+    )),
+    tracker_seconds(registry.add_histogram(
+        "torrent_tracker_announce_seconds",
+        "Time from an announce being sent until the tracker answers.",
+        {0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30}
+    )),
+    disk_queue_depth(registry.add_gauge(
+        "torrent_disk_queue_depth",
+        "Reads and writes submitted to the file that are not complete."
+    )),
+    disk_buffer_bytes(registry.add_gauge(
+        "torrent_disk_buffer_bytes",
+        "Bytes of the buffers held by the disk operations."
+    )) {
+    static constexpr std::array<const char*, PEER_STATE_COUNT> state_names = {
+        "connecting",
+        "connected",
+        "handshook",
+        "idle",
+        "downloading"
+    };
+    for (std::size_t i = 0; i < PEER_STATE_COUNT; ++i) {
+        peers[i] = &registry.add_gauge(
+            "torrent_peers",
+            "Peers by the state of the connection.",
+            {{"state", state_names[i]}}
+        );
+    }
+}
+
+} // namespace torrent
@@ -0,0 +1,56 @@
+#include "metrics_server.hpp"
+
+#include <string_view>
+
+namespace torrent {
+
+MetricsServer::MetricsServer(
+    asio::io_context& io_context_ref,
+    std::uint16_t server_port,
+    std::shared_ptr<SessionMetrics> metrics_ptr
+) :
+    metrics(std::move(metrics_ptr)),
+    io_context(io_context_ref),
+    port(server_port) {}
+
+void MetricsServer::start() {
+    server = std::make_shared<HttpServer>(
+        io_context,
+        port,
+        [weak = weak_from_this()](const auto& request, auto session) {
+            if (const auto self = weak.lock()) {
+                self->on_request(request, std::move(session));
+            }
+        }
+    );
+    server->start();
+}
+
+void MetricsServer::on_request(
+    const HttpServer::Request& request,
+    std::shared_ptr<HttpServer::Session> session
+) {
+    if (request.method() != http::verb::get) {
+        session->send(
+            http::status::method_not_allowed,
+            "text/plain",
+            "Only GET is supported.\n"
+        );
+        return;
+    }
+    const auto target = std::string_view {
+        request.target().data(),
+        request.target().size()
+    };
+    if (target != "/metrics") {
+        session->send(http::status::not_found, "text/plain", "Not found.\n");
+        return;
+    }
+    session->send(
+        http::status::ok,
+        "text/plain; version=0.0.4",
+        metrics->to_prometheus()
+    );
+}
+
+} // namespace torrent
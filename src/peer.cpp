@@ -2,24 +2,43 @@
 
 #include <algorithm>
 #include <boost/endian/conversion.hpp>
-#include <boost/log/trivial.hpp>
 #include <boost/range/iterator_range_core.hpp>
 #include <boost/range/join.hpp>
+#include <bit>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
 #include <memory>
 #include <mutex>
 
+#include "log.hpp"
 #include "message.hpp"
 #include "peer_manager.hpp"
+#include "trace.hpp"
 
 namespace torrent {
 
+Peer::~Peer() {
+    set_state_gauge(nullptr);
+}
+
+void Peer::set_state_gauge(Gauge* gauge) {
+    if (state_gauge != nullptr) {
+        state_gauge->sub();
+    }
+    state_gauge = gauge;
+    if (state_gauge != nullptr) {
+        state_gauge->add();
+    }
+}
+
 void Peer::connect() {
+    // Peers in the Disconnected state are counted as connecting.
+    const auto connecting = static_cast<std::size_t>(State::Disconnected);
+    set_state_gauge(peer_manager->metrics->peers[connecting]);
     // Capturing a copy of the shared pointer into the lambda will
     //      effectively make the object alive until the lambda gets dropped.
-    socket.async_connect(endpoint, [self = get_ptr()](const auto& error) {
+    stream->async_connect(endpoint, [self = get_ptr()](const auto& error) {
         if (error) {
             self->change_state(State::Disconnected);
         } else {
@@ -30,26 +49,37 @@ void Peer::connect() {
 
 void Peer::change_state(State new_state) {
     state = new_state;
+    set_state_gauge(
+        state == State::Disconnected
+            ? nullptr
+            : peer_manager->metrics->peers[static_cast<std::size_t>(state)]
+    );
     switch (state) {
         case State::Connected:
-            BOOST_LOG_TRIVIAL(info)
-                << "Active peers: " << peer_manager.get_active_peers()
+            TORRENT_LOG(info)
+                << "Active peers: " << peer_manager->get_active_peers()
                 << ", Connected to " << *this;
             start_handshake();
             break;
         case State::Disconnected:
-            peer_manager.pieces->bitfield->piece_failed(current_piece_index);
-            peer_manager.remove(endpoint); // Remove this peer.
+            if (peer_manager->pieces->is_initialized()) {
+                peer_manager->pieces->picker->piece_failed(current_piece_index);
+                if (availability_counted.exchange(false)) {
+                    peer_manager->pieces->picker->remove_peer(*peer_bitfield);
+                }
+            }
+            peer_manager->remove(endpoint); // Remove this peer.
             break;
         case State::Handshook:
             handshook = true;
-            peer_manager.on_handshake(*this);
+            peer_manager->on_handshake(*this);
             // Bitfield should be sent immiediately after the handshake.
             send_message(
-                peer_manager.pieces->bitfield->as_message(),
+                peer_manager->pieces->bitfield->as_message(),
                 [](auto& peer) {
                     // Send Unchoke after sending the Bitfield.
                     peer->send_message(Message {Message::Id::Unchoke});
+                    peer->am_choking = false;
                 }
             );
 
@@ -57,7 +87,7 @@ void Peer::change_state(State new_state) {
             listen_peer();
             break;
         case State::Idle:
-            if (!peer_manager.metadata->is_ready()) {
+            if (!peer_manager->metadata->is_ready()) {
                 // Our metadata of the torrent file is
                 //     still not complete enough to start the download
                 // Fetch the metadata from the peer if they enabled BEP9 extension.
@@ -70,16 +100,17 @@ void Peer::change_state(State new_state) {
             if (current_piece_index.has_value()) {
                 // This should never happen but check anyway.
                 // State changed to Idle but we already hold a piece_index
-                peer_manager.pieces->bitfield->piece_failed(current_piece_index
-                );
+                peer_manager->pieces->picker->piece_failed(current_piece_index);
             }
 
             if (peer_bitfield == nullptr) {
                 // Peers may not have a bitfield if they dont have any piece.
                 // So create an empty bitfield if they didn't already sent one.
                 peer_bitfield = std::make_unique<Bitfield>(
-                    peer_manager.pieces->bitfield->size()
+                    peer_manager->pieces->bitfield->size()
                 );
+                // Has no pieces to count, but the later Haves are counted.
+                availability_counted = true;
             }
 
             if (!peer_choking) {
@@ -95,28 +126,32 @@ void Peer::change_state(State new_state) {
 }
 
 void Peer::assign_piece() {
-    current_piece_index =
-        peer_manager.pieces->bitfield->assign_piece(*peer_bitfield);
+    // Faster peers get the time critical pieces when streaming.
+    // Peers on parole download pieces alone so bad data can be blamed.
+    current_piece_index = peer_manager->pieces->picker->assign_piece(
+        *peer_bitfield,
+        download_rate.get_rate(),
+        peer_manager->is_on_parole(endpoint.address())
+    );
 
     if (current_piece_index.has_value()) {
-#ifndef NDEBUG
-        BOOST_LOG_TRIVIAL(debug) << "Assigned " << current_piece_index.value()
-                                 << "th piece to " << *this;
-#endif
+        TORRENT_LOG(debug) << "Assigned " << current_piece_index.value()
+                           << "th piece to " << *this;
 
         assert(peer_bitfield->has_piece(current_piece_index.value()));
         current_block = 0; // Set current block to 0.
+        piece_start = Clock::now();
         change_state(State::DownloadingPiece);
     } else {
         // TODO: Terrible implementation. Should be a
         //      consumer/producer relation with the Bitfield using a condition variable.
         // Could not assign a piece to this peer.
         // Wait some time before trying again.
-        BOOST_LOG_TRIVIAL(error) << "No valid piece for " << *this;
-        timer.expires_after(asio::chrono::seconds(10)); // Wait 10 seconds
-        timer.async_wait([self = get_ptr()](auto error) {
+        TORRENT_LOG(error) << "No valid piece for " << *this;
+        timer->expires_after(std::chrono::seconds(10)); // Wait 10 seconds
+        timer->async_wait([self = get_ptr()](auto error) {
             if (error) {
-                BOOST_LOG_TRIVIAL(error)
+                TORRENT_LOG(error)
                     << "Error in async_wait: " << error.message();
                 return;
             }
@@ -132,7 +167,7 @@ void Peer::assign_piece() {
 void Peer::listen_peer() {
     // First listen the length of the packet, which is 4 bytes exact.
     buffer.resize(4);
-    socket.async_receive(
+    stream->async_read_some(
         asio::buffer(buffer),
         [self = get_ptr()](const auto& error, const auto bytes_read) {
             if (error || bytes_read != self->buffer.size()) {
@@ -155,16 +190,20 @@ void Peer::listen_peer() {
                 self->listen_peer();
             } else {
                 self->buffer.resize(static_cast<std::size_t>(length));
-                // Then listen the actual message.
+                // Then listen the actual message. Waiting for the download
+                //      limit before reading slows the peer down with TCP.
                 self->read_message_bytes = 0;
-                self->listen_message();
+                self->peer_manager->throttle_download(
+                    self->buffer.size(),
+                    [self] { self->listen_message(); }
+                );
             }
         }
     );
 }
 
 void Peer::listen_message() {
-    socket.async_receive(
+    stream->async_read_some(
         asio::buffer(
             buffer.data() + read_message_bytes,
             buffer.size() - read_message_bytes
@@ -187,8 +226,8 @@ void Peer::listen_message() {
 }
 
 void Peer::listen_handshake() {
-    buffer.resize(peer_manager.get_handshake().size());
-    socket.async_receive(
+    buffer.resize(peer_manager->get_handshake().size());
+    stream->async_read_some(
         asio::buffer(buffer),
         [self = get_ptr()](const auto& error, const auto bytes_read) {
             if (error || bytes_read != self->buffer.size()) {
@@ -196,7 +235,7 @@ void Peer::listen_handshake() {
                 return;
             }
             // Compare them and disconnect if there is an error.
-            const auto& our_handshake = self->peer_manager.get_handshake();
+            const auto& our_handshake = self->peer_manager->get_handshake();
             bool is_header_equal = std::equal(
                 self->buffer.begin(),
                 self->buffer.begin() + 20,
@@ -224,6 +263,7 @@ void Peer::listen_handshake() {
                 peer_str.size()
             );
             self->remote_peer_id = {std::move(peer_str)};
+            self->supports_v2 = (self->buffer[27] & 0x10) != 0;
             self->change_state(State::Handshook);
         }
     );
@@ -231,14 +271,14 @@ void Peer::listen_handshake() {
 
 void Peer::start_handshake() {
     // First send the handshake.
-    socket.async_send(
-        asio::buffer(peer_manager.get_handshake()),
+    stream->async_write_some(
+        asio::buffer(peer_manager->get_handshake()),
         [self = get_ptr()](const auto& error, const auto) {
             if (error) {
                 self->change_state(State::Disconnected);
                 return;
             }
-            BOOST_LOG_TRIVIAL(info) << "Sent handshake to " << *self;
+            TORRENT_LOG(info) << "Sent handshake to " << *self;
             // After sending it start to listen the peer for a handshake.
             self->listen_handshake();
         }
@@ -246,9 +286,7 @@ void Peer::start_handshake() {
 }
 
 void Peer::on_message(Message message) {
-#ifndef NDEBUG
-    BOOST_LOG_TRIVIAL(debug) << *this << " sent: " << message;
-#endif
+    TORRENT_LOG(debug) << *this << " sent: " << message;
     auto& payload = message.get_payload();
 
     switch (message.get_id()) {
@@ -260,6 +298,10 @@ void Peer::on_message(Message message) {
             break;
         case Message::Id::Choke: // unchoke: <len=0001><id=1>
             // Drop the current index because peer is choking us.
+            // Unassign it so the other peers can download it.
+            if (current_piece_index.has_value()) {
+                peer_manager->pieces->picker->piece_failed(current_piece_index);
+            }
             current_piece_index = {};
             peer_choking = true;
             break;
@@ -275,23 +317,34 @@ void Peer::on_message(Message message) {
                 break;
             }
             const auto index = message.get_int(0); // Get first int.
+            if (peer_bitfield->has_piece(index)) {
+                break;
+            }
             peer_bitfield->set_piece(index);
+            if (availability_counted) {
+                peer_manager->pieces->picker->add_have(index);
+            }
             break;
         }
         case Message::Id::Bitfield: // bitfield: <len=0001+X><id=5><bitfield>
-            if (!peer_manager.metadata->is_ready()) {
+            if (!peer_manager->metadata->is_ready()) {
                 return;
             }
 
-            if (payload.size() < peer_manager.pieces->bitfield->size()) {
+            if (payload.size() < peer_manager->pieces->bitfield->size()) {
                 // Invalid payload. Ignore the message.
                 break;
             }
+            if (availability_counted.exchange(false)) {
+                peer_manager->pieces->picker->remove_peer(*peer_bitfield);
+            }
             peer_bitfield = std::make_unique<Bitfield>(payload);
+            peer_manager->pieces->picker->add_peer(*peer_bitfield);
+            availability_counted = true;
             break;
         case Message::Id::Request: // <len=0013><id=6><index><begin><length>
         {
-            if (!peer_manager.metadata->is_ready()) {
+            if (!peer_manager->metadata->is_ready()) {
                 return;
             }
             // Peer is requesting a piece.
@@ -305,73 +358,97 @@ void Peer::on_message(Message message) {
                 change_state(State::Disconnected);
                 break;
             }
-            peer_manager.pieces->read_block_async(
-                index,
-                begin,
+            // Blocks are read only once they fit in the upload limit.
+            peer_manager->throttle_upload(
                 length,
-                [self = get_ptr(), length](Message piece_message) {
-                    self->send_message(
-                        std::move(piece_message),
-                        [length](auto& peer) {
-                            // Increase the uploaded counter.
-                            peer->peer_manager.metadata->increase_uploaded(
-                                length
-                            );
-                        }
-                    );
+                [self = get_ptr(), index, begin, length] {
+                    self->send_block(index, begin, length);
                 }
             );
             break;
         }
         case Message::Id::Piece: // <len=0009+X><id=7><index><begin><block>
         {
-            if (!peer_manager.metadata->is_ready()) {
+            if (!peer_manager->metadata->is_ready()) {
                 return;
             }
             if (payload.size() < 8 || !current_piece_index.has_value()) {
                 // Invalid payload. Ignore the message.
                 break;
             }
+            trace::Span span {"block_receive", message.get_int(0)};
             // Increase the downloaded counter.
-            peer_manager.metadata->increase_downloaded(payload.size() - 8);
+            peer_manager->metadata->increase_downloaded(payload.size() - 8);
+            download_rate.add(payload.size() - 8);
+            peer_manager->metrics->downloaded_bytes.add(payload.size() - 8);
+            peer_manager->metrics->request_seconds.observe(
+                Clock::now() - request_time
+            );
 
             const auto index = message.get_int(0);
             const auto begin = message.get_int(1);
             // TODO: change piece_received as current piece offset
-            peer_manager.pieces->write_block_async(
+            peer_manager->pieces->write_block_async(
                 index,
                 begin,
                 std::move(payload),
-                [self = get_ptr()](const auto& error_code, bool finished) {
+                endpoint.address(),
+                [self = get_ptr(), index](const auto& error_code, auto result) {
+                    using BlockResult = Pieces::BlockResult;
                     std::scoped_lock<std::mutex> lock {self->mutex};
-                    if (!self->current_piece_index.has_value()) {
+                    // Late, shared or duplicate blocks can belong to
+                    //      another piece than the one we are assigned.
+                    const bool is_current = self->current_piece_index == index;
+                    if (result == BlockResult::PieceComplete) {
+                        // The piece passed its hash check, so it is had
+                        //      even if we moved on to another piece.
+                        TORRENT_LOG(info)
+                            << "["
+                            << self->peer_manager->metadata->get_pieces_done()
+                            << "/"
+                            << self->peer_manager->metadata->get_piece_count()
+                            << "]. Finished piece#" << index << ".";
+                        auto& metrics = *self->peer_manager->metrics;
+                        metrics.pieces_completed.add();
+                        self->peer_manager->on_piece_passed(
+                            self->endpoint.address()
+                        );
+                        self->peer_manager->pieces->bitfield->set_piece(index);
+                        if (!is_current) {
+                            return;
+                        }
+                        metrics.piece_seconds.observe(
+                            Clock::now() - self->piece_start
+                        );
+                        self->current_piece_index = {};
+                        self->change_state(State::Idle);
+                        return;
+                    }
+                    if (!is_current) {
                         return;
                     }
 
                     self->piece_received += 1;
-                    if (error_code) {
-                        self->current_block -= REQUEST_COUNT_PER_CALL;
-                    } else if (finished) {
-                        // Finished downloading the piece.
-                        BOOST_LOG_TRIVIAL(info)
-                            << "["
-                            << self->peer_manager.metadata->get_pieces_done()
-                            << "/"
-                            << self->peer_manager.metadata->get_piece_count()
-                            << "]. Finished piece#"
-                            << self->current_piece_index.value() << ".";
-                        self->peer_manager.pieces->bitfield->piece_success(
+                    if (result == BlockResult::PieceFailed) {
+                        // Piece is bad or could not be checked.
+                        // Give it back so it gets downloaded again.
+                        TORRENT_LOG(warning) << "Piece#" << index << " from "
+                                             << *self << " failed.";
+                        self->peer_manager->pieces->picker->piece_failed(
                             self->current_piece_index
                         );
+                        self->current_piece_index = {};
                         self->change_state(State::Idle);
-                    } else if (self->current_block
-                               < self->peer_manager.metadata->get_block_count(
-                               )) {
-                        if (self->piece_received == REQUEST_COUNT_PER_CALL) {
-                            self->send_requests(); // Request pieces again.
-                        }
                         return;
                     }
+                    if (error_code || result == BlockResult::BlockFailed) {
+                        // Go over the piece again once this batch is done.
+                        // Written blocks are skipped.
+                        self->current_block = 0;
+                    }
+                    if (self->piece_received == self->requests_sent) {
+                        self->send_requests(); // Request pieces again.
+                    }
                 }
             );
             break;
@@ -380,54 +457,270 @@ void Peer::on_message(Message message) {
             break;
         case Message::Id::InvalidMessage:
             break;
+        case Message::Id::HashRequest:
+            // <len=0049><id=21><pieces root><base layer><index><length>
+            //      <proof layers>
+            on_hash_request(message);
+            break;
+        case Message::Id::Hashes: // <len=0049+X><id=22><...><hashes>
+            on_hashes(message);
+            break;
+        case Message::Id::HashReject: // <len=0049><id=23><...>
+            TORRENT_LOG(debug) << *this << " rejected a hash request.";
+            break;
     }
 }
 
+void Peer::send_block(
+    std::uint32_t index,
+    std::uint32_t begin,
+    std::uint32_t length
+) {
+    peer_manager->pieces->read_block_async(
+        index,
+        begin,
+        length,
+        [self = get_ptr(), length](Message piece_message) {
+            self->send_message(
+                std::move(piece_message),
+                [length](auto& peer) {
+                    // Increase the uploaded counter.
+                    peer->peer_manager->metadata->increase_uploaded(length);
+                    peer->peer_manager->metrics->uploaded_bytes.add(length);
+                    peer->upload_rate.add(length);
+                }
+            );
+        }
+    );
+}
+
 void Peer::send_requests() {
     if (!current_piece_index.has_value()) {
         change_state(State::Idle);
+        return;
     }
     // Request the piece block by block.
-    const auto piece_length =
-        static_cast<std::uint32_t>(peer_manager.metadata->get_piece_length());
-    const auto block_count = peer_manager.metadata->get_block_count();
     const auto piece_index =
         static_cast<std::uint32_t>(current_piece_index.value());
+    // The last pieces, and the last pieces of the files in v2,
+    //      can be shorter than usual pieces.
+    const auto piece_size = static_cast<std::uint32_t>(
+        peer_manager->metadata->get_piece_size(piece_index)
+    );
+    const auto block_count =
+        (piece_size + Metadata::BLOCK_LENGTH - 1) / Metadata::BLOCK_LENGTH;
 
-    const auto end_block =
-        std::min(block_count, current_block + REQUEST_COUNT_PER_CALL);
     piece_received = 0;
-    for (; current_block < end_block; ++current_block) {
+    requests_sent = 0;
+    request_time = Clock::now();
+    // Another peer may have finished the piece while it was shared.
+    const bool have_piece =
+        peer_manager->pieces->bitfield->has_piece(piece_index);
+    for (; !have_piece && current_block < block_count
+         && requests_sent < REQUEST_COUNT_PER_CALL;
+         ++current_block) {
+        if (peer_manager->pieces->has_block(piece_index, current_block)) {
+            continue;
+        }
         auto message = Message {
             Message::Id::Request,
             std::vector<std::uint8_t>(3 * sizeof(int))
         };
-        message.write_int(0, piece_index);
         const std::uint32_t begin =
             static_cast<std::uint32_t>(current_block * Metadata::BLOCK_LENGTH);
+        const std::uint32_t length = std::min<std::uint32_t>(
+            Metadata::BLOCK_LENGTH,
+            piece_size - begin
+        );
+        message.write_int(0, piece_index);
         message.write_int(1, begin);
-        std::uint32_t length = Metadata::BLOCK_LENGTH;
-        if (current_block == block_count - 1) {
-            // Last block, request everything left.
-            length = piece_length - begin;
-        }
-        if (piece_index == peer_manager.metadata->get_piece_count() - 1) {
-            // The last pieces can be a little bit shorter than usual pieces.
-            // So be careful not to go out of bound when requesting.
-            auto file_size = static_cast<std::uint32_t>(
-                peer_manager.metadata->get_total_length()
-            );
-            auto start = piece_index * piece_length + begin;
-            if (start + length >= file_size) {
-                length = file_size - start;
-                message.write_int(2, length);
-                send_message(std::move(message));
-                break;
+        message.write_int(2, length);
+        send_message(std::move(message));
+        requests_sent += 1;
+    }
+    if (requests_sent == 0) {
+        // Every block is written, the piece is done or being checked.
+        // The picker doesn't give it out again while it is checked.
+        peer_manager->pieces->picker->piece_failed(current_piece_index);
+        current_piece_index = {};
+        // Picking the next piece from here could come back to this call
+        //      without bound, so it is done by a handler of its own.
+        asio::post(io_context, [self = get_ptr()] {
+            if (self->state == State::DownloadingPiece
+                && !self->current_piece_index.has_value()) {
+                self->change_state(State::Idle);
+            }
+        });
+    }
+}
+
+void Peer::send_hash_request(std::size_t piece_index) {
+    const auto& metadata = *peer_manager->metadata;
+    const auto piece_length = metadata.get_piece_length();
+    const auto file_index = metadata.get_file_index(piece_index * piece_length);
+    const auto first_piece =
+        metadata.get_file_offset(file_index) / piece_length;
+    const auto leaf_count = metadata.get_piece_leaf_count(piece_index);
+    if (leaf_count > MAX_HASH_COUNT) {
+        return; // Can't be asked in one request.
+    }
+
+    Message message {
+        Message::Id::HashRequest,
+        std::vector<std::uint8_t>(HASH_HEADER_LENGTH)
+    };
+    const auto& root = metadata.get_pieces_root(file_index);
+    std::memcpy(message.get_payload().data(), root.data(), root.size());
+    message.write_int(8, 0); // Base layer is the leaves.
+    message.write_int(
+        9,
+        static_cast<std::uint32_t>((piece_index - first_piece) * leaf_count)
+    );
+    message.write_int(10, static_cast<std::uint32_t>(leaf_count));
+    message.write_int(11, 0); // Root of the piece is known, no proof.
+    TORRENT_LOG(info)
+        << "Requesting the block hashes of piece#" << piece_index << " from "
+        << *this << ".";
+    send_message(std::move(message));
+}
+
+void Peer::on_hash_request(const Message& message) {
+    const auto& payload = message.get_payload();
+    if (payload.size() < HASH_HEADER_LENGTH) {
+        return;
+    }
+    const std::vector<std::uint8_t> header {
+        payload.begin(),
+        payload.begin() + HASH_HEADER_LENGTH
+    };
+    const auto reject = [self = get_ptr(), header] {
+        self->send_message(Message {Message::Id::HashReject, header});
+    };
+
+    const auto& metadata = *peer_manager->metadata;
+    if (!metadata.is_ready() || !metadata.has_v2()) {
+        return reject();
+    }
+    Sha256Hash root;
+    std::memcpy(root.data(), payload.data(), root.size());
+    const auto base_layer = message.get_int(8);
+    const auto index = message.get_int(9);
+    const auto length = message.get_int(10);
+    const auto proof_layers = message.get_int(11);
+    const auto file_index = metadata.find_file(root);
+    if (file_index == metadata.get_files().size() || length < 2
+        || length > MAX_HASH_COUNT || !std::has_single_bit(length)
+        || index % length != 0) {
+        return reject();
+    }
+
+    // Pieces of the file are the leaves of the tree above the piece layer.
+    const auto* tree = metadata.get_piece_layer_tree(file_index);
+    if (tree == nullptr) {
+        return reject();
+    }
+    const auto piece_layer = metadata.get_piece_layer(file_index);
+    const auto leaves_per_piece =
+        metadata.get_piece_length() / Metadata::BLOCK_LENGTH;
+    const auto send_hashes = [self = get_ptr(), header](
+                                 std::span<const Sha256Hash> hashes,
+                                 const std::vector<Sha256Hash>& proof
+                             ) {
+        auto hashes_payload = header;
+        for (const auto& hashes_part : {hashes, std::span {proof}}) {
+            for (const auto& hash : hashes_part) {
+                hashes_payload.insert(
+                    hashes_payload.end(),
+                    hash.begin(),
+                    hash.end()
+                );
             }
         }
+        self->send_message(
+            Message {Message::Id::Hashes, std::move(hashes_payload)}
+        );
+    };
 
-        message.write_int(2, length);
-        send_message(std::move(message));
+    if (base_layer == 0) {
+        // Leaves of a whole piece.
+        const auto first_piece =
+            metadata.get_file_offset(file_index) / metadata.get_piece_length();
+        const auto piece_index = first_piece + index / length;
+        if (piece_layer.empty() || index / length >= piece_layer.size()
+            || metadata.get_piece_leaf_count(piece_index) != length) {
+            return reject();
+        }
+        auto proof = tree->get_proof(0, index / length, proof_layers);
+        peer_manager->pieces->hash_blocks_async(
+            piece_index,
+            [=](const auto& error_code, std::vector<Sha256Hash> leaves) {
+                if (error_code) {
+                    return reject();
+                }
+                leaves.resize(length);
+                send_hashes(leaves, proof);
+            }
+        );
+        return;
+    }
+    const auto layer_of_pieces =
+        static_cast<std::uint32_t>(std::countr_zero(leaves_per_piece));
+    if (base_layer == layer_of_pieces && piece_layer.size() > 1
+        && index + length <= tree->get_layer(0).size()) {
+        send_hashes(
+            tree->get_layer(0).subspan(index, length),
+            tree->get_proof(
+                static_cast<std::size_t>(std::countr_zero(length)),
+                index / length,
+                proof_layers
+            )
+        );
+        return;
+    }
+    reject();
+}
+
+void Peer::on_hashes(const Message& message) {
+    const auto& payload = message.get_payload();
+    const auto& metadata = *peer_manager->metadata;
+    if (!metadata.is_ready() || !metadata.has_v2()
+        || payload.size() < HASH_HEADER_LENGTH) {
+        return;
+    }
+    Sha256Hash root;
+    std::memcpy(root.data(), payload.data(), root.size());
+    const auto base_layer = message.get_int(8);
+    const auto index = message.get_int(9);
+    const auto length = message.get_int(10);
+    const auto file_index = metadata.find_file(root);
+    // Only the leaves of whole pieces are requested.
+    if (file_index == metadata.get_files().size() || base_layer != 0
+        || length == 0 || index % length != 0
+        || payload.size() < HASH_HEADER_LENGTH + length * sizeof(Sha256Hash)) {
+        return;
+    }
+    const auto piece_index =
+        metadata.get_file_offset(file_index) / metadata.get_piece_length()
+        + index / length;
+    if (index / length >= metadata.get_piece_layer(file_index).size()) {
+        return;
+    }
+    // Proof hashes after the leaves are not needed, the root is known.
+    std::vector<Sha256Hash> hashes(length);
+    std::memcpy(
+        hashes.data(),
+        payload.data() + HASH_HEADER_LENGTH,
+        hashes.size() * sizeof(Sha256Hash)
+    );
+    const auto& pieces = peer_manager->pieces;
+    if (pieces->add_block_hashes(piece_index, std::move(hashes))) {
+        TORRENT_LOG(info)
+            << "Got the block hashes of piece#" << piece_index << " from "
+            << *this << ".";
+    } else {
+        TORRENT_LOG(warning)
+            << *this << " sent bad block hashes for piece#" << piece_index
+            << ".";
     }
 }
 
@@ -1,11 +1,11 @@
 #include "peer_manager.hpp"
 
-#include <boost/log/trivial.hpp>
 #include <cstring>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 
+#include "log.hpp"
 #include "message.hpp"
 
 namespace torrent {
@@ -29,13 +29,30 @@ void PeerManager::calculate_handshake(
         protocol_identifier.size()
     );
     std::memset(handshake.data() + 20, 0, 8); // Reserved bytes. Set all to 0
+    if (metadata->is_ready() && metadata->has_v2()) {
+        // We can answer the hash requests of BEP52.
+        handshake[27] |= 0x10;
+    }
     std::memcpy(handshake.data() + 28, info_hash.data(), info_hash.size());
     std::memcpy(handshake.data() + 48, peer_id.data(), peer_id.size());
 }
 
 void PeerManager::add(tcp::endpoint endpoint) {
     std::scoped_lock<std::mutex> lock {mutex};
-    auto peer = std::make_shared<Peer>(*this, io_context, endpoint);
+    if (stopped || banned.contains(endpoint.address())
+        || peers.contains(endpoint)) {
+        return;
+    }
+    auto peer = std::make_shared<Peer>(
+        shared_from_this(),
+        io_context,
+        wrap_stream(
+            transport->create_stream(),
+            EncryptedStream::Role::Initiator
+        ),
+        transport->create_timer(),
+        endpoint
+    );
     peer->connect();
     peers.insert({std::move(endpoint), std::move(peer)});
 }
@@ -50,7 +67,7 @@ void PeerManager::remove(const tcp::endpoint& endpoint) {
         active_peers -= 1;
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Active peers: " << active_peers
+    TORRENT_LOG(info) << "Active peers: " << active_peers
                             << ", Connection lost with " << *peer_it->second;
 
     peers.erase(peer_it);
@@ -64,26 +81,175 @@ void PeerManager::on_handshake(Peer& peer) {
 
     active_peers += 1;
 
-    BOOST_LOG_TRIVIAL(info)
+    TORRENT_LOG(info)
         << "Active peers: " << active_peers << ", Handshake complete: " << str
         << " -> " << peer;
 }
 
-void PeerManager::accept_new_peers() {
-    acceptor.async_accept(new_peer_socket, [this](auto error_code) {
-        if (!error_code) {
-            auto peer = std::make_shared<Peer>(
-                *this,
-                io_context,
-                std::move(new_peer_socket)
-            );
+void PeerManager::on_hash_failure(
+    std::size_t piece_index,
+    const std::vector<address>& sources
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (sources.size() != 1) {
+        for (const auto& source : sources) {
+            parole.insert(source);
+        }
+        return;
+    }
 
-            peers.insert({peer->get_endpoint(), std::move(peer)});
+    const auto& source = sources.front();
+    const auto failures = ++hash_failures[source];
+    TORRENT_LOG(warning)
+        << source << " sent a bad piece#" << piece_index << " (" << failures
+        << "/" << MAX_HASH_FAILURES << ").";
+    if (failures >= MAX_HASH_FAILURES) {
+        ban(source);
+    } else {
+        parole.insert(source);
+    }
+}
 
-            new_peer_socket = tcp::socket {io_context};
+void PeerManager::request_hashes(std::size_t piece_index) {
+    std::vector<std::shared_ptr<Peer>> candidates;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        for (const auto& [endpoint, peer] : peers) {
+            if (peer->get_handshook() && peer->supports_v2) {
+                candidates.push_back(peer);
+            }
         }
-        accept_new_peers();
+    }
+    // Asking a single peer is enough, the hashes are checked with the root.
+    asio::post(io_context, [candidates = std::move(candidates), piece_index] {
+        for (const auto& peer : candidates) {
+            if (peer->peer_bitfield != nullptr
+                && peer->peer_bitfield->has_piece(piece_index)) {
+                peer->send_hash_request(piece_index);
+                return;
+            }
+        }
+        TORRENT_LOG(info)
+            << "No peer to ask the block hashes of piece#" << piece_index
+            << ".";
     });
 }
 
+void PeerManager::on_piece_passed(const address& peer_address) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    // The peer downloaded a piece alone so it can be trusted again.
+    parole.erase(peer_address);
+}
+
+void PeerManager::ban(const address& peer_address) {
+    TORRENT_LOG(warning) << "Banned " << peer_address << ".";
+    parole.erase(peer_address);
+    banned.insert(peer_address);
+    for (const auto& [endpoint, peer] : peers) {
+        if (endpoint.address() == peer_address) {
+            peer->disconnect();
+        }
+    }
+}
+
+std::vector<PeerManager::PeerInfo> PeerManager::get_peer_infos() {
+    std::scoped_lock<std::mutex> lock {mutex};
+    std::vector<PeerInfo> infos;
+    infos.reserve(peers.size());
+    for (const auto& [endpoint, peer] : peers) {
+        infos.push_back(
+            {endpoint,
+             peer->download_rate.get_total(),
+             peer->download_rate.get_rate(),
+             peer->upload_rate.get_total(),
+             peer->upload_rate.get_rate(),
+             peer->am_choking,
+             peer->am_interested,
+             peer->peer_choking,
+             peer->peer_interested}
+        );
+    }
+    return infos;
+}
+
+void PeerManager::throttle(
+    BandwidthLimit* limit,
+    std::size_t bytes,
+    std::function<void()> handler
+) {
+    const auto delay = limit == nullptr ? std::chrono::nanoseconds::zero()
+                                        : limit->reserve(bytes);
+    if (delay == std::chrono::nanoseconds::zero()) {
+        handler();
+        return;
+    }
+    // The timer keeps itself alive until it expires.
+    std::shared_ptr<Timer> timer = transport->create_timer();
+    timer->expires_after(delay);
+    timer->async_wait([timer, handler = std::move(handler)](const auto&) {
+        // Also called when aborted, so the peer finds its stream closed
+        //      and disconnects instead of hanging.
+        handler();
+    });
+}
+
+void PeerManager::accept_new_peers() {
+    acceptor->async_accept(
+        [self = shared_from_this()](const auto& error_code, auto stream) {
+            if (error_code == asio::error::operation_aborted) {
+                return; // Stopped.
+            }
+            if (!error_code) {
+                self->add_incoming(std::move(stream));
+            }
+            self->accept_new_peers();
+        }
+    );
+}
+
+void PeerManager::add_incoming(std::unique_ptr<Stream> stream) {
+    auto remote = stream->remote_endpoint();
+    if (is_banned(remote.address())) {
+        stream->close();
+        return;
+    }
+    auto peer = std::make_shared<Peer>(
+        shared_from_this(),
+        io_context,
+        wrap_stream(std::move(stream), EncryptedStream::Role::Responder),
+        transport->create_timer(),
+        std::move(remote)
+    );
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        if (stopped) {
+            return;
+        }
+        peers.insert({peer->get_endpoint(), peer});
+    }
+    // The peer can only start once it is owned by a shared_ptr.
+    peer->change_state(Peer::State::Connected);
+}
+
+std::unique_ptr<Stream> PeerManager::wrap_stream(
+    std::unique_ptr<Stream> stream,
+    EncryptedStream::Role role
+) {
+    if (encryption == EncryptionPolicy::Disabled) {
+        return stream;
+    }
+    // Both sides know the info hash, it keys the stream.
+    std::string info_hash {
+        reinterpret_cast<const char*>(handshake.data() + 28),
+        20
+    };
+    return std::make_unique<EncryptedStream>(
+        io_context,
+        std::move(stream),
+        role,
+        std::move(info_hash),
+        encryption
+    );
+}
+
 } // namespace torrent
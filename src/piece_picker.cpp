@@ -0,0 +1,288 @@
+#include "piece_picker.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "trace.hpp"
+
+namespace torrent {
+
+PieceIndex PiecePicker::assign_piece(
+    Bitfield& peer_bitfield,
+    std::size_t peer_rate,
+    bool exclusive
+) {
+    trace::Span span {"assign_piece"};
+    std::scoped_lock<std::mutex> lock1 {mutex};
+    std::scoped_lock<std::mutex> lock2 {peer_bitfield.mutex};
+
+    const auto& peer_vec = peer_bitfield.vec;
+    if (peer_vec.size() * 8 < pieces.size()) {
+        // Internal logic error. Should never happen
+        throw std::runtime_error(
+            "PiecePicker::assign_piece called with a smaller bitfield"
+        );
+    }
+
+    // Forget about peers that were fast a long time ago.
+    fastest_rate = std::max(peer_rate, fastest_rate - fastest_rate / 16);
+
+    if (!deadlines.empty()) {
+        auto result = assign_deadline_piece(peer_vec, peer_rate, exclusive);
+        if (result.has_value()) {
+            return result;
+        }
+    }
+
+    PieceIndex result;
+    Priority best = Priority::Skip;
+    for (std::size_t i = 0; i < peer_vec.size(); ++i) {
+        if (peer_vec[i] == 0) {
+            // Peer has none of these 8 pieces.
+            continue;
+        }
+        const auto end = std::min(pieces.size(), (i + 1) * 8);
+        for (std::size_t j = i * 8; j < end; ++j) {
+            const auto& piece = pieces[j];
+            if (piece.state != State::Missing || piece.priority <= best
+                || ((peer_vec[i] >> (7 - (j % 8))) & 1) == 0) {
+                continue;
+            }
+            result = j;
+            best = piece.priority;
+        }
+        if (best == Priority::High) {
+            // Can't find anything more important.
+            break;
+        }
+    }
+
+    if (result.has_value()) {
+        // Other peers can't assign the same piece.
+        pieces[result.value()].state = State::Assigned;
+        pieces[result.value()].assigned = 1;
+        pieces[result.value()].exclusive = exclusive;
+    }
+    return result;
+}
+
+PieceIndex PiecePicker::assign_deadline_piece(
+    const std::vector<std::uint8_t>& peer_vec,
+    std::size_t peer_rate,
+    bool exclusive
+) {
+    const auto now = Clock::now();
+    // Peers at least half as fast as the fastest one.
+    const bool is_fast = peer_rate * 2 >= fastest_rate;
+
+    PieceIndex result;
+    auto earliest = Clock::time_point::max();
+    for (const auto& [piece_index, deadline] : deadlines) {
+        const auto& piece = pieces[piece_index];
+        if (deadline >= earliest || !is_wanted(piece)
+            || !has_piece(peer_vec, piece_index)) {
+            continue;
+        }
+        const bool is_urgent = deadline - now < URGENT_WINDOW;
+        if (is_urgent && !is_fast) {
+            // A slow peer would likely miss the deadline.
+            continue;
+        }
+        if (piece.state == State::Checking) {
+            continue;
+        }
+        if (piece.state == State::Assigned
+            && (!is_urgent || piece.assigned >= MAX_ASSIGNED || exclusive
+                || piece.exclusive || piece.hash_failed)) {
+            // Pieces are shared only if we can tell who sent bad data.
+            continue;
+        }
+        result = piece_index;
+        earliest = deadline;
+    }
+
+    if (result.has_value()) {
+        // Urgent pieces might already be assigned to another peer.
+        // Whichever finishes first wins.
+        auto& piece = pieces[result.value()];
+        piece.state = State::Assigned;
+        piece.assigned += 1;
+        piece.exclusive = exclusive;
+    }
+    return result;
+}
+
+bool PiecePicker::try_assign(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (piece_index >= pieces.size()) {
+        return false;
+    }
+    auto& piece = pieces[piece_index];
+    if (piece.state != State::Missing || !is_wanted(piece)) {
+        return false;
+    }
+    piece.state = State::Assigned;
+    piece.assigned = 1;
+    return true;
+}
+
+void PiecePicker::piece_failed(PieceIndex piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (!piece_index.has_value() || piece_index.value() >= pieces.size()) {
+        return;
+    }
+    auto& piece = pieces[piece_index.value()];
+    if (piece.state == State::Checking && piece.assigned != 0) {
+        // Stays unassignable until the check is done.
+        piece.assigned -= 1;
+    } else if (piece.state == State::Assigned) {
+        piece.assigned -= 1;
+        if (piece.assigned == 0) {
+            // Other peers may assign it to themselfs now.
+            piece.state = State::Missing;
+            piece.exclusive = false;
+        }
+    }
+}
+
+void PiecePicker::set_checking(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (piece_index < pieces.size()
+        && pieces[piece_index].state != State::Have) {
+        pieces[piece_index].state = State::Checking;
+    }
+}
+
+void PiecePicker::set_check_failed(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (piece_index >= pieces.size()) {
+        return;
+    }
+    auto& piece = pieces[piece_index];
+    if (piece.state != State::Checking) {
+        return;
+    }
+    if (piece.assigned != 0) {
+        // Released by the last of its peers with piece_failed.
+        piece.state = State::Assigned;
+        return;
+    }
+    piece.state = State::Missing;
+    piece.exclusive = false;
+}
+
+bool PiecePicker::set_have(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (piece_index >= pieces.size()) {
+        return false;
+    }
+    auto& piece = pieces[piece_index];
+    const bool was_wanted = is_wanted(piece);
+    piece.state = State::Have;
+    piece.assigned = 0;
+    piece.exclusive = false;
+    deadlines.erase(piece_index);
+    if (!was_wanted) {
+        return false;
+    }
+    wanted_left -= 1;
+    return wanted_left == 0;
+}
+
+void PiecePicker::set_priority(
+    std::size_t first_piece,
+    std::size_t last_piece,
+    Priority priority
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    for (std::size_t i = first_piece; i <= last_piece && i < pieces.size();
+         ++i) {
+        auto& piece = pieces[i];
+        const bool was_wanted = is_wanted(piece);
+        piece.priority = priority;
+        if (was_wanted && !is_wanted(piece)) {
+            wanted_left -= 1;
+        } else if (!was_wanted && is_wanted(piece)) {
+            wanted_left += 1;
+        }
+    }
+}
+
+void PiecePicker::set_hash_failed(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (piece_index < pieces.size()) {
+        pieces[piece_index].hash_failed = true;
+    }
+}
+
+void PiecePicker::set_deadline(
+    std::size_t piece_index,
+    Clock::time_point deadline
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (piece_index >= pieces.size()
+        || pieces[piece_index].state == State::Have) {
+        return;
+    }
+    deadlines[piece_index] = deadline;
+}
+
+void PiecePicker::clear_deadlines() {
+    std::scoped_lock<std::mutex> lock {mutex};
+    deadlines.clear();
+}
+
+Priority PiecePicker::get_priority(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    return pieces.at(piece_index).priority;
+}
+
+void PiecePicker::add_peer(Bitfield& peer_bitfield) {
+    add_availability(peer_bitfield, 1);
+}
+
+void PiecePicker::remove_peer(Bitfield& peer_bitfield) {
+    add_availability(peer_bitfield, -1);
+}
+
+void PiecePicker::add_availability(Bitfield& peer_bitfield, int amount) {
+    std::scoped_lock<std::mutex> lock1 {mutex};
+    std::scoped_lock<std::mutex> lock2 {peer_bitfield.mutex};
+    const auto& peer_vec = peer_bitfield.vec;
+    const auto end = std::min(pieces.size(), peer_vec.size() * 8);
+    for (std::size_t i = 0; i < end; ++i) {
+        if (has_piece(peer_vec, i)) {
+            pieces[i].availability = static_cast<std::uint16_t>(
+                pieces[i].availability + amount
+            );
+        }
+    }
+}
+
+void PiecePicker::add_have(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (piece_index < pieces.size()) {
+        pieces[piece_index].availability += 1;
+    }
+}
+
+std::vector<PiecePicker::PieceInfo> PiecePicker::get_piece_infos() {
+    std::scoped_lock<std::mutex> lock {mutex};
+    std::vector<PieceInfo> infos;
+    infos.reserve(pieces.size());
+    for (const auto& piece : pieces) {
+        auto status = PieceStatus::Missing;
+        if (piece.state == State::Have) {
+            status = PieceStatus::Have;
+        } else if (piece.state == State::Assigned
+                   || piece.state == State::Checking) {
+            status = PieceStatus::Downloading;
+        } else if (piece.priority == Priority::Skip) {
+            status = PieceStatus::Skipped;
+        }
+        infos.push_back({status, piece.availability});
+    }
+    return infos;
+}
+
+} // namespace torrent
@@ -1,20 +1,25 @@
 #include "pieces.hpp"
 
-#include <boost/log/trivial.hpp>
+#include <algorithm>
 #include <chrono>
 #include <exception>
 #include <filesystem>
 #include <fstream>
+#include <future>
 #include <ios>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 
 #include "async_file.hpp"
+#include "log.hpp"
+#include "sha1.hpp"
+#include "trace.hpp"
 
 namespace torrent {
 
-void Pieces::init_file() {
+void Pieces::init_file(std::vector<Priority> priorities) {
     // Metadata should be ready before calling this function.
     assert(metadata->is_ready());
 
@@ -25,30 +30,60 @@ void Pieces::init_file() {
 
     bitfield =
         std::make_unique<Bitfield>((piece_count / 8) + (piece_count % 8 != 0));
-    const auto& file_name = metadata->get_file_name();
+    picker = std::make_unique<PiecePicker>(piece_count);
+
+    file_priorities = std::move(priorities);
+    file_priorities.resize(metadata->get_files().size(), Priority::Normal);
+    for (std::size_t i = 0; i < file_priorities.size(); ++i) {
+        if (file_priorities[i] != Priority::Normal) {
+            update_file_pieces(i);
+        }
+    }
+
+    const auto file_name =
+        (download_directory / metadata->get_file_name()).string();
     const std::size_t file_length = metadata->get_total_length();
 
     bool file_exists = std::filesystem::exists(file_name);
 
     // Create the file if its already not created.
-    file.open(
-        file_name,
-        AsyncFileOpenMode::Binary | AsyncFileOpenMode::ReadWrite
-    );
-
-    if (!file.is_open()) {
-        throw std::runtime_error(
-            "Error while opening/creating the file " + file_name + "."
-        );
-    }
+    // Released by the destructor.
+    file_path = file_name;
+    file_pool->retain(file_path);
+    const auto file =
+        file_pool->open(io_context, file_path, FilePool::Mode::ReadWrite);
 
     // file_length is the variable we got from the .torrent file.
     // They could potentially be different. So resize it.
-    file.resize(file_length);
+    // Resizing doesn't allocate the blocks, so pieces of skipped files
+    //      don't take any disk space on file systems with sparse files.
+    file->resize(file_length);
+    switch (allocation) {
+        case Allocation::Sparse:
+            break;
+        case Allocation::Full:
+            if (!file->allocate(0, file_length)) {
+                TORRENT_LOG(warning)
+                    << "Could not preallocate " << file_name
+                    << ", it is allocated as it is written.";
+            }
+            break;
+        case Allocation::Extents: {
+            std::scoped_lock<std::mutex> lock {allocation_mutex};
+            allocated_extents.assign(
+                (file_length + ALLOCATION_EXTENT - 1) / ALLOCATION_EXTENT,
+                false
+            );
+            break;
+        }
+    }
 
     auto file_megabytes = file_length / (1024 * 1024);
-    BOOST_LOG_TRIVIAL(info)
+    TORRENT_LOG(info)
         << "Opened the file " << file_name << " (" << file_megabytes << " Mb).";
+    // Publish the picker and the file. Readers that see it initialized
+    //      also see them.
+    initialized.store(true, std::memory_order_release);
 
     if (file_exists) {
         // Create a temporary on piece callback.
@@ -58,14 +93,19 @@ void Pieces::init_file() {
             [self_weak = get_weak()](std::size_t piece_index) mutable {
                 if (auto self = self_weak.lock()) {
                     self->metadata->on_piece_complete(piece_index);
+                    // Reads may be queued while the pieces are checked.
+                    self->wake_reads();
+                    self->picker->set_have(piece_index);
                 }
             }
         );
 
         run_sha1_checksum_multithread();
-        // The file is already complete. Just extract the torrent.
-        if (metadata->is_file_complete()) {
+        // The wanted files are already complete. Just extract the torrent.
+        if (picker->is_complete()) {
             extract_torrent();
+            // Answers the reads of pieces on the disk, stop fails the rest.
+            wake_reads();
             stop();
             return;
         }
@@ -77,7 +117,11 @@ void Pieces::init_file() {
             // Create a weak pointer to avoid cyclic reference.
             if (auto self = self_weak.lock()) {
                 self->metadata->on_piece_complete(piece_index);
-                if (!self->metadata->is_file_complete()) {
+                self->wake_reads();
+                if (!self->picker->set_have(piece_index)) {
+                    // Move the stream window forward if we are streaming.
+                    std::scoped_lock<std::mutex> lock {self->stream_mutex};
+                    self->update_stream_deadlines();
                     return;
                 }
                 // Downloading has finished. Extract the torrent if its necessary.
@@ -88,6 +132,680 @@ void Pieces::init_file() {
     );
 }
 
+void Pieces::set_file_priority(std::size_t file_index, Priority priority) {
+    std::scoped_lock<std::mutex> lock {priority_mutex};
+    if (file_index >= file_priorities.size()) {
+        TORRENT_LOG(error)
+            << "Pieces::set_file_priority called with invalid parameters.";
+        return;
+    }
+    file_priorities[file_index] = priority;
+    update_file_pieces(file_index);
+}
+
+void Pieces::update_file_pieces(std::size_t file_index) {
+    const auto& files = metadata->get_files();
+    const auto length = files[file_index].first;
+    if (length == 0) {
+        return;
+    }
+    const auto offset = metadata->get_file_offset(file_index);
+    const auto first_piece = offset / piece_length;
+    const auto last_piece = (offset + length - 1) / piece_length;
+
+    // Pieces at the edges can be shared with the neighbouring files.
+    // A piece gets the highest priority of the files it overlaps.
+    for (auto piece = first_piece; piece <= last_piece; ++piece) {
+        const auto piece_start = piece * piece_length;
+        const auto piece_end = piece_start + metadata->get_piece_size(piece);
+        const auto first_file = metadata->get_file_index(piece_start);
+        const auto last_file = metadata->get_file_index(piece_end - 1);
+
+        auto priority = Priority::Skip;
+        for (auto i = first_file; i <= last_file; ++i) {
+            if (files[i].first != 0 && !metadata->is_pad_file(i)) {
+                priority = std::max(priority, file_priorities[i]);
+            }
+        }
+        if (piece != first_piece && piece != last_piece) {
+            // Inner pieces belong to this file only. Set them all at once.
+            picker->set_priority(piece, last_piece - 1, priority);
+            piece = last_piece - 1;
+            continue;
+        }
+        picker->set_priority(piece, piece, priority);
+    }
+}
+
+void Pieces::set_stream_position(
+    std::size_t offset,
+    std::size_t bytes_per_second
+) {
+    std::scoped_lock<std::mutex> lock {stream_mutex};
+    if (offset >= metadata->get_total_length() || bytes_per_second == 0) {
+        TORRENT_LOG(error)
+            << "Pieces::set_stream_position called with invalid parameters.";
+        return;
+    }
+    stream = Stream {offset, bytes_per_second, PiecePicker::Clock::now()};
+    // Deadlines of the old window are not relevant after a seek.
+    picker->clear_deadlines();
+    update_stream_deadlines();
+}
+
+void Pieces::clear_stream_position() {
+    std::scoped_lock<std::mutex> lock {stream_mutex};
+    stream.reset();
+    picker->clear_deadlines();
+}
+
+void Pieces::update_stream_deadlines() {
+    if (!stream.has_value()) {
+        return;
+    }
+    const auto [offset, bytes_per_second, start_time] = stream.value();
+
+    // Skip the pieces we already have at the start of the stream.
+    auto first_piece = offset / piece_length;
+    while (first_piece < piece_count && bitfield->has_piece(first_piece)) {
+        first_piece += 1;
+    }
+    const auto end_piece =
+        std::min(piece_count, first_piece + STREAM_WINDOW_PIECES);
+    for (auto i = first_piece; i < end_piece; ++i) {
+        // The piece is needed when the consumer reaches its first byte.
+        const auto piece_start = i * piece_length;
+        const auto bytes_ahead = piece_start > offset ? piece_start - offset : 0;
+        const auto delay = std::chrono::microseconds(
+            bytes_ahead * 1'000'000 / bytes_per_second
+        );
+        picker->set_deadline(i, start_time + delay);
+    }
+}
+
+void Pieces::async_read(
+    std::size_t offset,
+    asio::mutable_buffer buffer,
+    ReadHandler on_finish
+) {
+    const auto total_length = metadata->get_total_length();
+    if (offset > total_length) {
+        on_finish(asio::error::invalid_argument, 0);
+        return;
+    }
+    // Shorten the reads past the end of the torrent.
+    buffer = asio::buffer(buffer, total_length - offset);
+    if (buffer.size() == 0) {
+        on_finish({}, 0);
+        return;
+    }
+
+    const auto first_piece = offset / piece_length;
+    const auto last_piece = (offset + buffer.size() - 1) / piece_length;
+    bool aborted = false;
+    {
+        // Pieces may complete while we are checking them.
+        // wake_reads locks read_mutex too, so they can't be missed.
+        std::scoped_lock<std::mutex> lock {read_mutex};
+        bool complete = true;
+        const auto now = PiecePicker::Clock::now();
+        for (auto i = first_piece; i <= last_piece; ++i) {
+            if (bitfield->has_piece(i)) {
+                continue;
+            }
+            complete = false;
+            // Someone is waiting for this piece. Download it now.
+            if (picker->get_priority(i) == Priority::Skip) {
+                picker->set_priority(i, i, Priority::Normal);
+            }
+            picker->set_deadline(i, now);
+        }
+        if (!complete) {
+            if (!reads_stopped) {
+                pending_reads.push_back(
+                    {first_piece,
+                     last_piece,
+                     offset,
+                     buffer,
+                     std::move(on_finish)}
+                );
+                return;
+            }
+            aborted = true;
+        }
+    }
+    if (aborted) {
+        on_finish(asio::error::operation_aborted, 0);
+        return;
+    }
+    read_range_async(offset, buffer, 0, std::move(on_finish));
+}
+
+std::size_t Pieces::read(std::size_t offset, asio::mutable_buffer buffer) {
+    std::promise<std::size_t> promise;
+    auto future = promise.get_future();
+    async_read(
+        offset,
+        buffer,
+        [&promise](const auto& error_code, std::size_t bytes_read) {
+            if (error_code) {
+                promise.set_exception(std::make_exception_ptr(
+                    boost::system::system_error(error_code)
+                ));
+            } else {
+                promise.set_value(bytes_read);
+            }
+        }
+    );
+    return future.get();
+}
+
+void Pieces::wake_reads() {
+    std::vector<PendingRead> ready_reads;
+    {
+        std::scoped_lock<std::mutex> lock {read_mutex};
+        auto it = std::partition(
+            pending_reads.begin(),
+            pending_reads.end(),
+            [this](const auto& pending) {
+                for (auto i = pending.first_piece; i <= pending.last_piece;
+                     ++i) {
+                    if (!bitfield->has_piece(i)) {
+                        return true; // Keep waiting.
+                    }
+                }
+                return false;
+            }
+        );
+        std::move(it, pending_reads.end(), std::back_inserter(ready_reads));
+        pending_reads.erase(it, pending_reads.end());
+    }
+    for (auto& pending : ready_reads) {
+        read_range_async(
+            pending.offset,
+            pending.buffer,
+            0,
+            std::move(pending.on_finish)
+        );
+    }
+}
+
+void Pieces::read_range_async(
+    std::size_t offset,
+    asio::mutable_buffer buffer,
+    std::size_t bytes_read,
+    ReadHandler on_finish
+) {
+    // Read directly into the buffer of the consumer.
+    start_disk_operation();
+    auto file = get_file();
+    file->async_read_some_at(
+        offset + bytes_read,
+        buffer + bytes_read,
+        [=,
+         this,
+         self = get_ptr(),
+         held_file = file,
+         on_finish = std::move(on_finish)](
+            const auto& error_code,
+            std::size_t bytes_transferred
+        ) mutable {
+            finish_disk_operation();
+            if (error_code) {
+                TORRENT_LOG(error)
+                    << "Error while reading from the file: "
+                    << error_code.message();
+                on_finish(error_code, bytes_read);
+                return;
+            }
+            bytes_read += bytes_transferred;
+            if (bytes_read < buffer.size() && bytes_transferred != 0) {
+                read_range_async(
+                    offset,
+                    buffer,
+                    bytes_read,
+                    std::move(on_finish)
+                );
+                return;
+            }
+            on_finish(error_code, bytes_read);
+        }
+    );
+}
+
+void Pieces::write_piece_async(
+    std::size_t piece_index,
+    asio::const_buffer piece,
+    std::function<void(const boost::system::error_code&, bool)> on_finish
+) {
+    if (piece_index >= piece_count
+        || piece.size() != metadata->get_piece_size(piece_index)) {
+        on_finish(asio::error::invalid_argument, false);
+        return;
+    }
+    // The piece is already in memory. Check it before touching the file.
+    const std::string_view piece_view {
+        static_cast<const char*>(piece.data()),
+        piece.size()
+    };
+    if (!check_piece(piece_index, piece_view)) {
+        metrics->hash_failures.add();
+        on_finish({}, false);
+        return;
+    }
+    write_range_async(
+        piece_index * piece_length,
+        piece,
+        [on_finish = std::move(on_finish)](const auto& error_code) {
+            on_finish(error_code, !error_code);
+        }
+    );
+}
+
+void Pieces::write_range_async(
+    std::size_t offset,
+    asio::const_buffer buffer,
+    std::function<void(const boost::system::error_code&)> on_finish
+) {
+    allocate_range(offset, buffer.size());
+    trace::Span span {"disk_write_submit"};
+    const auto submitted = trace::now();
+    start_disk_operation();
+    auto file = get_file();
+    file->async_write_some_at(
+        offset,
+        buffer,
+        [=,
+         this,
+         self = get_ptr(),
+         held_file = file,
+         on_finish = std::move(on_finish)](
+            const auto& error_code,
+            std::size_t bytes_transferred
+        ) mutable {
+            trace::record_async("disk_write", submitted);
+            finish_disk_operation();
+            if (error_code) {
+                TORRENT_LOG(error)
+                    << "Error while writing to the file: "
+                    << error_code.message();
+                on_finish(error_code);
+                return;
+            }
+            if (bytes_transferred == 0 && buffer.size() != 0) {
+                on_finish(asio::error::eof);
+                return;
+            }
+            if (bytes_transferred < buffer.size()) {
+                // Write the rest.
+                write_range_async(
+                    offset + bytes_transferred,
+                    buffer + bytes_transferred,
+                    std::move(on_finish)
+                );
+                return;
+            }
+            on_finish(error_code);
+        }
+    );
+}
+
+void Pieces::queue_write(
+    std::uint64_t offset,
+    asio::const_buffer buffer,
+    WriteHandler handler
+) {
+    bool flush = false;
+    {
+        std::scoped_lock<std::mutex> lock {write_mutex};
+        pending_writes.push_back({offset, buffer, std::move(handler)});
+        pending_write_bytes += buffer.size();
+        if (writes_in_flight < MAX_WRITES_IN_FLIGHT
+            || pending_write_bytes >= MAX_PENDING_WRITE_BYTES) {
+            flush = true;
+        } else if (!write_timer_armed) {
+            write_timer_armed = true;
+            write_timer.expires_after(WRITE_WINDOW);
+            write_timer.async_wait([self_weak = get_weak()](const auto& error) {
+                if (auto self = self_weak.lock(); self && !error) {
+                    self->flush_writes();
+                }
+            });
+        }
+    }
+    if (flush) {
+        flush_writes();
+    }
+}
+
+void Pieces::flush_writes() {
+    std::vector<PendingWrite> writes;
+    {
+        std::scoped_lock<std::mutex> lock {write_mutex};
+        writes.swap(pending_writes);
+        pending_write_bytes = 0;
+        if (write_timer_armed) {
+            write_timer_armed = false;
+            write_timer.cancel();
+        }
+    }
+    if (writes.empty()) {
+        return;
+    }
+    trace::Span span {
+        "disk_write_flush",
+        static_cast<std::int64_t>(writes.size())
+    };
+    for (auto& run : make_write_runs(std::move(writes))) {
+        write_run(std::move(run));
+    }
+}
+
+std::vector<std::vector<Pieces::PendingWrite>>
+Pieces::make_write_runs(std::vector<PendingWrite> writes) {
+    std::stable_sort(
+        writes.begin(),
+        writes.end(),
+        [](const auto& x, const auto& y) { return x.offset < y.offset; }
+    );
+
+    std::vector<std::vector<PendingWrite>> runs;
+    for (auto& write : writes) {
+        if (runs.empty()
+            || write.offset
+                != runs.back().back().offset + runs.back().back().buffer.size()
+            || runs.back().size() >= MAX_WRITE_RUN_BUFFERS) {
+            runs.emplace_back();
+        }
+        runs.back().push_back(std::move(write));
+    }
+    return runs;
+}
+
+void Pieces::write_run(std::vector<PendingWrite> run) {
+    std::vector<asio::const_buffer> buffers;
+    buffers.reserve(run.size());
+    for (const auto& write : run) {
+        buffers.push_back(write.buffer);
+    }
+    const auto offset = run.front().offset;
+    auto run_ptr = std::make_shared<std::vector<PendingWrite>>(std::move(run));
+    {
+        std::scoped_lock<std::mutex> lock {write_mutex};
+        ++writes_in_flight;
+    }
+
+    auto file = get_file();
+    file->async_write_at(
+        offset,
+        buffers,
+        // Holding the file keeps it open until the write completes.
+        [this, self = get_ptr(), run_ptr, held_file = file](
+            const auto& error_code,
+            std::size_t
+        ) {
+            bool more = false;
+            {
+                std::scoped_lock<std::mutex> lock {write_mutex};
+                --writes_in_flight;
+                more = !pending_writes.empty();
+            }
+            for (auto& write : *run_ptr) {
+                write.handler(error_code, error_code ? 0 : write.buffer.size());
+            }
+            if (more) {
+                flush_writes();
+            }
+        }
+    );
+}
+
+void Pieces::allocate_range(std::size_t offset, std::size_t length) {
+    std::scoped_lock<std::mutex> lock {allocation_mutex};
+    const auto extents = take_extents(
+        allocated_extents,
+        offset,
+        length,
+        metadata->get_total_length()
+    );
+    for (const auto& [start, extent_length] : extents) {
+        if (!get_file()->allocate(start, extent_length)) {
+            TORRENT_LOG(warning) << "Could not allocate the file in extents, "
+                                    "it is allocated as it is written.";
+            allocated_extents.clear();
+            return;
+        }
+    }
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> Pieces::take_extents(
+    std::vector<bool>& allocated_extents,
+    std::size_t offset,
+    std::size_t length,
+    std::size_t file_length
+) {
+    std::vector<std::pair<std::size_t, std::size_t>> extents;
+    if (length == 0) {
+        return extents;
+    }
+    const auto last = (offset + length - 1) / ALLOCATION_EXTENT;
+    for (auto extent = offset / ALLOCATION_EXTENT;
+         extent <= last && extent < allocated_extents.size();
+         ++extent) {
+        if (allocated_extents[extent]) {
+            continue;
+        }
+        allocated_extents[extent] = true;
+        const auto start = extent * ALLOCATION_EXTENT;
+        extents.emplace_back(
+            start,
+            std::min(ALLOCATION_EXTENT, file_length - start)
+        );
+    }
+    return extents;
+}
+
+Pieces::BlockStatus Pieces::add_block(
+    std::size_t piece_index,
+    std::size_t begin,
+    std::string_view block,
+    const BlockSource& source
+) {
+    const auto block_index = begin / Metadata::BLOCK_LENGTH;
+    const auto block_count =
+        (metadata->get_piece_size(piece_index) + Metadata::BLOCK_LENGTH - 1)
+        / Metadata::BLOCK_LENGTH;
+    if (block_index >= block_count || bitfield->has_piece(piece_index)) {
+        // Late and duplicate blocks of a checked piece are not tracked,
+        //      its entry is already gone and would never be removed.
+        return BlockStatus::Missing;
+    }
+    // Blocks of hybrid torrents can run into a pad file, which is not hashed.
+    const auto data_size = metadata->get_piece_data_size(piece_index);
+    const bool has_leaf = metadata->has_v2() && begin < data_size;
+    Sha256Hash leaf {};
+    if (has_leaf) {
+        trace::Span span {
+            "sha256_block",
+            static_cast<std::int64_t>(piece_index)
+        };
+        leaf = sha256(block.substr(0, data_size - begin));
+    }
+
+    std::function<void(std::size_t, const std::vector<BlockSource>&)> callback;
+    {
+        std::scoped_lock<std::mutex> lock {block_mutex};
+        const auto trusted = trusted_leaves.find(piece_index);
+        if (!has_leaf || trusted == trusted_leaves.end()
+            || block_index >= trusted->second.size()
+            || trusted->second[block_index] == leaf) {
+            auto& piece = partial_pieces[piece_index];
+            if (piece.written.empty()) {
+                piece.sources.resize(block_count);
+                piece.leaves.resize(block_count);
+                piece.written.resize(block_count);
+            }
+            piece.sources[block_index] = source;
+            piece.leaves[block_index] = leaf;
+            if (piece.written[block_index]) {
+                return BlockStatus::Missing; // Sent twice.
+            }
+            piece.written[block_index] = true;
+            piece.written_count += 1;
+            if (piece.written_count < block_count) {
+                return BlockStatus::Missing;
+            }
+            // Every block is skipped while it is checked, so nobody may
+            //      be assigned the piece until the check is done.
+            picker->set_checking(piece_index);
+            return BlockStatus::Complete;
+        }
+        callback = on_piece_failed;
+    }
+
+    // Only the peer that sent this block is at fault.
+    metrics->hash_failures.add();
+    TORRENT_LOG(warning)
+        << "Block#" << block_index << " of piece#" << piece_index << " from "
+        << source << " failed SHA-256.";
+    if (callback) {
+        callback(piece_index, {source});
+    }
+    return BlockStatus::Bad;
+}
+
+bool Pieces::check_piece_leaves(std::size_t piece_index) {
+    trace::Span span {"sha256_verify", static_cast<std::int64_t>(piece_index)};
+    const auto leaf_count =
+        (metadata->get_piece_data_size(piece_index) + Metadata::BLOCK_LENGTH
+         - 1)
+        / Metadata::BLOCK_LENGTH;
+    std::vector<Sha256Hash> leaves;
+    {
+        std::scoped_lock<std::mutex> lock {block_mutex};
+        const auto it = partial_pieces.find(piece_index);
+        if (it == partial_pieces.end()) {
+            return false;
+        }
+        leaves = it->second.leaves;
+    }
+    leaves.resize(leaf_count);
+    return merkle_root(leaves, metadata->get_piece_leaf_count(piece_index))
+        == metadata->get_piece_hash_v2(piece_index);
+}
+
+bool Pieces::has_block(std::size_t piece_index, std::size_t block_index) {
+    std::scoped_lock<std::mutex> lock {block_mutex};
+    const auto it = partial_pieces.find(piece_index);
+    return it != partial_pieces.end()
+        && block_index < it->second.written.size()
+        && it->second.written[block_index];
+}
+
+bool Pieces::add_block_hashes(
+    std::size_t piece_index,
+    std::vector<Sha256Hash> hashes
+) {
+    if (!metadata->has_v2() || piece_index >= piece_count) {
+        return false;
+    }
+    const auto leaf_count = metadata->get_piece_leaf_count(piece_index);
+    if (hashes.size() != leaf_count
+        || merkle_root(hashes, leaf_count)
+            != metadata->get_piece_hash_v2(piece_index)) {
+        return false;
+    }
+    // Leaves past the end of the file are only padding.
+    hashes.resize(
+        (metadata->get_piece_data_size(piece_index) + Metadata::BLOCK_LENGTH
+         - 1)
+        / Metadata::BLOCK_LENGTH
+    );
+    std::scoped_lock<std::mutex> lock {block_mutex};
+    trusted_leaves.insert_or_assign(piece_index, std::move(hashes));
+    return true;
+}
+
+void Pieces::hash_blocks_async(
+    std::size_t piece_index,
+    std::function<
+        void(const boost::system::error_code&, std::vector<Sha256Hash>)>
+        on_finish
+) {
+    if (!metadata->has_v2() || piece_index >= piece_count
+        || !bitfield->has_piece(piece_index)) {
+        on_finish(asio::error::invalid_argument, {});
+        return;
+    }
+    auto buffer_ptr = std::make_shared<std::string>(
+        metadata->get_piece_data_size(piece_index),
+        '\0'
+    );
+    read_range_async(
+        piece_index * piece_length,
+        asio::buffer(*buffer_ptr),
+        0,
+        [buffer_ptr, on_finish = std::move(on_finish)](
+            const auto& error_code,
+            std::size_t bytes_read
+        ) {
+            if (error_code || bytes_read != buffer_ptr->size()) {
+                on_finish(error_code ? error_code : asio::error::eof, {});
+                return;
+            }
+            on_finish(error_code, merkle_leaves(*buffer_ptr));
+        }
+    );
+}
+
+std::vector<Pieces::BlockSource>
+Pieces::take_block_sources(std::size_t piece_index) {
+    std::scoped_lock<std::mutex> lock {block_mutex};
+    trusted_leaves.erase(piece_index);
+    const auto it = partial_pieces.find(piece_index);
+    if (it == partial_pieces.end()) {
+        return {};
+    }
+    auto sources = std::move(it->second.sources);
+    partial_pieces.erase(it);
+
+    // Only return every peer once.
+    std::erase(sources, BlockSource {});
+    std::sort(sources.begin(), sources.end());
+    sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+    return sources;
+}
+
+void Pieces::on_hash_failure(std::size_t piece_index) {
+    metrics->hash_failures.add();
+    const auto sources = take_block_sources(piece_index);
+    TORRENT_LOG(warning) << "Piece#" << piece_index << " from "
+                               << sources.size() << " peers failed SHA1.";
+
+    // Download it from a single peer from now on.
+    picker->set_hash_failed(piece_index);
+    picker->set_check_failed(piece_index);
+
+    std::function<void(std::size_t, const std::vector<BlockSource>&)> callback;
+    std::function<void(std::size_t)> hashes_callback;
+    {
+        std::scoped_lock<std::mutex> lock {block_mutex};
+        callback = on_piece_failed;
+        // With the leaf hashes the bad blocks are caught as they arrive.
+        // Pieces of a single block are already checked block by block.
+        if (metadata->has_v2() && !trusted_leaves.contains(piece_index)
+            && metadata->get_piece_leaf_count(piece_index) > 1) {
+            hashes_callback = on_hashes_needed;
+        }
+    }
+    if (callback) {
+        callback(piece_index, sources);
+    }
+    if (hashes_callback) {
+        hashes_callback(piece_index);
+    }
+}
+
 void Pieces::extract_file(
     std::size_t offset,
     std::size_t length,
@@ -95,10 +813,10 @@ void Pieces::extract_file(
 ) {
     std::ofstream output_file(path, std::ios::binary | std::ios::trunc);
     if (!output_file) {
-        BOOST_LOG_TRIVIAL(error) << "Could not create file: " << path;
+        TORRENT_LOG(error) << "Could not create file: " << path;
         return;
     } else {
-        BOOST_LOG_TRIVIAL(info) << "Created file: " << path;
+        TORRENT_LOG(info) << "Created file: " << path;
     }
     const auto buffer = read_some_at(offset, length);
     output_file.write(
@@ -110,30 +828,41 @@ void Pieces::extract_file(
 void Pieces::extract_torrent() {
     // File is complete and its time to extract it.
     namespace fs = std::filesystem;
+    if (!extract_files) {
+        return;
+    }
 
     const auto& files = metadata->get_files();
     if (files.size() == 1) {
         // Torrent is in single file mode.
+        if (file_priorities[0] == Priority::Skip) {
+            return;
+        }
         auto [length, path] = files[0];
-        extract_file(0, length, path);
+        extract_file(0, length, (download_directory / path).string());
         return;
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Started extracting the torrent file.";
-    const std::string folder_path = "./" + metadata->get_name();
+    TORRENT_LOG(info) << "Started extracting the torrent file.";
+    const std::string folder_path =
+        (download_directory / metadata->get_name()).string();
     try {
         fs::create_directory(folder_path);
-        BOOST_LOG_TRIVIAL(info) << "Created the folder in: " << folder_path;
+        TORRENT_LOG(info) << "Created the folder in: " << folder_path;
     } catch (const std::exception& exception) {
-        BOOST_LOG_TRIVIAL(error)
+        TORRENT_LOG(error)
             << "Error while creating the folder: " << exception.what();
         return;
     }
 
-    std::size_t offset = 0;
-    for (auto [length, path] : files) {
-        extract_file(offset, length, folder_path + path);
-        offset += length;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        const auto& [length, path] = files[i];
+        if (file_priorities[i] == Priority::Skip
+            || metadata->is_pad_file(i)) {
+            // This file is not downloaded, or only aligns the next one.
+            continue;
+        }
+        extract_file(metadata->get_file_offset(i), length, folder_path + path);
     }
 }
 
@@ -143,55 +872,79 @@ void Pieces::wait() {
 }
 
 void Pieces::stop() {
-    std::scoped_lock<std::mutex> lock {running_cv_mutex};
-    running = false;
-    running_cv.notify_all();
+    // Blocks waiting in the queue are still written.
+    flush_writes();
+    {
+        std::scoped_lock<std::mutex> lock {running_cv_mutex};
+        running = false;
+        running_cv.notify_all();
+    }
+
+    // Pieces of the waiting reads will never arrive.
+    std::vector<PendingRead> aborted_reads;
+    {
+        std::scoped_lock<std::mutex> lock {read_mutex};
+        aborted_reads.swap(pending_reads);
+        reads_stopped = true;
+    }
+    for (auto& pending : aborted_reads) {
+        pending.on_finish(asio::error::operation_aborted, 0);
+    }
 }
 
 bool Pieces::check_sha1_piece(
     std::size_t piece_index,
     const std::string_view piece
 ) {
-    unsigned char hash[20];
-    SHA1(
-        reinterpret_cast<const unsigned char*>(piece.data()),
-        piece.size(),
-        hash
-    );
-    const auto& pieces = metadata->get_pieces();
+    trace::Span span {"sha1_verify", static_cast<std::int64_t>(piece_index)};
+    const auto hash = sha1(piece);
+    const auto& piece_hash = metadata->get_piece_hash(piece_index);
     int sha1_check = std::memcmp(
-        static_cast<const void*>(&pieces[piece_index * 20]),
-        static_cast<const void*>(hash),
-        20
+        static_cast<const void*>(piece_hash.data()),
+        static_cast<const void*>(hash.data()),
+        piece_hash.size()
     );
     return sha1_check == 0;
 }
 
+bool Pieces::check_piece(
+    std::size_t piece_index,
+    const std::string_view piece
+) {
+    if (!metadata->has_v2()) {
+        return check_sha1_piece(piece_index, piece);
+    }
+    trace::Span span {"sha256_verify", static_cast<std::int64_t>(piece_index)};
+    const auto leaves = merkle_leaves(
+        piece.substr(0, metadata->get_piece_data_size(piece_index))
+    );
+    return merkle_root(leaves, metadata->get_piece_leaf_count(piece_index))
+        == metadata->get_piece_hash_v2(piece_index);
+}
+
 void Pieces::check_pieces_sha1(std::size_t start_piece, std::size_t end_piece) {
     std::string piece_buffer;
+    const auto file = get_file();
     for (std::size_t i = start_piece; i < end_piece; i += 1) {
-        std::size_t length = piece_length;
-        if (i == piece_count - 1) {
-            // Last pieces can be shorter then usual.
-            length = file.size() - i * piece_length;
-        }
+        // Last pieces can be shorter then usual.
+        const std::size_t length = metadata->get_piece_size(i);
 
         piece_buffer.resize(length);
-        file.read_some_at(i * piece_length, asio::buffer(piece_buffer));
+        file->read_some_at(i * piece_length, asio::buffer(piece_buffer));
 
-        if (check_sha1_piece(i, piece_buffer)) {
+        if (check_piece(i, piece_buffer)) {
             // SHA1 check passed. Add this piece to bitfield.
             bitfield->set_piece(i);
         } /* else { // TODO: Decide if we actually have to zero the piece.
                 // SHA1 check failed. Zero this piece.
                 std::memset(piece_buffer.data(), 0, piece_length);
-                file.write_some_at(i * piece_length, asio_buffer);
+                file->write_some_at(i * piece_length, asio_buffer);
             } */
     }
 }
 
 void Pieces::run_sha1_checksum() {
-    BOOST_LOG_TRIVIAL(info) << "Starting the SHA1 checksum";
+    TORRENT_LOG(info) << "Starting the SHA1 checksum";
 
     auto start = std::chrono::steady_clock::now();
 
@@ -205,7 +958,7 @@ void Pieces::run_sha1_checksum() {
     auto elapsed =
         std::chrono::duration_cast<std::chrono::seconds>(end - start);
 
-    BOOST_LOG_TRIVIAL(info) << "Finished SHA1 checksum in " << elapsed.count()
+    TORRENT_LOG(info) << "Finished SHA1 checksum in " << elapsed.count()
                             << " seconds. Found " << metadata->get_pieces_done()
                             << " valid pieces out of " << piece_count << ".";
 }
@@ -220,7 +973,7 @@ void Pieces::run_sha1_checksum_multithread() {
     const auto thread_count = std::thread::hardware_concurrency();
     thread_pool.reserve(thread_count);
 
-    BOOST_LOG_TRIVIAL(info)
+    TORRENT_LOG(info)
         << "Starting the SHA1 checksum with " << thread_count << " threads.";
 
     // Start the timer
@@ -253,7 +1006,7 @@ void Pieces::run_sha1_checksum_multithread() {
     auto elapsed =
         std::chrono::duration_cast<std::chrono::seconds>(end - start);
 
-    BOOST_LOG_TRIVIAL(info) << "Finished SHA1 checksum in " << elapsed.count()
+    TORRENT_LOG(info) << "Finished SHA1 checksum in " << elapsed.count()
                             << " seconds. Found " << metadata->get_pieces_done()
                             << " valid pieces out of " << piece_count << ".";
 }
@@ -0,0 +1,198 @@
+#include "range_server.hpp"
+
+#include <charconv>
+#include <string>
+
+namespace torrent {
+
+RangeServer::RangeServer(
+    asio::io_context& io_context_ref,
+    std::uint16_t server_port,
+    std::shared_ptr<Metadata> metadata_ptr,
+    std::shared_ptr<Pieces> pieces_ptr
+) :
+    metadata(std::move(metadata_ptr)),
+    pieces(std::move(pieces_ptr)),
+    io_context(io_context_ref),
+    port(server_port) {}
+
+void RangeServer::start() {
+    server = std::make_shared<HttpServer>(
+        io_context,
+        port,
+        [weak = weak_from_this()](const auto& request, auto session) {
+            if (const auto self = weak.lock()) {
+                self->on_request(request, std::move(session));
+            }
+        }
+    );
+    server->start();
+}
+
+std::optional<std::pair<std::size_t, std::size_t>>
+RangeServer::parse_range(std::string_view range, std::size_t length) {
+    constexpr std::string_view unit = "bytes=";
+    if (!range.starts_with(unit) || length == 0) {
+        return {};
+    }
+    range.remove_prefix(unit.size());
+    const auto dash = range.find('-');
+    if (dash == std::string_view::npos
+        || range.find(',') != std::string_view::npos) {
+        return {};
+    }
+
+    const auto parse = [](std::string_view str, std::size_t& value) {
+        const auto [ptr, error] =
+            std::from_chars(str.data(), str.data() + str.size(), value);
+        return !str.empty() && error == std::errc {}
+            && ptr == str.data() + str.size();
+    };
+
+    const auto first_str = range.substr(0, dash);
+    const auto last_str = range.substr(dash + 1);
+    std::size_t first = 0;
+    std::size_t last = length - 1;
+    if (first_str.empty()) {
+        // Suffix range, "bytes=-500" is the last 500 bytes.
+        std::size_t suffix_length;
+        if (!parse(last_str, suffix_length) || suffix_length == 0) {
+            return {};
+        }
+        first = length - std::min(length, suffix_length);
+    } else {
+        if (!parse(first_str, first)) {
+            return {};
+        }
+        if (!last_str.empty() && !parse(last_str, last)) {
+            return {};
+        }
+        last = std::min(last, length - 1);
+    }
+    if (first > last) {
+        return {};
+    }
+    return std::make_pair(first, last);
+}
+
+void RangeServer::on_request(
+    const HttpServer::Request& request,
+    std::shared_ptr<HttpServer::Session> session
+) {
+    if (request.method() != http::verb::get) {
+        session->send(
+            http::status::method_not_allowed,
+            "text/plain",
+            "Only GET is supported.\n"
+        );
+        return;
+    }
+    if (!metadata->is_ready() || !pieces->is_initialized()) {
+        session->send(
+            http::status::service_unavailable,
+            "text/plain",
+            "Metadata of the torrent is not ready.\n"
+        );
+        return;
+    }
+
+    const auto target = std::string_view {
+        request.target().data(),
+        request.target().size()
+    };
+    const auto& files = metadata->get_files();
+    if (target == "/") {
+        // One line per file: index, length and path.
+        std::string listing;
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            listing += std::to_string(i) + '\t' + std::to_string(files[i].first)
+                + '\t' + files[i].second + '\n';
+        }
+        session->send(http::status::ok, "text/plain", std::move(listing));
+        return;
+    }
+
+    std::size_t file_index;
+    const auto index_str = target.substr(1);
+    const auto [ptr, error] = std::from_chars(
+        index_str.data(),
+        index_str.data() + index_str.size(),
+        file_index
+    );
+    if (error != std::errc {} || ptr != index_str.data() + index_str.size()
+        || file_index >= files.size()) {
+        session->send(http::status::not_found, "text/plain", "Not found.\n");
+        return;
+    }
+    send_file(request, std::move(session), file_index);
+}
+
+void RangeServer::send_file(
+    const HttpServer::Request& request,
+    std::shared_ptr<HttpServer::Session> session,
+    std::size_t file_index
+) {
+    const auto file_length = metadata->get_files()[file_index].first;
+    const auto file_offset = metadata->get_file_offset(file_index);
+
+    http::response<http::buffer_body> response {http::status::ok, 11};
+    response.set(http::field::content_type, "application/octet-stream");
+    response.set(http::field::accept_ranges, "bytes");
+
+    std::size_t first = 0;
+    std::size_t length = file_length;
+    const auto range_it = request.find(http::field::range);
+    if (range_it != request.end()) {
+        const auto range = parse_range(
+            {range_it->value().data(), range_it->value().size()},
+            file_length
+        );
+        if (!range.has_value()) {
+            session->send(
+                http::status::range_not_satisfiable,
+                "text/plain",
+                "Invalid range.\n",
+                {{http::field::content_range,
+                  "bytes */" + std::to_string(file_length)}}
+            );
+            return;
+        }
+        first = range->first;
+        length = range->second - range->first + 1;
+        response.result(http::status::partial_content);
+        response.set(
+            http::field::content_range,
+            "bytes " + std::to_string(range->first) + '-'
+                + std::to_string(range->second) + '/'
+                + std::to_string(file_length)
+        );
+    }
+
+    // Body is read straight into the send buffer of the session
+    //      once the pieces covering it are verified.
+    session->send_stream(
+        std::move(response),
+        length,
+        [pieces = pieces, start = file_offset + first](
+            std::size_t position,
+            asio::mutable_buffer buffer,
+            auto on_read
+        ) {
+            pieces->async_read(
+                start + position,
+                buffer,
+                [size = buffer.size(),
+                 on_read = std::move(on_read)](const auto& error, auto read) {
+                    if (!error && read != size) {
+                        // File is shorter than the torrent says.
+                        on_read(asio::error::eof);
+                        return;
+                    }
+                    on_read(error);
+                }
+            );
+        }
+    );
+}
+
+} // namespace torrent
@@ -0,0 +1,235 @@
+#include "session.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include "log.hpp"
+
+namespace torrent {
+
+Session::Session(
+    asio::ssl::context& ssl_context_ref,
+    std::size_t thread_count
+) :
+    ssl_context(ssl_context_ref),
+    download_limit(std::make_shared<BandwidthLimit>()),
+    upload_limit(std::make_shared<BandwidthLimit>()),
+    file_pool(std::make_shared<FilePool>()),
+    work(asio::make_work_guard(io_context)) {
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back([this]() { run(); });
+    }
+}
+
+Session::~Session() {
+    stop();
+}
+
+Session::Id Session::add(std::string source, std::filesystem::path directory) {
+    Torrent torrent;
+    torrent.source = std::move(source);
+    torrent.directory = std::move(directory);
+    torrent.client = start_client(torrent);
+
+    std::scoped_lock<std::mutex> lock {mutex};
+    const auto id = next_id++;
+    TORRENT_LOG(info) << "Added torrent#" << id << ": " << torrent.source;
+    torrents.insert({id, std::move(torrent)});
+    return id;
+}
+
+void Session::remove(Id id) {
+    std::shared_ptr<Client> client;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        client = std::move(get_torrent(id).client);
+        torrents.erase(id);
+    }
+    TORRENT_LOG(info) << "Removed torrent#" << id << ".";
+    if (client) {
+        client->stop();
+    }
+}
+
+void Session::pause(Id id) {
+    std::shared_ptr<Client> client;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        auto& torrent = get_torrent(id);
+        // A client that is being started is stopped once it is.
+        torrent.starting = false;
+        if (!torrent.client) {
+            return;
+        }
+        torrent.stats = torrent.client->get_stats();
+        torrent.stats.peers.clear();
+        torrent.stats.pieces.clear();
+        client = std::move(torrent.client);
+    }
+    TORRENT_LOG(info) << "Paused torrent#" << id << ".";
+    client->stop();
+}
+
+void Session::resume(Id id) {
+    Torrent resumed;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        auto& torrent = get_torrent(id);
+        if (torrent.client || torrent.starting) {
+            return;
+        }
+        torrent.starting = true;
+        resumed.source = torrent.source;
+        resumed.directory = torrent.directory;
+        resumed.file_priorities = torrent.file_priorities;
+    }
+
+    // Starting checks the pieces on the disk, which can take long.
+    //      The other torrents are not blocked meanwhile.
+    std::shared_ptr<Client> client;
+    try {
+        client = start_client(resumed);
+    } catch (...) {
+        std::scoped_lock<std::mutex> lock {mutex};
+        const auto it = torrents.find(id);
+        if (it != torrents.end()) {
+            it->second.starting = false;
+        }
+        throw;
+    }
+
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        const auto it = torrents.find(id);
+        if (it != torrents.end() && it->second.starting) {
+            auto& torrent = it->second;
+            torrent.starting = false;
+            // Priorities may have changed while the client was starting.
+            for (const auto& [file_index, priority] : torrent.file_priorities) {
+                client->set_file_priority(file_index, priority);
+            }
+            torrent.client = std::move(client);
+            TORRENT_LOG(info) << "Resumed torrent#" << id << ".";
+            return;
+        }
+    }
+    // Removed or paused while it was starting.
+    client->stop();
+}
+
+void Session::set_file_priority(
+    Id id,
+    std::size_t file_index,
+    Priority priority
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    auto& torrent = get_torrent(id);
+    torrent.file_priorities[file_index] = priority;
+    if (torrent.client) {
+        torrent.client->set_file_priority(file_index, priority);
+    }
+}
+
+std::vector<Session::Status> Session::list() {
+    std::scoped_lock<std::mutex> lock {mutex};
+    std::vector<Status> result;
+    result.reserve(torrents.size());
+    for (auto& [id, torrent] : torrents) {
+        result.push_back(get_status(id, torrent, false));
+    }
+    return result;
+}
+
+Session::Status Session::get_status(Id id) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    return get_status(id, get_torrent(id), true);
+}
+
+Session::Status
+Session::get_status(Id id, Torrent& torrent, bool with_details) {
+    Status status {
+        id,
+        torrent.source,
+        torrent.directory,
+        !torrent.client,
+        torrent.stats
+    };
+    if (torrent.client) {
+        status.stats = torrent.client->get_stats();
+        if (!with_details) {
+            status.stats.pieces.clear();
+        }
+    }
+    return status;
+}
+
+void Session::stop() {
+    std::map<Id, Torrent> stopped;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        stopped = std::move(torrents);
+        torrents.clear();
+    }
+    for (auto& [id, torrent] : stopped) {
+        if (torrent.client) {
+            torrent.client->stop();
+        }
+    }
+    stopped.clear();
+
+    work.reset();
+    // Let the aborted operations call their handlers,
+    //      so the blocks that are being written reach the disk.
+    const auto deadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+    while (!io_context.stopped()
+           && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    io_context.stop();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+std::shared_ptr<Client> Session::start_client(const Torrent& torrent) {
+    // Port zero so the torrents don't fight over the default port.
+    auto client = std::make_shared<Client>(io_context, ssl_context, 0);
+    client->set_download_directory(torrent.directory);
+    client->set_bandwidth_limits(download_limit, upload_limit);
+    client->set_file_pool(file_pool);
+    for (const auto& [file_index, priority] : torrent.file_priorities) {
+        client->set_file_priority(file_index, priority);
+    }
+    if (!client->start(torrent.source)) {
+        // The client logs why it failed.
+        throw std::runtime_error("Could not start the torrent.");
+    }
+    return client;
+}
+
+void Session::run() {
+    while (true) {
+        try {
+            io_context.run();
+            return;
+        } catch (const std::exception& exception) {
+            // Which torrent threw can't be told, so all of them go on.
+            TORRENT_LOG(error)
+                << "Error while running the torrents: " << exception.what();
+        }
+    }
+}
+
+Session::Torrent& Session::get_torrent(Id id) {
+    const auto it = torrents.find(id);
+    if (it == torrents.end()) {
+        throw std::runtime_error("Unknown torrent id " + std::to_string(id));
+    }
+    return it->second;
+}
+
+} // namespace torrent
@@ -0,0 +1,774 @@
+#include "simulated_network.hpp"
+
+#include <algorithm>
+#include <boost/asio/error.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "log.hpp"
+#include "tracker.hpp"
+#include "tracker_manager.hpp"
+
+namespace torrent {
+
+namespace {
+
+using Duration = SimulatedNetwork::Duration;
+
+/*
+ * Returns when the bytes finish going through a link that
+ *      sends at the bandwidth, and reserves the link until then.
+ * */
+Duration serialize(
+    Duration& link_free,
+    Duration start,
+    std::size_t bytes,
+    std::size_t bandwidth
+) {
+    if (bandwidth == 0) {
+        return start;
+    }
+    const auto nanoseconds = bytes * 1'000'000'000ull / bandwidth;
+    link_free = std::max(link_free, start)
+        + Duration {static_cast<Duration::rep>(nanoseconds)};
+    return link_free;
+}
+
+} // namespace
+
+class SimulatedStream: public Stream {
+  public:
+    SimulatedStream(
+        std::shared_ptr<SimulatedNetwork> network_ptr,
+        std::shared_ptr<SimulatedNetwork::Socket> socket_ptr
+    ) :
+        network(std::move(network_ptr)),
+        socket(std::move(socket_ptr)) {}
+
+    ~SimulatedStream() {
+        close();
+    }
+
+    void async_connect(const tcp::endpoint& endpoint, ConnectHandler handler)
+        override {
+        network->connect(socket, endpoint, std::move(handler));
+    }
+
+    void async_read_some(asio::mutable_buffer buffer, IoHandler handler)
+        override {
+        network->read(socket, buffer, std::move(handler));
+    }
+
+    void async_write_some(asio::const_buffer buffer, IoHandler handler)
+        override {
+        network->write(socket, buffer, std::move(handler));
+    }
+
+    void close() override {
+        network->close(socket);
+    }
+
+    tcp::endpoint remote_endpoint() const override {
+        std::scoped_lock<std::mutex> lock {network->mutex};
+        return socket->remote;
+    }
+
+  private:
+    std::shared_ptr<SimulatedNetwork> network;
+    std::shared_ptr<SimulatedNetwork::Socket> socket;
+};
+
+class SimulatedAcceptor: public Acceptor {
+  public:
+    SimulatedAcceptor(
+        std::shared_ptr<SimulatedNetwork> network_ptr,
+        std::shared_ptr<SimulatedNetwork::Listener> listener_ptr
+    ) :
+        network(std::move(network_ptr)),
+        listener(std::move(listener_ptr)) {}
+
+    ~SimulatedAcceptor() {
+        close();
+    }
+
+    void async_accept(AcceptHandler handler) override {
+        network->accept(listener, std::move(handler));
+    }
+
+    void close() override {
+        network->close(listener);
+    }
+
+    std::uint16_t get_port() const override {
+        return listener->endpoint.port();
+    }
+
+  private:
+    std::shared_ptr<SimulatedNetwork> network;
+    std::shared_ptr<SimulatedNetwork::Listener> listener;
+};
+
+class SimulatedTimer: public Timer {
+  public:
+    explicit SimulatedTimer(std::shared_ptr<SimulatedNetwork> network_ptr) :
+        network(std::move(network_ptr)) {}
+
+    ~SimulatedTimer() {
+        cancel();
+    }
+
+    void expires_after(std::chrono::nanoseconds duration) override {
+        cancel();
+        std::scoped_lock<std::mutex> lock {network->mutex};
+        expiry = network->current_time + duration;
+    }
+
+    void async_wait(WaitHandler handler) override {
+        std::scoped_lock<std::mutex> lock {network->mutex};
+        if (network->stopped) {
+            return;
+        }
+        // The network holds the handlers, so stop() can drop them.
+        const auto id = network->next_wait_id++;
+        network->waits.emplace(id, std::move(handler));
+        wait_ids.push_back(id);
+        network->schedule(expiry, [network = network.get(), id] {
+            std::scoped_lock<std::mutex> event_lock {network->mutex};
+            network->complete_wait(id, {});
+        });
+    }
+
+    void cancel() override {
+        std::scoped_lock<std::mutex> lock {network->mutex};
+        for (const auto id : wait_ids) {
+            network->complete_wait(id, asio::error::operation_aborted);
+        }
+        wait_ids.clear();
+    }
+
+  private:
+    std::shared_ptr<SimulatedNetwork> network;
+    Duration expiry {0};
+    // Waits that might still be pending.
+    std::vector<std::uint64_t> wait_ids;
+};
+
+/*
+ * Announces to the tracker of the simulated network.
+ * */
+class SimulatedTracker: public Tracker {
+  private:
+    struct Private {
+        explicit Private() = default;
+    };
+
+  public:
+    SimulatedTracker(
+        Private,
+        std::weak_ptr<TrackerManager> tracker_manager_ptr,
+        std::shared_ptr<SimulatedNetwork> network_ptr,
+        SimulatedNetwork::Host& host_ref,
+        std::string announce_url
+    ) :
+        Tracker(std::move(tracker_manager_ptr)),
+        network(network_ptr),
+        host(host_ref),
+        timer(std::make_unique<SimulatedTimer>(std::move(network_ptr))) {
+        announce = std::move(announce_url);
+    }
+
+    static std::shared_ptr<Tracker> create(
+        std::weak_ptr<TrackerManager> tracker_manager,
+        std::shared_ptr<SimulatedNetwork> network,
+        SimulatedNetwork::Host& host,
+        std::string announce
+    ) {
+        return std::make_shared<SimulatedTracker>(
+            Private {},
+            std::move(tracker_manager),
+            std::move(network),
+            host,
+            std::move(announce)
+        );
+    }
+
+    void initiate_connection(boost::url) override {
+        // The tracker sits in the middle of the network.
+        announce_after(2 * Duration {host.link.latency});
+    }
+
+    void stop() override {
+        timer->cancel();
+    }
+
+  private:
+    void announce_after(Duration delay) {
+        timer->expires_after(delay);
+        // The tracker manager owns the tracker, so don't keep it alive.
+        timer->async_wait([weak = weak_from_this()](const auto& error) {
+            const auto self =
+                std::dynamic_pointer_cast<SimulatedTracker>(weak.lock());
+            if (error || !self) {
+                return;
+            }
+            self->on_announce();
+        });
+    }
+
+    void on_announce() {
+        const auto manager = tracker_manager.lock();
+        if (!manager) {
+            return;
+        }
+        const auto& metadata = manager->metadata;
+        const auto peers = network->announce(
+            metadata->get_info_hash(),
+            tcp::endpoint {host.address, manager->get_port()}
+        );
+        // Seeds don't need peers. They wait for the others to connect.
+        if (metadata->get_left() != 0) {
+            for (const auto& peer : peers) {
+                on_new_peer(peer);
+            }
+        }
+        announce_after(INTERVAL);
+    }
+
+  private:
+    std::shared_ptr<SimulatedNetwork> network;
+    SimulatedNetwork::Host& host;
+    std::unique_ptr<Timer> timer;
+
+    static constexpr Duration INTERVAL = std::chrono::seconds {30};
+};
+
+class SimulatedTransport: public Transport {
+  public:
+    SimulatedTransport(
+        std::shared_ptr<SimulatedNetwork> network_ptr,
+        SimulatedNetwork::Host& host_ref
+    ) :
+        network(std::move(network_ptr)),
+        host(host_ref) {}
+
+    std::unique_ptr<Stream> create_stream() override {
+        return std::make_unique<SimulatedStream>(
+            network,
+            network->open_socket(host)
+        );
+    }
+
+    std::unique_ptr<Acceptor> create_acceptor(std::uint16_t port) override {
+        return std::make_unique<SimulatedAcceptor>(
+            network,
+            network->listen(host, port)
+        );
+    }
+
+    std::unique_ptr<Timer> create_timer() override {
+        return std::make_unique<SimulatedTimer>(network);
+    }
+
+    std::shared_ptr<Tracker> create_tracker(
+        const std::shared_ptr<TrackerManager>& tracker_manager,
+        std::string announce
+    ) override {
+        auto tracker = SimulatedTracker::create(
+            tracker_manager,
+            network,
+            host,
+            std::move(announce)
+        );
+        tracker->initiate_connection({});
+        TORRENT_LOG(info) << "New simulated tracker: " << *tracker;
+        return tracker;
+    }
+
+  private:
+    std::shared_ptr<SimulatedNetwork> network;
+    SimulatedNetwork::Host& host;
+};
+
+std::shared_ptr<Transport> SimulatedNetwork::add_host(
+    const address_v4& host_address,
+    const SimulatedLink& link
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (hosts.contains(host_address.to_uint())) {
+        throw std::runtime_error(
+            "Simulated host " + host_address.to_string() + " already exists"
+        );
+    }
+    auto host = std::make_unique<Host>();
+    host->address = host_address;
+    host->link = link;
+    auto& host_ref = *host;
+    hosts.emplace(host_address.to_uint(), std::move(host));
+    return std::make_shared<SimulatedTransport>(shared_from_this(), host_ref);
+}
+
+bool SimulatedNetwork::run_until(
+    const std::function<bool()>& done,
+    Duration limit
+) {
+    const auto work_guard = asio::make_work_guard(io_context);
+    io_context.restart();
+    while (!done()) {
+        // Everything that is ready at the current time goes first.
+        if (io_context.poll() > 0) {
+            continue;
+        }
+        if (io_grace.count() > 0 && io_context.run_one_for(io_grace) > 0) {
+            continue;
+        }
+
+        Event event;
+        {
+            std::scoped_lock<std::mutex> lock {mutex};
+            if (events.empty()) {
+                return false;
+            }
+            if (events.front().time > limit) {
+                current_time = std::max(current_time, limit);
+                return false;
+            }
+            std::pop_heap(events.begin(), events.end(), std::greater<Event> {});
+            event = std::move(events.back());
+            events.pop_back();
+            current_time = event.time;
+        }
+        event.function();
+    }
+    return true;
+}
+
+void SimulatedNetwork::stop() {
+    std::vector<Event> dropped_events;
+    std::unordered_map<std::uint64_t, Timer::WaitHandler> dropped_waits;
+    {
+        std::scoped_lock<std::mutex> lock {mutex};
+        stopped = true;
+        dropped_events.swap(events);
+        dropped_waits.swap(waits);
+        swarms.clear();
+    }
+    // Destroyed without the lock, the handlers might own streams.
+}
+
+void SimulatedNetwork::schedule(Duration time, std::function<void()> function) {
+    events.push_back({time, next_sequence++, std::move(function)});
+    std::push_heap(events.begin(), events.end(), std::greater<Event> {});
+}
+
+Duration SimulatedNetwork::get_delay(
+    const Host& from,
+    const Host& to,
+    std::size_t bytes
+) {
+    const auto latency = Duration {from.link.latency + to.link.latency};
+    auto delay = latency;
+
+    const auto jitter = Duration {from.link.jitter + to.link.jitter};
+    if (jitter.count() > 0) {
+        delay += Duration {std::uniform_int_distribution<Duration::rep> {
+            0,
+            jitter.count()
+        }(random_engine)};
+    }
+
+    const auto loss = 1.0 - (1.0 - from.link.loss) * (1.0 - to.link.loss);
+    if (loss > 0.0) {
+        // The packet is late if any of its MTU sized parts is lost.
+        const auto parts = std::max<std::size_t>(1, (bytes + MTU - 1) / MTU);
+        const auto late =
+            1.0 - std::pow(1.0 - loss, static_cast<double>(parts));
+        if (std::bernoulli_distribution {late}(random_engine)) {
+            delay += std::max(MIN_RETRANSMISSION_TIMEOUT, 4 * latency);
+        }
+    }
+    return delay;
+}
+
+std::shared_ptr<SimulatedNetwork::Socket>
+SimulatedNetwork::open_socket(Host& host) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    auto socket = std::make_shared<Socket>();
+    socket->host = &host;
+    socket->local = tcp::endpoint {host.address, host.next_port++};
+    return socket;
+}
+
+std::shared_ptr<SimulatedNetwork::Listener>
+SimulatedNetwork::listen(Host& host, std::uint16_t port) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (port == 0) {
+        // Pick a free port.
+        port = host.next_port++;
+        while (listeners.contains(tcp::endpoint {host.address, port})) {
+            port = host.next_port++;
+        }
+    }
+    const auto endpoint = tcp::endpoint {host.address, port};
+    if (listeners.contains(endpoint)) {
+        throw boost::system::system_error(asio::error::address_in_use);
+    }
+    auto listener = std::make_shared<Listener>();
+    listener->endpoint = endpoint;
+    listeners.emplace(endpoint, listener);
+    return listener;
+}
+
+void SimulatedNetwork::connect(
+    const std::shared_ptr<Socket>& socket,
+    const tcp::endpoint& endpoint,
+    Stream::ConnectHandler handler
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (stopped) {
+        return;
+    }
+    if (socket->closed || socket->connect_handler) {
+        asio::post(io_context, [handler = std::move(handler)] {
+            handler(asio::error::bad_descriptor);
+        });
+        return;
+    }
+    socket->remote = endpoint;
+    socket->connect_handler = std::move(handler);
+
+    const auto to = endpoint.address().is_v4()
+        ? hosts.find(endpoint.address().to_v4().to_uint())
+        : hosts.end();
+    if (to == hosts.end()) {
+        complete_connect(*socket, asio::error::host_unreachable);
+        return;
+    }
+    auto& from = *socket->host;
+    auto& remote_host = *to->second;
+
+    // The remote answers the connection once it gets there.
+    schedule(
+        current_time + get_delay(from, remote_host, 0),
+        [this, weak = std::weak_ptr {socket}, endpoint, &from, &remote_host] {
+            std::scoped_lock<std::mutex> event_lock {mutex};
+            const auto client = weak.lock();
+            if (!client || client->closed) {
+                return;
+            }
+            const auto answer = current_time + get_delay(remote_host, from, 0);
+            const auto listener = listeners.find(endpoint);
+            if (listener == listeners.end() || listener->second->closed) {
+                schedule(answer, [this, weak] {
+                    std::scoped_lock<std::mutex> answer_lock {mutex};
+                    if (const auto refused = weak.lock()) {
+                        complete_connect(
+                            *refused,
+                            asio::error::connection_refused
+                        );
+                    }
+                });
+                return;
+            }
+
+            auto server = std::make_shared<Socket>();
+            server->host = &remote_host;
+            server->local = endpoint;
+            server->remote = client->local;
+            server->peer = client;
+            server->last_arrival = current_time;
+            client->peer = server;
+            client->last_arrival = answer;
+            listener->second->backlog.push_back(std::move(server));
+            complete_accept(*listener->second);
+
+            schedule(answer, [this, weak] {
+                std::scoped_lock<std::mutex> answer_lock {mutex};
+                if (const auto connected = weak.lock()) {
+                    complete_connect(*connected, {});
+                }
+            });
+        }
+    );
+}
+
+void SimulatedNetwork::read(
+    const std::shared_ptr<Socket>& socket,
+    asio::mutable_buffer buffer,
+    Stream::IoHandler handler
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (stopped) {
+        return;
+    }
+    if (socket->closed || socket->read_handler) {
+        asio::post(io_context, [handler = std::move(handler)] {
+            handler(asio::error::bad_descriptor, 0);
+        });
+        return;
+    }
+    socket->read_buffer = buffer;
+    socket->read_handler = std::move(handler);
+    complete_read(*socket);
+}
+
+void SimulatedNetwork::write(
+    const std::shared_ptr<Socket>& socket,
+    asio::const_buffer buffer,
+    Stream::IoHandler handler
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (stopped) {
+        return;
+    }
+    const auto peer = socket->peer.lock();
+    if (socket->closed || !peer || peer->closed) {
+        asio::post(io_context, [handler = std::move(handler)] {
+            handler(asio::error::broken_pipe, 0);
+        });
+        return;
+    }
+    const auto length = std::min(buffer.size(), MAX_PACKET_LENGTH);
+    auto& from = *socket->host;
+    auto& to = *peer->host;
+
+    // The write completes once the packet left the sender,
+    //      so the sender can't queue more than the link carries.
+    const auto sent = serialize(
+        from.upload_free,
+        current_time,
+        length,
+        from.link.bandwidth
+    );
+    auto arrival = serialize(
+        to.download_free,
+        sent + get_delay(from, to, length),
+        length,
+        to.link.bandwidth
+    );
+    arrival = std::max(arrival, peer->last_arrival);
+    peer->last_arrival = arrival;
+
+    schedule(sent, [this, weak = std::weak_ptr {socket}, handler, length] {
+        std::scoped_lock<std::mutex> event_lock {mutex};
+        const auto sender = weak.lock();
+        if (!sender || sender->closed) {
+            asio::post(io_context, [handler] {
+                handler(asio::error::operation_aborted, 0);
+            });
+            return;
+        }
+        asio::post(io_context, [handler, length] {
+            handler(boost::system::error_code {}, length);
+        });
+    });
+    schedule(
+        arrival,
+        [this,
+         weak = std::weak_ptr {peer},
+         data = std::string {static_cast<const char*>(buffer.data()), length}] {
+            std::scoped_lock<std::mutex> event_lock {mutex};
+            const auto receiver = weak.lock();
+            if (!receiver || receiver->closed) {
+                return;
+            }
+            delivered_bytes += data.size();
+            receiver->inbound.append(data);
+            complete_read(*receiver);
+        }
+    );
+}
+
+void SimulatedNetwork::close(const std::shared_ptr<Socket>& socket) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    close_socket(socket);
+}
+
+void SimulatedNetwork::close_socket(const std::shared_ptr<Socket>& socket) {
+    if (socket->closed) {
+        return;
+    }
+    socket->closed = true;
+    if (stopped) {
+        // Only the peer of the socket can own its handlers,
+        //      so dropping them doesn't destroy any other socket.
+        socket->connect_handler = nullptr;
+        socket->read_handler = nullptr;
+        return;
+    }
+    complete_connect(*socket, asio::error::operation_aborted);
+    if (socket->read_handler) {
+        asio::post(io_context, [handler = std::move(socket->read_handler)] {
+            handler(asio::error::operation_aborted, 0);
+        });
+        socket->read_handler = nullptr;
+    }
+
+    const auto peer = socket->peer.lock();
+    if (!peer) {
+        return;
+    }
+    // The remote reads the end of the stream after the data sent before.
+    const auto fin = std::max(
+        current_time + get_delay(*socket->host, *peer->host, 0),
+        peer->last_arrival
+    );
+    peer->last_arrival = fin;
+    schedule(fin, [this, weak = std::weak_ptr {peer}] {
+        std::scoped_lock<std::mutex> event_lock {mutex};
+        const auto receiver = weak.lock();
+        if (!receiver || receiver->closed) {
+            return;
+        }
+        receiver->eof = true;
+        complete_read(*receiver);
+    });
+}
+
+void SimulatedNetwork::accept(
+    const std::shared_ptr<Listener>& listener,
+    Acceptor::AcceptHandler handler
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (stopped) {
+        return;
+    }
+    if (listener->closed || listener->accept_handler) {
+        asio::post(io_context, [handler = std::move(handler)] {
+            handler(asio::error::operation_aborted, nullptr);
+        });
+        return;
+    }
+    listener->accept_handler = std::move(handler);
+    complete_accept(*listener);
+}
+
+void SimulatedNetwork::close(const std::shared_ptr<Listener>& listener) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    if (listener->closed) {
+        return;
+    }
+    listener->closed = true;
+    const auto listener_it = listeners.find(listener->endpoint);
+    if (listener_it != listeners.end() && listener_it->second == listener) {
+        listeners.erase(listener_it);
+    }
+    if (stopped) {
+        listener->accept_handler = nullptr;
+    } else if (listener->accept_handler) {
+        asio::post(
+            io_context,
+            [handler = std::move(listener->accept_handler)] {
+                handler(asio::error::operation_aborted, nullptr);
+            }
+        );
+        listener->accept_handler = nullptr;
+    }
+    for (const auto& socket : listener->backlog) {
+        close_socket(socket);
+    }
+    listener->backlog.clear();
+}
+
+void SimulatedNetwork::complete_read(Socket& socket) {
+    if (!socket.read_handler) {
+        return;
+    }
+    const auto available = socket.inbound.size() - socket.inbound_offset;
+    if (available == 0 && !socket.eof && socket.read_buffer.size() != 0) {
+        return; // Wait for data.
+    }
+    const auto length = std::min(available, socket.read_buffer.size());
+    std::memcpy(
+        socket.read_buffer.data(),
+        socket.inbound.data() + socket.inbound_offset,
+        length
+    );
+    socket.inbound_offset += length;
+    if (socket.inbound_offset == socket.inbound.size()) {
+        socket.inbound.clear();
+        socket.inbound_offset = 0;
+    }
+
+    boost::system::error_code error;
+    if (length == 0 && socket.read_buffer.size() != 0) {
+        error = asio::error::eof;
+    }
+    asio::post(
+        io_context,
+        [handler = std::move(socket.read_handler), error, length] {
+            handler(error, length);
+        }
+    );
+    socket.read_handler = nullptr;
+}
+
+void SimulatedNetwork::complete_connect(
+    Socket& socket,
+    boost::system::error_code error
+) {
+    if (!socket.connect_handler) {
+        return;
+    }
+    asio::post(
+        io_context,
+        [handler = std::move(socket.connect_handler), error] { handler(error); }
+    );
+    socket.connect_handler = nullptr;
+}
+
+void SimulatedNetwork::complete_wait(
+    std::uint64_t id,
+    boost::system::error_code error
+) {
+    const auto wait = waits.find(id);
+    if (wait == waits.end()) {
+        return; // Expired or cancelled already.
+    }
+    asio::post(io_context, [handler = std::move(wait->second), error] {
+        handler(error);
+    });
+    waits.erase(wait);
+}
+
+void SimulatedNetwork::complete_accept(Listener& listener) {
+    if (!listener.accept_handler || listener.backlog.empty()) {
+        return;
+    }
+    auto stream = std::make_unique<SimulatedStream>(
+        shared_from_this(),
+        std::move(listener.backlog.front())
+    );
+    listener.backlog.erase(listener.backlog.begin());
+    asio::post(
+        io_context,
+        [handler = std::move(listener.accept_handler),
+         stream = std::move(stream)]() mutable {
+            handler(boost::system::error_code {}, std::move(stream));
+        }
+    );
+    listener.accept_handler = nullptr;
+}
+
+std::vector<tcp::endpoint> SimulatedNetwork::announce(
+    const std::string& info_hash,
+    const tcp::endpoint& endpoint
+) {
+    std::scoped_lock<std::mutex> lock {mutex};
+    auto& swarm = swarms[info_hash];
+    std::vector<tcp::endpoint> others;
+    others.reserve(swarm.size());
+    for (const auto& member : swarm) {
+        if (member != endpoint) {
+            others.push_back(member);
+        }
+    }
+    if (others.size() == swarm.size()) {
+        swarm.push_back(endpoint);
+    }
+    return others;
+}
+
+} // namespace torrent
@@ -0,0 +1,298 @@
+#include "torrent_creator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+
+#include "bencode_writer.hpp"
+#include "log.hpp"
+
+namespace torrent {
+
+namespace {
+
+using Element = BencodeParser::Element;
+
+Element make_integer(std::size_t value) {
+    return Element {
+        Element::Type {static_cast<BencodeParser::Integer>(value)}
+    };
+}
+
+Element make_string(std::string value) {
+    return Element {Element::Type {std::move(value)}};
+}
+
+/*
+ * Reads byte ranges of the files as if they were a single file.
+ * Keeps the last file open, so reading consecutive ranges
+ *      doesn't open a file for every range.
+ * */
+class FileReader {
+  public:
+    FileReader(
+        std::span<const std::filesystem::path> file_paths,
+        std::span<const std::size_t> file_offsets,
+        std::size_t total_length_value
+    ) :
+        paths(file_paths),
+        offsets(file_offsets),
+        total_length(total_length_value) {}
+
+    void read(std::size_t offset, std::span<char> buffer) {
+        // Last file starting before the offset. Empty files are skipped.
+        auto index = static_cast<std::size_t>(
+            std::upper_bound(offsets.begin(), offsets.end(), offset)
+            - offsets.begin() - 1
+        );
+        while (!buffer.empty()) {
+            const auto file_end =
+                index + 1 < offsets.size() ? offsets[index + 1] : total_length;
+            const auto length = std::min(buffer.size(), file_end - offset);
+            if (length == 0) {
+                index += 1;
+                continue;
+            }
+            open(index);
+            file.seekg(static_cast<std::streamoff>(offset - offsets[index]));
+            file.read(buffer.data(), static_cast<std::streamsize>(length));
+            if (static_cast<std::size_t>(file.gcount()) != length) {
+                throw std::runtime_error(
+                    "Could not read " + paths[index].string()
+                    + ". Did it change while hashing?"
+                );
+            }
+            buffer = buffer.subspan(length);
+            offset += length;
+            index += 1;
+        }
+    }
+
+  private:
+    void open(std::size_t index) {
+        if (open_index == index && file.is_open()) {
+            return;
+        }
+        file.close();
+        file.clear();
+        file.open(paths[index], std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open " + paths[index].string());
+        }
+        open_index = index;
+    }
+
+  private:
+    std::span<const std::filesystem::path> paths;
+    std::span<const std::size_t> offsets;
+    const std::size_t total_length;
+
+    std::ifstream file;
+    std::size_t open_index = 0;
+};
+
+} // namespace
+
+TorrentCreator::TorrentCreator(std::filesystem::path root_path) :
+    root(std::filesystem::absolute(root_path).lexically_normal()) {
+    if (!root.has_filename()) {
+        root = root.parent_path(); // Ended with a separator.
+    }
+    if (std::filesystem::is_regular_file(root)) {
+        files.emplace_back(std::filesystem::file_size(root), root.filename());
+    } else if (std::filesystem::is_directory(root)) {
+        for (const auto& entry :
+             std::filesystem::recursive_directory_iterator {root}) {
+            if (entry.is_regular_file()) {
+                files.emplace_back(
+                    entry.file_size(),
+                    entry.path().lexically_relative(root)
+                );
+            }
+        }
+        std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+            return a.second < b.second;
+        });
+    }
+    for (const auto& [length, path] : files) {
+        total_length += length;
+    }
+    if (total_length == 0) {
+        throw std::runtime_error(
+            "There is nothing to share in " + root.string() + "."
+        );
+    }
+}
+
+std::size_t TorrentCreator::choose_piece_length(std::size_t total_length) {
+    auto length = MIN_PIECE_LENGTH;
+    while (length < MAX_PIECE_LENGTH
+           && total_length / length > TARGET_PIECE_COUNT) {
+        length *= 2;
+    }
+    return length;
+}
+
+std::string TorrentCreator::create() {
+    const auto length = get_piece_length();
+    if (length < MIN_PIECE_LENGTH || (length & (length - 1)) != 0) {
+        throw std::runtime_error(
+            "The piece length should be a power of two and at least 16 KiB."
+        );
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto pieces = hash_pieces(length);
+    const auto elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    );
+    const auto throughput = static_cast<double>(total_length) / (1 << 20)
+        / std::max(elapsed.count(), 1e-9);
+    TORRENT_LOG(info)
+        << "Hashed " << files.size() << " files of " << total_length
+        << " bytes in " << elapsed.count() << " seconds (" << throughput
+        << " MiB/s).";
+
+    BencodeParser::Dictionary info;
+    info["name"] = make_string(root.filename().string());
+    info["piece length"] = make_integer(length);
+    info["pieces"] = make_string(std::move(pieces));
+    if (private_torrent) {
+        info["private"] = make_integer(1);
+    }
+    if (std::filesystem::is_regular_file(root)) {
+        info["length"] = make_integer(total_length);
+    } else {
+        BencodeParser::List file_list;
+        file_list.reserve(files.size());
+        for (const auto& [file_length, relative_path] : files) {
+            BencodeParser::List path;
+            for (const auto& component : relative_path) {
+                path.push_back(make_string(component.string()));
+            }
+            BencodeParser::Dictionary file;
+            file["length"] = make_integer(file_length);
+            file["path"] = Element {Element::Type {std::move(path)}};
+            file_list.push_back(Element {Element::Type {std::move(file)}});
+        }
+        info["files"] = Element {Element::Type {std::move(file_list)}};
+    }
+
+    BencodeParser::Dictionary torrent;
+    if (!trackers.empty()) {
+        torrent["announce"] = make_string(trackers.front());
+    }
+    if (trackers.size() > 1) {
+        // Every tracker in its own tier. See BEP12.
+        BencodeParser::List tiers;
+        for (const auto& tracker : trackers) {
+            BencodeParser::List tier;
+            tier.push_back(make_string(tracker));
+            tiers.push_back(Element {Element::Type {std::move(tier)}});
+        }
+        torrent["announce-list"] = Element {Element::Type {std::move(tiers)}};
+    }
+    if (!web_seeds.empty()) {
+        BencodeParser::List urls;
+        for (const auto& url : web_seeds) {
+            urls.push_back(make_string(url));
+        }
+        torrent["url-list"] = Element {Element::Type {std::move(urls)}};
+    }
+    if (!comment.empty()) {
+        torrent["comment"] = make_string(comment);
+    }
+    torrent["created by"] = make_string("torrent");
+    torrent["creation date"] =
+        make_integer(static_cast<std::size_t>(std::time(nullptr)));
+    torrent["info"] = Element {Element::Type {std::move(info)}};
+    return BencodeWriter::encode(Element {Element::Type {std::move(torrent)}}
+    );
+}
+
+std::string TorrentCreator::hash_pieces(std::size_t length) {
+    std::vector<std::filesystem::path> paths;
+    std::vector<std::size_t> offsets;
+    paths.reserve(files.size());
+    offsets.reserve(files.size());
+    std::size_t offset = 0;
+    for (const auto& [file_length, relative_path] : files) {
+        paths.push_back(
+            std::filesystem::is_regular_file(root) ? root : root / relative_path
+        );
+        offsets.push_back(offset);
+        offset += file_length;
+    }
+
+    const auto piece_count = (total_length + length - 1) / length;
+    const auto pieces_per_run = std::max<std::size_t>(1, READ_LENGTH / length);
+    const auto run_count = (piece_count + pieces_per_run - 1) / pieces_per_run;
+    std::string hashes(piece_count * SHA_DIGEST_LENGTH, '\0');
+
+    std::atomic<std::size_t> next_run = 0;
+    std::atomic<std::size_t> hashed = 0;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    const auto hash_runs = [&]() {
+        FileReader reader {paths, offsets, total_length};
+        std::string buffer;
+        try {
+            // Runs are taken in order, so the threads read close
+            //      to each other and the disk mostly moves forward.
+            for (auto run = next_run++; run < run_count; run = next_run++) {
+                const auto first_piece = run * pieces_per_run;
+                const auto run_offset = first_piece * length;
+                const auto run_length = std::min(
+                    pieces_per_run * length,
+                    total_length - run_offset
+                );
+                buffer.resize(run_length);
+                reader.read(run_offset, buffer);
+
+                for (std::size_t i = 0; i * length < run_length; ++i) {
+                    const auto hash = sha1(
+                        std::string_view {buffer}.substr(i * length, length)
+                    );
+                    std::memcpy(
+                        hashes.data() + (first_piece + i) * SHA_DIGEST_LENGTH,
+                        hash.data(),
+                        hash.size()
+                    );
+                }
+                const auto total = hashed += run_length;
+                if (on_progress) {
+                    on_progress(total, total_length);
+                }
+            }
+        } catch (const std::exception&) {
+            std::scoped_lock<std::mutex> lock {error_mutex};
+            if (!error) {
+                error = std::current_exception();
+            }
+            next_run = run_count; // Stop the other threads.
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const auto count = std::clamp<std::size_t>(thread_count, 1, run_count);
+    for (std::size_t i = 0; i < count; ++i) {
+        threads.emplace_back(hash_runs);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return hashes;
+}
+
+} // namespace torrent
@@ -0,0 +1,209 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "log.hpp"
+
+namespace torrent::trace {
+
+namespace {
+
+struct Event {
+    const char* name;
+    Clock::time_point start;
+    Clock::time_point end;
+    std::int64_t arg;
+    bool async;
+};
+
+/*
+ * Latest events of a thread. Kept after the thread exits so its
+ *      events are still written.
+ * Only the owning thread writes, the mutex is contended only while dumping.
+ * */
+struct Buffer {
+    explicit Buffer(std::uint32_t thread_id) :
+        events(CAPACITY),
+        tid(thread_id) {}
+
+    static constexpr std::size_t CAPACITY = 1 << 14;
+
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::size_t next = 0; // Total number of events recorded.
+    const std::uint32_t tid;
+};
+
+class Tracer {
+  public:
+    static Tracer& get() {
+        // Never destroyed so the events can be written at exit.
+        static Tracer* tracer = new Tracer;
+        return *tracer;
+    }
+
+    Buffer& get_buffer() {
+        thread_local std::shared_ptr<Buffer> buffer;
+        if (!buffer) {
+            std::scoped_lock<std::mutex> lock {mutex};
+            buffer = std::make_shared<Buffer>(
+                static_cast<std::uint32_t>(buffers.size() + 1)
+            );
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    void start(std::string new_path) {
+        std::scoped_lock<std::mutex> lock {mutex};
+        path = std::move(new_path);
+        if (!exit_registered) {
+            exit_registered = true;
+            std::atexit([] { trace::dump(); });
+        }
+        detail::enabled.store(true, std::memory_order_relaxed);
+    }
+
+    std::string get_path() {
+        std::scoped_lock<std::mutex> lock {mutex};
+        return path;
+    }
+
+    void dump(std::ostream& os) {
+        std::vector<std::shared_ptr<Buffer>> snapshot;
+        {
+            std::scoped_lock<std::mutex> lock {mutex};
+            snapshot = buffers;
+        }
+        os << std::fixed << std::setprecision(3);
+        os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        std::uint64_t async_id = 0;
+        std::vector<Event> events;
+        for (const auto& buffer : snapshot) {
+            {
+                // Copy so the thread is not blocked while formatting.
+                std::scoped_lock<std::mutex> lock {buffer->mutex};
+                const auto count = std::min(buffer->next, Buffer::CAPACITY);
+                events.clear();
+                for (auto i = buffer->next - count; i < buffer->next; ++i) {
+                    events.push_back(buffer->events[i % Buffer::CAPACITY]);
+                }
+            }
+            for (const auto& event : events) {
+                os << (first ? "\n" : ",\n");
+                first = false;
+                if (!event.async) {
+                    write_event(os, event, buffer->tid, 'X', event.start);
+                    os << ",\"dur\":"
+                       << to_microseconds(event.end - event.start) << '}';
+                    continue;
+                }
+                // Async spans are a begin and an end event with the same id.
+                async_id += 1;
+                write_event(os, event, buffer->tid, 'b', event.start);
+                os << ",\"cat\":\"async\",\"id\":" << async_id << "},\n";
+                write_event(os, event, buffer->tid, 'e', event.end);
+                os << ",\"cat\":\"async\",\"id\":" << async_id << '}';
+            }
+        }
+        os << "\n]}\n";
+    }
+
+  private:
+    Tracer() = default;
+
+    /*
+     * Writes the fields every event has, without the closing brace.
+     * */
+    void write_event(
+        std::ostream& os,
+        const Event& event,
+        std::uint32_t tid,
+        char phase,
+        Clock::time_point time
+    ) const {
+        os << "{\"name\":\"" << event.name << "\",\"ph\":\"" << phase
+           << "\",\"pid\":1,\"tid\":" << tid
+           << ",\"ts\":" << to_microseconds(time - epoch);
+        if (event.arg != NO_ARG) {
+            os << ",\"args\":{\"value\":" << event.arg << '}';
+        }
+    }
+
+    static double to_microseconds(Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+  private:
+    const Clock::time_point epoch = Clock::now();
+
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    std::string path;
+    bool exit_registered = false;
+};
+
+void push(const Event& event) {
+    auto& buffer = Tracer::get().get_buffer();
+    std::scoped_lock<std::mutex> lock {buffer.mutex};
+    buffer.events[buffer.next % Buffer::CAPACITY] = event;
+    buffer.next += 1;
+}
+
+} // namespace
+
+void start(std::string path) {
+    Tracer::get().start(std::move(path));
+}
+
+void stop() {
+    detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+bool dump() {
+    const auto path = Tracer::get().get_path();
+    if (path.empty()) {
+        return false;
+    }
+    std::ofstream file {path, std::ios::trunc};
+    if (!file) {
+        TORRENT_LOG(error) << "Could not open the trace file " << path;
+        return false;
+    }
+    Tracer::get().dump(file);
+    if (!file) {
+        TORRENT_LOG(error) << "Could not write the trace file " << path;
+        return false;
+    }
+    TORRENT_LOG(info) << "Wrote the trace to " << path;
+    return true;
+}
+
+void dump(std::ostream& os) {
+    Tracer::get().dump(os);
+}
+
+void record(
+    const char* name,
+    Clock::time_point start,
+    Clock::time_point end,
+    std::int64_t arg
+) {
+    push({name, start, end, arg, false});
+}
+
+void record_async(const char* name, Clock::time_point start, std::int64_t arg) {
+    if (start == Clock::time_point {}) {
+        return;
+    }
+    push({name, start, Clock::now(), arg, true});
+}
+
+} // namespace torrent::trace
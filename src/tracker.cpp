@@ -3,61 +3,67 @@
 #include <boost/asio/ssl/stream.hpp>
 #include <boost/url/scheme.hpp>
 #include <boost/url/urls.hpp>
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
 
 #include "http_tracker.hpp"
+#include "trace.hpp"
 #include "tracker_manager.hpp"
 #include "udp_tracker.hpp"
 
 namespace torrent {
 
-std::shared_ptr<Tracker>
-Tracker::create_tracker(TrackerManager& tracker_manager, std::string announce) {
+std::shared_ptr<Tracker> Tracker::create_tracker(
+    const std::shared_ptr<TrackerManager>& tracker_manager,
+    std::string announce
+) {
     std::shared_ptr<Tracker> tracker;
     if (announce.starts_with("udp")) {
         // Udp tracker
         tracker =
-            UdpTracker::create(tracker_manager, tracker_manager.io_context);
+            UdpTracker::create(tracker_manager, tracker_manager->io_context);
         tracker->initiate_connection(boost::url {announce});
         tracker->announce = std::move(announce);
 
-        BOOST_LOG_TRIVIAL(info) << "New udp tracker: " << *tracker;
+        TORRENT_LOG(info) << "New udp tracker: " << *tracker;
         return tracker;
     }
     // Http/Https tracker
     auto url = boost::url(announce);
     auto params = url.encoded_params();
 
-    params.append({"info_hash", tracker_manager.metadata->get_info_hash()});
-    params.append({"peer_id", tracker_manager.get_peer_id()});
-    params.append({"port", std::to_string(tracker_manager.get_port())});
+    params.append({"info_hash", tracker_manager->metadata->get_info_hash()});
+    params.append({"peer_id", tracker_manager->get_peer_id()});
+    params.append({"port", std::to_string(tracker_manager->get_port())});
     params.append(
-        {"uploaded", std::to_string(tracker_manager.metadata->get_uploaded())}
+        {"uploaded", std::to_string(tracker_manager->metadata->get_uploaded())}
     );
     params.append(
         {"downloaded",
-         std::to_string(tracker_manager.metadata->get_downloaded())}
+         std::to_string(tracker_manager->metadata->get_downloaded())}
     );
     params.append({"compact", "1"});
-    params.append({"left", std::to_string(tracker_manager.metadata->get_left())}
+    params.append(
+        {"left", std::to_string(tracker_manager->metadata->get_left())}
     );
 
     switch (url.scheme_id()) {
         case boost::urls::scheme::http:
             tracker = HttpTracker::create(
                 tracker_manager,
-                tracker_manager.io_context,
-                tcp::socket {tracker_manager.io_context}
+                tracker_manager->io_context,
+                tcp::socket {tracker_manager->io_context}
             );
             break;
         case boost::urls::scheme::https:
             tracker = HttpsTracker::create(
                 tracker_manager,
-                tracker_manager.io_context,
+                tracker_manager->io_context,
                 asio::ssl::stream<tcp::socket> {
-                    tracker_manager.io_context,
-                    tracker_manager.ssl_context
+                    tracker_manager->io_context,
+                    tracker_manager->ssl_context
                 }
             );
             break;
@@ -66,16 +72,47 @@ Tracker::create_tracker(TrackerManager& tracker_manager, std::string announce) {
     }
     tracker->announce = std::move(announce);
     tracker->initiate_connection(std::move(url));
-    BOOST_LOG_TRIVIAL(info) << "New http tracker: " << *tracker;
+    TORRENT_LOG(info) << "New http tracker: " << *tracker;
     return tracker;
 }
 
+std::vector<tcp::endpoint>
+Tracker::parse_compact_peers(std::string_view peers) {
+    std::vector<tcp::endpoint> endpoints;
+    endpoints.reserve(peers.size() / 6);
+    for (std::size_t i = 0; i + 6 <= peers.size(); i += 6) {
+        const auto byte = [&peers, i](std::size_t offset) {
+            // Bytes are unsigned so ports over 32767 are not sign extended.
+            return static_cast<std::uint8_t>(peers[i + offset]);
+        };
+        const address_v4::bytes_type ip {byte(0), byte(1), byte(2), byte(3)};
+        const auto port = static_cast<std::uint16_t>(byte(4) << 8 | byte(5));
+        endpoints.emplace_back(address_v4 {ip}, port);
+    }
+    return endpoints;
+}
+
 void Tracker::on_disconnect() {
-    tracker_manager.remove(announce);
+    if (const auto manager = tracker_manager.lock()) {
+        manager->remove(announce);
+    }
 }
 
 void Tracker::on_new_peer(tcp::endpoint endpoint) {
-    tracker_manager.on_new_peer(std::move(endpoint));
+    if (const auto manager = tracker_manager.lock()) {
+        manager->on_new_peer(std::move(endpoint));
+    }
+}
+
+void Tracker::on_round_trip(std::chrono::steady_clock::time_point sent) {
+    if (trace::is_enabled()) {
+        trace::record_async("tracker_round_trip", sent);
+    }
+    if (const auto manager = tracker_manager.lock()) {
+        manager->metrics->tracker_seconds.observe(
+            std::chrono::steady_clock::now() - sent
+        );
+    }
 }
 
 } // namespace torrent
@@ -0,0 +1,138 @@
+#include "transport.hpp"
+
+#include <boost/asio/steady_timer.hpp>
+#include <memory>
+
+#include "tracker.hpp"
+
+namespace torrent {
+
+namespace {
+
+class TcpStream: public Stream {
+  public:
+    TcpStream(tcp::socket stream_socket, tcp::endpoint remote) :
+        socket(std::move(stream_socket)),
+        endpoint(std::move(remote)) {}
+
+    ~TcpStream() {
+        close();
+    }
+
+    void async_connect(const tcp::endpoint& remote, ConnectHandler handler)
+        override {
+        endpoint = remote;
+        socket.async_connect(endpoint, std::move(handler));
+    }
+
+    void async_read_some(asio::mutable_buffer buffer, IoHandler handler)
+        override {
+        socket.async_read_some(buffer, std::move(handler));
+    }
+
+    void async_write_some(asio::const_buffer buffer, IoHandler handler)
+        override {
+        socket.async_write_some(buffer, std::move(handler));
+    }
+
+    void close() override {
+        boost::system::error_code error;
+        socket.close(error);
+    }
+
+    tcp::endpoint remote_endpoint() const override {
+        return endpoint;
+    }
+
+  private:
+    tcp::socket socket;
+    tcp::endpoint endpoint;
+};
+
+class TcpAcceptor: public Acceptor {
+  public:
+    TcpAcceptor(asio::io_context& io_context, std::uint16_t port) :
+        acceptor(io_context, tcp::endpoint(tcp::v4(), port)) {}
+
+    void async_accept(AcceptHandler handler) override {
+        acceptor.async_accept([handler = std::move(handler)](
+                                  const auto& error,
+                                  tcp::socket socket
+                              ) {
+            if (error) {
+                return handler(error, nullptr);
+            }
+            // The peer might be gone already.
+            boost::system::error_code endpoint_error;
+            auto remote = socket.remote_endpoint(endpoint_error);
+            if (endpoint_error) {
+                return handler(endpoint_error, nullptr);
+            }
+            handler(
+                error,
+                std::make_unique<TcpStream>(
+                    std::move(socket),
+                    std::move(remote)
+                )
+            );
+        });
+    }
+
+    void close() override {
+        boost::system::error_code error;
+        acceptor.close(error);
+    }
+
+    std::uint16_t get_port() const override {
+        return acceptor.local_endpoint().port();
+    }
+
+  private:
+    tcp::acceptor acceptor;
+};
+
+class SteadyTimer: public Timer {
+  public:
+    explicit SteadyTimer(asio::io_context& io_context) : timer(io_context) {}
+
+    void expires_after(std::chrono::nanoseconds duration) override {
+        timer.expires_after(duration);
+    }
+
+    void async_wait(WaitHandler handler) override {
+        timer.async_wait(std::move(handler));
+    }
+
+    void cancel() override {
+        timer.cancel();
+    }
+
+  private:
+    asio::steady_timer timer;
+};
+
+} // namespace
+
+std::unique_ptr<Stream> TcpTransport::create_stream() {
+    return std::make_unique<TcpStream>(
+        tcp::socket {io_context},
+        tcp::endpoint {}
+    );
+}
+
+std::unique_ptr<Acceptor> TcpTransport::create_acceptor(std::uint16_t port) {
+    return std::make_unique<TcpAcceptor>(io_context, port);
+}
+
+std::unique_ptr<Timer> TcpTransport::create_timer() {
+    return std::make_unique<SteadyTimer>(io_context);
+}
+
+std::shared_ptr<Tracker> TcpTransport::create_tracker(
+    const std::shared_ptr<TrackerManager>& tracker_manager,
+    std::string announce
+) {
+    return Tracker::create_tracker(tracker_manager, std::move(announce));
+}
+
+} // namespace torrent
@@ -2,8 +2,6 @@
 
 #include <boost/asio/detail/chrono.hpp>
 #include <boost/endian/conversion.hpp>
-#include <boost/log/sources/record_ostream.hpp>
-#include <boost/log/trivial.hpp>
 #include <chrono>
 #include <cstdint>
 #include <limits>
@@ -11,7 +9,9 @@
 #include <mutex>
 #include <optional>
 #include <random>
+#include <string_view>
 
+#include "log.hpp"
 #include "tracker_manager.hpp"
 
 namespace torrent {
@@ -247,7 +247,7 @@ void UdpTracker::change_state(State new_state) {
                     ); // Set the timer for 1 minute.
                     self->connection_id_timer.async_wait([self](auto error) {
                         if (error) {
-                            BOOST_LOG_TRIVIAL(error)
+                            TORRENT_LOG(error)
                                 << "Error in async_wait: " << error.message();
                             return;
                         }
@@ -263,20 +263,25 @@ void UdpTracker::change_state(State new_state) {
                 // Timer is not yet expired. So don't announce again.
                 break;
             }
+            const auto manager = tracker_manager.lock();
+            if (!manager) {
+                break; // The client is gone.
+            }
             // We acquired the connection_id, now its time to announce.
             send_request(
-                Packet::create_announce_request(tracker_manager, connection_id),
+                Packet::create_announce_request(*manager, connection_id),
                 [self = get_ptr()](Packet response) {
                     auto interval = response.read<std::uint32_t>(8);
-                    for (std::size_t offset = 20;
-                         offset < response.length() - 6;
-                         ++offset) {
-                        auto ip = response.read<std::uint32_t>(offset);
-                        auto port = response.read<std::uint16_t>(offset + 4);
-
-                        self->on_new_peer({address_v4(ip), port});
+                    // Peers follow the 20 bytes of the header.
+                    const auto& bytes = response.get_bytes();
+                    const std::string_view peers {
+                        reinterpret_cast<const char*>(bytes.data()) + 20,
+                        bytes.size() - 20
+                    };
+                    for (auto& endpoint : parse_compact_peers(peers)) {
+                        self->on_new_peer(std::move(endpoint));
                     }
-                    BOOST_LOG_TRIVIAL(info)
+                    TORRENT_LOG(info)
                         << "Fetched " << (response.length() - 20) / 6
                         << " peers";
 
@@ -285,7 +290,7 @@ void UdpTracker::change_state(State new_state) {
                     );
                     self->interval_timer.async_wait([self](auto error) {
                         if (error) {
-                            BOOST_LOG_TRIVIAL(error)
+                            TORRENT_LOG(error)
                                 << "Error in async_wait: " << error.message();
                             return;
                         }
@@ -305,30 +310,30 @@ void UdpTracker::change_state(State new_state) {
 
 void UdpTracker::send_request(Packet request, auto on_response) {
     auto request_ptr = std::make_shared<Packet>(std::move(request));
+    const auto sent = std::chrono::steady_clock::now();
     // TODO: Implement time outs
     socket.async_send(
         asio::buffer(request_ptr->get_bytes()),
         [self = get_ptr(),
          request_ptr,
+         sent,
          on_response](const auto& send_error, const std::size_t) {
             if (send_error) {
-                BOOST_LOG_TRIVIAL(error)
+                TORRENT_LOG(error)
                     << *self
                     << " could not send a message: " << send_error.message();
                 return self->change_state(State::Disconnected);
             }
-#ifndef NDEBUG
-            BOOST_LOG_TRIVIAL(debug)
+            TORRENT_LOG(debug)
                 << "Sent " << *request_ptr << " to " << *self;
-#endif
             self->socket.async_receive(
                 asio::buffer(self->receive_buffer),
-                [self, request_ptr, on_response](
+                [self, request_ptr, sent, on_response](
                     const auto& receive_error,
                     const std::size_t bytes_read
                 ) {
                     if (receive_error) {
-                        BOOST_LOG_TRIVIAL(error)
+                        TORRENT_LOG(error)
                             << *self << " could not receive a message: "
                             << receive_error.message();
                         return self->change_state(State::Disconnected);
@@ -342,24 +347,23 @@ void UdpTracker::send_request(Packet request, auto on_response) {
 
                     if (packet.has_value()) {
                         if (packet->get_action() == Action::Error) {
-                            BOOST_LOG_TRIVIAL(error)
+                            TORRENT_LOG(error)
                                 << "Received an error message from the "
                                 << *self << ": " << packet->get_error_message();
                         } else if (packet->get_action()
                                    == request_ptr->get_action()) {
                     // Packet is valid.
-#ifndef NDEBUG
-                            BOOST_LOG_TRIVIAL(debug)
+                            TORRENT_LOG(debug)
                                 << *self << " sent: " << packet.value();
-#endif
+                            self->on_round_trip(sent);
                             on_response(std::move(packet.value()));
                         } else {
-                            BOOST_LOG_TRIVIAL(error)
+                            TORRENT_LOG(error)
                                 << "Received the incorrect message from the "
                                 << *self;
                         }
                     } else {
-                        BOOST_LOG_TRIVIAL(error)
+                        TORRENT_LOG(error)
                             << "An invalid response received from the "
                             << *self;
                     }
@@ -369,13 +373,23 @@ void UdpTracker::send_request(Packet request, auto on_response) {
     );
 }
 
+void UdpTracker::stop() {
+    asio::post(socket.get_executor(), [self = get_ptr()] {
+        self->connection_id_timer.cancel();
+        self->interval_timer.cancel();
+        self->resolver.cancel();
+        boost::system::error_code ignored;
+        self->socket.close(ignored);
+    });
+}
+
 void UdpTracker::initiate_connection(boost::url url) {
     resolver.async_resolve(
         url.host(),
         url.port(),
         [self = get_ptr()](const auto& error, auto endpoints) {
             if (error) {
-                BOOST_LOG_TRIVIAL(error)
+                TORRENT_LOG(error)
                     << *self
                     << " could not resolve the given url: " << error.message();
                 return self->change_state(State::Disconnected);
@@ -385,7 +399,7 @@ void UdpTracker::initiate_connection(boost::url url) {
                 endpoints,
                 [self](const auto& connect_error, const auto&) {
                     if (connect_error) {
-                        BOOST_LOG_TRIVIAL(error)
+                        TORRENT_LOG(error)
                             << "Could not connect to the " << *self << ": "
                             << connect_error.message();
                         return self->change_state(State::Disconnected);
@@ -0,0 +1,196 @@
+#include "web_seed.hpp"
+
+#include <algorithm>
+#include <string_view>
+
+namespace torrent {
+
+WebSeed::WebSeed(
+    asio::io_context& io_context_ref,
+    asio::ssl::context& ssl_context_ref,
+    boost::url seed_url,
+    std::shared_ptr<Metadata> metadata_ptr,
+    std::shared_ptr<Pieces> pieces_ptr
+) :
+    strand(asio::make_strand(io_context_ref)),
+    ssl_context(ssl_context_ref),
+    url(std::move(seed_url)),
+    metadata(std::move(metadata_ptr)),
+    pieces(std::move(pieces_ptr)) {
+    seed_bitfield = std::make_unique<Bitfield>(
+        std::vector<std::uint8_t>(pieces->bitfield->size(), 0xff)
+    );
+
+    // A url ending with a slash is a directory that has the torrent in it.
+    // Multi file torrents are always in a directory named after the torrent.
+    const auto& files = metadata->get_files();
+    const bool is_directory = url.path().ends_with('/');
+    file_targets.reserve(files.size());
+    for (const auto& [length, path] : files) {
+        boost::url file_url = url;
+        auto segments = file_url.segments();
+        if (!segments.empty() && segments.back().empty()) {
+            segments.pop_back(); // Trailing slash.
+        }
+        if (metadata->is_single_file()) {
+            if (is_directory) {
+                segments.push_back(metadata->get_name());
+            }
+        } else {
+            segments.push_back(metadata->get_name());
+            // Paths of the files start with a slash.
+            std::string_view rest = path;
+            while (!rest.empty()) {
+                rest.remove_prefix(1);
+                const auto end = std::min(rest.find('/'), rest.size());
+                segments.push_back(rest.substr(0, end));
+                rest.remove_prefix(end);
+            }
+        }
+        file_targets.emplace_back(file_url.encoded_target());
+    }
+}
+
+std::shared_ptr<WebSeed> WebSeed::create(
+    asio::io_context& io_context,
+    asio::ssl::context& ssl_context,
+    const std::string& url,
+    std::shared_ptr<Metadata> metadata,
+    std::shared_ptr<Pieces> pieces
+) {
+    const auto parsed = boost::urls::parse_uri(url);
+    if (!parsed.has_value()) {
+        TORRENT_LOG(error) << "Invalid web seed url: " << url;
+        return nullptr;
+    }
+    switch (parsed->scheme_id()) {
+        case boost::urls::scheme::http:
+            return HttpWebSeed::create(
+                io_context,
+                ssl_context,
+                boost::url {*parsed},
+                std::move(metadata),
+                std::move(pieces)
+            );
+        case boost::urls::scheme::https:
+            return HttpsWebSeed::create(
+                io_context,
+                ssl_context,
+                boost::url {*parsed},
+                std::move(metadata),
+                std::move(pieces)
+            );
+        default:
+            TORRENT_LOG(error) << "Unknown web seed scheme: " << url;
+            return nullptr;
+    }
+}
+
+std::shared_ptr<WebSeed::Span> WebSeed::assign_span() {
+    auto& picker = *pieces->picker;
+    const auto first_piece =
+        picker.assign_piece(*seed_bitfield, download_rate.get_rate());
+    if (!first_piece.has_value()) {
+        return nullptr;
+    }
+
+    auto span = std::make_shared<Span>();
+    span->first_piece = first_piece.value();
+    span->piece_count = 1;
+
+    // Extend the span with the following pieces nobody is downloading.
+    const auto piece_length = metadata->get_piece_length();
+    const auto max_pieces =
+        std::max<std::size_t>(1, SPAN_LENGTH / piece_length);
+    while (span->piece_count < max_pieces
+           && picker.try_assign(span->first_piece + span->piece_count)) {
+        span->piece_count += 1;
+    }
+
+    const auto offset = span->first_piece * piece_length;
+    const auto end = std::min(
+        metadata->get_total_length(),
+        (span->first_piece + span->piece_count) * piece_length
+    );
+    span->data.resize(end - offset);
+
+    // Files are separate resources on the server. Split the span by them.
+    const auto& files = metadata->get_files();
+    for (auto position = offset; position < end;) {
+        const auto file_index = metadata->get_file_index(position);
+        const auto file_start = metadata->get_file_offset(file_index);
+        const auto file_end = file_start + files[file_index].first;
+        const auto length = std::min(end, file_end) - position;
+        // Pad files are not on the server, their zeros are already there.
+        if (length != 0 && !metadata->is_pad_file(file_index)) {
+            span->ranges.push_back(
+                {file_index, position - file_start, length, position - offset}
+            );
+        }
+        position += length;
+    }
+    return span;
+}
+
+void WebSeed::on_span_complete(std::shared_ptr<Span> span) {
+    const auto piece_length = metadata->get_piece_length();
+    for (std::size_t i = 0; i < span->piece_count; ++i) {
+        const auto piece_index = span->first_piece + i;
+        const auto piece = asio::buffer(
+            span->data.data() + i * piece_length,
+            metadata->get_piece_size(piece_index)
+        );
+        // The span is kept alive until its every piece is written.
+        pieces->write_piece_async(
+            piece_index,
+            piece,
+            [self = shared_from_this(),
+             span,
+             piece_index](const auto& error_code, bool sha1_passed) {
+                if (sha1_passed) {
+                    self->pieces->bitfield->set_piece(piece_index);
+                    return;
+                }
+                if (!error_code) {
+                    TORRENT_LOG(error)
+                        << *self << " sent a corrupt piece#" << piece_index;
+                    if (self->failed_pieces.fetch_add(1) + 1
+                        == MAX_FAILED_PIECES) {
+                        self->stop();
+                    }
+                }
+                self->pieces->picker->piece_failed(piece_index);
+            }
+        );
+    }
+}
+
+void WebSeed::release_span(const Span& span) {
+    for (std::size_t i = 0; i < span.piece_count; ++i) {
+        pieces->picker->piece_failed(span.first_piece + i);
+    }
+}
+
+http::request<http::empty_body>
+WebSeed::make_request(const FileRange& range) const {
+    http::request<http::empty_body> request {
+        http::verb::get,
+        file_targets[range.file_index],
+        11
+    };
+    // The port is part of the host, see RFC 9110 section 7.2.
+    request.set(
+        http::field::host,
+        std::string {url.encoded_host_and_port()}
+    );
+    request.set(http::field::user_agent, "torrent");
+    request.set(
+        http::field::range,
+        "bytes=" + std::to_string(range.file_offset) + '-'
+            + std::to_string(range.file_offset + range.length - 1)
+    );
+    request.keep_alive(true);
+    return request;
+}
+
+} // namespace torrent
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bencode_reader.hpp"
+
+namespace torrent {
+
+namespace {
+
+/*
+ * Records every event as a line of text.
+ * */
+class RecordingHandler: public BencodeReader::Handler {
+  public:
+    void on_integer(BencodeReader::Integer value) override {
+        events.push_back("i" + std::to_string(value));
+    }
+
+    void on_string(std::string_view value) override {
+        events.push_back("s" + std::string {value});
+    }
+
+    void on_key(std::string_view value) override {
+        events.push_back("k" + std::string {value});
+    }
+
+    void on_list_begin() override {
+        events.push_back("l");
+    }
+
+    void on_dictionary_begin() override {
+        events.push_back("d");
+    }
+
+    void on_end() override {
+        events.push_back("e");
+    }
+
+    std::vector<std::string> events;
+};
+
+constexpr std::string_view NESTED = "d3:bar4:spam3:fooli1ei-2eee";
+
+const std::vector<std::string> NESTED_EVENTS =
+    {"d", "kbar", "sspam", "kfoo", "l", "i1", "i-2", "e", "e"};
+
+} // namespace
+
+TEST(BencodeReader, ReadsNestedValues) {
+    RecordingHandler handler;
+    BencodeReader reader {handler};
+    EXPECT_EQ(reader.feed(NESTED), NESTED.size());
+    EXPECT_TRUE(reader.is_complete());
+    EXPECT_EQ(handler.events, NESTED_EVENTS);
+}
+
+TEST(BencodeReader, ResumesAtEveryByte) {
+    RecordingHandler handler;
+    BencodeReader reader {handler};
+    for (std::size_t i = 0; i < NESTED.size(); ++i) {
+        EXPECT_FALSE(reader.is_complete());
+        EXPECT_EQ(reader.feed(NESTED.substr(i, 1)), 1u);
+    }
+    EXPECT_TRUE(reader.is_complete());
+    EXPECT_EQ(handler.events, NESTED_EVENTS);
+}
+
+TEST(BencodeReader, StopsAfterTheTopLevelValue) {
+    RecordingHandler handler;
+    BencodeReader reader {handler};
+    EXPECT_EQ(reader.feed("4:spami42e"), 6u);
+    EXPECT_TRUE(reader.is_complete());
+    EXPECT_EQ(reader.feed("i42e"), 0u);
+
+    reader.reset();
+    EXPECT_EQ(reader.feed("i42e"), 4u);
+    EXPECT_EQ(handler.events, (std::vector<std::string> {"sspam", "i42"}));
+}
+
+TEST(BencodeReader, ReadsEmptyStrings) {
+    RecordingHandler handler;
+    BencodeReader reader {handler};
+    reader.feed("l0:e");
+    EXPECT_EQ(handler.events, (std::vector<std::string> {"l", "s", "e"}));
+}
+
+TEST(BencodeReader, LimitsTheDepth) {
+    RecordingHandler handler;
+    BencodeReader reader {handler, {.max_depth = 2}};
+    EXPECT_NO_THROW(reader.feed("llee"));
+    reader.reset();
+    EXPECT_THROW(reader.feed("llleee"), std::runtime_error);
+}
+
+TEST(BencodeReader, LimitsTheStringLength) {
+    RecordingHandler handler;
+    BencodeReader reader {handler, {.max_string_length = 3}};
+    EXPECT_NO_THROW(reader.feed("3:abc"));
+    reader.reset();
+    // Thrown at the length prefix, before the string is buffered.
+    EXPECT_THROW(reader.feed("4:"), std::runtime_error);
+}
+
+TEST(BencodeReader, LimitsTheTotalLength) {
+    RecordingHandler handler;
+    BencodeReader reader {handler, {.max_total_length = 8}};
+    reader.feed("l3:abc");
+    EXPECT_THROW(reader.feed("3:def"), std::runtime_error);
+}
+
+TEST(BencodeReader, LimitsTheTotalLengthWithinAChunk) {
+    RecordingHandler handler;
+    BencodeReader reader {handler, {.max_total_length = 8}};
+    // Thrown before the string past the limit is read.
+    EXPECT_THROW(reader.feed("l20:abcdefghijklmnopqrste"), std::runtime_error);
+    EXPECT_EQ(handler.events, (std::vector<std::string> {"l"}));
+
+    // A value that ends within the limit is read.
+    reader.reset();
+    EXPECT_EQ(reader.feed("3:abci42e"), 5u);
+    EXPECT_TRUE(reader.is_complete());
+}
+
+TEST(BencodeReader, ReadsZero) {
+    RecordingHandler handler;
+    BencodeReader reader {handler};
+    reader.feed("i0e");
+    EXPECT_EQ(handler.events, (std::vector<std::string> {"i0"}));
+}
+
+TEST(BencodeReader, RejectsInvalidInput) {
+    const std::vector<std::string_view> inputs = {
+        "e",
+        "x",
+        "i12xe",
+        "ie",
+        "i--1e",
+        "i9223372036854775808e",
+        "i-0e",
+        "i03e",
+        "i-03e",
+        "i00e",
+        "03:abc",
+        "00:",
+        "di1ei2ee",
+        "d3:fooe",
+    };
+    for (const auto input : inputs) {
+        RecordingHandler handler;
+        BencodeReader reader {handler};
+        EXPECT_THROW(reader.feed(input), std::runtime_error) << input;
+    }
+}
+
+} // namespace torrent
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bencode_parser.hpp"
+#include "bencode_writer.hpp"
+
+namespace torrent {
+
+namespace {
+
+BencodeParser::Element parse(const std::string& input) {
+    BencodeParser parser {std::make_unique<std::istringstream>(input)};
+    parser.parse();
+    return parser.get();
+}
+
+} // namespace
+
+TEST(BencodeWriter, IntegerSize) {
+    using Integer = BencodeWriter::Integer;
+    EXPECT_EQ(BencodeWriter::integer_size(0), 3u);
+    EXPECT_EQ(BencodeWriter::integer_size(9), 3u);
+    EXPECT_EQ(BencodeWriter::integer_size(10), 4u);
+    EXPECT_EQ(BencodeWriter::integer_size(-1), 4u);
+    EXPECT_EQ(BencodeWriter::integer_size(-10), 5u);
+    EXPECT_EQ(
+        BencodeWriter::integer_size(std::numeric_limits<Integer>::max()),
+        21u
+    );
+    EXPECT_EQ(
+        BencodeWriter::integer_size(std::numeric_limits<Integer>::min()),
+        22u
+    );
+}
+
+TEST(BencodeWriter, StringSize) {
+    EXPECT_EQ(BencodeWriter::string_size(""), 2u);
+    EXPECT_EQ(BencodeWriter::string_size("spam"), 6u);
+    EXPECT_EQ(BencodeWriter::string_size(std::string(10, 'a')), 13u);
+}
+
+TEST(BencodeWriter, EncodesTheParsedInput) {
+    const std::vector<std::string> inputs = {
+        "i-42e",
+        "0:",
+        "le",
+        "de",
+        "d3:bar4:spam3:fooli1ei-2eee",
+        "d4:infod6:lengthi1048576e4:name4:filee8:url-listl0:ee",
+    };
+    for (const auto& input : inputs) {
+        const auto element = parse(input);
+        EXPECT_EQ(BencodeWriter::encoded_size(element), input.size());
+        EXPECT_EQ(BencodeWriter::encode(element), input);
+    }
+}
+
+TEST(BencodeWriter, WritesValuesOneByOne) {
+    std::string output(
+        2 + BencodeWriter::string_size("a") + BencodeWriter::integer_size(-7)
+            + BencodeWriter::string_size("b") + 2
+            + BencodeWriter::string_size("c"),
+        '\0'
+    );
+    BencodeWriter writer {std::span<char> {output}};
+    writer.write_dictionary_begin();
+    writer.write_string("a");
+    writer.write_integer(-7);
+    writer.write_string("b");
+    writer.write_list_begin();
+    writer.write_string("c");
+    writer.write_end();
+    writer.write_end();
+    EXPECT_EQ(writer.size(), output.size());
+    EXPECT_EQ(output, "d1:ai-7e1:bl1:cee");
+}
+
+TEST(BencodeWriter, ThrowsIfTheBufferIsTooSmall) {
+    std::string output(5, '\0');
+    BencodeWriter writer {std::span<char> {output}};
+    EXPECT_THROW(writer.write_string("spam"), std::runtime_error);
+
+    BencodeWriter number_writer {std::span<char> {output}};
+    EXPECT_THROW(number_writer.write_integer(123456), std::runtime_error);
+}
+
+TEST(BencodeWriter, EncodesIntoTheEndOfAVector) {
+    std::vector<std::uint8_t> output = {'x'};
+    BencodeWriter::encode_into(parse("li1ee"), output);
+    EXPECT_EQ(std::string(output.begin(), output.end()), "xli1ee");
+}
+
+} // namespace torrent
@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/ssl.hpp>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "client.hpp"
+#include "metadata.hpp"
+#include "simulated_network.hpp"
+#include "torrent_creator.hpp"
+
+namespace torrent {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr std::size_t PIECE_LENGTH = 1 << 14;
+constexpr std::size_t PIECE_COUNT = 64;
+
+/*
+ * Writes a file of random bytes and a torrent of it into the directory.
+ * @return Path of the torrent.
+ * */
+fs::path write_torrent(const fs::path& directory) {
+    const auto data_path = directory / "payload.bin";
+    std::mt19937 random_engine {1};
+    std::string data(PIECE_LENGTH * PIECE_COUNT, '\0');
+    for (auto& byte : data) {
+        byte = static_cast<char>(random_engine());
+    }
+    std::ofstream {data_path, std::ios::binary} << data;
+
+    TorrentCreator creator {data_path};
+    creator.set_piece_length(PIECE_LENGTH);
+    // The simulated network answers every announce url.
+    creator.add_tracker("http://tracker.invalid/announce");
+    creator.set_thread_count(1);
+    const auto torrent_path = directory / "payload.torrent";
+    std::ofstream {torrent_path, std::ios::binary} << creator.create();
+    return torrent_path;
+}
+
+/*
+ * A seed and a client of the torrent on a simulated network.
+ * The seed starts first, so it only learns of the client from the
+ *      tracker once it announces again.
+ * */
+class Swarm {
+  public:
+    explicit Swarm(const std::string& name) :
+        directory(fs::temp_directory_path() / name),
+        network(SimulatedNetwork::create(io_context)) {
+        fs::remove_all(directory);
+        fs::create_directories(directory / "seed");
+        fs::create_directories(directory / "client");
+        const auto torrent_path = write_torrent(directory).string();
+        fs::copy_file(
+            directory / "payload.bin",
+            directory / "seed"
+                / Metadata::from_torrent_file(torrent_path)->get_file_name()
+        );
+        seed = start(address_v4 {{10, 0, 0, 2}}, "seed", torrent_path);
+        client = start(address_v4 {{10, 0, 0, 1}}, "client", torrent_path);
+    }
+
+    ~Swarm() {
+        client->stop();
+        seed->stop();
+        network->stop();
+        io_context.restart();
+        io_context.poll();
+        client.reset();
+        seed.reset();
+        fs::remove_all(directory);
+    }
+
+    /*
+     * Runs until the clients are connected to each other.
+     * */
+    bool connect() {
+        return network->run_until(
+            [this] {
+                return !seed->get_peer_infos().empty()
+                    && !client->get_peer_infos().empty();
+            },
+            network->now() + std::chrono::seconds {10}
+        );
+    }
+
+    fs::path directory;
+    asio::ssl::context ssl_context {asio::ssl::context::tls_client};
+    asio::io_context io_context;
+    std::shared_ptr<SimulatedNetwork> network;
+    std::shared_ptr<Client> seed;
+    std::shared_ptr<Client> client;
+
+  private:
+    std::shared_ptr<Client> start(
+        const address_v4& host,
+        const std::string& name,
+        const std::string& torrent_path
+    ) {
+        auto started = std::make_shared<Client>(io_context, ssl_context);
+        started->set_transport(network->add_host(host, {}));
+        started->set_download_directory(directory / name);
+        started->set_extract_files(false);
+        EXPECT_TRUE(started->start(torrent_path));
+        return started;
+    }
+};
+
+} // namespace
+
+TEST(Client, AcceptsIncomingPeers) {
+    Swarm swarm {"torrent_client_accept_test"};
+    ASSERT_TRUE(swarm.connect());
+    // The seed didn't connect to the client, it accepted its connection.
+    const auto peers = swarm.seed->get_peer_infos();
+    ASSERT_EQ(peers.size(), 1u);
+    EXPECT_EQ(peers[0].endpoint.address(), address_v4({10, 0, 0, 1}));
+    EXPECT_NE(peers[0].endpoint.port(), swarm.client->get_port());
+}
+
+TEST(Client, StopDisconnectsThePeers) {
+    Swarm swarm {"torrent_client_stop_test"};
+    ASSERT_TRUE(swarm.connect());
+    swarm.client->stop();
+    EXPECT_TRUE(swarm.client->get_peer_infos().empty());
+    // The seed sees the connection close.
+    EXPECT_TRUE(swarm.network->run_until(
+        [&swarm] { return swarm.seed->get_peer_infos().empty(); },
+        swarm.network->now() + std::chrono::seconds {10}
+    ));
+}
+
+TEST(Client, CanBeDestroyedWhileDownloading) {
+    const auto directory =
+        fs::temp_directory_path() / "torrent_client_lifetime_test";
+    fs::remove_all(directory);
+    fs::create_directories(directory / "seed");
+    fs::create_directories(directory / "client");
+    const auto torrent_path = write_torrent(directory);
+    const auto file_name =
+        Metadata::from_torrent_file(torrent_path.string())->get_file_name();
+    fs::copy_file(directory / "payload.bin", directory / "seed" / file_name);
+
+    asio::ssl::context ssl_context {asio::ssl::context::tls_client};
+    asio::io_context io_context;
+    auto network = SimulatedNetwork::create(io_context);
+    // Slow enough that the download takes many seconds of virtual time.
+    const SimulatedLink link {std::chrono::milliseconds {20}, {}, 1 << 16};
+
+    auto seed = std::make_shared<Client>(io_context, ssl_context);
+    seed->set_transport(network->add_host(address_v4 {{10, 0, 0, 2}}, link));
+    seed->set_download_directory(directory / "seed");
+    seed->set_extract_files(false);
+    ASSERT_TRUE(seed->start(torrent_path.string()));
+
+    auto client = std::make_shared<Client>(io_context, ssl_context);
+    client->set_transport(network->add_host(address_v4 {{10, 0, 0, 1}}, link));
+    client->set_download_directory(directory / "client");
+    client->set_extract_files(false);
+    ASSERT_TRUE(client->start(torrent_path.string()));
+    const auto metadata = client->get_metadata();
+    ASSERT_TRUE(metadata);
+
+    ASSERT_TRUE(network->run_until(
+        [&metadata] { return metadata->get_downloaded() >= 4 * PIECE_LENGTH; },
+        network->now() + std::chrono::seconds {60}
+    ));
+    ASSERT_FALSE(metadata->is_file_complete());
+    ASSERT_FALSE(seed->get_peer_infos().empty());
+
+    // Reads, writes, timers and connections of the client are pending.
+    // None of their handlers may keep the client alive.
+    const std::weak_ptr<Client> weak_client = client;
+    client.reset();
+    EXPECT_TRUE(weak_client.expired());
+
+    // The handlers run without the client, and the seed sees it leave.
+    network->run_until(
+        [&seed] { return seed->get_peer_infos().empty(); },
+        network->now() + std::chrono::seconds {10}
+    );
+    EXPECT_TRUE(seed->get_peer_infos().empty());
+
+    seed->stop();
+    network->stop();
+    io_context.restart();
+    io_context.poll();
+    seed.reset();
+    fs::remove_all(directory);
+}
+
+TEST(Client, ReportsWhenItCantStart) {
+    asio::ssl::context ssl_context {asio::ssl::context::tls_client};
+    asio::io_context io_context;
+    auto client = std::make_shared<Client>(io_context, ssl_context);
+    EXPECT_FALSE(client->start(
+        (fs::temp_directory_path() / "torrent_client_missing.torrent").string()
+    ));
+}
+
+} // namespace torrent
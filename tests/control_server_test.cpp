@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ssl.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "control_server.hpp"
+#include "json.hpp"
+#include "session.hpp"
+
+namespace torrent {
+
+namespace {
+
+/*
+ * Calls the handler of the server, which is only started to check
+ *      its socket. No torrents are added, so no files are used.
+ * */
+class ControlServerTest: public testing::Test {
+  protected:
+    ControlServerTest() :
+        ssl_context(asio::ssl::context::tls_client),
+        session(ssl_context, 1),
+        server(
+            io_context,
+            std::filesystem::temp_directory_path() / "torrent_control_test",
+            session
+        ) {}
+
+    /*
+     * Handles the line and parses the response.
+     * */
+    Json call(std::string_view line) {
+        const auto response = server.handle(line);
+        EXPECT_FALSE(response.shutdown);
+        return Json::parse(response.line);
+    }
+
+    static std::int64_t get_error_code(const Json& response) {
+        const auto* error = response.find("error");
+        if (error == nullptr || response.find("result") != nullptr) {
+            ADD_FAILURE() << response.dump();
+            return 0;
+        }
+        return error->find("code")->get<std::int64_t>();
+    }
+
+    asio::io_context io_context;
+    asio::ssl::context ssl_context;
+    Session session;
+    ControlServer server;
+};
+
+} // namespace
+
+TEST_F(ControlServerTest, AnswersWithTheIdOfTheRequest) {
+    const auto response =
+        call(R"({"jsonrpc":"2.0","id":"a","method":"list"})");
+    EXPECT_EQ(response.find("jsonrpc")->get<std::string>(), "2.0");
+    EXPECT_EQ(response.find("id")->get<std::string>(), "a");
+    EXPECT_TRUE(response.find("result")->get<Json::Array>().empty());
+    EXPECT_EQ(response.find("error"), nullptr);
+}
+
+TEST_F(ControlServerTest, SetsTheLimits) {
+    auto response = call(
+        R"({"jsonrpc":"2.0","id":1,"method":"set_limits",)"
+        R"("params":{"download":1000,"upload":2000}})"
+    );
+    EXPECT_EQ(
+        response.find("result")->dump(),
+        R"({"download":1000,"upload":2000})"
+    );
+    EXPECT_EQ(session.get_download_limit(), 1000u);
+
+    // A missing limit is left as it is.
+    response = call(
+        R"({"jsonrpc":"2.0","id":2,"method":"set_limits",)"
+        R"("params":{"upload":0}})"
+    );
+    EXPECT_EQ(
+        response.find("result")->dump(),
+        R"({"download":1000,"upload":0})"
+    );
+}
+
+TEST_F(ControlServerTest, ReportsErrors) {
+    const auto parse_error = call("{\"jsonrpc\":");
+    EXPECT_EQ(get_error_code(parse_error), -32700);
+    EXPECT_TRUE(parse_error.find("id")->is<std::nullptr_t>());
+
+    EXPECT_EQ(get_error_code(call(R"([1,2])")), -32600);
+    EXPECT_EQ(get_error_code(call(R"({"id":1,"method":"list"})")), -32600);
+    EXPECT_EQ(
+        get_error_code(call(R"({"jsonrpc":"1.0","id":1,"method":"list"})")),
+        -32600
+    );
+    EXPECT_EQ(
+        get_error_code(call(R"({"jsonrpc":"2.0","id":1,"method":7})")),
+        -32600
+    );
+    EXPECT_EQ(
+        get_error_code(
+            call(R"({"jsonrpc":"2.0","id":1,"method":"list","params":[]})")
+        ),
+        -32600
+    );
+    EXPECT_EQ(
+        get_error_code(call(R"({"jsonrpc":"2.0","id":1,"method":"seed"})")),
+        -32601
+    );
+    EXPECT_EQ(
+        get_error_code(call(R"({"jsonrpc":"2.0","id":1,"method":"stats"})")),
+        -32602
+    );
+    EXPECT_EQ(
+        get_error_code(call(
+            R"({"jsonrpc":"2.0","id":1,"method":"pause","params":{"id":-1}})"
+        )),
+        -32602
+    );
+    EXPECT_EQ(
+        get_error_code(call(
+            R"({"jsonrpc":"2.0","id":1,"method":"set_file_priority",)"
+            R"("params":{"id":1,"file":0,"priority":"urgent"}})"
+        )),
+        -32602
+    );
+    // There is no torrent with the id.
+    EXPECT_EQ(
+        get_error_code(call(
+            R"({"jsonrpc":"2.0","id":1,"method":"stats","params":{"id":1}})"
+        )),
+        -32000
+    );
+}
+
+TEST_F(ControlServerTest, DoesNotAnswerNotifications) {
+    auto response = server.handle(
+        R"({"jsonrpc":"2.0","method":"set_limits","params":{"download":5}})"
+    );
+    EXPECT_TRUE(response.line.empty());
+    EXPECT_EQ(session.get_download_limit(), 5u);
+
+    // Not even when they fail.
+    response = server.handle(R"({"jsonrpc":"2.0","method":"seed"})");
+    EXPECT_TRUE(response.line.empty());
+}
+
+TEST_F(ControlServerTest, OnlyTheOwnerCanConnect) {
+    namespace fs = std::filesystem;
+    server.start();
+    const auto path = fs::temp_directory_path() / "torrent_control_test";
+    EXPECT_TRUE(fs::is_socket(path));
+    EXPECT_EQ(
+        fs::status(path).permissions() & fs::perms::all,
+        fs::perms::owner_read | fs::perms::owner_write
+    );
+    server.stop();
+    EXPECT_FALSE(fs::exists(path));
+}
+
+TEST_F(ControlServerTest, AsksToShutDown) {
+    auto response =
+        server.handle(R"({"jsonrpc":"2.0","id":1,"method":"shutdown"})");
+    EXPECT_TRUE(response.shutdown);
+    EXPECT_TRUE(Json::parse(response.line).find("result")->get<bool>());
+
+    response = server.handle(R"({"jsonrpc":"2.0","method":"shutdown"})");
+    EXPECT_TRUE(response.shutdown);
+    EXPECT_TRUE(response.line.empty());
+
+    // Only a valid request shuts down.
+    response = server.handle(
+        R"({"jsonrpc":"2.0","id":1,"method":"shutdown","params":[]})"
+    );
+    EXPECT_FALSE(response.shutdown);
+}
+
+} // namespace torrent
@@ -0,0 +1,320 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "encrypted_stream.hpp"
+#include "rc4.hpp"
+#include "simulated_network.hpp"
+
+namespace torrent {
+
+namespace {
+
+std::vector<std::uint8_t> to_bytes(std::string_view text) {
+    return {text.begin(), text.end()};
+}
+
+std::vector<std::uint8_t>
+rc4(std::string_view key, std::string_view plaintext) {
+    const auto key_bytes = to_bytes(key);
+    auto data = to_bytes(plaintext);
+    Rc4 {key_bytes}.process(data.data(), data.size());
+    return data;
+}
+
+constexpr std::uint16_t PORT = 6881;
+const std::string INFO_HASH(20, 'i');
+
+/*
+ * Connects an initiator on one simulated host to a responder on another.
+ * */
+class Connection {
+  public:
+    Connection(
+        EncryptionPolicy initiator_policy,
+        EncryptionPolicy responder_policy,
+        std::string responder_skey = INFO_HASH
+    ) :
+        network(SimulatedNetwork::create(io_context)),
+        initiator_transport(network->add_host(address_v4 {{10, 0, 0, 1}}, {})),
+        responder_transport(network->add_host(address_v4 {{10, 0, 0, 2}}, {})),
+        acceptor(responder_transport->create_acceptor(PORT)),
+        initiator_policy(initiator_policy),
+        responder_policy(responder_policy),
+        responder_skey(std::move(responder_skey)) {
+        acceptor->async_accept([this](const auto& error, auto stream) {
+            ASSERT_FALSE(error);
+            responder = std::make_unique<EncryptedStream>(
+                io_context,
+                std::move(stream),
+                EncryptedStream::Role::Responder,
+                this->responder_skey,
+                this->responder_policy
+            );
+            // The responder does the handshake on its first read.
+            read(*responder, responder_read, responder_buffer);
+        });
+    }
+
+    ~Connection() {
+        network->stop();
+        io_context.restart();
+        io_context.poll();
+    }
+
+    /*
+     * Connects with the initiator.
+     * @return The error of the handshake.
+     * */
+    boost::system::error_code connect() {
+        initiator = std::make_unique<EncryptedStream>(
+            io_context,
+            initiator_transport->create_stream(),
+            EncryptedStream::Role::Initiator,
+            INFO_HASH,
+            initiator_policy
+        );
+        return connect(*initiator);
+    }
+
+    /*
+     * Connects with a plain stream, without the encryption handshake.
+     * */
+    std::unique_ptr<Stream> connect_plain() {
+        auto stream = initiator_transport->create_stream();
+        EXPECT_FALSE(connect(*stream));
+        return stream;
+    }
+
+    /*
+     * Writes the text to the stream.
+     * */
+    void write(Stream& stream, std::string_view text) {
+        auto data = std::make_shared<std::string>(text);
+        stream.async_write_some(
+            asio::buffer(*data),
+            [data](const auto& error, std::size_t length) {
+                EXPECT_FALSE(error);
+                EXPECT_EQ(length, data->size());
+            }
+        );
+    }
+
+    /*
+     * Runs until the initiator received the length.
+     * @return The received bytes, fewer if the stream failed.
+     * */
+    std::string read_initiator(std::size_t length) {
+        if (!initiator_reading) {
+            initiator_reading = true;
+            read(*initiator, initiator_read, initiator_buffer);
+        }
+        return wait_read(initiator_read, length);
+    }
+
+    /*
+     * Runs until the responder received the length.
+     * @return The received bytes, fewer if the stream failed.
+     * */
+    std::string read_responder(std::size_t length) {
+        return wait_read(responder_read, length);
+    }
+
+    asio::io_context io_context;
+    std::shared_ptr<SimulatedNetwork> network;
+    std::shared_ptr<Transport> initiator_transport;
+    std::shared_ptr<Transport> responder_transport;
+    std::unique_ptr<Acceptor> acceptor;
+    std::unique_ptr<EncryptedStream> initiator;
+    std::unique_ptr<EncryptedStream> responder;
+    bool read_failed = false;
+
+  private:
+    using Buffer = std::array<char, 1024>;
+
+    boost::system::error_code connect(Stream& stream) {
+        std::optional<boost::system::error_code> result;
+        stream.async_connect(
+            tcp::endpoint {address_v4 {{10, 0, 0, 2}}, PORT},
+            [&result](const auto& error) { result = error; }
+        );
+        network->run_until(
+            [&result] { return result.has_value(); },
+            network->now() + std::chrono::seconds {10}
+        );
+        EXPECT_TRUE(result.has_value());
+        return result.value_or(asio::error::timed_out);
+    }
+
+    std::string wait_read(const std::string& received, std::size_t length) {
+        network->run_until(
+            [&] { return received.size() >= length || read_failed; },
+            network->now() + std::chrono::seconds {10}
+        );
+        return received;
+    }
+
+    /*
+     * Keeps reading the stream into the output until it fails.
+     * */
+    void read(Stream& stream, std::string& output, Buffer& buffer) {
+        stream.async_read_some(
+            asio::buffer(buffer),
+            [this, &stream, &output, &buffer](
+                const auto& error,
+                std::size_t length
+            ) {
+                if (error) {
+                    read_failed = true;
+                    return;
+                }
+                output.append(buffer.data(), length);
+                read(stream, output, buffer);
+            }
+        );
+    }
+
+    EncryptionPolicy initiator_policy;
+    EncryptionPolicy responder_policy;
+    std::string responder_skey;
+    std::string responder_read;
+    std::string initiator_read;
+    bool initiator_reading = false;
+    Buffer responder_buffer;
+    Buffer initiator_buffer;
+};
+
+} // namespace
+
+TEST(Rc4, MatchesTheTestVectors) {
+    EXPECT_EQ(
+        rc4("Key", "Plaintext"),
+        (std::vector<std::uint8_t> {
+            0xBB, 0xF3, 0x16, 0xE8, 0xD9, 0x40, 0xAF, 0x0A, 0xD3
+        })
+    );
+    EXPECT_EQ(
+        rc4("Wiki", "pedia"),
+        (std::vector<std::uint8_t> {0x10, 0x21, 0xBF, 0x04, 0x20})
+    );
+    EXPECT_EQ(
+        rc4("Secret", "Attack at dawn"),
+        (std::vector<std::uint8_t> {
+            0x45, 0xA0, 0x1F, 0x64, 0x5F, 0xC3, 0x5B,
+            0x38, 0x35, 0x52, 0x54, 0x4B, 0x9B, 0xF5
+        })
+    );
+}
+
+TEST(Rc4, DecryptsWhatItEncrypts) {
+    const auto key = to_bytes("key");
+    Rc4 encryptor {key};
+    Rc4 decryptor {key};
+    auto data = to_bytes("attack at dawn, attack at dusk");
+    // Splitting the data doesn't change the key stream.
+    encryptor.process(data.data(), 10);
+    encryptor.process(data.data() + 10, data.size() - 10);
+    decryptor.process(data.data(), data.size());
+    EXPECT_EQ(data, to_bytes("attack at dawn, attack at dusk"));
+}
+
+TEST(Rc4, DiscardsTheKeyStream) {
+    const auto key = to_bytes("key");
+    Rc4 discarded {key};
+    Rc4 processed {key};
+    // Longer than the buffer discard uses.
+    std::vector<std::uint8_t> skipped(1024 + 7);
+    processed.process(skipped.data(), skipped.size());
+    discarded.discard(skipped.size());
+
+    auto a = to_bytes("payload");
+    auto b = a;
+    discarded.process(a.data(), a.size());
+    processed.process(b.data(), b.size());
+    EXPECT_EQ(a, b);
+}
+
+TEST(EncryptedStream, EncryptsWhenBothSidesCan) {
+    Connection connection {
+        EncryptionPolicy::Enabled,
+        EncryptionPolicy::Enabled
+    };
+    ASSERT_FALSE(connection.connect());
+    ASSERT_TRUE(connection.responder);
+    EXPECT_TRUE(connection.initiator->is_encrypted());
+    EXPECT_TRUE(connection.responder->is_encrypted());
+
+    connection.write(*connection.initiator, "hello");
+    EXPECT_EQ(connection.read_responder(5), "hello");
+    connection.write(*connection.responder, "world");
+    EXPECT_EQ(connection.read_initiator(5), "world");
+}
+
+TEST(EncryptedStream, FallsBackToPlaintext) {
+    Connection connection {
+        EncryptionPolicy::Enabled,
+        EncryptionPolicy::Disabled
+    };
+    ASSERT_FALSE(connection.connect());
+    ASSERT_TRUE(connection.responder);
+    EXPECT_FALSE(connection.initiator->is_encrypted());
+    EXPECT_FALSE(connection.responder->is_encrypted());
+
+    connection.write(*connection.initiator, "hello");
+    EXPECT_EQ(connection.read_responder(5), "hello");
+}
+
+TEST(EncryptedStream, FailsIfPlaintextIsRefused) {
+    Connection connection {
+        EncryptionPolicy::Forced,
+        EncryptionPolicy::Disabled
+    };
+    EXPECT_TRUE(connection.connect());
+}
+
+TEST(EncryptedStream, FailsForAnotherTorrent) {
+    Connection connection {
+        EncryptionPolicy::Enabled,
+        EncryptionPolicy::Enabled,
+        std::string(20, 'x')
+    };
+    EXPECT_TRUE(connection.connect());
+}
+
+TEST(EncryptedStream, AcceptsPlainHandshakes) {
+    const std::string handshake = "\x13" "BitTorrent protocol";
+    {
+        Connection connection {
+            EncryptionPolicy::Disabled,
+            EncryptionPolicy::Enabled
+        };
+        auto stream = connection.connect_plain();
+        connection.write(*stream, handshake);
+        // The bytes read to tell the handshakes apart are given back.
+        EXPECT_EQ(connection.read_responder(handshake.size()), handshake);
+        ASSERT_TRUE(connection.responder);
+        EXPECT_FALSE(connection.responder->is_encrypted());
+    }
+    {
+        Connection connection {
+            EncryptionPolicy::Disabled,
+            EncryptionPolicy::Forced
+        };
+        auto stream = connection.connect_plain();
+        connection.write(*stream, handshake);
+        EXPECT_EQ(connection.read_responder(handshake.size()), "");
+        EXPECT_TRUE(connection.read_failed);
+    }
+}
+
+} // namespace torrent
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_context.hpp>
+#include <filesystem>
+#include <memory>
+
+#include "file_pool.hpp"
+
+namespace torrent {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+fs::path make_directory() {
+    const auto directory = fs::temp_directory_path() / "torrent_file_pool_test";
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    return directory;
+}
+
+} // namespace
+
+TEST(FilePool, ClosesTheLeastRecentlyUsedFile) {
+    const auto directory = make_directory();
+    asio::io_context io_context;
+    FilePool pool {2};
+    const auto mode = FilePool::Mode::ReadWrite;
+
+    const std::weak_ptr<AsyncFile> a =
+        pool.open(io_context, directory / "a", mode);
+    const std::weak_ptr<AsyncFile> b =
+        pool.open(io_context, directory / "b", mode);
+    // Using a again leaves b as the least recently used.
+    EXPECT_EQ(pool.open(io_context, directory / "a", mode), a.lock());
+    pool.open(io_context, directory / "c", mode);
+
+    EXPECT_EQ(pool.get_open_count(), 2u);
+    EXPECT_FALSE(a.expired());
+    EXPECT_TRUE(b.expired());
+    fs::remove_all(directory);
+}
+
+TEST(FilePool, KeepsFilesThatAreHeld) {
+    const auto directory = make_directory();
+    asio::io_context io_context;
+    FilePool pool {1};
+    const auto mode = FilePool::Mode::ReadWrite;
+
+    const auto a = pool.open(io_context, directory / "a", mode);
+    pool.open(io_context, directory / "b", mode);
+    // a is in use, so the limit is exceeded instead.
+    EXPECT_EQ(pool.get_open_count(), 2u);
+    EXPECT_TRUE(a->is_open());
+    fs::remove_all(directory);
+}
+
+TEST(FilePool, ForgetsAPathOnceEveryUserReleasedIt) {
+    const auto directory = make_directory();
+    const auto path = directory / "a";
+    asio::io_context io_context;
+    FilePool pool;
+
+    // Like the Pieces of a torrent that is removed and added again.
+    pool.retain(path);
+    pool.retain(path);
+    const std::weak_ptr<AsyncFile> file =
+        pool.open(io_context, path, FilePool::Mode::ReadWrite);
+
+    pool.release(path);
+    EXPECT_EQ(pool.get_open_count(), 1u);
+    EXPECT_FALSE(file.expired());
+
+    pool.release(path);
+    EXPECT_EQ(pool.get_open_count(), 0u);
+    EXPECT_TRUE(file.expired());
+    fs::remove_all(directory);
+}
+
+} // namespace torrent
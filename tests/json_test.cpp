@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.hpp"
+
+namespace torrent {
+
+TEST(Json, ParsesEveryType) {
+    const auto json = Json::parse(
+        R"( {"a": [1, -2, 2.5, true, false, null], "b": {"c": "d"}} )"
+    );
+    const auto& array = json.find("a")->get<Json::Array>();
+    ASSERT_EQ(array.size(), 6u);
+    EXPECT_EQ(array[0].get<std::int64_t>(), 1);
+    EXPECT_EQ(array[1].get<std::int64_t>(), -2);
+    EXPECT_EQ(array[2].get<double>(), 2.5);
+    EXPECT_TRUE(array[3].get<bool>());
+    EXPECT_FALSE(array[4].get<bool>());
+    EXPECT_TRUE(array[5].is<std::nullptr_t>());
+    EXPECT_EQ(json.find("b")->find("c")->get<std::string>(), "d");
+    EXPECT_EQ(json.find("e"), nullptr);
+    EXPECT_EQ(array[0].find("a"), nullptr);
+    EXPECT_THROW(array[0].get<std::string>(), std::runtime_error);
+}
+
+TEST(Json, DumpsWhatItParses) {
+    const std::string text =
+        R"({"a":[1,2.5,true,null,"x"],"b":{},"c":[],"d":-7})";
+    EXPECT_EQ(Json::parse(text).dump(), text);
+}
+
+TEST(Json, DecodesEscapes) {
+    EXPECT_EQ(
+        Json::parse(R"("\"\\\/\b\f\n\r\t")").get<std::string>(),
+        "\"\\/\b\f\n\r\t"
+    );
+    EXPECT_EQ(Json::parse(R"("\u00e9")").get<std::string>(), "\xc3\xa9");
+    EXPECT_EQ(Json::parse(R"("\u20AC")").get<std::string>(), "\xe2\x82\xac");
+    // Characters outside the basic plane are surrogate pairs.
+    EXPECT_EQ(
+        Json::parse(R"("\ud83d\ude00")").get<std::string>(),
+        "\xf0\x9f\x98\x80"
+    );
+}
+
+TEST(Json, EscapesControlCharacters) {
+    EXPECT_EQ(Json {"a\"b\\c\nd"}.dump(), R"("a\"b\\c\nd")");
+    EXPECT_EQ(Json {"\x01\x1f"}.dump(), R"("\u0001\u001f")");
+    // Other bytes are written as they are.
+    EXPECT_EQ(Json {"\xc3\xa9"}.dump(), "\"\xc3\xa9\"");
+}
+
+TEST(Json, ReadsIntegersTooBigAsDoubles) {
+    const auto max = Json::parse("9223372036854775807");
+    ASSERT_TRUE(max.is<std::int64_t>());
+    EXPECT_EQ(max.get<std::int64_t>(), 9223372036854775807);
+
+    const auto big = Json::parse("9223372036854775808");
+    ASSERT_TRUE(big.is<double>());
+    EXPECT_EQ(big.get<double>(), 9223372036854775808.0);
+}
+
+TEST(Json, RejectsInvalidText) {
+    const std::vector<std::string_view> texts = {
+        "",
+        " ",
+        "{",
+        "[1,]",
+        "[1 2]",
+        "{\"a\"}",
+        "{1:2}",
+        "tru",
+        "nul",
+        "\"abc",
+        "\"a\nb\"",
+        "\"\\x\"",
+        "\"\\u12\"",
+        "\"\\ud83d\\u0041\"",
+        "1 2",
+        "-",
+        "1.2.3",
+    };
+    for (const auto text : texts) {
+        EXPECT_THROW(Json::parse(text), std::runtime_error) << text;
+    }
+}
+
+TEST(Json, LimitsTheDepth) {
+    const auto nested = [](std::size_t depth) {
+        return std::string(depth, '[') + std::string(depth, ']');
+    };
+    EXPECT_NO_THROW(Json::parse(nested(64)));
+    EXPECT_THROW(Json::parse(nested(1000)), std::runtime_error);
+}
+
+} // namespace torrent
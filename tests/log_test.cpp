@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <ios>
+#include <sstream>
+#include <string>
+
+#include "log.hpp"
+
+namespace torrent::log {
+
+namespace {
+
+std::string format(const Record& record) {
+    std::ostringstream stream;
+    record.format(stream);
+    return std::move(stream).str();
+}
+
+} // namespace
+
+TEST(RateLimiter, DropsMessagesPastTheBurst) {
+    RateLimiter limiter;
+    std::size_t allowed = 0;
+    for (std::size_t i = 0; i < 25; ++i) {
+        allowed += limiter.allow() ? 1 : 0;
+    }
+    EXPECT_EQ(allowed, 20u);
+    EXPECT_EQ(limiter.take_suppressed(), 5u);
+    // Taking the count resets it.
+    EXPECT_EQ(limiter.take_suppressed(), 0u);
+    EXPECT_FALSE(limiter.allow());
+    EXPECT_EQ(limiter.take_suppressed(), 1u);
+}
+
+TEST(Record, FormatsTheOperandsInOrder) {
+    Record record;
+    const std::string name = "peer";
+    record.push("Connected to ");
+    record.push(name);
+    record.push(std::string_view {" at "});
+    record.push(std::hex);
+    record.push(255);
+    record.push('.');
+    EXPECT_EQ(format(record), "Connected to peer at ff.");
+
+    // Cleared records are reused for the next message.
+    record.clear();
+    record.push(1.5);
+    EXPECT_EQ(format(record), "1.5");
+}
+
+TEST(Record, KeepsTheOrderWhenTheOperandsOverflow) {
+    Record record;
+    std::string expected;
+    // Many more operands than fit in the buffer of the record.
+    for (int i = 0; i < 100; ++i) {
+        record.push(i);
+        record.push(' ');
+        expected += std::to_string(i) + ' ';
+    }
+    record.push(std::string(1000, 'x'));
+    expected += std::string(1000, 'x');
+    EXPECT_EQ(format(record), expected);
+
+    record.clear();
+    record.push("short");
+    EXPECT_EQ(format(record), "short");
+}
+
+} // namespace torrent::log
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "merkle.hpp"
+
+namespace torrent {
+
+namespace {
+
+Sha256Hash leaf(char c) {
+    return sha256(std::string(MERKLE_LEAF_LENGTH, c));
+}
+
+} // namespace
+
+TEST(Merkle, RoundsUpToPowersOfTwo) {
+    EXPECT_EQ(next_power_of_two(0), 1u);
+    EXPECT_EQ(next_power_of_two(1), 1u);
+    EXPECT_EQ(next_power_of_two(3), 4u);
+    EXPECT_EQ(next_power_of_two(4), 4u);
+    EXPECT_EQ(next_power_of_two(5), 8u);
+}
+
+TEST(Merkle, HashesEveryBlockAsALeaf) {
+    const std::string data = std::string(MERKLE_LEAF_LENGTH, 'a') + "b";
+    const auto leaves = merkle_leaves(data);
+    ASSERT_EQ(leaves.size(), 2u);
+    EXPECT_EQ(leaves[0], leaf('a'));
+    // The last block is hashed as it is, without padding.
+    EXPECT_EQ(leaves[1], sha256("b"));
+}
+
+TEST(Merkle, ParentHashesBothChildren) {
+    const auto left = leaf('a');
+    const auto right = leaf('b');
+    std::string children {left.begin(), left.end()};
+    children.append(right.begin(), right.end());
+    EXPECT_EQ(merkle_parent(left, right), sha256(children));
+}
+
+TEST(Merkle, ComputesTheRoot) {
+    const std::vector<Sha256Hash> leaves = {leaf('a'), leaf('b'), leaf('c')};
+    EXPECT_EQ(merkle_root({leaves.data(), 1}, 1), leaves[0]);
+
+    // The fourth leaf is the zero hash.
+    const auto root = merkle_parent(
+        merkle_parent(leaves[0], leaves[1]),
+        merkle_parent(leaves[2], Sha256Hash {})
+    );
+    EXPECT_EQ(merkle_root(leaves, 4), root);
+    // Wider trees pad the other half with zero leaves.
+    EXPECT_EQ(
+        merkle_root(leaves, 8),
+        merkle_parent(root, merkle_pad(4))
+    );
+}
+
+TEST(Merkle, PadsWithTheGivenHash) {
+    const auto pad = leaf('p');
+    const auto pair = merkle_parent(pad, pad);
+    EXPECT_EQ(merkle_pad(1, pad), pad);
+    EXPECT_EQ(merkle_pad(4, pad), merkle_parent(pair, pair));
+
+    const std::vector<Sha256Hash> leaves = {leaf('a')};
+    EXPECT_EQ(
+        merkle_root(leaves, 4, pad),
+        merkle_parent(merkle_parent(leaves[0], pad), pair)
+    );
+}
+
+TEST(Merkle, PieceLayerHasTheRootOfTheLeaves) {
+    // Three pieces of two blocks each, the last one short.
+    std::string data;
+    for (const char c : std::string {"abcde"}) {
+        data.append(MERKLE_LEAF_LENGTH, c);
+    }
+    data += 'f';
+    const auto leaves = merkle_leaves(data);
+    ASSERT_EQ(leaves.size(), 6u);
+
+    std::vector<Sha256Hash> pieces;
+    for (std::size_t i = 0; i < leaves.size(); i += 2) {
+        pieces.push_back(merkle_root({leaves.data() + i, 2}, 2));
+    }
+    // Missing pieces of the layer are trees of zero leaves.
+    EXPECT_EQ(
+        merkle_root(pieces, 4, merkle_pad(2)),
+        merkle_root(leaves, 8)
+    );
+}
+
+TEST(MerkleTree, KeepsEveryLayer) {
+    const std::vector<Sha256Hash> leaves = {leaf('a'), leaf('b'), leaf('c')};
+    const MerkleTree tree {leaves, 4};
+
+    ASSERT_EQ(tree.get_layer_count(), 3u);
+    EXPECT_EQ(tree.get_layer(0).size(), 4u);
+    EXPECT_EQ(tree.get_layer(1).size(), 2u);
+    EXPECT_EQ(tree.get_layer(0)[2], leaves[2]);
+    EXPECT_EQ(tree.get_layer(0)[3], Sha256Hash {});
+    EXPECT_EQ(tree.get_root(), merkle_root(leaves, 4));
+}
+
+TEST(MerkleTree, ProofLeadsToTheRoot) {
+    std::vector<Sha256Hash> leaves;
+    for (const char c : std::string {"abcde"}) {
+        leaves.push_back(leaf(c));
+    }
+    const MerkleTree tree {leaves, 8};
+
+    for (std::size_t index = 0; index < 8; ++index) {
+        const auto proof = tree.get_proof(0, index, 8);
+        ASSERT_EQ(proof.size(), 3u);
+        auto hash = tree.get_layer(0)[index];
+        auto position = index;
+        for (const auto& uncle : proof) {
+            hash = position % 2 == 0 ? merkle_parent(hash, uncle)
+                                     : merkle_parent(uncle, hash);
+            position /= 2;
+        }
+        EXPECT_EQ(hash, tree.get_root()) << index;
+    }
+
+    // Proofs can stop before the root.
+    const auto proof = tree.get_proof(1, 3, 1);
+    ASSERT_EQ(proof.size(), 1u);
+    EXPECT_EQ(proof[0], tree.get_layer(1)[2]);
+}
+
+} // namespace torrent
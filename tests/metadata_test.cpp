@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "merkle.hpp"
+#include "metadata.hpp"
+
+namespace torrent {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr std::size_t PIECE_LENGTH = 2 * MERKLE_LEAF_LENGTH;
+
+std::string encode(std::string_view value) {
+    return std::to_string(value.size()) + ':' + std::string {value};
+}
+
+std::string encode(const Sha256Hash& hash) {
+    return encode(std::string_view {
+        reinterpret_cast<const char*>(hash.data()),
+        hash.size()
+    });
+}
+
+/*
+ * Writes a torrent with the info directory and the other entries.
+ * @return Metadata of the torrent.
+ * */
+std::shared_ptr<Metadata>
+load(std::string_view info, std::string_view entries = {}) {
+    const auto path = fs::temp_directory_path() / "torrent_metadata_test";
+    std::ofstream {path, std::ios::binary}
+        << "d8:announce" << encode("http://tracker.invalid/announce")
+        << "4:info" << info << entries << 'e';
+    const auto metadata = Metadata::from_torrent_file(path.string());
+    fs::remove(path);
+    return metadata;
+}
+
+/*
+ * A single file v2 torrent of three pieces, the last one short.
+ * */
+class V2Torrent {
+  public:
+    V2Torrent() {
+        std::string data(2 * PIECE_LENGTH + 1, '\0');
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(i * 7);
+        }
+        const auto leaves = merkle_leaves(data);
+        root = merkle_root(leaves, next_power_of_two(leaves.size()));
+        for (std::size_t i = 0; i < leaves.size(); i += 2) {
+            const auto count = std::min<std::size_t>(leaves.size() - i, 2);
+            pieces.push_back(merkle_root({leaves.data() + i, count}, 2));
+            layer.append(pieces.back().begin(), pieces.back().end());
+        }
+        info = "d9:file treed6:v2.bind0:d6:lengthi"
+            + std::to_string(data.size()) + "e11:pieces root" + encode(root)
+            + "eee12:meta versioni2e4:name6:v2.bin12:piece lengthi"
+            + std::to_string(PIECE_LENGTH) + "ee";
+    }
+
+    std::string piece_layers(std::string_view hashes) const {
+        return "12:piece layersd" + encode(root) + encode(hashes) + 'e';
+    }
+
+    Sha256Hash root;
+    std::vector<Sha256Hash> pieces;
+    std::string layer;
+    std::string info;
+};
+
+} // namespace
+
+TEST(Metadata, HashesTheInfoAsItWasWritten) {
+    // The keys are not sorted, so encoding the parsed directory
+    //      gives other bytes than the ones the info hash is of.
+    const std::string pieces(20, '\0');
+    const std::string info = "d6:pieces" + encode(pieces)
+        + "4:name1:a12:piece lengthi16384e6:lengthi5ee";
+    const std::string sorted = "d6:lengthi5e4:name1:a12:piece lengthi16384e"
+        + ("6:pieces" + encode(pieces)) + 'e';
+
+    const auto metadata = load(info);
+    EXPECT_EQ(metadata->get_info_hash(), Metadata::get_info_hash(info));
+    EXPECT_NE(metadata->get_info_hash(), Metadata::get_info_hash(sorted));
+    EXPECT_EQ(metadata->get_info_hash().size(), 20u);
+}
+
+TEST(Metadata, FindsTheFileOfAnOffset) {
+    const std::string info = "d5:filesl"
+                             "d6:lengthi10e4:pathl1:aee"
+                             "d6:lengthi0e4:pathl1:bee"
+                             "d6:lengthi20e4:pathl1:cee"
+                             "e4:name3:dir12:piece lengthi16384e6:pieces"
+        + encode(std::string(20, '\0')) + 'e';
+
+    const auto metadata = load(info);
+    ASSERT_EQ(metadata->get_files().size(), 3u);
+    EXPECT_EQ(metadata->get_file_index(0), 0u);
+    EXPECT_EQ(metadata->get_file_index(9), 0u);
+    // The empty file has no bytes, so the offset is in the next one.
+    EXPECT_EQ(metadata->get_file_index(10), 2u);
+    EXPECT_EQ(metadata->get_file_index(29), 2u);
+}
+
+TEST(Metadata, LoadsThePieceLayers) {
+    const V2Torrent torrent;
+    const auto metadata =
+        load(torrent.info, torrent.piece_layers(torrent.layer));
+
+    ASSERT_TRUE(metadata->has_v2());
+    EXPECT_EQ(
+        metadata->get_info_hash_v2(),
+        Metadata::get_info_hash_v2(torrent.info)
+    );
+    // Pure v2 torrents are found by the truncated v2 info hash.
+    EXPECT_EQ(
+        metadata->get_info_hash(),
+        Metadata::get_info_hash_v2(torrent.info).substr(0, 20)
+    );
+    ASSERT_EQ(metadata->get_piece_count(), torrent.pieces.size());
+    for (std::size_t i = 0; i < torrent.pieces.size(); ++i) {
+        EXPECT_EQ(metadata->get_piece_hash_v2(i), torrent.pieces[i]) << i;
+    }
+}
+
+TEST(Metadata, KeepsTheTreesOfThePieceLayers) {
+    const V2Torrent torrent;
+    const auto metadata =
+        load(torrent.info, torrent.piece_layers(torrent.layer));
+
+    const auto* tree = metadata->get_piece_layer_tree(0);
+    ASSERT_NE(tree, nullptr);
+    EXPECT_EQ(tree->get_root(), torrent.root);
+    // The layer is padded to a power of two.
+    ASSERT_EQ(tree->get_layer(0).size(), 4u);
+    for (std::size_t i = 0; i < torrent.pieces.size(); ++i) {
+        EXPECT_EQ(tree->get_layer(0)[i], torrent.pieces[i]) << i;
+    }
+    EXPECT_EQ(metadata->get_piece_layer_tree(1), nullptr);
+}
+
+TEST(Metadata, RejectsInvalidPieceLayers) {
+    const V2Torrent torrent;
+    auto corrupt = torrent.layer;
+    corrupt[40] ^= 1;
+    EXPECT_THROW(
+        load(torrent.info, torrent.piece_layers(corrupt)),
+        std::runtime_error
+    );
+    EXPECT_THROW(
+        load(
+            torrent.info,
+            torrent.piece_layers(std::string_view {torrent.layer}.substr(32))
+        ),
+        std::runtime_error
+    );
+    // Pure v2 torrents can't be checked without them.
+    EXPECT_THROW(load(torrent.info), std::runtime_error);
+}
+
+TEST(Metadata, UsesTheRootOfSmallFilesAsThePieceHash) {
+    const auto root = sha256("small");
+    const std::string info = "d9:file treed5:smalld0:d6:lengthi5e11:pieces root"
+        + encode(root) + "eee12:meta versioni2e4:name5:small12:piece lengthi"
+        + std::to_string(PIECE_LENGTH) + "ee";
+
+    const auto metadata = load(info);
+    ASSERT_EQ(metadata->get_piece_count(), 1u);
+    EXPECT_EQ(metadata->get_piece_hash_v2(0), root);
+}
+
+} // namespace torrent
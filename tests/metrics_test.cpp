@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.hpp"
+
+namespace torrent {
+
+TEST(MetricsRegistry, WritesCountersAndGauges) {
+    MetricsRegistry registry;
+    auto& downloaded =
+        registry.add_counter("bytes", "Bytes.", {{"dir", "down"}});
+    auto& uploaded = registry.add_counter("bytes", "Bytes.", {{"dir", "up"}});
+    auto& peers = registry.add_gauge("peers", "Connected peers.");
+    downloaded.add(10);
+    uploaded.add();
+    peers.add(3);
+    peers.sub();
+    // The same name and labels give the same metric.
+    registry.add_counter("bytes", "Bytes.", {{"dir", "down"}}).add(5);
+
+    EXPECT_EQ(
+        registry.to_prometheus(),
+        "# HELP bytes Bytes.\n"
+        "# TYPE bytes counter\n"
+        "bytes{dir=\"down\"} 15\n"
+        "bytes{dir=\"up\"} 1\n"
+        "# HELP peers Connected peers.\n"
+        "# TYPE peers gauge\n"
+        "peers 2\n"
+    );
+    EXPECT_THROW(registry.add_gauge("bytes", "Bytes."), std::runtime_error);
+}
+
+TEST(MetricsRegistry, WritesCumulativeBuckets) {
+    MetricsRegistry registry;
+    auto& histogram = registry.add_histogram("seconds", "Latency.", {0.5, 1});
+    histogram.observe(0.25);
+    histogram.observe(1.0);
+    histogram.observe(4.0);
+
+    EXPECT_EQ(
+        registry.to_prometheus(),
+        "# HELP seconds Latency.\n"
+        "# TYPE seconds histogram\n"
+        "seconds_bucket{le=\"0.5\"} 1\n"
+        "seconds_bucket{le=\"1\"} 2\n"
+        "seconds_bucket{le=\"+Inf\"} 3\n"
+        "seconds_sum 5.25\n"
+        "seconds_count 3\n"
+    );
+}
+
+TEST(MetricsRegistry, EscapesLabelValues) {
+    MetricsRegistry registry;
+    registry.add_gauge("files", "Files.", {{"path", "a\"b\\c\nd"}}).set(1);
+    EXPECT_NE(
+        registry.to_prometheus().find("files{path=\"a\\\"b\\\\c\\nd\"} 1\n"),
+        std::string::npos
+    );
+}
+
+TEST(Counter, SumsTheShardsOfTheThreads) {
+    Counter counter;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&counter] {
+            for (int j = 0; j < 1000; ++j) {
+                counter.add();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(counter.get(), 8000u);
+}
+
+} // namespace torrent
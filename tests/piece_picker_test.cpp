@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "bitfield.hpp"
+#include "piece_picker.hpp"
+
+namespace torrent {
+
+namespace {
+
+constexpr std::size_t PIECE_COUNT = 16;
+
+/*
+ * Returns the bytes of a bitfield with the given pieces set.
+ * */
+std::vector<std::uint8_t> bits(const std::vector<std::size_t>& piece_indices) {
+    std::vector<std::uint8_t> result(PIECE_COUNT / 8, 0);
+    for (const auto i : piece_indices) {
+        result[i / 8] |= static_cast<std::uint8_t>(1 << (7 - (i % 8)));
+    }
+    return result;
+}
+
+std::vector<std::uint8_t> all_bits() {
+    return std::vector<std::uint8_t>(PIECE_COUNT / 8, 0xFF);
+}
+
+} // namespace
+
+TEST(PiecePicker, PicksTheFirstPieceOfTheHighestPriority) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {all_bits()};
+    picker.set_priority(8, 9, Priority::High);
+    picker.set_priority(0, 0, Priority::Low);
+
+    EXPECT_EQ(picker.assign_piece(peer), 8u);
+    EXPECT_EQ(picker.assign_piece(peer), 9u);
+    EXPECT_EQ(picker.assign_piece(peer), 1u);
+}
+
+TEST(PiecePicker, OnlyPicksPiecesOfThePeer) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {bits({3, 12})};
+    EXPECT_EQ(picker.assign_piece(peer), 3u);
+    EXPECT_EQ(picker.assign_piece(peer), 12u);
+    EXPECT_FALSE(picker.assign_piece(peer).has_value());
+}
+
+TEST(PiecePicker, FailedPiecesArePickedAgain) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {bits({0, 1})};
+    EXPECT_EQ(picker.assign_piece(peer), 0u);
+    EXPECT_EQ(picker.assign_piece(peer), 1u);
+    picker.piece_failed(0);
+    EXPECT_EQ(picker.assign_piece(peer), 0u);
+    EXPECT_FALSE(picker.try_assign(1));
+}
+
+TEST(PiecePicker, SkippedPiecesAreNotWanted) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {bits({0, 1, 2})};
+    picker.set_priority(0, 1, Priority::Skip);
+    EXPECT_EQ(picker.get_wanted_left(), PIECE_COUNT - 2);
+    EXPECT_EQ(picker.assign_piece(peer), 2u);
+    EXPECT_FALSE(picker.assign_piece(peer).has_value());
+    EXPECT_FALSE(picker.try_assign(0));
+
+    // Having a skipped piece doesn't count towards the wanted ones.
+    EXPECT_FALSE(picker.set_have(0));
+    EXPECT_EQ(picker.get_wanted_left(), PIECE_COUNT - 2);
+    picker.set_priority(1, 1, Priority::Normal);
+    EXPECT_EQ(picker.get_wanted_left(), PIECE_COUNT - 1);
+}
+
+TEST(PiecePicker, CompletesOnTheLastWantedPiece) {
+    PiecePicker picker {PIECE_COUNT};
+    picker.set_priority(2, PIECE_COUNT - 1, Priority::Skip);
+    EXPECT_FALSE(picker.set_have(0));
+    EXPECT_FALSE(picker.is_complete());
+    EXPECT_TRUE(picker.set_have(1));
+    EXPECT_TRUE(picker.is_complete());
+    // Only the first call reports completion.
+    EXPECT_FALSE(picker.set_have(1));
+}
+
+TEST(PiecePicker, PicksTheEarliestDeadlineFirst) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {all_bits()};
+    const auto now = PiecePicker::Clock::now();
+    picker.set_deadline(7, now + std::chrono::seconds(20));
+    picker.set_deadline(5, now + std::chrono::seconds(10));
+    picker.set_priority(0, 0, Priority::High);
+
+    EXPECT_EQ(picker.assign_piece(peer), 5u);
+    EXPECT_EQ(picker.assign_piece(peer), 7u);
+    EXPECT_EQ(picker.assign_piece(peer), 0u);
+
+    picker.set_deadline(9, now);
+    picker.clear_deadlines();
+    EXPECT_EQ(picker.assign_piece(peer), 1u);
+}
+
+TEST(PiecePicker, SharesUrgentPiecesBetweenFastPeers) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {all_bits()};
+    picker.set_deadline(5, PiecePicker::Clock::now());
+
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 5u);
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 5u);
+    // At most two peers download it.
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 0u);
+}
+
+TEST(PiecePicker, SlowPeersDontGetUrgentPieces) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {all_bits()};
+    picker.set_deadline(5, PiecePicker::Clock::now());
+    picker.set_deadline(6, PiecePicker::Clock::now());
+
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 5u);
+    EXPECT_EQ(picker.assign_piece(peer, 10), 0u);
+}
+
+TEST(PiecePicker, ParoleAndHashFailedPiecesAreNotShared) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {all_bits()};
+    picker.set_deadline(5, PiecePicker::Clock::now());
+    picker.set_deadline(6, PiecePicker::Clock::now());
+    picker.set_hash_failed(6);
+
+    // A peer on parole downloads the piece alone.
+    EXPECT_EQ(picker.assign_piece(peer, 1000, true), 5u);
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 6u);
+    // Otherwise we couldn't tell who sent the bad data.
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 0u);
+
+    picker.piece_failed(5);
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 5u);
+}
+
+TEST(PiecePicker, CheckedPiecesAreNotPickedAgain) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {bits({0, 1})};
+    EXPECT_EQ(picker.assign_piece(peer), 0u);
+    picker.set_checking(0);
+    // The peer lets the piece go, but every block of it is written.
+    picker.piece_failed(0);
+    EXPECT_EQ(picker.assign_piece(peer), 1u);
+    EXPECT_FALSE(picker.assign_piece(peer).has_value());
+    EXPECT_FALSE(picker.try_assign(0));
+    EXPECT_EQ(
+        picker.get_piece_infos()[0].status,
+        PiecePicker::PieceStatus::Downloading
+    );
+
+    picker.set_check_failed(0);
+    EXPECT_EQ(picker.assign_piece(peer), 0u);
+}
+
+TEST(PiecePicker, CheckedPiecesAreNotShared) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {all_bits()};
+    picker.set_deadline(5, PiecePicker::Clock::now());
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 5u);
+    picker.set_checking(5);
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 0u);
+
+    // Its peer still holds it when the check fails.
+    picker.set_check_failed(5);
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 5u);
+    picker.piece_failed(5);
+    picker.piece_failed(5);
+    EXPECT_EQ(picker.assign_piece(peer, 1000), 5u);
+
+    picker.set_checking(5);
+    EXPECT_FALSE(picker.set_have(5));
+    EXPECT_EQ(
+        picker.get_piece_infos()[5].status,
+        PiecePicker::PieceStatus::Have
+    );
+}
+
+TEST(PiecePicker, HavingAPieceRemovesItsDeadline) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield peer {all_bits()};
+    picker.set_deadline(5, PiecePicker::Clock::now());
+    picker.set_have(5);
+    picker.set_deadline(5, PiecePicker::Clock::now());
+    EXPECT_EQ(picker.assign_piece(peer), 0u);
+}
+
+TEST(PiecePicker, CountsAvailability) {
+    PiecePicker picker {PIECE_COUNT};
+    Bitfield first {bits({0, 1})};
+    Bitfield second {bits({1})};
+    picker.add_peer(first);
+    picker.add_peer(second);
+    picker.add_have(2);
+    picker.remove_peer(first);
+
+    const auto infos = picker.get_piece_infos();
+    EXPECT_EQ(infos[0].availability, 0);
+    EXPECT_EQ(infos[1].availability, 1);
+    EXPECT_EQ(infos[2].availability, 1);
+}
+
+} // namespace torrent
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "pieces.hpp"
+
+namespace torrent {
+
+namespace {
+
+constexpr std::size_t BLOCK = 16;
+
+const std::array<char, BLOCK> data {};
+
+/*
+ * Returns a write of a block, told apart by its id.
+ * */
+Pieces::PendingWrite
+make_write(std::uint64_t offset, std::vector<int>& done, int id) {
+    return {
+        offset,
+        asio::buffer(data),
+        [&done, id](const auto&, std::size_t) { done.push_back(id); }
+    };
+}
+
+std::vector<std::uint64_t>
+get_offsets(const std::vector<Pieces::PendingWrite>& run) {
+    std::vector<std::uint64_t> offsets;
+    for (const auto& write : run) {
+        offsets.push_back(write.offset);
+    }
+    return offsets;
+}
+
+} // namespace
+
+TEST(Pieces, SortsAndMergesTheWrites) {
+    std::vector<int> done;
+    std::vector<Pieces::PendingWrite> writes;
+    writes.push_back(make_write(5 * BLOCK, done, 0));
+    writes.push_back(make_write(2 * BLOCK, done, 1));
+    writes.push_back(make_write(0, done, 2));
+    writes.push_back(make_write(BLOCK, done, 3));
+
+    const auto runs = Pieces::make_write_runs(std::move(writes));
+    ASSERT_EQ(runs.size(), 2u);
+    EXPECT_EQ(
+        get_offsets(runs[0]),
+        (std::vector<std::uint64_t> {0, BLOCK, 2 * BLOCK})
+    );
+    EXPECT_EQ(get_offsets(runs[1]), (std::vector<std::uint64_t> {5 * BLOCK}));
+    // The handlers go with their writes.
+    for (const auto& run : runs) {
+        for (const auto& write : run) {
+            write.handler({}, write.buffer.size());
+        }
+    }
+    EXPECT_EQ(done, (std::vector<int> {2, 3, 1, 0}));
+}
+
+TEST(Pieces, KeepsTheOrderOfWritesToTheSameOffset) {
+    std::vector<int> done;
+    std::vector<Pieces::PendingWrite> writes;
+    writes.push_back(make_write(BLOCK, done, 0));
+    writes.push_back(make_write(0, done, 1));
+    writes.push_back(make_write(BLOCK, done, 2));
+
+    const auto runs = Pieces::make_write_runs(std::move(writes));
+    // A rewrite of a block is not contiguous with the first write of it.
+    ASSERT_EQ(runs.size(), 2u);
+    EXPECT_EQ(get_offsets(runs[0]), (std::vector<std::uint64_t> {0, BLOCK}));
+    EXPECT_EQ(get_offsets(runs[1]), (std::vector<std::uint64_t> {BLOCK}));
+    for (const auto& run : runs) {
+        for (const auto& write : run) {
+            write.handler({}, write.buffer.size());
+        }
+    }
+    EXPECT_EQ(done, (std::vector<int> {1, 0, 2}));
+}
+
+TEST(Pieces, CapsTheBuffersOfAWrite) {
+    std::vector<int> done;
+    std::vector<Pieces::PendingWrite> writes;
+    const auto count = 2 * Pieces::MAX_WRITE_RUN_BUFFERS + 3;
+    for (std::size_t i = 0; i < count; ++i) {
+        writes.push_back(make_write(i * BLOCK, done, static_cast<int>(i)));
+    }
+
+    const auto runs = Pieces::make_write_runs(std::move(writes));
+    ASSERT_EQ(runs.size(), 3u);
+    EXPECT_EQ(runs[0].size(), Pieces::MAX_WRITE_RUN_BUFFERS);
+    EXPECT_EQ(runs[1].size(), Pieces::MAX_WRITE_RUN_BUFFERS);
+    EXPECT_EQ(runs[2].size(), 3u);
+    EXPECT_EQ(runs[1].front().offset, Pieces::MAX_WRITE_RUN_BUFFERS * BLOCK);
+    EXPECT_TRUE(Pieces::make_write_runs({}).empty());
+}
+
+TEST(Pieces, AllocatesEveryExtentOnce) {
+    using Extents = std::vector<std::pair<std::size_t, std::size_t>>;
+    constexpr auto EXTENT = Pieces::ALLOCATION_EXTENT;
+    // The last extent is a half one.
+    const auto file_length = 2 * EXTENT + EXTENT / 2;
+    std::vector<bool> allocated(3, false);
+
+    // A block across the end of the first extent needs two of them.
+    EXPECT_EQ(
+        Pieces::take_extents(allocated, EXTENT - BLOCK, 2 * BLOCK, file_length),
+        (Extents {{0, EXTENT}, {EXTENT, EXTENT}})
+    );
+    EXPECT_EQ(allocated, (std::vector<bool> {true, true, false}));
+    EXPECT_TRUE(
+        Pieces::take_extents(allocated, 0, EXTENT, file_length).empty()
+    );
+    EXPECT_EQ(
+        Pieces::take_extents(allocated, 0, file_length, file_length),
+        (Extents {{2 * EXTENT, EXTENT / 2}})
+    );
+    EXPECT_TRUE(
+        Pieces::take_extents(allocated, EXTENT, 0, file_length).empty()
+    );
+
+    // Nothing is allocated unless the file is allocated in extents.
+    std::vector<bool> sparse;
+    EXPECT_TRUE(Pieces::take_extents(sparse, 0, BLOCK, file_length).empty());
+}
+
+} // namespace torrent
@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "range_server.hpp"
+
+namespace torrent {
+
+TEST(RangeServer, ParsesSatisfiableRanges) {
+    using Range = std::pair<std::size_t, std::size_t>;
+    EXPECT_EQ(RangeServer::parse_range("bytes=0-99", 1000), Range(0, 99));
+    EXPECT_EQ(RangeServer::parse_range("bytes=0-0", 1000), Range(0, 0));
+    EXPECT_EQ(RangeServer::parse_range("bytes=900-", 1000), Range(900, 999));
+    // The last byte is clamped to the end of the file.
+    EXPECT_EQ(RangeServer::parse_range("bytes=500-5000", 1000), Range(500, 999));
+    // Suffix ranges are the last bytes of the file.
+    EXPECT_EQ(RangeServer::parse_range("bytes=-100", 1000), Range(900, 999));
+    EXPECT_EQ(RangeServer::parse_range("bytes=-5000", 1000), Range(0, 999));
+}
+
+TEST(RangeServer, RejectsInvalidRanges) {
+    const std::vector<std::string_view> ranges = {
+        "",
+        "bytes=",
+        "bytes=-",
+        "bytes=-0",
+        "bytes=1000-",
+        "bytes=5-4",
+        "bytes=a-b",
+        "bytes=1-2x",
+        "bytes=0-1,5-6",
+        "items=0-1",
+    };
+    for (const auto range : ranges) {
+        EXPECT_FALSE(RangeServer::parse_range(range, 1000).has_value())
+            << range;
+    }
+    EXPECT_FALSE(RangeServer::parse_range("bytes=0-", 0).has_value());
+}
+
+} // namespace torrent
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "metadata.hpp"
+#include "sha1.hpp"
+#include "torrent_creator.hpp"
+
+namespace torrent {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+std::string make_data(std::size_t length, char seed) {
+    std::string data(length, '\0');
+    for (std::size_t i = 0; i < length; ++i) {
+        data[i] = static_cast<char>(seed + i * 31);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(TorrentCreator, CreatesATorrentOfADirectory) {
+    const auto directory = fs::temp_directory_path() / "torrent_creator_test";
+    fs::remove_all(directory);
+    fs::create_directories(directory / "files" / "sub");
+    // Pieces cross the files.
+    const auto a = make_data(20000, 'a');
+    const auto b = make_data(30001, 'b');
+    std::ofstream {directory / "files" / "a.bin", std::ios::binary} << a;
+    std::ofstream {directory / "files" / "sub" / "b.bin", std::ios::binary}
+        << b;
+
+    TorrentCreator creator {directory / "files"};
+    creator.set_piece_length(1 << 14);
+    creator.add_tracker("http://tracker.invalid/announce");
+    // Pieces are hashed by many threads and put back in order.
+    creator.set_thread_count(3);
+    const auto torrent_path = directory / "files.torrent";
+    std::ofstream {torrent_path, std::ios::binary} << creator.create();
+
+    const auto metadata = Metadata::from_torrent_file(torrent_path.string());
+    EXPECT_EQ(metadata->get_name(), "files");
+    ASSERT_EQ(metadata->get_trackers().size(), 1u);
+    EXPECT_EQ(metadata->get_trackers()[0], "http://tracker.invalid/announce");
+    EXPECT_FALSE(metadata->is_single_file());
+    ASSERT_EQ(metadata->get_files().size(), 2u);
+    EXPECT_EQ(metadata->get_files()[0].first, a.size());
+    EXPECT_EQ(metadata->get_files()[0].second, "/a.bin");
+    EXPECT_EQ(metadata->get_files()[1].first, b.size());
+    EXPECT_EQ(metadata->get_files()[1].second, "/sub/b.bin");
+
+    const auto data = a + b;
+    ASSERT_EQ(metadata->get_total_length(), data.size());
+    ASSERT_EQ(metadata->get_piece_count(), 4u);
+    for (std::size_t i = 0; i < metadata->get_piece_count(); ++i) {
+        const auto piece = std::string_view {data}.substr(i << 14, 1 << 14);
+        EXPECT_EQ(metadata->get_piece_hash(i), sha1(piece)) << i;
+    }
+    fs::remove_all(directory);
+}
+
+TEST(TorrentCreator, ChoosesAPieceLength) {
+    EXPECT_EQ(TorrentCreator::choose_piece_length(0), 1u << 14);
+    EXPECT_EQ(TorrentCreator::choose_piece_length(1 << 20), 1u << 14);
+    const auto length =
+        TorrentCreator::choose_piece_length(std::size_t {1} << 40);
+    EXPECT_EQ(length & (length - 1), 0u);
+    EXPECT_GT(length, 1u << 14);
+}
+
+} // namespace torrent
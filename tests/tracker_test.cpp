@@ -0,0 +1,27 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "tracker.hpp"
+
+namespace torrent {
+
+TEST(Tracker, ParsesCompactPeers) {
+    using namespace std::string_literals;
+    const auto peers = "\x0A\x00\x00\x01\x1A\xE1"s // 10.0.0.1:6881
+        "\xC0\xA8\x01\xFE\xFF\xFE"s // 192.168.1.254:65534
+        "\x7F\x00"s; // Not a whole peer.
+
+    EXPECT_EQ(
+        Tracker::parse_compact_peers(peers),
+        (std::vector<tcp::endpoint> {
+            {make_address_v4("10.0.0.1"), 6881},
+            // Ports over 32767 are not sign extended.
+            {make_address_v4("192.168.1.254"), 65534}
+        })
+    );
+    EXPECT_TRUE(Tracker::parse_compact_peers("").empty());
+}
+
+} // namespace torrent